@@ -0,0 +1,147 @@
+// Batch latency of PNG encoding with very uneven job sizes: one large
+// frame next to ten small window crops, encoded together as one batch, as
+// a multi-window capture does. Two schedules are compared:
+//
+//   static: the frames are dealt round-robin to `threads` threads, each
+//           encoding its frames whole, one after the other; the thread that
+//           draws the large frame decides the batch time.
+//   pool:   every frame is a task on EncodeTaskPool() and is itself split
+//           into stripe tasks there, so idle workers steal pieces of the
+//           large frame once the small ones are done.
+//
+// Prints p50/p90/p99/max/mean batch latency in ms for each. The gain only
+// shows with several cores; on one core both schedules serialise.
+//
+//   encode_pool_bench [threads [batches [large_w large_h]]]
+
+#include "encode_png.h"
+#include "parallel.h"
+#include "record.h"
+#include "task_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace sc {
+namespace {
+
+// Gradients with some noise: compresses like a desktop rather than like
+// either a flat fill or white noise.
+ImageBuffer MakeFrame(int width, int height, uint32_t seed) {
+  ImageBuffer img;
+  AllocateImage(width, height, &img);
+  uint32_t s = seed * 2654435761u;
+  for (int y = 0; y < height; ++y) {
+    uint8_t *row = img.bgra.data() + static_cast<size_t>(y) * img.row_pitch;
+    for (int x = 0; x < width; ++x) {
+      s = s * 1664525u + 1013904223u;
+      row[x * 4 + 0] = static_cast<uint8_t>(x + y);
+      row[x * 4 + 1] = static_cast<uint8_t>((x * y) >> 6);
+      row[x * 4 + 2] = static_cast<uint8_t>((s >> 28) + (y >> 2));
+      row[x * 4 + 3] = 255;
+    }
+  }
+  return img;
+}
+
+using Batch = std::vector<ImageBuffer>;
+using Outputs = std::vector<std::vector<uint8_t>>;
+
+void EncodeStatic(const Batch &frames, int threads, Outputs *out) {
+  PngOptions opt;
+  opt.level = PngLevel::kFast;
+  opt.threads = 1;
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      for (size_t i = t; i < frames.size(); i += threads) {
+        ErrorInfo err;
+        EncodePng(frames[i], opt, &(*out)[i], &err);
+      }
+    });
+  }
+  for (std::thread &t : pool) {
+    t.join();
+  }
+}
+
+void EncodePooled(const Batch &frames, int threads, Outputs *out) {
+  PngOptions opt;
+  opt.level = PngLevel::kFast;
+  opt.threads = threads;
+  TaskGroup group(&EncodeTaskPool());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    group.Run([&, i] {
+      ErrorInfo err;
+      EncodePng(frames[i], opt, &(*out)[i], &err);
+    });
+  }
+  group.Wait();
+}
+
+void Report(const char *name, const Batch &frames, int threads, int batches,
+            void (*encode)(const Batch &, int, Outputs *)) {
+  std::vector<double> ms;
+  size_t bytes = 0;
+  for (int b = 0; b < batches; ++b) {
+    Outputs out(frames.size());
+    const auto start = std::chrono::steady_clock::now();
+    encode(frames, threads, &out);
+    ms.push_back(std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+    for (const auto &o : out) {
+      bytes += o.size();
+    }
+  }
+  const LatencySummary s = SummarizeLatency(ms);
+  std::printf("%-7s p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f  mean %8.1f"
+              "  (%zu bytes/batch)\n",
+              name, s.p50_ms, s.p90_ms, s.p99_ms, s.max_ms, s.mean_ms,
+              bytes / static_cast<size_t>(batches));
+}
+
+} // namespace
+} // namespace sc
+
+int main(int argc, char **argv) {
+  using namespace sc;
+  int threads = static_cast<int>(std::thread::hardware_concurrency());
+  int batches = 30;
+  int large_w = 7680;
+  int large_h = 2160;
+  if (argc >= 2) {
+    threads = std::atoi(argv[1]);
+  }
+  if (argc >= 3) {
+    batches = std::atoi(argv[2]);
+  }
+  if (argc >= 5) {
+    large_w = std::atoi(argv[3]);
+    large_h = std::atoi(argv[4]);
+  }
+  if (threads <= 0 || batches <= 0 || large_w <= 0 || large_h <= 0) {
+    std::fprintf(stderr, "usage: encode_pool_bench [threads [batches "
+                         "[large_w large_h]]]\n");
+    return 2;
+  }
+  // The pool gets threads - 1 workers; the batch's own thread is the last.
+  SetParallelThreads(threads);
+
+  Batch frames;
+  frames.push_back(MakeFrame(large_w, large_h, 1));
+  for (int i = 0; i < 10; ++i) {
+    frames.push_back(MakeFrame(640 + 32 * i, 400 + 16 * i,
+                               static_cast<uint32_t>(i + 2)));
+  }
+  std::printf("%d threads (%u cores), %d batches of one %dx%d frame and ten "
+              "crops, png fast\n",
+              threads, std::thread::hardware_concurrency(), batches, large_w,
+              large_h);
+  Report("static", frames, threads, batches, EncodeStatic);
+  Report("pool", frames, threads, batches, EncodePooled);
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Throughput of the image_stats row kernels at each SIMD level the CPU
+// supports, in GB/s of BGRA read, best of several passes over one frame.
+//
+//   image_stats_bench [width height [passes]]
+
+#include "cpu_features.h"
+#include "image_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace sc {
+namespace {
+
+template <typename Fn> double BestSeconds(int passes, Fn &&fn) {
+  double best = 1e30;
+  for (int i = 0; i < passes; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    const std::chrono::duration<double> d =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, d.count());
+  }
+  return best;
+}
+
+} // namespace
+} // namespace sc
+
+int main(int argc, char **argv) {
+  using namespace sc;
+  int width = 3840;
+  int height = 2160;
+  int passes = 20;
+  if (argc >= 3) {
+    width = std::atoi(argv[1]);
+    height = std::atoi(argv[2]);
+  }
+  if (argc >= 4) {
+    passes = std::atoi(argv[3]);
+  }
+  if (width <= 0 || height <= 0 || passes <= 0) {
+    std::fprintf(stderr, "usage: image_stats_bench [width height [passes]]\n");
+    return 2;
+  }
+
+  const size_t stride = static_cast<size_t>(width) * 4;
+  const size_t bytes = stride * static_cast<size_t>(height);
+  std::vector<uint8_t> frame(bytes);
+  std::vector<uint8_t> copy(bytes);
+  std::mt19937 rng(1);
+  for (uint8_t &b : frame) {
+    b = static_cast<uint8_t>(rng());
+  }
+
+  std::printf("%dx%d, best of %d passes, GB/s of BGRA read\n", width, height,
+              passes);
+  std::printf("%-8s %10s %10s %10s\n", "level", "stats", "copy+stats",
+              "full");
+  const SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                              SimdLevel::kAvx2, SimdLevel::kAvx512};
+  uint64_t sink = 0; // printed, so the passes cannot be optimised away
+  for (const SimdLevel level : levels) {
+    if (level > DetectSimdLevel()) {
+      std::printf("%-8s %10s\n", SimdLevelName(level), "unsupported");
+      continue;
+    }
+    const StatsRowFn stats = StatsRowKernel(level);
+    const CopyStatsRowFn copy_stats = CopyStatsRowKernel(level);
+    const double t_stats = BestSeconds(passes, [&] {
+      StatsAccum acc;
+      for (int y = 0; y < height; ++y) {
+        stats(frame.data() + y * stride, width, &acc);
+      }
+      sink += acc.luma;
+    });
+    const double t_copy = BestSeconds(passes, [&] {
+      StatsAccum acc;
+      for (int y = 0; y < height; ++y) {
+        copy_stats(frame.data() + y * stride, width, 0xFF000000u,
+                   copy.data() + y * stride, &acc);
+      }
+      sink += acc.luma;
+    });
+    // FullStatsRow has a single SIMD tier; the cap selects it.
+    SetSimdLevelCap(level);
+    const double t_full = BestSeconds(passes, [&] {
+      FullStatsAccum acc;
+      for (int y = 0; y < height; ++y) {
+        FullStatsRow(frame.data() + y * stride, width, &acc);
+      }
+      sink += acc.sum[0];
+    });
+    const double gb = static_cast<double>(bytes) / 1e9;
+    std::printf("%-8s %10.2f %10.2f %10.2f\n", SimdLevelName(level),
+                gb / t_stats, gb / t_copy, gb / t_full);
+  }
+  std::printf("(checksum %llu)\n", static_cast<unsigned long long>(sink));
+  return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cli.h"
+#include "capture_source.h"
 #include "common.h"
 #include "monitor_enum.h"
 #include "window_enum.h"
@@ -16,12 +17,4 @@ struct CaptureContext {
   Rect capture_rect_screen;
 };
 
-bool CaptureWithGdi(const CaptureContext &ctx, ImageBuffer *out,
-                    ErrorInfo *err);
-bool CaptureWithDxgi(const CaptureContext &ctx, ImageBuffer *out,
-                     int *out_adapter_index, int *out_output_index,
-                     ErrorInfo *err);
-bool CaptureWithWgc(const CaptureContext &ctx, ImageBuffer *out,
-                    ErrorInfo *err);
-
 } // namespace sc
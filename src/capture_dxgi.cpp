@@ -1,11 +1,13 @@
 #include "capture.h"
+#include "rotate.h"
 
 #include <d3d11.h>
-#include <dxgi1_2.h>
+#include <dxgi1_5.h>
 
-#include <cstring>
 #include <wrl/client.h>
 
+#include <algorithm>
+
 namespace sc {
 
 namespace {
@@ -58,145 +60,305 @@ bool FindOutputForMonitor(HMONITOR hmon, IDXGIAdapter1 **out_adapter,
   return false;
 }
 
-bool AcquireDupFrame(IDXGIOutput1 *output1, IDXGIAdapter1 *adapter,
-                     int timeout_ms, Rect capture_rect, ImageBuffer *out,
-                     ErrorInfo *err) {
-  ComPtr<ID3D11Device> device;
-  ComPtr<ID3D11DeviceContext> context;
-  HRESULT hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr,
-                                 D3D11_CREATE_DEVICE_BGRA_SUPPORT, nullptr, 0,
-                                 D3D11_SDK_VERSION, &device, nullptr, &context);
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"D3D11CreateDevice failed", "AcquireDupFrame",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
+// Duplication surfaces keep the panel's native orientation; this is the
+// turn that brings one upright on the desktop.
+Orientation OrientationFromDxgi(DXGI_MODE_ROTATION rotation) {
+  switch (rotation) {
+  case DXGI_MODE_ROTATION_ROTATE90:
+    return Orientation::kRotate90;
+  case DXGI_MODE_ROTATION_ROTATE180:
+    return Orientation::kRotate180;
+  case DXGI_MODE_ROTATION_ROTATE270:
+    return Orientation::kRotate270;
+  default:
+    return Orientation::kIdentity;
   }
+}
 
-  ComPtr<IDXGIOutputDuplication> dup;
-  hr = output1->DuplicateOutput(device.Get(), &dup);
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"DuplicateOutput failed", "AcquireDupFrame",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
-  }
+// Holds the device, the duplication and one staging texture between
+// grabs. Each grab copies the newest desktop image into the staging
+// texture, which is recreated only when the surface changes; when nothing
+// new has been presented since, the last copy is delivered again.
+class DxgiSession : public CaptureSession {
+public:
+  ~DxgiSession() override { Close(); }
 
-  DXGI_OUTDUPL_FRAME_INFO frame_info{};
-  ComPtr<IDXGIResource> resource;
-  hr = dup->AcquireNextFrame(static_cast<UINT>(timeout_ms), &frame_info,
-                             &resource);
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"AcquireNextFrame failed", "AcquireDupFrame",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
+  bool Open(const CaptureRequest &req, ErrorInfo *err) override {
+    Close();
+    if (!req.context) {
+      *err = ErrorInfo{"dxgi methods need a capture context", "DxgiSession",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    const CaptureContext &ctx = *req.context;
+    if (ctx.monitor.has_value()) {
+      hmon_ = ctx.monitor->hmon;
+    } else if (ctx.window.has_value()) {
+      hmon_ = MonitorFromWindow(ctx.window->hwnd, MONITOR_DEFAULTTONEAREST);
+    }
+    if (!hmon_) {
+      *err = ErrorInfo{"unable to resolve monitor for DXGI", "DxgiSession",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    timeout_ms_ = ctx.common.timeout_ms;
+    force_alpha_ = ctx.cap.force_alpha_255;
+    hdr_ = ctx.cap.hdr;
+
+    if (!FindOutputForMonitor(hmon_, &adapter_, &output_, &adapter_index_,
+                              &output_index_, err)) {
+      Close();
+      return false;
+    }
+    const HRESULT hr = D3D11CreateDevice(
+        adapter_.Get(), D3D_DRIVER_TYPE_UNKNOWN, nullptr,
+        D3D11_CREATE_DEVICE_BGRA_SUPPORT, nullptr, 0, D3D11_SDK_VERSION,
+        &device_, nullptr, &context_);
+    if (FAILED(hr)) {
+      *err = ErrorInfo{"D3D11CreateDevice failed", "DxgiSession",
+                       static_cast<uint32_t>(hr), std::nullopt};
+      Close();
+      return false;
+    }
+    if (!Duplicate(err)) {
+      Close();
+      return false;
+    }
+    return true;
   }
 
-  ComPtr<ID3D11Texture2D> tex;
-  hr = resource.As(&tex);
-  if (FAILED(hr)) {
-    dup->ReleaseFrame();
-    *err = ErrorInfo{"frame resource to texture failed", "AcquireDupFrame",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
+  bool Grab(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) override {
+    if (!dup_) {
+      *err = ErrorInfo{"session is not open", "DxgiSession", std::nullopt,
+                       std::nullopt};
+      return false;
+    }
+    if (!UpdateStaging(err)) {
+      return false;
+    }
+    return DeliverStaging(sink, out, err);
   }
 
-  D3D11_TEXTURE2D_DESC desc{};
-  tex->GetDesc(&desc);
-  desc.BindFlags = 0;
-  desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-  desc.MiscFlags = 0;
-  desc.Usage = D3D11_USAGE_STAGING;
+  void Close() override {
+    staging_.Reset();
+    dup_.Reset();
+    context_.Reset();
+    device_.Reset();
+    output_.Reset();
+    adapter_.Reset();
+    hmon_ = nullptr;
+    has_frame_ = false;
+  }
 
-  ComPtr<ID3D11Texture2D> staging;
-  hr = device->CreateTexture2D(&desc, nullptr, &staging);
-  if (FAILED(hr)) {
-    dup->ReleaseFrame();
-    *err = ErrorInfo{"CreateTexture2D staging failed", "AcquireDupFrame",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
+  std::string Details() const override {
+    return "DXGI adapter_index=" + std::to_string(adapter_index_) +
+           " output_index=" + std::to_string(output_index_);
   }
 
-  context->CopyResource(staging.Get(), tex.Get());
+private:
+  // With `hdr_` set the duplication asks for FP16 surfaces, which carry HDR
+  // desktops without the OS clipping them; an SDR output may still hand out
+  // BGRA, so the surface format decides the path.
+  bool Duplicate(ErrorInfo *err) {
+    dup_.Reset();
+    has_frame_ = false;
+    HRESULT hr;
+    if (hdr_.has_value()) {
+      ComPtr<IDXGIOutput5> output5;
+      hr = output_->QueryInterface(IID_PPV_ARGS(&output5));
+      if (FAILED(hr)) {
+        *err = ErrorInfo{"QueryInterface IDXGIOutput5 failed", "DxgiSession",
+                         static_cast<uint32_t>(hr), std::nullopt};
+        return false;
+      }
+      const DXGI_FORMAT formats[] = {DXGI_FORMAT_R16G16B16A16_FLOAT,
+                                     DXGI_FORMAT_B8G8R8A8_UNORM};
+      hr = output5->DuplicateOutput1(device_.Get(), 0, ARRAYSIZE(formats),
+                                     formats, &dup_);
+      if (FAILED(hr)) {
+        *err = ErrorInfo{"DuplicateOutput1 failed", "DxgiSession",
+                         static_cast<uint32_t>(hr), std::nullopt};
+        return false;
+      }
+    } else {
+      hr = output_->DuplicateOutput(device_.Get(), &dup_);
+      if (FAILED(hr)) {
+        *err = ErrorInfo{"DuplicateOutput failed", "DxgiSession",
+                         static_cast<uint32_t>(hr), std::nullopt};
+        return false;
+      }
+    }
+    dup_->GetDesc(&dup_desc_);
 
-  D3D11_MAPPED_SUBRESOURCE map{};
-  hr = context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &map);
-  if (FAILED(hr)) {
-    dup->ReleaseFrame();
-    *err = ErrorInfo{"Map staging failed", "AcquireDupFrame",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
+    // A new duplication usually follows a mode change, which can move or
+    // resize the monitor as well.
+    MONITORINFO mi{};
+    mi.cbSize = sizeof(mi);
+    if (!GetMonitorInfoW(hmon_, &mi)) {
+      *err = ErrorInfo{"GetMonitorInfo failed", "DxgiSession", std::nullopt,
+                       static_cast<uint32_t>(GetLastError())};
+      return false;
+    }
+    monitor_rect_ = ToRect(mi.rcMonitor);
+    return true;
   }
 
-  const int w = Width(capture_rect);
-  const int h = Height(capture_rect);
-  out->width = w;
-  out->height = h;
-  out->row_pitch = w * 4;
-  out->origin_x = capture_rect.left;
-  out->origin_y = capture_rect.top;
-  out->bgra.resize(static_cast<size_t>(w * h * 4));
-
-  for (int y = 0; y < h; ++y) {
-    const uint8_t *src = static_cast<const uint8_t *>(map.pData) +
-                         static_cast<size_t>(y * map.RowPitch);
-    uint8_t *dst = out->bgra.data() + static_cast<size_t>(y * out->row_pitch);
-    memcpy(dst, src, static_cast<size_t>(w * 4));
-  }
+  // Copies the newest frame into the staging texture. The first grab waits
+  // up to the timeout for one; later grabs do not wait, since an unchanged
+  // desktop is already in the staging texture.
+  bool UpdateStaging(ErrorInfo *err) {
+    for (int attempt = 0;; ++attempt) {
+      DXGI_OUTDUPL_FRAME_INFO frame_info{};
+      ComPtr<IDXGIResource> resource;
+      const UINT timeout = has_frame_ ? 0 : static_cast<UINT>(timeout_ms_);
+      HRESULT hr = dup_->AcquireNextFrame(timeout, &frame_info, &resource);
+      if (hr == DXGI_ERROR_WAIT_TIMEOUT && has_frame_) {
+        return true;
+      }
+      // Mode changes, full-screen switches and the secure desktop end a
+      // duplication; a new one carries on from the current desktop.
+      if (hr == DXGI_ERROR_ACCESS_LOST && attempt == 0) {
+        if (!Duplicate(err)) {
+          return false;
+        }
+        continue;
+      }
+      if (FAILED(hr)) {
+        *err = ErrorInfo{"AcquireNextFrame failed", "DxgiSession",
+                         static_cast<uint32_t>(hr), std::nullopt};
+        return false;
+      }
 
-  context->Unmap(staging.Get(), 0);
-  dup->ReleaseFrame();
-  return true;
-}
+      ComPtr<ID3D11Texture2D> tex;
+      hr = resource.As(&tex);
+      if (FAILED(hr)) {
+        dup_->ReleaseFrame();
+        *err = ErrorInfo{"frame resource to texture failed", "DxgiSession",
+                         static_cast<uint32_t>(hr), std::nullopt};
+        return false;
+      }
 
-} // namespace
+      D3D11_TEXTURE2D_DESC desc{};
+      tex->GetDesc(&desc);
+      desc.BindFlags = 0;
+      desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+      desc.MiscFlags = 0;
+      desc.Usage = D3D11_USAGE_STAGING;
+      if (!staging_ || desc.Width != staging_desc_.Width ||
+          desc.Height != staging_desc_.Height ||
+          desc.Format != staging_desc_.Format) {
+        staging_.Reset();
+        hr = device_->CreateTexture2D(&desc, nullptr, &staging_);
+        if (FAILED(hr)) {
+          dup_->ReleaseFrame();
+          *err = ErrorInfo{"CreateTexture2D staging failed", "DxgiSession",
+                           static_cast<uint32_t>(hr), std::nullopt};
+          return false;
+        }
+        staging_desc_ = desc;
+      }
 
-bool CaptureWithDxgi(const CaptureContext &ctx, ImageBuffer *out,
-                     int *out_adapter_index, int *out_output_index,
-                     ErrorInfo *err) {
-  HMONITOR hmon = nullptr;
-  if (ctx.monitor.has_value()) {
-    hmon = ctx.monitor->hmon;
-  } else if (ctx.window.has_value()) {
-    hmon = MonitorFromWindow(ctx.window->hwnd, MONITOR_DEFAULTTONEAREST);
-  }
-  if (!hmon) {
-    *err = ErrorInfo{"unable to resolve monitor for DXGI", "CaptureWithDxgi",
-                     std::nullopt, std::nullopt};
-    return false;
+      // The copy is queued on the device, so the frame can go back to the
+      // duplication straight away.
+      context_->CopyResource(staging_.Get(), tex.Get());
+      dup_->ReleaseFrame();
+      has_frame_ = true;
+      return true;
+    }
   }
 
-  ComPtr<IDXGIAdapter1> adapter;
-  ComPtr<IDXGIOutput1> output;
-  int ai = -1;
-  int oi = -1;
-  if (!FindOutputForMonitor(hmon, &adapter, &output, &ai, &oi, err)) {
-    return false;
-  }
+  bool DeliverStaging(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) {
+    D3D11_MAPPED_SUBRESOURCE map{};
+    const HRESULT hr =
+        context_->Map(staging_.Get(), 0, D3D11_MAP_READ, 0, &map);
+    if (FAILED(hr)) {
+      *err = ErrorInfo{"Map staging failed", "DxgiSession",
+                       static_cast<uint32_t>(hr), std::nullopt};
+      return false;
+    }
 
-  MONITORINFO mi{};
-  mi.cbSize = sizeof(mi);
-  if (!GetMonitorInfoW(hmon, &mi)) {
-    *err = ErrorInfo{"GetMonitorInfo failed", "CaptureWithDxgi", std::nullopt,
-                     static_cast<uint32_t>(GetLastError())};
-    return false;
-  }
-  Rect monitor_rect = ToRect(mi.rcMonitor);
+    // The copy is sized from the surface, not the monitor rect: on a
+    // rotated display the two have their sides swapped until the surface
+    // is turned.
+    const Rect capture_rect = monitor_rect_;
+    const int surface_w = static_cast<int>(staging_desc_.Width);
+    const int surface_h = static_cast<int>(staging_desc_.Height);
+    const bool half = hdr_.has_value() &&
+                      staging_desc_.Format == DXGI_FORMAT_R16G16B16A16_FLOAT;
+    const Orientation orientation = OrientationFromDxgi(dup_desc_.Rotation);
+    bool delivered = false;
+    if (half && orientation == Orientation::kIdentity) {
+      const HalfImageView frame = MappedHalfView(
+          map.pData, map.RowPitch, std::min(surface_w, Width(capture_rect)),
+          std::min(surface_h, Height(capture_rect)), capture_rect.left,
+          capture_rect.top);
+      delivered = DeliverHdrFrame(frame, hdr_.value(), sink, out, err);
+    } else {
+      ImageView frame = MappedView(map.pData, map.RowPitch, surface_w,
+                                   surface_h, capture_rect.left,
+                                   capture_rect.top);
+      if (half) {
+        // Turning works on 8-bit pixels, so a rotated HDR surface is
+        // tone-mapped whole and goes on as an SDR frame.
+        ToneMapImage(MappedHalfView(map.pData, map.RowPitch, surface_w,
+                                    surface_h, capture_rect.left,
+                                    capture_rect.top),
+                     hdr_.value(), &tone_mapped_);
+        frame = tone_mapped_;
+      }
+      if (orientation != Orientation::kIdentity) {
+        OrientImage(frame, orientation, &upright_);
+        frame = upright_;
+      }
+      frame.width = std::min(frame.width, Width(capture_rect));
+      frame.height = std::min(frame.height, Height(capture_rect));
+      delivered = DeliverFrame(
+          frame, force_alpha_ ? AlphaPolicy::kForceOpaque : AlphaPolicy::kKeep,
+          sink, out, err);
+    }
 
-  ImageBuffer full;
-  if (!AcquireDupFrame(output.Get(), adapter.Get(), ctx.common.timeout_ms,
-                       monitor_rect, &full, err)) {
-    return false;
+    context_->Unmap(staging_.Get(), 0);
+    return delivered;
   }
 
-  *out = std::move(full);
-  *out_adapter_index = ai;
-  *out_output_index = oi;
+  HMONITOR hmon_ = nullptr;
+  int timeout_ms_ = 0;
+  bool force_alpha_ = false;
+  std::optional<ToneMapOptions> hdr_;
+  ComPtr<IDXGIAdapter1> adapter_;
+  ComPtr<IDXGIOutput1> output_;
+  int adapter_index_ = -1;
+  int output_index_ = -1;
+  ComPtr<ID3D11Device> device_;
+  ComPtr<ID3D11DeviceContext> context_;
+  ComPtr<IDXGIOutputDuplication> dup_;
+  DXGI_OUTDUPL_DESC dup_desc_{};
+  Rect monitor_rect_;
+  ComPtr<ID3D11Texture2D> staging_;
+  D3D11_TEXTURE2D_DESC staging_desc_{};
+  bool has_frame_ = false; // staging_ holds a desktop image
+  // Turned and tone-mapped frames, kept so repeated grabs reuse them.
+  ImageBuffer tone_mapped_;
+  ImageBuffer upright_;
+};
 
-  if (ctx.cap.force_alpha_255) {
-    for (size_t i = 3; i < out->bgra.size(); i += 4) {
-      out->bgra[i] = 0xFF;
-    }
-  }
-  return true;
+std::unique_ptr<CaptureSession> CreateDxgi() {
+  return std::make_unique<DxgiSession>();
+}
+
+// Both duplicate a whole output; dxgi-window crops it to the window.
+CaptureCaps DxgiCaps() {
+  CaptureCaps caps;
+  caps.window = true;
+  caps.monitor = true;
+  caps.hdr = true;
+  return caps;
 }
 
+const bool kRegistered =
+    RegisterCaptureMethod({"dxgi-window", DxgiCaps(), CreateDxgi}) &&
+    RegisterCaptureMethod({"dxgi-monitor", DxgiCaps(), CreateDxgi});
+
+} // namespace
+
 } // namespace sc
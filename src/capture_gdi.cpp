@@ -1,199 +1,181 @@
 #include "capture.h"
 
-#include <cstring>
-
 namespace sc {
 
 namespace {
 
-bool CaptureFromDc(HDC src_dc, int src_x, int src_y, int w, int h, int origin_x,
-                   int origin_y, ImageBuffer *out, ErrorInfo *err) {
-  HDC mem_dc = CreateCompatibleDC(src_dc);
-  if (!mem_dc) {
-    *err = ErrorInfo{"CreateCompatibleDC failed", "CaptureFromDc", std::nullopt,
-                     static_cast<uint32_t>(GetLastError())};
-    return false;
-  }
-
-  BITMAPINFO bmi{};
-  bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-  bmi.bmiHeader.biWidth = w;
-  bmi.bmiHeader.biHeight = -h;
-  bmi.bmiHeader.biPlanes = 1;
-  bmi.bmiHeader.biBitCount = 32;
-  bmi.bmiHeader.biCompression = BI_RGB;
-
-  void *bits = nullptr;
-  HBITMAP bmp =
-      CreateDIBSection(mem_dc, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
-  if (!bmp || !bits) {
-    DeleteDC(mem_dc);
-    *err = ErrorInfo{"CreateDIBSection failed", "CaptureFromDc", std::nullopt,
-                     static_cast<uint32_t>(GetLastError())};
-    return false;
-  }
+enum class GdiMode { kPrintWindow, kClient, kWindowDc, kScreen };
 
-  HGDIOBJ old = SelectObject(mem_dc, bmp);
-  BOOL ok =
-      BitBlt(mem_dc, 0, 0, w, h, src_dc, src_x, src_y, SRCCOPY | CAPTUREBLT);
-  if (!ok) {
-    SelectObject(mem_dc, old);
-    DeleteObject(bmp);
-    DeleteDC(mem_dc);
-    *err = ErrorInfo{"BitBlt failed", "CaptureFromDc", std::nullopt,
-                     static_cast<uint32_t>(GetLastError())};
-    return false;
-  }
-
-  out->width = w;
-  out->height = h;
-  out->row_pitch = w * 4;
-  out->origin_x = origin_x;
-  out->origin_y = origin_y;
-  out->bgra.assign(static_cast<uint8_t *>(bits),
-                   static_cast<uint8_t *>(bits) +
-                       static_cast<size_t>(out->row_pitch * h));
-
-  SelectObject(mem_dc, old);
-  DeleteObject(bmp);
-  DeleteDC(mem_dc);
-  return true;
-}
-
-} // namespace
-
-bool CaptureWithGdi(const CaptureContext &ctx, ImageBuffer *out,
-                    ErrorInfo *err) {
-  const auto &method = ctx.method;
-
-  if (method == "gdi-printwindow") {
-    if (!ctx.window.has_value()) {
-      *err = ErrorInfo{"gdi-printwindow requires window target",
-                       "CaptureWithGdi", std::nullopt, std::nullopt};
-      return false;
-    }
-    const auto &w = ctx.window.value();
-    int width = Width(w.rect);
-    int height = Height(w.rect);
+// Keeps the memory DC and its DIB section between grabs; only the source
+// DC is taken per grab, since a window's DC may not be held across calls.
+class GdiSession : public CaptureSession {
+public:
+  ~GdiSession() override { Close(); }
 
-    HDC win_dc = GetWindowDC(w.hwnd);
-    if (!win_dc) {
-      *err = ErrorInfo{"GetWindowDC failed", "CaptureWithGdi", std::nullopt,
-                       static_cast<uint32_t>(GetLastError())};
+  bool Open(const CaptureRequest &req, ErrorInfo *err) override {
+    Close();
+    if (!req.context) {
+      *err = ErrorInfo{"gdi methods need a capture context", "GdiSession",
+                       std::nullopt, std::nullopt};
       return false;
     }
-    HDC mem_dc = CreateCompatibleDC(win_dc);
-    BITMAPINFO bmi{};
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = width;
-    bmi.bmiHeader.biHeight = -height;
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 32;
-    bmi.bmiHeader.biCompression = BI_RGB;
-
-    void *bits = nullptr;
-    HBITMAP bmp =
-        CreateDIBSection(mem_dc, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
-    if (!bmp || !bits) {
-      if (bmp)
-        DeleteObject(bmp);
-      DeleteDC(mem_dc);
-      ReleaseDC(w.hwnd, win_dc);
-      *err = ErrorInfo{"CreateDIBSection failed", "CaptureWithGdi",
-                       std::nullopt, static_cast<uint32_t>(GetLastError())};
+    const CaptureContext &ctx = *req.context;
+    const std::string &method = ctx.method;
+    if (method == "gdi-printwindow") {
+      mode_ = GdiMode::kPrintWindow;
+    } else if (method == "gdi-bitblt-client") {
+      mode_ = GdiMode::kClient;
+    } else if (method == "gdi-bitblt-windowdc") {
+      mode_ = GdiMode::kWindowDc;
+    } else if (method == "gdi-bitblt-screen") {
+      mode_ = GdiMode::kScreen;
+    } else {
+      *err = ErrorInfo{"unknown gdi method", "GdiSession", std::nullopt,
+                       std::nullopt};
       return false;
     }
 
-    HGDIOBJ old = SelectObject(mem_dc, bmp);
-    BOOL ok = PrintWindow(w.hwnd, mem_dc, PW_RENDERFULLCONTENT);
-    if (!ok) {
-      *err = ErrorInfo{"PrintWindow failed", "CaptureWithGdi", std::nullopt,
-                       static_cast<uint32_t>(GetLastError())};
-      SelectObject(mem_dc, old);
-      DeleteObject(bmp);
-      DeleteDC(mem_dc);
-      ReleaseDC(w.hwnd, win_dc);
-      return false;
+    Rect area;
+    if (mode_ == GdiMode::kScreen) {
+      hwnd_ = nullptr;
+      area = ctx.capture_rect_screen;
+      src_x_ = area.left;
+      src_y_ = area.top;
+    } else {
+      if (!ctx.window.has_value()) {
+        *err = ErrorInfo{method + " requires window target", "GdiSession",
+                         std::nullopt, std::nullopt};
+        return false;
+      }
+      const auto &w = ctx.window.value();
+      hwnd_ = w.hwnd;
+      area = mode_ == GdiMode::kClient ? w.client_rect_screen : w.rect;
+      src_x_ = 0;
+      src_y_ = 0;
     }
-
-    out->width = width;
-    out->height = height;
-    out->row_pitch = width * 4;
-    out->origin_x = w.rect.left;
-    out->origin_y = w.rect.top;
-    out->bgra.assign(static_cast<uint8_t *>(bits),
-                     static_cast<uint8_t *>(bits) +
-                         static_cast<size_t>(out->row_pitch * height));
-
-    SelectObject(mem_dc, old);
-    DeleteObject(bmp);
-    DeleteDC(mem_dc);
-    ReleaseDC(w.hwnd, win_dc);
-    return true;
+    origin_x_ = area.left;
+    origin_y_ = area.top;
+    return CreateBitmap(Width(area), Height(area), err);
   }
 
-  if (method == "gdi-bitblt-client") {
-    if (!ctx.window.has_value()) {
-      *err = ErrorInfo{"gdi-bitblt-client requires window target",
-                       "CaptureWithGdi", std::nullopt, std::nullopt};
+  bool Grab(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) override {
+    if (!mem_dc_) {
+      *err = ErrorInfo{"session is not open", "GdiSession", std::nullopt,
+                       std::nullopt};
       return false;
     }
-    const auto &w = ctx.window.value();
-    HDC src = GetDC(w.hwnd);
+    HDC src = mode_ == GdiMode::kClient || mode_ == GdiMode::kScreen
+                  ? GetDC(hwnd_)
+                  : GetWindowDC(hwnd_);
     if (!src) {
-      *err = ErrorInfo{"GetDC(hwnd) failed", "CaptureWithGdi", std::nullopt,
+      *err = ErrorInfo{"GetDC failed", "GdiSession", std::nullopt,
                        static_cast<uint32_t>(GetLastError())};
       return false;
     }
-    int ww = Width(w.client_rect_screen);
-    int hh = Height(w.client_rect_screen);
-    bool ok = CaptureFromDc(src, 0, 0, ww, hh, w.client_rect_screen.left,
-                            w.client_rect_screen.top, out, err);
-    ReleaseDC(w.hwnd, src);
-    return ok;
+    BOOL ok;
+    const char *call;
+    if (mode_ == GdiMode::kPrintWindow) {
+      ok = PrintWindow(hwnd_, mem_dc_, PW_RENDERFULLCONTENT);
+      call = "PrintWindow failed";
+    } else {
+      ok = BitBlt(mem_dc_, 0, 0, width_, height_, src, src_x_, src_y_,
+                  SRCCOPY | CAPTUREBLT);
+      call = "BitBlt failed";
+    }
+    const DWORD last_error = GetLastError();
+    ReleaseDC(hwnd_, src);
+    if (!ok) {
+      *err = ErrorInfo{call, "GdiSession", std::nullopt,
+                       static_cast<uint32_t>(last_error)};
+      return false;
+    }
+    // The DIB bits are read directly, so queued GDI drawing must land first.
+    GdiFlush();
+    return DeliverFrame(MappedView(bits_, static_cast<size_t>(width_) * 4,
+                                   width_, height_, origin_x_, origin_y_),
+                        AlphaPolicy::kKeep, sink, out, err);
   }
 
-  if (method == "gdi-bitblt-windowdc") {
-    if (!ctx.window.has_value()) {
-      *err = ErrorInfo{"gdi-bitblt-windowdc requires window target",
-                       "CaptureWithGdi", std::nullopt, std::nullopt};
-      return false;
+  void Close() override {
+    if (mem_dc_) {
+      SelectObject(mem_dc_, old_);
+      DeleteDC(mem_dc_);
     }
-    const auto &w = ctx.window.value();
-    HDC src = GetWindowDC(w.hwnd);
-    if (!src) {
-      *err = ErrorInfo{"GetWindowDC failed", "CaptureWithGdi", std::nullopt,
-                       static_cast<uint32_t>(GetLastError())};
-      return false;
+    if (bmp_) {
+      DeleteObject(bmp_);
     }
-    int ww = Width(w.rect);
-    int hh = Height(w.rect);
-    bool ok =
-        CaptureFromDc(src, 0, 0, ww, hh, w.rect.left, w.rect.top, out, err);
-    ReleaseDC(w.hwnd, src);
-    return ok;
+    mem_dc_ = nullptr;
+    bmp_ = nullptr;
+    old_ = nullptr;
+    bits_ = nullptr;
+    width_ = 0;
+    height_ = 0;
   }
 
-  if (method == "gdi-bitblt-screen") {
-    HDC src = GetDC(nullptr);
-    if (!src) {
-      *err = ErrorInfo{"GetDC(NULL) failed", "CaptureWithGdi", std::nullopt,
+private:
+  bool CreateBitmap(int w, int h, ErrorInfo *err) {
+    mem_dc_ = CreateCompatibleDC(nullptr);
+    if (!mem_dc_) {
+      *err = ErrorInfo{"CreateCompatibleDC failed", "GdiSession", std::nullopt,
                        static_cast<uint32_t>(GetLastError())};
       return false;
     }
 
-    Rect r = ctx.capture_rect_screen;
-    int ww = Width(r);
-    int hh = Height(r);
-    bool ok =
-        CaptureFromDc(src, r.left, r.top, ww, hh, r.left, r.top, out, err);
-    ReleaseDC(nullptr, src);
-    return ok;
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = w;
+    bmi.bmiHeader.biHeight = -h;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    void *bits = nullptr;
+    bmp_ = CreateDIBSection(mem_dc_, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+    if (!bmp_ || !bits) {
+      *err = ErrorInfo{"CreateDIBSection failed", "GdiSession", std::nullopt,
+                       static_cast<uint32_t>(GetLastError())};
+      Close();
+      return false;
+    }
+    old_ = SelectObject(mem_dc_, bmp_);
+    bits_ = bits;
+    width_ = w;
+    height_ = h;
+    return true;
   }
 
-  *err = ErrorInfo{"unknown gdi method", "CaptureWithGdi", std::nullopt,
-                   std::nullopt};
-  return false;
+  GdiMode mode_ = GdiMode::kScreen;
+  HWND hwnd_ = nullptr; // nullptr reads the screen DC
+  int src_x_ = 0;
+  int src_y_ = 0;
+  int origin_x_ = 0;
+  int origin_y_ = 0;
+  HDC mem_dc_ = nullptr;
+  HBITMAP bmp_ = nullptr;
+  HGDIOBJ old_ = nullptr;
+  void *bits_ = nullptr;
+  int width_ = 0;
+  int height_ = 0;
+};
+
+std::unique_ptr<CaptureSession> CreateGdi() {
+  return std::make_unique<GdiSession>();
+}
+
+// bitblt-screen copies the screen area under a window target as well.
+CaptureCaps GdiCaps(bool monitor) {
+  CaptureCaps caps;
+  caps.window = true;
+  caps.monitor = monitor;
+  return caps;
 }
 
+const bool kRegistered =
+    RegisterCaptureMethod({"gdi-printwindow", GdiCaps(false), CreateGdi}) &&
+    RegisterCaptureMethod({"gdi-bitblt-client", GdiCaps(false), CreateGdi}) &&
+    RegisterCaptureMethod({"gdi-bitblt-windowdc", GdiCaps(false), CreateGdi}) &&
+    RegisterCaptureMethod({"gdi-bitblt-screen", GdiCaps(true), CreateGdi});
+
+} // namespace
+
 } // namespace sc
@@ -0,0 +1,65 @@
+#include "capture_source.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+namespace sc {
+
+namespace {
+
+// Registration runs during static initialisation, in no particular order
+// across translation units, so the table is created on first use. A deque
+// keeps the pointers handed out stable.
+struct Registry {
+  std::mutex mu;
+  std::deque<CaptureMethodInfo> methods;
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+} // namespace
+
+bool RegisterCaptureMethod(const CaptureMethodInfo &info) {
+  Registry &r = GetRegistry();
+  std::lock_guard<std::mutex> lock(r.mu);
+  for (CaptureMethodInfo &m : r.methods) {
+    if (m.name == info.name) {
+      m = info;
+      return true;
+    }
+  }
+  r.methods.push_back(info);
+  return true;
+}
+
+const CaptureMethodInfo *FindCaptureMethod(const std::string &name) {
+  Registry &r = GetRegistry();
+  std::lock_guard<std::mutex> lock(r.mu);
+  for (const CaptureMethodInfo &m : r.methods) {
+    if (m.name == name) {
+      return &m;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<const CaptureMethodInfo *> CaptureMethods() {
+  Registry &r = GetRegistry();
+  std::lock_guard<std::mutex> lock(r.mu);
+  std::vector<const CaptureMethodInfo *> out;
+  out.reserve(r.methods.size());
+  for (const CaptureMethodInfo &m : r.methods) {
+    out.push_back(&m);
+  }
+  std::sort(out.begin(), out.end(),
+            [](const CaptureMethodInfo *a, const CaptureMethodInfo *b) {
+              return a->name < b->name;
+            });
+  return out;
+}
+
+} // namespace sc
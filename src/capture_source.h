@@ -0,0 +1,73 @@
+#pragma once
+
+#include "frame_copy.h"
+#include "replay_source.h"
+#include "synthetic_source.h"
+#include "types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+// Defined by the Windows CLI (capture.h): resolved window and monitor
+// targets plus the parsed options. Portable backends never touch it.
+struct CaptureContext;
+
+// What a capture method can do; the CLI checks options against these
+// before anything is captured.
+struct CaptureCaps {
+  bool window = false;      // takes a window target (--target window)
+  bool monitor = false;     // takes a monitor or virtual-screen target
+  bool alpha = false;       // delivers meaningful alpha
+  bool hdr = false;         // can deliver scRGB frames (--hdr)
+};
+
+struct CaptureRequest {
+  std::string method;
+  SyntheticOptions synthetic; // synthetic-* only
+  ReplayOptions replay;       // replay only
+  const CaptureContext *context = nullptr; // required by Windows backends
+};
+
+// One open capture of one target. Open does the setup that outlives a
+// frame (devices, duplications or frame pools, staging surfaces, bitmaps),
+// which costs far more than a frame does; each Grab then only waits for
+// the next frame and copies it. Close releases everything, and a closed
+// session can be opened again.
+class CaptureSession {
+public:
+  virtual ~CaptureSession() = default;
+  // `req` must outlive the session while it is open.
+  virtual bool Open(const CaptureRequest &req, ErrorInfo *err) = 0;
+  // Hands the current frame to `sink` while the backend still has it
+  // mapped; without a sink the frame is copied into `out`.
+  virtual bool Grab(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) = 0;
+  // Also run by every session's destructor.
+  virtual void Close() = 0;
+  // Backend facts worth logging after a grab (the DXGI adapter and output
+  // used, for instance); empty when there are none.
+  virtual std::string Details() const { return {}; }
+};
+
+using CaptureSessionFactory = std::unique_ptr<CaptureSession> (*)();
+
+struct CaptureMethodInfo {
+  std::string name; // the --method value
+  CaptureCaps caps;
+  CaptureSessionFactory create = nullptr;
+};
+
+// Backends register their methods from static initialisers in their own
+// translation unit, so linking a backend in is all it takes to offer it.
+// Returns true, for use as such an initialiser.
+bool RegisterCaptureMethod(const CaptureMethodInfo &info);
+
+// The method called `name`, or nullptr.
+const CaptureMethodInfo *FindCaptureMethod(const std::string &name);
+
+// Every registered method, sorted by name.
+std::vector<const CaptureMethodInfo *> CaptureMethods();
+
+} // namespace sc
@@ -5,7 +5,6 @@
 #include <windows.graphics.capture.interop.h>
 #include <windows.graphics.directx.direct3d11.interop.h>
 
-#include <cstring>
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Graphics.Capture.h>
 #include <winrt/Windows.Graphics.DirectX.Direct3D11.h>
@@ -13,6 +12,8 @@
 
 #include <wrl/client.h>
 
+#include <mutex>
+
 namespace sc {
 
 namespace {
@@ -87,157 +88,298 @@ bool CreateCaptureItemFromMonitor(HMONITOR hmon, wgc::GraphicsCaptureItem *item,
   return true;
 }
 
-bool CopyFrameToImage(const wgc::Direct3D11CaptureFrame &frame,
-                      ID3D11Device *device,
-                      ID3D11DeviceContext *context, const Rect &origin_rect,
-                      ImageBuffer *out, ErrorInfo *err) {
-  auto surface = frame.Surface();
-  auto access =
-      surface.as<::Windows::Graphics::DirectX::Direct3D11::
-                     IDirect3DDxgiInterfaceAccess>();
-
-  ComPtr<ID3D11Texture2D> tex;
-  HRESULT hr = access->GetInterface(IID_PPV_ARGS(&tex));
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"GetInterface(ID3D11Texture2D) failed", "CopyFrameToImage",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
-  }
-
-  D3D11_TEXTURE2D_DESC desc{};
-  tex->GetDesc(&desc);
-  desc.BindFlags = 0;
-  desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-  desc.MiscFlags = 0;
-  desc.Usage = D3D11_USAGE_STAGING;
-
-  ComPtr<ID3D11Texture2D> staging;
-  hr = device->CreateTexture2D(&desc, nullptr, &staging);
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"CreateTexture2D staging failed", "CopyFrameToImage",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
-  }
-
-  context->CopyResource(staging.Get(), tex.Get());
-
-  D3D11_MAPPED_SUBRESOURCE map{};
-  hr = context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &map);
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"Map staging failed", "CopyFrameToImage",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
-  }
-
-  out->width = static_cast<int>(desc.Width);
-  out->height = static_cast<int>(desc.Height);
-  out->row_pitch = out->width * 4;
-  out->origin_x = origin_rect.left;
-  out->origin_y = origin_rect.top;
-  out->bgra.resize(static_cast<size_t>(out->row_pitch * out->height));
-
-  for (int y = 0; y < out->height; ++y) {
-    const uint8_t *src = static_cast<const uint8_t *>(map.pData) +
-                         static_cast<size_t>(y * map.RowPitch);
-    uint8_t *dst = out->bgra.data() + static_cast<size_t>(y * out->row_pitch);
-    memcpy(dst, src, static_cast<size_t>(out->row_pitch));
-  }
+// Keeps the device, capture item, frame pool and a staging texture between
+// grabs. The pool runs for the whole session and the FrameArrived handler
+// keeps only the newest frame; a grab copies that into the staging texture,
+// or delivers the last copy again when nothing new has arrived.
+class WgcSession : public CaptureSession {
+public:
+  ~WgcSession() override { Close(); }
+
+  bool Open(const CaptureRequest &req, ErrorInfo *err) override {
+    Close();
+    if (!req.context) {
+      *err = ErrorInfo{"wgc methods need a capture context", "WgcSession",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    const CaptureContext &ctx = *req.context;
+    winrt::init_apartment(winrt::apartment_type::multi_threaded);
 
-  context->Unmap(staging.Get(), 0);
-  return true;
-}
+    if (!wgc::GraphicsCaptureSession::IsSupported()) {
+      *err = ErrorInfo{"GraphicsCaptureSession::IsSupported false",
+                       "WgcSession", std::nullopt, std::nullopt};
+      return false;
+    }
 
-} // namespace
+    HRESULT hr =
+        D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
+                          D3D11_CREATE_DEVICE_BGRA_SUPPORT, nullptr, 0,
+                          D3D11_SDK_VERSION, &device_, nullptr, &context_);
+    if (FAILED(hr)) {
+      *err = ErrorInfo{"D3D11CreateDevice failed", "WgcSession",
+                       static_cast<uint32_t>(hr), std::nullopt};
+      Close();
+      return false;
+    }
 
-bool CaptureWithWgc(const CaptureContext &ctx, ImageBuffer *out,
-                    ErrorInfo *err) {
-  winrt::init_apartment(winrt::apartment_type::multi_threaded);
+    auto winrt_device = CreateWinRtD3DDevice(device_.Get(), err);
+    if (!winrt_device) {
+      Close();
+      return false;
+    }
 
-  if (!wgc::GraphicsCaptureSession::IsSupported()) {
-    *err = ErrorInfo{"GraphicsCaptureSession::IsSupported false",
-                     "CaptureWithWgc", std::nullopt, std::nullopt};
-    return false;
-  }
+    wgc::GraphicsCaptureItem item{nullptr};
+    if (ctx.method == "wgc-window") {
+      if (!ctx.window.has_value()) {
+        *err = ErrorInfo{"wgc-window needs window target", "WgcSession",
+                         std::nullopt, std::nullopt};
+        Close();
+        return false;
+      }
+      if (!CreateCaptureItemFromHwnd(ctx.window->hwnd, &item, err)) {
+        Close();
+        return false;
+      }
+    } else if (ctx.method == "wgc-monitor") {
+      if (!ctx.monitor.has_value()) {
+        *err = ErrorInfo{"wgc-monitor needs monitor target", "WgcSession",
+                         std::nullopt, std::nullopt};
+        Close();
+        return false;
+      }
+      if (!CreateCaptureItemFromMonitor(ctx.monitor->hmon, &item, err)) {
+        Close();
+        return false;
+      }
+    } else {
+      *err = ErrorInfo{"unknown wgc method", "WgcSession", std::nullopt,
+                       std::nullopt};
+      Close();
+      return false;
+    }
 
-  ComPtr<ID3D11Device> d3d_device;
-  ComPtr<ID3D11DeviceContext> d3d_context;
-  HRESULT hr =
-      D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
-                        D3D11_CREATE_DEVICE_BGRA_SUPPORT, nullptr, 0,
-                        D3D11_SDK_VERSION, &d3d_device, nullptr, &d3d_context);
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"D3D11CreateDevice failed", "CaptureWithWgc",
-                     static_cast<uint32_t>(hr), std::nullopt};
-    return false;
-  }
+    origin_ = ctx.capture_rect_screen;
+    if (ctx.method == "wgc-window" && ctx.window.has_value()) {
+      origin_ = ctx.window->rect;
+    }
+    timeout_ms_ = ctx.common.timeout_ms;
+    hdr_ = ctx.cap.hdr;
+
+    ev_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!ev_) {
+      *err = ErrorInfo{"CreateEvent failed", "WgcSession", std::nullopt,
+                       static_cast<uint32_t>(GetLastError())};
+      Close();
+      return false;
+    }
 
-  auto winrt_device = CreateWinRtD3DDevice(d3d_device.Get(), err);
-  if (!winrt_device) {
-    return false;
+    // FP16 frames keep HDR content as scRGB instead of the OS's SDR
+    // version. Two buffers let the next frame arrive while one is copied.
+    device_winrt_ = winrt_device;
+    pixel_format_ = hdr_.has_value()
+                        ? wgd::DirectXPixelFormat::R16G16B16A16Float
+                        : wgd::DirectXPixelFormat::B8G8R8A8UIntNormalized;
+    pool_size_ = item.Size();
+    frame_pool_ = wgc::Direct3D11CaptureFramePool::CreateFreeThreaded(
+        device_winrt_, pixel_format_, 2, pool_size_);
+    frame_arrived_ = frame_pool_.FrameArrived(
+        [this](const wgc::Direct3D11CaptureFramePool &sender,
+               const winrt::Windows::Foundation::IInspectable &) {
+          wgc::Direct3D11CaptureFrame frame = sender.TryGetNextFrame();
+          if (!frame) {
+            return;
+          }
+          std::lock_guard<std::mutex> lock(mu_);
+          if (latest_) {
+            latest_.Close(); // hands its buffer back to the pool
+          }
+          latest_ = frame;
+          SetEvent(ev_);
+        });
+    session_ = frame_pool_.CreateCaptureSession(item);
+    session_.StartCapture();
+    return true;
   }
 
-  wgc::GraphicsCaptureItem item{nullptr};
-  if (ctx.method == "wgc-window") {
-    if (!ctx.window.has_value()) {
-      *err = ErrorInfo{"wgc-window needs window target", "CaptureWithWgc",
-                       std::nullopt, std::nullopt};
+  bool Grab(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) override {
+    if (!session_) {
+      *err = ErrorInfo{"session is not open", "WgcSession", std::nullopt,
+                       std::nullopt};
       return false;
     }
-    if (!CreateCaptureItemFromHwnd(ctx.window->hwnd, &item, err)) {
+    // Only the first frame is waited for; after that an unchanged target
+    // produces no frames and the staging texture still holds it.
+    if (!has_frame_ &&
+        WaitForSingleObject(ev_, static_cast<DWORD>(timeout_ms_)) !=
+            WAIT_OBJECT_0) {
+      *err = ErrorInfo{"WGC frame timeout", "WgcSession", std::nullopt,
+                       std::nullopt};
       return false;
     }
-  } else if (ctx.method == "wgc-monitor") {
-    if (!ctx.monitor.has_value()) {
-      *err = ErrorInfo{"wgc-monitor needs monitor target", "CaptureWithWgc",
-                       std::nullopt, std::nullopt};
+    wgc::Direct3D11CaptureFrame frame{nullptr};
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      std::swap(frame, latest_);
+    }
+    if (frame && !CopyToStaging(frame, err)) {
       return false;
     }
-    if (!CreateCaptureItemFromMonitor(ctx.monitor->hmon, &item, err)) {
+    if (!has_frame_) {
+      *err = ErrorInfo{"WGC frame timeout", "WgcSession", std::nullopt,
+                       std::nullopt};
       return false;
     }
-  } else {
-    *err = ErrorInfo{"unknown wgc method", "CaptureWithWgc", std::nullopt,
-                     std::nullopt};
-    return false;
+    return DeliverStaging(sink, out, err);
   }
 
-  auto size = item.Size();
-  auto frame_pool = wgc::Direct3D11CaptureFramePool::CreateFreeThreaded(
-      winrt_device, wgd::DirectXPixelFormat::B8G8R8A8UIntNormalized, 1, size);
-  auto session = frame_pool.CreateCaptureSession(item);
-
-  HANDLE ev = CreateEventW(nullptr, TRUE, FALSE, nullptr);
-  if (!ev) {
-    *err = ErrorInfo{"CreateEvent failed", "CaptureWithWgc", std::nullopt,
-                     static_cast<uint32_t>(GetLastError())};
-    return false;
+  void Close() override {
+    if (frame_pool_) {
+      frame_pool_.FrameArrived(frame_arrived_);
+    }
+    if (session_) {
+      session_.Close();
+    }
+    if (frame_pool_) {
+      frame_pool_.Close();
+    }
+    session_ = nullptr;
+    frame_pool_ = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (latest_) {
+        latest_.Close();
+      }
+      latest_ = nullptr;
+    }
+    if (ev_) {
+      CloseHandle(ev_);
+    }
+    ev_ = nullptr;
+    device_winrt_ = nullptr;
+    staging_.Reset();
+    context_.Reset();
+    device_.Reset();
+    has_frame_ = false;
   }
 
-  wgc::Direct3D11CaptureFrame captured{nullptr};
-  auto revoker =
-      frame_pool.FrameArrived(winrt::auto_revoke, [&](auto &sender, auto &) {
-        captured = sender.TryGetNextFrame();
-        SetEvent(ev);
-      });
-
-  session.StartCapture();
-  DWORD wr = WaitForSingleObject(ev, static_cast<DWORD>(ctx.common.timeout_ms));
-  session.Close();
-  frame_pool.Close();
-  CloseHandle(ev);
-
-  if (wr != WAIT_OBJECT_0 || !captured) {
-    *err = ErrorInfo{"WGC frame timeout", "CaptureWithWgc", std::nullopt,
-                     std::nullopt};
-    return false;
+private:
+  bool CopyToStaging(const wgc::Direct3D11CaptureFrame &frame,
+                     ErrorInfo *err) {
+    // A resized target keeps delivering frames at the pool's old size
+    // until the pool is recreated at the new one.
+    const auto content = frame.ContentSize();
+    if (content.Width != pool_size_.Width ||
+        content.Height != pool_size_.Height) {
+      pool_size_ = content;
+      frame_pool_.Recreate(device_winrt_, pixel_format_, 2, pool_size_);
+    }
+
+    auto access = frame.Surface()
+                      .as<::Windows::Graphics::DirectX::Direct3D11::
+                              IDirect3DDxgiInterfaceAccess>();
+    ComPtr<ID3D11Texture2D> tex;
+    HRESULT hr = access->GetInterface(IID_PPV_ARGS(&tex));
+    if (FAILED(hr)) {
+      frame.Close();
+      *err = ErrorInfo{"GetInterface(ID3D11Texture2D) failed", "WgcSession",
+                       static_cast<uint32_t>(hr), std::nullopt};
+      return false;
+    }
+
+    D3D11_TEXTURE2D_DESC desc{};
+    tex->GetDesc(&desc);
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.MiscFlags = 0;
+    desc.Usage = D3D11_USAGE_STAGING;
+    if (!staging_ || desc.Width != staging_desc_.Width ||
+        desc.Height != staging_desc_.Height ||
+        desc.Format != staging_desc_.Format) {
+      staging_.Reset();
+      hr = device_->CreateTexture2D(&desc, nullptr, &staging_);
+      if (FAILED(hr)) {
+        frame.Close();
+        *err = ErrorInfo{"CreateTexture2D staging failed", "WgcSession",
+                         static_cast<uint32_t>(hr), std::nullopt};
+        return false;
+      }
+      staging_desc_ = desc;
+    }
+
+    context_->CopyResource(staging_.Get(), tex.Get());
+    frame.Close();
+    has_frame_ = true;
+    return true;
   }
 
-  Rect origin = ctx.capture_rect_screen;
-  if (ctx.method == "wgc-window" && ctx.window.has_value()) {
-    origin = ctx.window->rect;
+  // FP16 frames (requested with `hdr`) go through the tone-mapping path.
+  bool DeliverStaging(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) {
+    D3D11_MAPPED_SUBRESOURCE map{};
+    const HRESULT hr =
+        context_->Map(staging_.Get(), 0, D3D11_MAP_READ, 0, &map);
+    if (FAILED(hr)) {
+      *err = ErrorInfo{"Map staging failed", "WgcSession",
+                       static_cast<uint32_t>(hr), std::nullopt};
+      return false;
+    }
+
+    const int w = static_cast<int>(staging_desc_.Width);
+    const int h = static_cast<int>(staging_desc_.Height);
+    bool delivered = false;
+    if (hdr_.has_value() &&
+        staging_desc_.Format == DXGI_FORMAT_R16G16B16A16_FLOAT) {
+      delivered = DeliverHdrFrame(MappedHalfView(map.pData, map.RowPitch, w, h,
+                                                 origin_.left, origin_.top),
+                                  hdr_.value(), sink, out, err);
+    } else {
+      delivered = DeliverFrame(MappedView(map.pData, map.RowPitch, w, h,
+                                          origin_.left, origin_.top),
+                               AlphaPolicy::kKeep, sink, out, err);
+    }
+
+    context_->Unmap(staging_.Get(), 0);
+    return delivered;
   }
-  return CopyFrameToImage(captured, d3d_device.Get(), d3d_context.Get(), origin,
-                          out, err);
+
+  Rect origin_;
+  int timeout_ms_ = 0;
+  std::optional<ToneMapOptions> hdr_;
+  ComPtr<ID3D11Device> device_;
+  ComPtr<ID3D11DeviceContext> context_;
+  wgd11::IDirect3DDevice device_winrt_{nullptr};
+  wgd::DirectXPixelFormat pixel_format_ =
+      wgd::DirectXPixelFormat::B8G8R8A8UIntNormalized;
+  winrt::Windows::Graphics::SizeInt32 pool_size_{};
+  wgc::Direct3D11CaptureFramePool frame_pool_{nullptr};
+  wgc::GraphicsCaptureSession session_{nullptr};
+  winrt::event_token frame_arrived_{};
+  HANDLE ev_ = nullptr; // auto-reset, set by each arriving frame
+  std::mutex mu_;       // guards latest_ against the pool's thread
+  wgc::Direct3D11CaptureFrame latest_{nullptr};
+  ComPtr<ID3D11Texture2D> staging_;
+  D3D11_TEXTURE2D_DESC staging_desc_{};
+  bool has_frame_ = false; // staging_ holds a frame
+};
+
+std::unique_ptr<CaptureSession> CreateWgc() {
+  return std::make_unique<WgcSession>();
 }
 
+// wgc-monitor also takes a window target and captures the monitor it is on.
+CaptureCaps WgcCaps(bool monitor) {
+  CaptureCaps caps;
+  caps.window = true;
+  caps.monitor = monitor;
+  caps.alpha = true;
+  caps.hdr = true;
+  return caps;
+}
+
+const bool kRegistered =
+    RegisterCaptureMethod({"wgc-window", WgcCaps(false), CreateWgc}) &&
+    RegisterCaptureMethod({"wgc-monitor", WgcCaps(true), CreateWgc});
+
+} // namespace
+
 } // namespace sc
@@ -0,0 +1,99 @@
+#include "checksum.h"
+
+namespace sc {
+
+namespace {
+
+constexpr uint32_t kCrcPolynomial = 0xEDB88320u;
+constexpr uint32_t kAdlerMod = 65521u;
+// Largest n such that 255n(n+1)/2 + (n+1)(kAdlerMod-1) fits in 32 bits.
+constexpr size_t kAdlerNmax = 5552;
+
+struct Crc32Tables {
+  uint32_t t[8][256];
+
+  Crc32Tables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (kCrcPolynomial ^ (c >> 1)) : (c >> 1);
+      }
+      t[0][i] = c;
+    }
+    for (int k = 1; k < 8; ++k) {
+      for (uint32_t i = 0; i < 256; ++i) {
+        const uint32_t prev = t[k - 1][i];
+        t[k][i] = (prev >> 8) ^ t[0][prev & 0xFF];
+      }
+    }
+  }
+};
+
+const Crc32Tables &CrcTables() {
+  static const Crc32Tables tables;
+  return tables;
+}
+
+inline uint32_t LoadLe32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+  const auto &t = CrcTables().t;
+  crc = ~crc;
+  // Slicing-by-8: consume 8 bytes per step with independent table lookups.
+  while (size >= 8) {
+    const uint32_t lo = LoadLe32(data) ^ crc;
+    const uint32_t hi = LoadLe32(data + 4);
+    crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+          t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    data += 8;
+    size -= 8;
+  }
+  while (size--) {
+    crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint32_t Adler32(uint32_t adler, const uint8_t *data, size_t size) {
+  uint32_t a = adler & 0xFFFF;
+  uint32_t b = adler >> 16;
+  while (size > 0) {
+    size_t chunk = size < kAdlerNmax ? size : kAdlerNmax;
+    size -= chunk;
+    while (chunk >= 16) {
+      for (int i = 0; i < 16; ++i) {
+        a += data[i];
+        b += a;
+      }
+      data += 16;
+      chunk -= 16;
+    }
+    while (chunk--) {
+      a += *data++;
+      b += a;
+    }
+    a %= kAdlerMod;
+    b %= kAdlerMod;
+  }
+  return (b << 16) | a;
+}
+
+uint32_t Adler32Combine(uint32_t adler_a, uint32_t adler_b, uint64_t size_b) {
+  const uint64_t rem = size_b % kAdlerMod;
+  uint64_t sum1 = adler_a & 0xFFFF;
+  uint64_t sum2 = (rem * sum1) % kAdlerMod;
+  sum1 += (adler_b & 0xFFFF) + kAdlerMod - 1;
+  sum2 += (adler_a >> 16) + (adler_b >> 16) + kAdlerMod - rem;
+  sum1 %= kAdlerMod;
+  sum2 %= kAdlerMod;
+  return static_cast<uint32_t>((sum2 << 16) | sum1);
+}
+
+} // namespace sc
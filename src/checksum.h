@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sc {
+
+// zlib-compatible running checksums. Start with Crc32(0, ...) and
+// Adler32(1, ...), then feed the previous result back in to continue.
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size);
+uint32_t Adler32(uint32_t adler, const uint8_t *data, size_t size);
+// Adler-32 of A followed by B, given the checksums of each and B's length.
+uint32_t Adler32Combine(uint32_t adler_a, uint32_t adler_b, uint64_t size_b);
+
+} // namespace sc
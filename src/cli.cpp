@@ -1,5 +1,8 @@
 #include "cli.h"
 
+#include "capture_source.h"
+#include "encode_raw.h"
+
 #include <algorithm>
 #include <cctype>
 #include <cstdlib>
@@ -26,6 +29,22 @@ bool ParseInt(const std::string &s, int *out) {
   return true;
 }
 
+bool ParseDouble(const std::string &s, double *out) {
+  char *end = nullptr;
+  double v = strtod(s.c_str(), &end);
+  if (!end || end == s.c_str() || *end != '\0')
+    return false;
+  *out = v;
+  return true;
+}
+
+// "<w>x<h>", both positive.
+bool ParseSize(const std::string &s, int *w, int *h) {
+  const size_t x = s.find_first_of("xX");
+  return x != std::string::npos && ParseInt(s.substr(0, x), w) &&
+         ParseInt(s.substr(x + 1), h) && *w > 0 && *h > 0;
+}
+
 bool ParseU64(const std::string &s, uint64_t *out) {
   char *end = nullptr;
   unsigned long long v = strtoull(s.c_str(), &end, 10);
@@ -158,6 +177,8 @@ ParseResult ParseArgs(int argc, char **argv) {
   std::string cmd = argv[i++];
   if (cmd == "cap") {
     out.command = CommandType::kCap;
+  } else if (cmd == "record") {
+    out.command = CommandType::kRecord;
   } else if (cmd == "list") {
     if (i >= argc) {
       r.error = "list needs subcommand: windows|monitors";
@@ -172,6 +193,8 @@ ParseResult ParseArgs(int argc, char **argv) {
       r.error = "unknown list subcommand: " + sub;
       return r;
     }
+  } else if (cmd == "diff") {
+    out.command = CommandType::kDiff;
   } else if (cmd == "-h" || cmd == "--help" || cmd == "help") {
     r.show_help = true;
     r.ok = true;
@@ -181,6 +204,16 @@ ParseResult ParseArgs(int argc, char **argv) {
     return r;
   }
 
+  const bool capture = IsCaptureCommand(out.command);
+  // --fps and --duration, checked once every option is in.
+  bool has_duration = false;
+  // --hdr and --sdr-white may come in either order; combined below.
+  std::optional<ToneMapOperator> hdr_op;
+  std::optional<double> sdr_white;
+  // The first --synthetic-* / --replay-* option seen; they need a
+  // synthetic-* or the replay method.
+  std::string synthetic_flag;
+  std::string replay_flag;
   while (i < argc) {
     std::string a = argv[i];
 
@@ -214,11 +247,11 @@ ParseResult ParseArgs(int argc, char **argv) {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.common.dpi_mode = ParseDpiMode(argv[++i]);
-    } else if (out.command == CommandType::kCap && a == "--method") {
+    } else if (capture && a == "--method") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.method = argv[++i];
-    } else if (out.command == CommandType::kCap && a == "--target") {
+    } else if (capture && a == "--target") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       std::string v = argv[++i];
@@ -230,14 +263,19 @@ ParseResult ParseArgs(int argc, char **argv) {
         r.error = "invalid --target";
         return r;
       }
-    } else if (out.command == CommandType::kCap && a == "--out") {
+    } else if (capture && a == "--out") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.out_path = argv[++i];
-    } else if (out.command == CommandType::kCap && a == "--stdout") {
-      r.error = "--stdout is not supported in this version";
-      return r;
-    } else if (out.command == CommandType::kCap && a == "--hwnd") {
+      out.cap.to_stdout = out.cap.out_path == "-";
+    } else if (capture && a == "--stdout") {
+      out.cap.out_path = "-";
+      out.cap.to_stdout = true;
+    } else if (capture && a == "--json-out") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      out.cap.json_out = argv[++i];
+    } else if (capture && a == "--hwnd") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       uint64_t v = 0;
@@ -246,7 +284,7 @@ ParseResult ParseArgs(int argc, char **argv) {
         return r;
       }
       out.cap.window_query.hwnd = v;
-    } else if (out.command == CommandType::kCap && a == "--pid") {
+    } else if (capture && a == "--pid") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       int v = 0;
@@ -255,27 +293,27 @@ ParseResult ParseArgs(int argc, char **argv) {
         return r;
       }
       out.cap.window_query.pid = v;
-    } else if (out.command == CommandType::kCap && a == "--foreground") {
+    } else if (capture && a == "--foreground") {
       out.cap.window_query.foreground = true;
-    } else if (out.command == CommandType::kCap && a == "--title") {
+    } else if (capture && a == "--title") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.window_query.title = argv[++i];
-    } else if (out.command == CommandType::kCap && a == "--class") {
+    } else if (capture && a == "--class") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.window_query.class_name = argv[++i];
-    } else if (out.command == CommandType::kCap && a == "--monitor") {
+    } else if (capture && a == "--monitor") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.screen_query.monitor = argv[++i];
-    } else if (out.command == CommandType::kCap && a == "--virtual-screen") {
+    } else if (capture && a == "--virtual-screen") {
       out.cap.screen_query.virtual_screen = true;
-    } else if (out.command == CommandType::kCap && a == "--crop") {
+    } else if (capture && a == "--crop") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.crop_mode = ParseCropMode(argv[++i]);
-    } else if (out.command == CommandType::kCap && a == "--crop-rect") {
+    } else if (capture && a == "--crop-rect") {
       if (i + 4 >= argc) {
         r.error = "--crop-rect needs 4 values";
         return r;
@@ -287,7 +325,7 @@ ParseResult ParseArgs(int argc, char **argv) {
         return r;
       }
       out.cap.crop_rect = c;
-    } else if (out.command == CommandType::kCap && a == "--pad") {
+    } else if (capture && a == "--pad") {
       if (i + 4 >= argc) {
         r.error = "--pad needs 4 values";
         return r;
@@ -299,11 +337,190 @@ ParseResult ParseArgs(int argc, char **argv) {
         r.error = "invalid --pad";
         return r;
       }
-    } else if (out.command == CommandType::kCap && a == "--format") {
+    } else if (capture && a == "--scale") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseDouble(argv[++i], &out.cap.scale) || !(out.cap.scale > 0.0) ||
+          out.cap.scale > 1.0) {
+        r.error = "invalid --scale (0 < scale <= 1)";
+        return r;
+      }
+    } else if (capture && a == "--max-size") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseSize(argv[++i], &out.cap.max_width, &out.cap.max_height)) {
+        r.error = "invalid --max-size (ex: 640x360)";
+        return r;
+      }
+    } else if (capture && a == "--scale-filter") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseScaleFilter(argv[++i], &out.cap.scale_filter)) {
+        r.error = "invalid --scale-filter (box|bilinear|lanczos3)";
+        return r;
+      }
+    } else if (capture && a == "--pixel-format") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      PixelFormat f = PixelFormat::kBgra8;
+      if (!ParsePixelFormat(argv[++i], &f)) {
+        r.error = "invalid --pixel-format "
+                  "(bgra8|rgba8|rgb8|gray8|rgba16|nv12|i420)";
+        return r;
+      }
+      out.cap.pixel_format = f;
+    } else if (capture && a == "--yuv-matrix") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseYuvMatrix(argv[++i], &out.cap.yuv.matrix)) {
+        r.error = "invalid --yuv-matrix (bt601|bt709)";
+        return r;
+      }
+    } else if (capture && a == "--yuv-range") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseYuvRange(argv[++i], &out.cap.yuv.range)) {
+        r.error = "invalid --yuv-range (limited|full)";
+        return r;
+      }
+    } else if (capture && a == "--hdr") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      ToneMapOperator op = ToneMapOperator::kAcesFit;
+      if (!ParseToneMapOperator(argv[++i], &op)) {
+        r.error = "invalid --hdr (clip|reinhard|aces)";
+        return r;
+      }
+      hdr_op = op;
+    } else if (capture && a == "--sdr-white") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      double nits = 0.0;
+      if (!ParseDouble(argv[++i], &nits) || nits < 1.0 || nits > 10000.0) {
+        r.error = "invalid --sdr-white (1-10000 nits)";
+        return r;
+      }
+      sdr_white = nits;
+    } else if (capture && a == "--synthetic-size") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseSize(argv[++i], &out.cap.synthetic.width,
+                     &out.cap.synthetic.height)) {
+        r.error = "invalid --synthetic-size (<w>x<h>)";
+        return r;
+      }
+      synthetic_flag = a;
+    } else if (capture &&
+               a == "--synthetic-latency") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseInt(argv[++i], &out.cap.synthetic.latency_ms) ||
+          out.cap.synthetic.latency_ms < 0) {
+        r.error = "invalid --synthetic-latency (ms >= 0)";
+        return r;
+      }
+      synthetic_flag = a;
+    } else if (capture && a == "--synthetic-setup") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseInt(argv[++i], &out.cap.synthetic.setup_ms) ||
+          out.cap.synthetic.setup_ms < 0) {
+        r.error = "invalid --synthetic-setup (ms >= 0)";
+        return r;
+      }
+      synthetic_flag = a;
+    } else if (capture && a == "--synthetic-seed") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      uint64_t seed = 0;
+      if (!ParseU64(argv[++i], &seed) || seed > UINT32_MAX) {
+        r.error = "invalid --synthetic-seed";
+        return r;
+      }
+      out.cap.synthetic.seed = static_cast<uint32_t>(seed);
+      synthetic_flag = a;
+    } else if (capture && a == "--replay") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      out.cap.replay.path = argv[++i];
+      replay_flag = a;
+    } else if (capture && a == "--replay-pacing") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseReplayPacing(argv[++i], &out.cap.replay.pacing)) {
+        r.error = "invalid --replay-pacing (fast|original)";
+        return r;
+      }
+      replay_flag = a;
+    } else if (capture && a == "--replay-fps") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseDouble(argv[++i], &out.cap.replay.fps) ||
+          !(out.cap.replay.fps > 0.0) || out.cap.replay.fps > 1000.0) {
+        r.error = "invalid --replay-fps (0 < fps <= 1000)";
+        return r;
+      }
+      replay_flag = a;
+    } else if (capture && a == "--replay-start") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseInt(argv[++i], &out.cap.replay.start) ||
+          out.cap.replay.start < 0) {
+        r.error = "invalid --replay-start (frame index >= 0)";
+        return r;
+      }
+      replay_flag = a;
+    } else if (capture && a == "--replay-loop") {
+      out.cap.replay.loop = true;
+      replay_flag = a;
+    } else if (capture && a == "--format") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.format = argv[++i];
-    } else if (out.command == CommandType::kCap && a == "--force-alpha") {
+    } else if (capture && a == "--png-encoder") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      out.cap.png_encoder = argv[++i];
+      if (out.cap.png_encoder != "builtin" && out.cap.png_encoder != "wic") {
+        r.error = "invalid --png-encoder (builtin|wic)";
+        return r;
+      }
+    } else if (capture && a == "--png-level") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParsePngLevel(argv[++i], &out.cap.png_level)) {
+        r.error = "invalid --png-level (store|fast|default|max)";
+        return r;
+      }
+    } else if (capture && a == "--png-threads") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseInt(argv[++i], &out.cap.png_threads) ||
+          out.cap.png_threads < 0 || out.cap.png_threads > 256) {
+        r.error = "invalid --png-threads (0-256)";
+        return r;
+      }
+    } else if (capture && a == "--stats") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      const std::string v = argv[++i];
+      if (v == "basic")
+        out.cap.stats_mode = StatsMode::kBasic;
+      else if (v == "full")
+        out.cap.stats_mode = StatsMode::kFull;
+      else {
+        r.error = "invalid --stats (basic|full)";
+        return r;
+      }
+    } else if (capture && a == "--threads") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseInt(argv[++i], &out.cap.threads) || out.cap.threads < 0 ||
+          out.cap.threads > 256) {
+        r.error = "invalid --threads (0-256)";
+        return r;
+      }
+    } else if (capture && a == "--force-alpha") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       int v = 0;
@@ -312,7 +529,79 @@ ParseResult ParseArgs(int argc, char **argv) {
         return r;
       }
       out.cap.force_alpha_255 = true;
-    } else if (out.command == CommandType::kCap && a == "--hotkey") {
+    } else if (capture && a == "--huge-pages") {
+      out.cap.huge_pages = true;
+    } else if (capture && a == "--simd") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      SimdLevel level = SimdLevel::kScalar;
+      if (!ParseSimdLevel(argv[++i], &level)) {
+        r.error = "invalid --simd (scalar|sse2|avx2|avx512)";
+        return r;
+      }
+      out.cap.simd_cap = level;
+    } else if (out.command == CommandType::kDiff && a == "--tile") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseInt(argv[++i], &out.diff.options.tile_size) ||
+          out.diff.options.tile_size < 4 ||
+          out.diff.options.tile_size > 1024) {
+        r.error = "invalid --tile (4-1024)";
+        return r;
+      }
+    } else if (out.command == CommandType::kDiff && a == "--ignore-origin") {
+      out.diff.options.ignore_origin = true;
+    } else if (out.command == CommandType::kDiff && a.rfind("--", 0) != 0) {
+      if (out.diff.a_path.empty()) {
+        out.diff.a_path = a;
+      } else if (out.diff.b_path.empty()) {
+        out.diff.b_path = a;
+      } else {
+        r.error = "diff takes two frames";
+        return r;
+      }
+    } else if (out.command == CommandType::kRecord && a == "--fps") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseDouble(argv[++i], &out.record.fps) ||
+          !(out.record.fps > 0.0) || out.record.fps > 1000.0) {
+        r.error = "invalid --fps (0 < fps <= 1000)";
+        return r;
+      }
+    } else if (out.command == CommandType::kRecord && a == "--duration") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseDouble(argv[++i], &out.record.duration_s) ||
+          !(out.record.duration_s > 0.0)) {
+        r.error = "invalid --duration (seconds > 0)";
+        return r;
+      }
+      has_duration = true;
+    } else if (out.command == CommandType::kRecord && a == "--queue-depth") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      int &depth = out.record.pipeline.queue_depth;
+      if (!ParseInt(argv[++i], &depth) || depth < 0 || depth > 64) {
+        r.error = "invalid --queue-depth (0-64)";
+        return r;
+      }
+    } else if (out.command == CommandType::kRecord && a == "--drop-policy") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      if (!ParseDropPolicy(argv[++i], &out.record.pipeline.drop)) {
+        r.error = "invalid --drop-policy (block|drop-oldest|skip-encode)";
+        return r;
+      }
+    } else if (out.command == CommandType::kRecord &&
+               a == "--encode-workers") {
+      if (!NeedValue(i, argc, a, &r.error))
+        return r;
+      int &workers = out.record.pipeline.encode_workers;
+      if (!ParseInt(argv[++i], &workers) || workers < 1 || workers > 64) {
+        r.error = "invalid --encode-workers (1-64)";
+        return r;
+      }
+    } else if (capture && a == "--hotkey") {
       if (!NeedValue(i, argc, a, &r.error))
         return r;
       out.cap.hotkey_spec = argv[++i];
@@ -322,7 +611,7 @@ ParseResult ParseArgs(int argc, char **argv) {
         return r;
       }
       out.cap.hotkey_enabled = true;
-    } else if (out.command == CommandType::kCap &&
+    } else if (capture &&
                a == "--hotkey-foreground") {
       out.cap.hotkey_foreground = true;
       out.cap.window_query.foreground = true;
@@ -333,20 +622,81 @@ ParseResult ParseArgs(int argc, char **argv) {
     ++i;
   }
 
-  if (out.command == CommandType::kCap) {
+  if (capture) {
+    const std::string cmd_name = CommandName(out.command);
     if (out.cap.method.empty()) {
-      r.error = "cap needs --method";
+      r.error = cmd_name + " needs --method";
+      return r;
+    }
+    const CaptureMethodInfo *method = FindCaptureMethod(out.cap.method);
+    if (!method) {
+      r.error = "unknown method: " + out.cap.method;
+      return r;
+    }
+    if (!synthetic_flag.empty() && out.cap.method.rfind("synthetic-", 0) != 0) {
+      r.error = synthetic_flag + " needs a synthetic-* method";
+      return r;
+    }
+    if (!replay_flag.empty() && out.cap.method != "replay") {
+      r.error = replay_flag + " needs --method replay";
+      return r;
+    }
+    if (out.cap.method == "replay" && out.cap.replay.path.empty()) {
+      r.error = "--method replay needs --replay <path>";
       return r;
     }
     if (out.cap.out_path.empty()) {
-      r.error = "cap needs --out";
+      r.error = cmd_name + " needs --out or --stdout";
       return r;
     }
-    if (out.cap.format != "png") {
-      r.error = "only --format png is supported";
+    if (out.cap.to_stdout && out.cap.png_encoder == "wic" &&
+        out.cap.format == "png") {
+      r.error = "--png-encoder wic cannot write to stdout";
       return r;
     }
-    if (out.cap.target == TargetType::kWindow) {
+    if (out.cap.format != "png" && out.cap.format != "qoi" &&
+        out.cap.format != "raw" && out.cap.format != "pam" &&
+        out.cap.format != "ppm") {
+      r.error = "invalid --format (png|qoi|raw|pam|ppm)";
+      return r;
+    }
+    if (out.cap.pixel_format.has_value()) {
+      const PixelFormat pf = out.cap.pixel_format.value();
+      const std::string &f = out.cap.format;
+      bool ok = f == "raw";
+      if (f == "png") {
+        ok = out.cap.png_encoder == "wic"
+                 ? pf == PixelFormat::kRgba8
+                 : pf == PixelFormat::kRgba8 || pf == PixelFormat::kRgb8 ||
+                       pf == PixelFormat::kGray8 || pf == PixelFormat::kRgba16;
+      } else if (f == "qoi") {
+        ok = pf == PixelFormat::kRgba8 || pf == PixelFormat::kRgb8;
+      } else if (f == "pam" || f == "ppm") {
+        ok = pf == RawLayoutOf(f, pf);
+      }
+      if (!ok) {
+        r.error = std::string("--format ") + f + " cannot store " +
+                  PixelFormatName(pf);
+        return r;
+      }
+    }
+    if (sdr_white.has_value() && !hdr_op.has_value()) {
+      r.error = "--sdr-white needs --hdr";
+      return r;
+    }
+    if (hdr_op.has_value()) {
+      if (!method->caps.hdr) {
+        r.error = "--hdr is not supported by " + out.cap.method;
+        return r;
+      }
+      ToneMapOptions tone;
+      tone.op = hdr_op.value();
+      tone.sdr_white_nits = static_cast<float>(sdr_white.value_or(80.0));
+      out.cap.hdr = tone;
+    }
+    // synthetic-* and replay frames have no window or screen to look up.
+    const bool needs_target = method->caps.window || method->caps.monitor;
+    if (needs_target && out.cap.target == TargetType::kWindow) {
       const bool has_window_target =
           out.cap.window_query.hwnd.has_value() ||
           out.cap.window_query.pid.has_value() ||
@@ -358,7 +708,7 @@ ParseResult ParseArgs(int argc, char **argv) {
                   "--hwnd/--pid/--foreground/--title/--class";
         return r;
       }
-    } else {
+    } else if (needs_target) {
       if (!out.cap.screen_query.monitor.has_value() &&
           !out.cap.screen_query.virtual_screen) {
         r.error = "screen target needs --monitor or --virtual-screen";
@@ -380,11 +730,48 @@ ParseResult ParseArgs(int argc, char **argv) {
     }
   }
 
+  if (out.command == CommandType::kRecord) {
+    if (!has_duration) {
+      r.error = "record needs --duration <seconds>";
+      return r;
+    }
+    if (out.cap.to_stdout) {
+      r.error = "record cannot write to stdout";
+      return r;
+    }
+    if (!IsFrameNamePattern(out.cap.out_path)) {
+      r.error = "record --out needs {n} or {n:W} in the file name";
+      return r;
+    }
+  }
+
+  if (out.command == CommandType::kDiff && out.diff.b_path.empty()) {
+    r.error = "diff needs two raw frames: diff a.raw b.raw";
+    return r;
+  }
+
   r.ok = true;
   r.args = std::move(out);
   return r;
 }
 
+const char *CommandName(CommandType c) {
+  switch (c) {
+  case CommandType::kHelp:
+    return "help";
+  case CommandType::kCap:
+    return "cap";
+  case CommandType::kRecord:
+    return "record";
+  case CommandType::kListWindows:
+  case CommandType::kListMonitors:
+    return "list";
+  case CommandType::kDiff:
+    return "diff";
+  }
+  return "unknown";
+}
+
 const char *DpiModeName(DpiMode mode) {
   switch (mode) {
   case DpiMode::kAuto:
@@ -417,19 +804,55 @@ const char *CropModeName(CropMode m) {
   return "none";
 }
 
+PixelFormat CapPixelFormat(const CapOptions &cap) {
+  if (cap.pixel_format.has_value()) {
+    return cap.pixel_format.value();
+  }
+  return cap.format == "raw" ? PixelFormat::kBgra8
+                             : RawLayoutOf(cap.format, PixelFormat::kRgba8);
+}
+
+bool IsCaptureCommand(CommandType c) {
+  return c == CommandType::kCap || c == CommandType::kRecord;
+}
+
 std::string BuildHelpText() {
   std::ostringstream oss;
   oss << "screencap - Windows screenshot comparison CLI\n\n"
       << "Commands:\n"
       << "  cap\n"
+      << "  record --fps <n> --duration <seconds> [--queue-depth <n>] "
+         "[--drop-policy block|drop-oldest|skip-encode] "
+         "[--encode-workers <n>] (cap options; --out with {n})\n"
       << "  list windows\n"
-      << "  list monitors\n\n"
+      << "  list monitors\n"
+      << "  diff <a.raw> <b.raw> [--tile N] [--ignore-origin]\n\n"
+      << "Methods:\n";
+  for (const CaptureMethodInfo *m : CaptureMethods()) {
+    oss << "  " << m->name << '\n';
+  }
+  oss << '\n'
       << "Examples:\n"
       << "  screencap list windows --json\n"
       << "  screencap cap --method dxgi-monitor --target screen --monitor "
          "primary --out a.png\n"
       << "  screencap cap --method dxgi-window --target window --hotkey "
-         "ctrl+shift+s --hotkey-foreground --out a.png\n";
+         "ctrl+shift+s --hotkey-foreground --out a.png\n"
+      << "  screencap cap --method dxgi-monitor --target screen --monitor "
+         "primary --format qoi --stdout --json > a.qoi\n"
+      << "  screencap cap --method dxgi-monitor --target screen --monitor "
+         "primary --format raw --pixel-format nv12 --out a.nv12\n"
+      << "  screencap cap --method dxgi-monitor --target screen --monitor "
+         "primary --hdr aces --sdr-white 200 --pixel-format rgba16 "
+         "--out a.png\n"
+      << "  screencap cap --method replay --replay frames.y4m --replay-start "
+         "120 --format png --out a.png\n"
+      << "  screencap cap --method synthetic-desktop --synthetic-size "
+         "3840x2160 --format qoi --out a.qoi --json\n"
+      << "  screencap record --method dxgi-monitor --target screen --monitor "
+         "primary --fps 2 --duration 3600 --format qoi --out "
+         "shots/{n:6}.qoi --json\n"
+      << "  screencap diff before.raw after.raw --json\n";
   return oss.str();
 }
 
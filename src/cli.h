@@ -1,7 +1,16 @@
 #pragma once
 
 #include "common.h"
+#include "cpu_features.h"
+#include "encode_png.h"
+#include "frame_diff.h"
 #include "logging.h"
+#include "pixel_format.h"
+#include "record.h"
+#include "replay_source.h"
+#include "resample.h"
+#include "synthetic_source.h"
+#include "tone_map.h"
 
 #include <optional>
 #include <string>
@@ -9,10 +18,18 @@
 
 namespace sc {
 
-enum class CommandType { kHelp, kCap, kListWindows, kListMonitors };
+enum class CommandType {
+  kHelp,
+  kCap,
+  kRecord,
+  kListWindows,
+  kListMonitors,
+  kDiff
+};
 enum class DpiMode { kAuto, kPerMonitorV2, kSystem };
 enum class TargetType { kWindow, kScreen };
 enum class CropMode { kNone, kWindow, kClient, kDwmFrame, kManual };
+enum class StatsMode { kBasic, kFull };
 
 struct CommonOptions {
   std::string log_dir = "./logs";
@@ -41,7 +58,13 @@ struct CapOptions {
   std::string method;
   TargetType target = TargetType::kWindow;
   std::string out_path;
-  std::string format = "png";
+  bool to_stdout = false; // --stdout or --out -; out_path is then "-"
+  std::string json_out; // result JSON goes here instead of the console
+  std::string format = "png"; // png, qoi, raw, pam or ppm
+  std::string png_encoder = "builtin"; // builtin or wic
+  PngLevel png_level = PngLevel::kDefault;
+  int png_threads = 0; // 0 = one per core
+  int threads = 0; // copy/stats/swizzle passes; 0 = one per core
   bool hotkey_enabled = false;
   std::string hotkey_spec;
   UINT hotkey_modifiers = 0;
@@ -52,13 +75,39 @@ struct CapOptions {
   CropMode crop_mode = CropMode::kNone;
   std::optional<CropRect> crop_rect;
   Pad pad{};
+  // Resampling between crop and encode; 1.0 and 0 limits keep full size.
+  double scale = 1.0;
+  int max_width = 0;
+  int max_height = 0;
+  ScaleFilter scale_filter = ScaleFilter::kLanczos3;
+  // Layout the encoder stores; unset keeps the format's own (bgra8 for
+  // raw, rgb8 for ppm, rgba8 otherwise).
+  std::optional<PixelFormat> pixel_format;
+  YuvOptions yuv; // nv12 and i420
+  // dxgi-* and wgc-*: capture scRGB and tone-map it instead of letting the
+  // OS convert HDR to 8-bit.
+  std::optional<ToneMapOptions> hdr;
+  SyntheticOptions synthetic; // synthetic-* test content
+  ReplayOptions replay;       // the replay method's recording
   bool force_alpha_255 = false;
+  StatsMode stats_mode = StatsMode::kBasic;
+  bool huge_pages = false; // back frame buffers with huge pages if possible
+  std::optional<SimdLevel> simd_cap; // highest SIMD tier kernels may use
+};
+
+// diff: two raw frames (with their .json sidecars) to compare.
+struct DiffArgs {
+  std::string a_path;
+  std::string b_path;
+  DiffOptions options;
 };
 
 struct ParsedArgs {
   CommandType command = CommandType::kHelp;
   CommonOptions common;
-  CapOptions cap;
+  CapOptions cap; // cap and record
+  RecordOptions record;
+  DiffArgs diff;
   std::vector<std::string> raw_args;
 };
 
@@ -70,9 +119,13 @@ struct ParseResult {
 };
 
 ParseResult ParseArgs(int argc, char **argv);
+const char *CommandName(CommandType c);
 const char *DpiModeName(DpiMode mode);
 const char *TargetTypeName(TargetType t);
 const char *CropModeName(CropMode m);
+PixelFormat CapPixelFormat(const CapOptions &cap);
+// cap and record share every capture option.
+bool IsCaptureCommand(CommandType c);
 std::string BuildHelpText();
 
 } // namespace sc
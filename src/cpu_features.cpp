@@ -0,0 +1,129 @@
+#include "cpu_features.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#ifdef SC_X86
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace sc {
+
+namespace {
+
+#ifdef SC_X86
+
+void Cpuid(int leaf, int sub, uint32_t regs[4]) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, leaf, sub);
+  for (int i = 0; i < 4; ++i)
+    regs[i] = static_cast<uint32_t>(r[i]);
+#else
+  __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t Xgetbv0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t lo = 0;
+  uint32_t hi = 0;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+
+SimdLevel Detect() {
+  uint32_t r[4] = {};
+  Cpuid(0, 0, r);
+  const uint32_t max_leaf = r[0];
+  Cpuid(1, 0, r);
+  if (!(r[3] & (1u << 26))) {
+    return SimdLevel::kScalar;
+  }
+  // AVX state must also be enabled by the OS (OSXSAVE + XCR0).
+  const bool osxsave = (r[2] & (1u << 27)) != 0;
+  const bool avx = (r[2] & (1u << 28)) != 0;
+  // F16C ships with every AVX2 CPU; the tier requires it so the half-float
+  // kernels need no level of their own.
+  const bool f16c = (r[2] & (1u << 29)) != 0;
+  if (!osxsave || !avx || max_leaf < 7) {
+    return SimdLevel::kSse2;
+  }
+  const uint64_t xcr0 = Xgetbv0();
+  if ((xcr0 & 0x6) != 0x6) {
+    return SimdLevel::kSse2;
+  }
+  Cpuid(7, 0, r);
+  const bool avx2 = (r[1] & (1u << 5)) != 0;
+  if (!avx2 || !f16c) {
+    return SimdLevel::kSse2;
+  }
+  const bool avx512f = (r[1] & (1u << 16)) != 0;
+  const bool avx512bw = (r[1] & (1u << 30)) != 0;
+  if (avx512f && avx512bw && (xcr0 & 0xE6) == 0xE6) {
+    return SimdLevel::kAvx512;
+  }
+  return SimdLevel::kAvx2;
+}
+
+#else
+
+SimdLevel Detect() { return SimdLevel::kScalar; }
+
+#endif
+
+std::atomic<int> g_cap{static_cast<int>(SimdLevel::kAvx512)};
+
+} // namespace
+
+SimdLevel DetectSimdLevel() {
+  static const SimdLevel level = Detect();
+  return level;
+}
+
+SimdLevel ActiveSimdLevel() {
+  return static_cast<SimdLevel>(
+      std::min(static_cast<int>(DetectSimdLevel()),
+               g_cap.load(std::memory_order_relaxed)));
+}
+
+void SetSimdLevelCap(SimdLevel cap) {
+  g_cap.store(static_cast<int>(cap), std::memory_order_relaxed);
+}
+
+const char *SimdLevelName(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::kScalar:
+    return "scalar";
+  case SimdLevel::kSse2:
+    return "sse2";
+  case SimdLevel::kAvx2:
+    return "avx2";
+  case SimdLevel::kAvx512:
+    return "avx512";
+  }
+  return "scalar";
+}
+
+bool ParseSimdLevel(const char *s, SimdLevel *out) {
+  for (SimdLevel l : {SimdLevel::kScalar, SimdLevel::kSse2, SimdLevel::kAvx2,
+                      SimdLevel::kAvx512}) {
+    if (strcmp(s, SimdLevelName(l)) == 0) {
+      *out = l;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace sc
@@ -0,0 +1,35 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#define SC_X86 1
+#endif
+
+// Marks a function as compiled for an instruction set beyond the build
+// baseline; callers must check ActiveSimdLevel() first. MSVC needs no
+// attribute to emit the intrinsics.
+#if defined(SC_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SC_TARGET(isa)
+#endif
+
+namespace sc {
+
+// Vector instruction set tiers used by runtime-dispatched kernels, lowest
+// first. kAvx2 includes F16C; kAvx512 means AVX-512 F and BW.
+enum class SimdLevel { kScalar, kSse2, kAvx2, kAvx512 };
+
+// The best level this CPU and OS support, detected once.
+SimdLevel DetectSimdLevel();
+
+// Kernels pick their implementation from this: the detected level, lowered
+// to the cap if one is set. Capping makes it possible to compare or time
+// the lower tiers on the same machine.
+SimdLevel ActiveSimdLevel();
+void SetSimdLevelCap(SimdLevel cap);
+
+const char *SimdLevelName(SimdLevel level);
+bool ParseSimdLevel(const char *s, SimdLevel *out);
+
+} // namespace sc
@@ -1,7 +1,6 @@
 #include "crop.h"
 
 #include <algorithm>
-#include <cstring>
 
 namespace sc {
 
@@ -72,37 +71,14 @@ Rect ResolveCropRectScreen(CropMode mode, const std::optional<CropRect> &manual,
   return clipped;
 }
 
-bool CropImageInPlace(const Rect &crop_screen_rect, ImageBuffer *img,
-                      ErrorInfo *err) {
-  Rect img_rect{img->origin_x, img->origin_y, img->origin_x + img->width,
-                img->origin_y + img->height};
-  Rect c = Intersect(crop_screen_rect, img_rect);
-  if (!IsValidRect(c)) {
-    *err = ErrorInfo{"crop does not overlap image", "CropImageInPlace",
-                     std::nullopt, std::nullopt};
+bool CropView(const Rect &crop_screen_rect, ImageView *img, ErrorInfo *err) {
+  const ImageView cropped = SubView(*img, crop_screen_rect);
+  if (!cropped.Valid()) {
+    *err = ErrorInfo{"crop does not overlap image", "CropView", std::nullopt,
+                     std::nullopt};
     return false;
   }
-
-  const int x0 = c.left - img->origin_x;
-  const int y0 = c.top - img->origin_y;
-  const int nw = Width(c);
-  const int nh = Height(c);
-
-  std::vector<uint8_t> out(static_cast<size_t>(nw * nh * 4));
-  for (int y = 0; y < nh; ++y) {
-    const uint8_t *src =
-        img->bgra.data() +
-        static_cast<size_t>((y0 + y) * img->row_pitch + x0 * 4);
-    uint8_t *dst = out.data() + static_cast<size_t>(y * nw * 4);
-    memcpy(dst, src, static_cast<size_t>(nw * 4));
-  }
-
-  img->width = nw;
-  img->height = nh;
-  img->row_pitch = nw * 4;
-  img->origin_x = c.left;
-  img->origin_y = c.top;
-  img->bgra.swap(out);
+  *img = cropped;
   return true;
 }
 
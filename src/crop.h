@@ -10,7 +10,8 @@ Rect ResolveCropRectScreen(CropMode mode, const std::optional<CropRect> &manual,
                            const WindowInfo *window,
                            const Rect &capture_screen_rect, const Pad &pad,
                            ErrorInfo *err);
-bool CropImageInPlace(const Rect &crop_screen_rect, ImageBuffer *img,
-                      ErrorInfo *err);
+// Narrows `img` to `crop_screen_rect` by offsetting its data pointer; no
+// pixels are copied or allocated.
+bool CropView(const Rect &crop_screen_rect, ImageView *img, ErrorInfo *err);
 
 } // namespace sc
@@ -0,0 +1,690 @@
+#include "deflate.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace sc {
+
+namespace {
+
+constexpr int kWindowSize = 32768;
+constexpr int kWindowMask = kWindowSize - 1;
+constexpr int kMinMatch = 4;
+constexpr int kMaxMatch = 258;
+constexpr int kHashBits = 15;
+constexpr size_t kMaxBlockSymbols = 1 << 15;
+constexpr size_t kMaxStoredBlock = 65535;
+
+constexpr int kNumLitLen = 286;
+constexpr int kNumDist = 30;
+constexpr int kNumCodeLen = 19;
+constexpr int kEndOfBlock = 256;
+
+constexpr uint16_t kLengthBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                      11, 13, 15, 17,  19,  23,  27,  31,
+                                      35, 43, 51, 59,  67,  83,  99,  115,
+                                      131, 163, 195, 227, 258};
+constexpr uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                      1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                      4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t kDistBase[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,
+                                    4, 4, 5, 5, 6, 6, 7, 7,  8,  8,
+                                    9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr uint8_t kCodeLenOrder[kNumCodeLen] = {16, 17, 18, 0, 8,  7, 9,
+                                                6,  10, 5,  11, 4, 12, 3,
+                                                13, 2,  14, 1,  15};
+
+struct CodeTables {
+  uint8_t length_code[kMaxMatch + 1];
+  // Distance code for (dist - 1) < 256, and for (dist - 1) >> 7 above that.
+  uint8_t dist_code_small[256];
+  uint8_t dist_code_large[256];
+  uint8_t fixed_lit_len[288];
+  uint8_t fixed_dist_len[kNumDist];
+
+  CodeTables() {
+    for (int c = 0; c < 29; ++c) {
+      for (int l = kLengthBase[c]; l < kLengthBase[c] + (1 << kLengthExtra[c]) &&
+                                   l <= kMaxMatch;
+           ++l) {
+        length_code[l] = static_cast<uint8_t>(c);
+      }
+    }
+    length_code[kMaxMatch] = 28;
+    for (int c = 0; c < kNumDist; ++c) {
+      for (int d = kDistBase[c]; d < kDistBase[c] + (1 << kDistExtra[c]);
+           ++d) {
+        if (d - 1 < 256) {
+          dist_code_small[d - 1] = static_cast<uint8_t>(c);
+        } else {
+          dist_code_large[(d - 1) >> 7] = static_cast<uint8_t>(c);
+        }
+      }
+    }
+    for (int i = 0; i < 288; ++i) {
+      fixed_lit_len[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    for (int i = 0; i < kNumDist; ++i) {
+      fixed_dist_len[i] = 5;
+    }
+  }
+
+  int DistCode(int dist) const {
+    return dist <= 256 ? dist_code_small[dist - 1]
+                       : dist_code_large[(dist - 1) >> 7];
+  }
+};
+
+const CodeTables &Tables() {
+  static const CodeTables tables;
+  return tables;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> *out) : out_(out) {}
+
+  void Put(uint32_t bits, int count) {
+    acc_ |= static_cast<uint64_t>(bits) << count_;
+    count_ += count;
+    if (count_ >= 32) {
+      const uint8_t b[4] = {static_cast<uint8_t>(acc_),
+                            static_cast<uint8_t>(acc_ >> 8),
+                            static_cast<uint8_t>(acc_ >> 16),
+                            static_cast<uint8_t>(acc_ >> 24)};
+      out_->insert(out_->end(), b, b + 4);
+      acc_ >>= 32;
+      count_ -= 32;
+    }
+  }
+
+  void AlignToByte() {
+    while (count_ > 0) {
+      out_->push_back(static_cast<uint8_t>(acc_));
+      acc_ >>= 8;
+      count_ -= 8;
+    }
+    acc_ = 0;
+    count_ = 0;
+  }
+
+  void PutBytes(const uint8_t *data, size_t size) {
+    out_->insert(out_->end(), data, data + size);
+  }
+
+private:
+  std::vector<uint8_t> *out_;
+  uint64_t acc_ = 0;
+  int count_ = 0;
+};
+
+// Code lengths for a Huffman code over `n` symbols, limited to `max_bits`.
+// Frequencies are flattened and the tree rebuilt until it fits.
+void BuildCodeLengths(const uint32_t *freq, int n, int max_bits,
+                      uint8_t *lengths) {
+  std::vector<uint32_t> f(freq, freq + n);
+  std::vector<std::pair<uint32_t, int>> leaves;
+  std::vector<uint64_t> weight;
+  std::vector<int> parent;
+  std::vector<int> depth;
+  for (;;) {
+    std::fill(lengths, lengths + n, static_cast<uint8_t>(0));
+    leaves.clear();
+    for (int i = 0; i < n; ++i) {
+      if (f[i] > 0) {
+        leaves.emplace_back(f[i], i);
+      }
+    }
+    if (leaves.empty()) {
+      return;
+    }
+    if (leaves.size() == 1) {
+      lengths[leaves[0].second] = 1;
+      return;
+    }
+    std::sort(leaves.begin(), leaves.end());
+
+    // Two-queue construction: leaves sorted by weight, internal nodes are
+    // produced in non-decreasing weight order.
+    const int m = static_cast<int>(leaves.size());
+    weight.assign(static_cast<size_t>(2 * m - 1), 0);
+    parent.assign(static_cast<size_t>(2 * m - 1), -1);
+    for (int i = 0; i < m; ++i) {
+      weight[i] = leaves[i].first;
+    }
+    int leaf = 0;
+    int inner = m;
+    for (int next = m; next < 2 * m - 1; ++next) {
+      auto pick = [&]() {
+        if (leaf < m && (inner >= next || weight[leaf] <= weight[inner])) {
+          return leaf++;
+        }
+        return inner++;
+      };
+      const int a = pick();
+      const int b = pick();
+      weight[next] = weight[a] + weight[b];
+      parent[a] = next;
+      parent[b] = next;
+    }
+
+    depth.assign(static_cast<size_t>(2 * m - 1), 0);
+    int max_depth = 0;
+    for (int i = 2 * m - 3; i >= 0; --i) {
+      depth[i] = depth[parent[i]] + 1;
+      max_depth = std::max(max_depth, depth[i]);
+    }
+    if (max_depth <= max_bits) {
+      for (int i = 0; i < m; ++i) {
+        lengths[leaves[i].second] = static_cast<uint8_t>(depth[i]);
+      }
+      return;
+    }
+    for (auto &v : f) {
+      if (v > 0) {
+        v = (v + 1) / 2;
+      }
+    }
+  }
+}
+
+// Canonical codes, bit-reversed so they can be written LSB first.
+void BuildCodes(const uint8_t *lengths, int n, uint16_t *codes) {
+  int count[16] = {};
+  for (int i = 0; i < n; ++i) {
+    ++count[lengths[i]];
+  }
+  count[0] = 0;
+  int next[16] = {};
+  int code = 0;
+  for (int bits = 1; bits < 16; ++bits) {
+    code = (code + count[bits - 1]) << 1;
+    next[bits] = code;
+  }
+  for (int i = 0; i < n; ++i) {
+    const int len = lengths[i];
+    if (len == 0) {
+      codes[i] = 0;
+      continue;
+    }
+    uint32_t c = static_cast<uint32_t>(next[len]++);
+    uint32_t r = 0;
+    for (int b = 0; b < len; ++b) {
+      r = (r << 1) | (c & 1);
+      c >>= 1;
+    }
+    codes[i] = static_cast<uint16_t>(r);
+  }
+}
+
+// At least two used symbols keep every decoder happy with the tree shape.
+void EnsureTwoSymbols(uint32_t *freq, int n) {
+  int used = 0;
+  for (int i = 0; i < n && used < 2; ++i) {
+    if (freq[i] > 0) {
+      ++used;
+    }
+  }
+  for (int i = 0; i < n && used < 2; ++i) {
+    if (freq[i] == 0) {
+      freq[i] = 1;
+      ++used;
+    }
+  }
+}
+
+struct Symbol {
+  uint16_t lit_or_len;
+  uint16_t dist; // 0 for literals
+};
+
+class SegmentCompressor {
+public:
+  SegmentCompressor(const uint8_t *base, size_t total, size_t start,
+                    const DeflateParams &params, std::vector<uint8_t> *out)
+      : base_(base), total_(total), params_(params), bw_(out),
+        block_start_(start), emitted_end_(start),
+        head_(static_cast<size_t>(1) << kHashBits, -1),
+        prev_(kWindowSize, -1) {
+    symbols_.reserve(kMaxBlockSymbols);
+  }
+
+  void Run(bool final) {
+    // Prime the dictionary with the history bytes without emitting them.
+    for (size_t p = 0; p < block_start_; ++p) {
+      Insert(p);
+    }
+    if (params_.lazy) {
+      RunLazy();
+    } else {
+      RunGreedy();
+    }
+    FlushBlock(final);
+    if (!final) {
+      bw_.Put(0, 3);
+      bw_.AlignToByte();
+      const uint8_t sync[4] = {0x00, 0x00, 0xFF, 0xFF};
+      bw_.PutBytes(sync, sizeof(sync));
+    }
+    bw_.AlignToByte();
+  }
+
+private:
+  static uint32_t Hash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - kHashBits);
+  }
+
+  void Insert(size_t pos) {
+    if (pos + kMinMatch > total_) {
+      return;
+    }
+    const uint32_t h = Hash(base_ + pos);
+    prev_[pos & kWindowMask] = head_[h];
+    head_[h] = static_cast<int32_t>(pos);
+  }
+
+  int MatchLength(const uint8_t *a, const uint8_t *b, int limit) const {
+    int len = 0;
+    while (len + 8 <= limit) {
+      uint64_t x;
+      uint64_t y;
+      memcpy(&x, a + len, 8);
+      memcpy(&y, b + len, 8);
+      const uint64_t diff = x ^ y;
+      if (diff != 0) {
+        return len + std::countr_zero(diff) / 8;
+      }
+      len += 8;
+    }
+    while (len < limit && a[len] == b[len]) {
+      ++len;
+    }
+    return len;
+  }
+
+  // Searches the chain for `pos` and inserts it. Returns the match length
+  // (0 when shorter than kMinMatch) and stores the distance in *dist.
+  int FindAndInsert(size_t pos, bool search, int *dist) {
+    if (pos + kMinMatch > total_) {
+      return 0;
+    }
+    const uint32_t h = Hash(base_ + pos);
+    int best_len = 0;
+    if (search) {
+      const int limit =
+          static_cast<int>(std::min<size_t>(kMaxMatch, total_ - pos));
+      const uint8_t *cur = base_ + pos;
+      int32_t cand = head_[h];
+      int chain = params_.max_chain;
+      while (cand >= 0 && chain-- > 0) {
+        const size_t d = pos - static_cast<size_t>(cand);
+        if (d > static_cast<size_t>(kWindowSize)) {
+          break;
+        }
+        const uint8_t *prev = base_ + cand;
+        if (prev[best_len] == cur[best_len]) {
+          const int len = MatchLength(prev, cur, limit);
+          if (len > best_len) {
+            best_len = len;
+            *dist = static_cast<int>(d);
+            if (len >= params_.nice_length || len == limit) {
+              break;
+            }
+          }
+        }
+        const int32_t next = prev_[cand & kWindowMask];
+        if (next >= cand) {
+          break;
+        }
+        cand = next;
+      }
+    }
+    prev_[pos & kWindowMask] = head_[h];
+    head_[h] = static_cast<int32_t>(pos);
+    return best_len >= kMinMatch ? best_len : 0;
+  }
+
+  void RunGreedy() {
+    size_t pos = block_start_;
+    while (pos < total_) {
+      int dist = 0;
+      const int len = FindAndInsert(pos, true, &dist);
+      if (len > 0) {
+        EmitMatch(len, dist);
+        if (len <= params_.max_insert_length) {
+          for (size_t q = pos + 1; q < pos + static_cast<size_t>(len); ++q) {
+            Insert(q);
+          }
+        }
+        pos += static_cast<size_t>(len);
+      } else {
+        EmitLiteral(base_[pos]);
+        ++pos;
+      }
+    }
+  }
+
+  void RunLazy() {
+    size_t pos = block_start_;
+    bool have_prev = false;
+    int prev_len = 0;
+    int prev_dist = 0;
+    while (pos < total_) {
+      int dist = 0;
+      const bool search = !(have_prev && prev_len >= params_.nice_length);
+      const int len = FindAndInsert(pos, search, &dist);
+      if (have_prev) {
+        if (prev_len > 0 && len <= prev_len) {
+          // The match found one byte earlier wins; it covers pos - 1 onward.
+          EmitMatch(prev_len, prev_dist);
+          const size_t end = pos - 1 + static_cast<size_t>(prev_len);
+          for (size_t q = pos + 1; q < end; ++q) {
+            Insert(q);
+          }
+          pos = end;
+          have_prev = false;
+          continue;
+        }
+        EmitLiteral(base_[pos - 1]);
+      }
+      have_prev = true;
+      prev_len = len;
+      prev_dist = dist;
+      ++pos;
+    }
+    if (have_prev) {
+      EmitLiteral(base_[pos - 1]);
+    }
+  }
+
+  void EmitLiteral(uint8_t c) {
+    symbols_.push_back(Symbol{c, 0});
+    ++lit_freq_[c];
+    emitted_end_ += 1;
+    if (symbols_.size() >= kMaxBlockSymbols) {
+      FlushBlock(false);
+    }
+  }
+
+  void EmitMatch(int len, int dist) {
+    const auto &t = Tables();
+    symbols_.push_back(
+        Symbol{static_cast<uint16_t>(len), static_cast<uint16_t>(dist)});
+    ++lit_freq_[257 + t.length_code[len]];
+    ++dist_freq_[t.DistCode(dist)];
+    emitted_end_ += static_cast<size_t>(len);
+    if (symbols_.size() >= kMaxBlockSymbols) {
+      FlushBlock(false);
+    }
+  }
+
+  uint64_t DataBits(const uint8_t *lit_len, const uint8_t *dist_len) const {
+    uint64_t bits = 0;
+    for (int i = 0; i < kNumLitLen; ++i) {
+      bits += static_cast<uint64_t>(lit_freq_[i]) * lit_len[i];
+      if (i >= 257) {
+        bits += static_cast<uint64_t>(lit_freq_[i]) * kLengthExtra[i - 257];
+      }
+    }
+    for (int i = 0; i < kNumDist; ++i) {
+      bits += static_cast<uint64_t>(dist_freq_[i]) *
+              (dist_len[i] + kDistExtra[i]);
+    }
+    return bits;
+  }
+
+  void WriteSymbols(const uint8_t *lit_len, const uint16_t *lit_code,
+                    const uint8_t *dist_len, const uint16_t *dist_code) {
+    const auto &t = Tables();
+    for (const Symbol &s : symbols_) {
+      if (s.dist == 0) {
+        bw_.Put(lit_code[s.lit_or_len], lit_len[s.lit_or_len]);
+        continue;
+      }
+      const int lc = t.length_code[s.lit_or_len];
+      bw_.Put(lit_code[257 + lc], lit_len[257 + lc]);
+      if (kLengthExtra[lc] > 0) {
+        bw_.Put(s.lit_or_len - kLengthBase[lc], kLengthExtra[lc]);
+      }
+      const int dc = t.DistCode(s.dist);
+      bw_.Put(dist_code[dc], dist_len[dc]);
+      if (kDistExtra[dc] > 0) {
+        bw_.Put(s.dist - kDistBase[dc], kDistExtra[dc]);
+      }
+    }
+    bw_.Put(lit_code[kEndOfBlock], lit_len[kEndOfBlock]);
+  }
+
+  void WriteStored(bool final) {
+    size_t pos = block_start_;
+    const size_t end = emitted_end_;
+    do {
+      const size_t n = std::min(kMaxStoredBlock, end - pos);
+      const bool last = pos + n == end;
+      bw_.Put(final && last ? 1 : 0, 1);
+      bw_.Put(0, 2);
+      bw_.AlignToByte();
+      const uint8_t hdr[4] = {
+          static_cast<uint8_t>(n), static_cast<uint8_t>(n >> 8),
+          static_cast<uint8_t>(~n), static_cast<uint8_t>((~n) >> 8)};
+      bw_.PutBytes(hdr, sizeof(hdr));
+      bw_.PutBytes(base_ + pos, n);
+      pos += n;
+    } while (pos < end);
+  }
+
+  void FlushBlock(bool final) {
+    const auto &t = Tables();
+    lit_freq_[kEndOfBlock] = 1;
+
+    uint32_t lit_build[kNumLitLen];
+    uint32_t dist_build[kNumDist];
+    memcpy(lit_build, lit_freq_, sizeof(lit_build));
+    memcpy(dist_build, dist_freq_, sizeof(dist_build));
+    EnsureTwoSymbols(lit_build, kNumLitLen);
+    EnsureTwoSymbols(dist_build, kNumDist);
+
+    uint8_t lit_len[kNumLitLen];
+    uint8_t dist_len[kNumDist];
+    BuildCodeLengths(lit_build, kNumLitLen, 15, lit_len);
+    BuildCodeLengths(dist_build, kNumDist, 15, dist_len);
+
+    int hlit = kNumLitLen;
+    while (hlit > 257 && lit_len[hlit - 1] == 0) {
+      --hlit;
+    }
+    int hdist = kNumDist;
+    while (hdist > 1 && dist_len[hdist - 1] == 0) {
+      --hdist;
+    }
+
+    // Run-length encode the concatenated code lengths (RFC 1951 3.2.7).
+    uint8_t all[kNumLitLen + kNumDist];
+    memcpy(all, lit_len, static_cast<size_t>(hlit));
+    memcpy(all + hlit, dist_len, static_cast<size_t>(hdist));
+    const int total_lens = hlit + hdist;
+    struct ClSym {
+      uint8_t sym;
+      uint8_t extra;
+    };
+    std::vector<ClSym> cl_syms;
+    uint32_t cl_freq[kNumCodeLen] = {};
+    auto push = [&](int sym, int extra) {
+      cl_syms.push_back(
+          ClSym{static_cast<uint8_t>(sym), static_cast<uint8_t>(extra)});
+      ++cl_freq[sym];
+    };
+    for (int i = 0; i < total_lens;) {
+      const uint8_t v = all[i];
+      int run = 1;
+      while (i + run < total_lens && all[i + run] == v) {
+        ++run;
+      }
+      i += run;
+      if (v == 0) {
+        while (run >= 11) {
+          const int n = std::min(run, 138);
+          push(18, n - 11);
+          run -= n;
+        }
+        if (run >= 3) {
+          push(17, run - 3);
+          run = 0;
+        }
+        while (run-- > 0) {
+          push(0, 0);
+        }
+      } else {
+        push(v, 0);
+        --run;
+        while (run >= 3) {
+          const int n = std::min(run, 6);
+          push(16, n - 3);
+          run -= n;
+        }
+        while (run-- > 0) {
+          push(v, 0);
+        }
+      }
+    }
+    uint32_t cl_build[kNumCodeLen];
+    memcpy(cl_build, cl_freq, sizeof(cl_build));
+    EnsureTwoSymbols(cl_build, kNumCodeLen);
+    uint8_t cl_len[kNumCodeLen];
+    BuildCodeLengths(cl_build, kNumCodeLen, 7, cl_len);
+    int hclen = kNumCodeLen;
+    while (hclen > 4 && cl_len[kCodeLenOrder[hclen - 1]] == 0) {
+      --hclen;
+    }
+
+    uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * static_cast<uint64_t>(hclen);
+    for (int i = 0; i < kNumCodeLen; ++i) {
+      dynamic_bits += static_cast<uint64_t>(cl_freq[i]) * cl_len[i];
+    }
+    dynamic_bits += 2ull * cl_freq[16] + 3ull * cl_freq[17] + 7ull * cl_freq[18];
+    dynamic_bits += DataBits(lit_len, dist_len);
+    const uint64_t fixed_bits =
+        3 + DataBits(t.fixed_lit_len, t.fixed_dist_len);
+    const uint64_t raw = emitted_end_ - block_start_;
+    const uint64_t stored_bits =
+        (raw / kMaxStoredBlock + 1) * (3 + 7 + 32) + 8 * raw;
+
+    if (stored_bits < dynamic_bits && stored_bits < fixed_bits) {
+      WriteStored(final);
+    } else if (fixed_bits <= dynamic_bits) {
+      uint16_t lit_code[288];
+      uint16_t dist_code[kNumDist];
+      BuildCodes(t.fixed_lit_len, 288, lit_code);
+      BuildCodes(t.fixed_dist_len, kNumDist, dist_code);
+      bw_.Put(final ? 1 : 0, 1);
+      bw_.Put(1, 2);
+      WriteSymbols(t.fixed_lit_len, lit_code, t.fixed_dist_len, dist_code);
+    } else {
+      uint16_t lit_code[kNumLitLen];
+      uint16_t dist_code[kNumDist];
+      uint16_t cl_code[kNumCodeLen];
+      BuildCodes(lit_len, kNumLitLen, lit_code);
+      BuildCodes(dist_len, kNumDist, dist_code);
+      BuildCodes(cl_len, kNumCodeLen, cl_code);
+      bw_.Put(final ? 1 : 0, 1);
+      bw_.Put(2, 2);
+      bw_.Put(static_cast<uint32_t>(hlit - 257), 5);
+      bw_.Put(static_cast<uint32_t>(hdist - 1), 5);
+      bw_.Put(static_cast<uint32_t>(hclen - 4), 4);
+      for (int i = 0; i < hclen; ++i) {
+        bw_.Put(cl_len[kCodeLenOrder[i]], 3);
+      }
+      for (const ClSym &s : cl_syms) {
+        bw_.Put(cl_code[s.sym], cl_len[s.sym]);
+        if (s.sym == 16) {
+          bw_.Put(s.extra, 2);
+        } else if (s.sym == 17) {
+          bw_.Put(s.extra, 3);
+        } else if (s.sym == 18) {
+          bw_.Put(s.extra, 7);
+        }
+      }
+      WriteSymbols(lit_len, lit_code, dist_len, dist_code);
+    }
+
+    symbols_.clear();
+    memset(lit_freq_, 0, sizeof(lit_freq_));
+    memset(dist_freq_, 0, sizeof(dist_freq_));
+    block_start_ = emitted_end_;
+  }
+
+  const uint8_t *base_;
+  size_t total_;
+  DeflateParams params_;
+  BitWriter bw_;
+  size_t block_start_;
+  size_t emitted_end_;
+  std::vector<int32_t> head_;
+  std::vector<int32_t> prev_;
+  std::vector<Symbol> symbols_;
+  uint32_t lit_freq_[kNumLitLen] = {};
+  uint32_t dist_freq_[kNumDist] = {};
+};
+
+void WriteStoredOnly(const uint8_t *data, size_t size, bool final,
+                     std::vector<uint8_t> *out) {
+  size_t pos = 0;
+  do {
+    const size_t n = std::min(kMaxStoredBlock, size - pos);
+    const bool last = pos + n == size;
+    out->push_back(final && last ? 1 : 0);
+    const uint8_t hdr[4] = {static_cast<uint8_t>(n), static_cast<uint8_t>(n >> 8),
+                            static_cast<uint8_t>(~n),
+                            static_cast<uint8_t>((~n) >> 8)};
+    out->insert(out->end(), hdr, hdr + 4);
+    out->insert(out->end(), data + pos, data + pos + n);
+    pos += n;
+  } while (pos < size);
+  if (!final) {
+    const uint8_t sync[5] = {0x00, 0x00, 0x00, 0xFF, 0xFF};
+    out->insert(out->end(), sync, sync + 5);
+  }
+}
+
+} // namespace
+
+void DeflateSegment(const uint8_t *data, size_t size, size_t history,
+                    bool final, const DeflateParams &params,
+                    std::vector<uint8_t> *out) {
+  if (params.max_chain <= 0) {
+    WriteStoredOnly(data, size, final, out);
+    return;
+  }
+  const size_t hist = std::min<size_t>(history, kWindowSize);
+  SegmentCompressor c(data - hist, hist + size, hist, params, out);
+  c.Run(final);
+}
+
+void AppendZlibHeader(const DeflateParams &params, std::vector<uint8_t> *out) {
+  // CMF: deflate with a 32 KiB window. FLG carries the informational level
+  // and the check bits that make (CMF << 8 | FLG) a multiple of 31.
+  uint8_t flg = 0x9C;
+  if (params.max_chain <= 0 || !params.lazy) {
+    flg = 0x01;
+  } else if (params.max_chain >= 256) {
+    flg = 0xDA;
+  }
+  out->push_back(0x78);
+  out->push_back(flg);
+}
+
+void AppendZlibTrailer(uint32_t adler, std::vector<uint8_t> *out) {
+  out->push_back(static_cast<uint8_t>(adler >> 24));
+  out->push_back(static_cast<uint8_t>(adler >> 16));
+  out->push_back(static_cast<uint8_t>(adler >> 8));
+  out->push_back(static_cast<uint8_t>(adler));
+}
+
+} // namespace sc
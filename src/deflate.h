@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sc {
+
+struct DeflateParams {
+  // Hash-chain candidates examined per position. 0 writes stored blocks.
+  int max_chain = 32;
+  // Stop searching once a match at least this long is found.
+  int nice_length = 128;
+  bool lazy = true;
+  // Greedy mode only: positions inside longer matches are not added to the
+  // hash chains, trading ratio for speed.
+  int max_insert_length = 258;
+};
+
+// Appends raw DEFLATE blocks for data[0, size) to *out. Up to 32 KiB of the
+// `history` bytes that immediately precede `data` may be referenced by
+// matches. When `final` is false the output ends with an empty stored block,
+// so it is byte aligned and the next segment can be appended directly.
+void DeflateSegment(const uint8_t *data, size_t size, size_t history,
+                    bool final, const DeflateParams &params,
+                    std::vector<uint8_t> *out);
+
+// Two-byte zlib stream header (CMF/FLG) matching `params`.
+void AppendZlibHeader(const DeflateParams &params, std::vector<uint8_t> *out);
+// Big-endian Adler-32 trailer that closes a zlib stream.
+void AppendZlibTrailer(uint32_t adler, std::vector<uint8_t> *out);
+
+} // namespace sc
@@ -0,0 +1,527 @@
+#include "encode_png.h"
+
+#include "checksum.h"
+#include "deflate.h"
+#include "output_file.h"
+#include "pixel_format.h"
+#include "task_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SC_PNG_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace sc {
+
+namespace {
+
+// Uncompressed scanline bytes per independently compressed stripe.
+constexpr size_t kStripeBytes = 1 << 20;
+constexpr size_t kDeflateWindow = 32768;
+
+enum PngFilter : uint8_t {
+  kFilterNone = 0,
+  kFilterSub = 1,
+  kFilterUp = 2,
+  kFilterAvg = 3,
+  kFilterPaeth = 4,
+};
+constexpr int kNumFilters = 5;
+
+void PutBe32(uint32_t v, uint8_t *p) {
+  p[0] = static_cast<uint8_t>(v >> 24);
+  p[1] = static_cast<uint8_t>(v >> 16);
+  p[2] = static_cast<uint8_t>(v >> 8);
+  p[3] = static_cast<uint8_t>(v);
+}
+
+void AppendChunk(const char *type, const uint8_t *data, size_t size,
+                 std::vector<uint8_t> *out) {
+  uint8_t hdr[8];
+  PutBe32(static_cast<uint32_t>(size), hdr);
+  memcpy(hdr + 4, type, 4);
+  out->insert(out->end(), hdr, hdr + 8);
+  if (size > 0) {
+    out->insert(out->end(), data, data + size);
+  }
+  uint32_t crc = Crc32(0, hdr + 4, 4);
+  crc = Crc32(crc, data, size);
+  uint8_t tail[4];
+  PutBe32(crc, tail);
+  out->insert(out->end(), tail, tail + 4);
+}
+
+inline uint8_t Paeth(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return static_cast<uint8_t>(a);
+  if (pb <= pc)
+    return static_cast<uint8_t>(b);
+  return static_cast<uint8_t>(c);
+}
+
+#ifdef SC_PNG_SSE2
+// Paeth-filters 16 bytes at `cur`, reading the pixel to the left
+// (cur - bpp) and the two predictors from `prev`. Lanes are widened to 16
+// bits.
+void PaethSse2(const uint8_t *cur, const uint8_t *prev, size_t bpp,
+               uint8_t *dst) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+  const __m128i a8 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur - bpp));
+  const __m128i b8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev));
+  const __m128i c8 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev - bpp));
+  auto predict = [&](__m128i a, __m128i b, __m128i c) {
+    const __m128i pa_raw = _mm_sub_epi16(b, c);
+    const __m128i pb_raw = _mm_sub_epi16(a, c);
+    const __m128i pc_raw = _mm_add_epi16(pa_raw, pb_raw);
+    const __m128i pa = _mm_max_epi16(pa_raw, _mm_sub_epi16(zero, pa_raw));
+    const __m128i pb = _mm_max_epi16(pb_raw, _mm_sub_epi16(zero, pb_raw));
+    const __m128i pc = _mm_max_epi16(pc_raw, _mm_sub_epi16(zero, pc_raw));
+    const __m128i not_a =
+        _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    const __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+    const __m128i b_or_c = _mm_or_si128(_mm_and_si128(use_c, c),
+                                        _mm_andnot_si128(use_c, b));
+    return _mm_or_si128(_mm_and_si128(not_a, b_or_c),
+                        _mm_andnot_si128(not_a, a));
+  };
+  const __m128i lo = predict(_mm_unpacklo_epi8(a8, zero),
+                             _mm_unpacklo_epi8(b8, zero),
+                             _mm_unpacklo_epi8(c8, zero));
+  const __m128i hi = predict(_mm_unpackhi_epi8(a8, zero),
+                             _mm_unpackhi_epi8(b8, zero),
+                             _mm_unpackhi_epi8(c8, zero));
+  const __m128i pred = _mm_packus_epi16(lo, hi);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_sub_epi8(x, pred));
+}
+#endif
+
+// `prev` is the previous unfiltered row, or all zeros for the first row.
+void ApplyFilter(PngFilter f, const uint8_t *cur, const uint8_t *prev,
+                 size_t n, size_t bpp, uint8_t *dst) {
+  switch (f) {
+  case kFilterNone:
+    memcpy(dst, cur, n);
+    break;
+  case kFilterSub:
+    for (size_t i = 0; i < bpp && i < n; ++i)
+      dst[i] = cur[i];
+    for (size_t i = bpp; i < n; ++i)
+      dst[i] = static_cast<uint8_t>(cur[i] - cur[i - bpp]);
+    break;
+  case kFilterUp:
+    for (size_t i = 0; i < n; ++i)
+      dst[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+    break;
+  case kFilterAvg:
+    for (size_t i = 0; i < bpp && i < n; ++i)
+      dst[i] = static_cast<uint8_t>(cur[i] - (prev[i] >> 1));
+    for (size_t i = bpp; i < n; ++i)
+      dst[i] = static_cast<uint8_t>(cur[i] - ((cur[i - bpp] + prev[i]) >> 1));
+    break;
+  case kFilterPaeth: {
+    for (size_t i = 0; i < bpp && i < n; ++i)
+      dst[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+    size_t i = bpp;
+#ifdef SC_PNG_SSE2
+    for (; i + 16 <= n; i += 16) {
+      PaethSse2(cur + i, prev + i, bpp, dst + i);
+    }
+#endif
+    for (; i < n; ++i)
+      dst[i] = static_cast<uint8_t>(
+          cur[i] - Paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+    break;
+  }
+  }
+}
+
+// Minimum sum of absolute differences, treating filtered bytes as signed.
+uint64_t FilterCost(const uint8_t *row, size_t n) {
+  uint64_t sum = 0;
+  size_t i = 0;
+#ifdef SC_PNG_SSE2
+  // |int8(v)| == min(v, 256 - v) as unsigned bytes; psadbw sums 8 at a time.
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    const __m128i mag = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(mag, zero));
+  }
+  sum = static_cast<uint64_t>(_mm_cvtsi128_si32(acc)) +
+        static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#endif
+  for (; i < n; ++i) {
+    sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(row[i])));
+  }
+  return sum;
+}
+
+struct FilterPlan {
+  bool adaptive = true;
+  PngFilter fixed = kFilterNone;
+};
+
+struct LevelSettings {
+  FilterPlan filter;
+  DeflateParams deflate;
+};
+
+// How source rows become PNG pixels.
+struct PixelPacking {
+  PackRowFn pack = nullptr;
+  size_t bpp = 4;
+};
+
+// PNG colour type for the formats the encoder stores, or -1.
+int ColourType(PixelFormat f) {
+  switch (f) {
+  case PixelFormat::kRgba8:
+  case PixelFormat::kRgba16:
+    return 6; // truecolour with alpha
+  case PixelFormat::kRgb8:
+    return 2; // truecolour
+  case PixelFormat::kGray8:
+    return 0; // greyscale
+  default:
+    return -1;
+  }
+}
+
+LevelSettings SettingsForLevel(PngLevel level) {
+  LevelSettings s;
+  switch (level) {
+  case PngLevel::kStore:
+    s.filter = FilterPlan{false, kFilterNone};
+    s.deflate.max_chain = 0;
+    break;
+  case PngLevel::kFast:
+    // Up is cheap and catches the vertical repetition typical of UI content.
+    s.filter = FilterPlan{false, kFilterUp};
+    s.deflate.max_chain = 1;
+    s.deflate.nice_length = 32;
+    s.deflate.lazy = false;
+    s.deflate.max_insert_length = 8;
+    break;
+  case PngLevel::kDefault:
+    break;
+  case PngLevel::kMax:
+    s.deflate.max_chain = 1024;
+    s.deflate.nice_length = 258;
+    break;
+  }
+  return s;
+}
+
+// Writes PNG scanlines (filter byte plus filtered pixel bytes) for rows
+// [y0, y1) to `dst`; rows[y] points at source row y, which is converted
+// here while it is being filtered. Filtering only depends on the row above,
+// so any band of rows can be produced independently of the others.
+void FilterRows(const uint8_t *const *rows, int width,
+                const PixelPacking &packing, const FilterPlan &plan, int y0,
+                int y1, uint8_t *dst) {
+  const size_t bpp = packing.bpp;
+  const size_t row_bytes = static_cast<size_t>(width) * bpp;
+  std::vector<uint8_t> prev(row_bytes, 0);
+  std::vector<uint8_t> cur(row_bytes);
+  std::vector<uint8_t> trial(plan.adaptive ? row_bytes * kNumFilters : 0);
+
+  if (y0 > 0) {
+    packing.pack(rows[y0 - 1], width, prev.data());
+  }
+  for (int y = y0; y < y1; ++y) {
+    packing.pack(rows[y], width, cur.data());
+
+    if (plan.adaptive) {
+      int best = 0;
+      uint64_t best_cost = UINT64_MAX;
+      for (int f = 0; f < kNumFilters; ++f) {
+        uint8_t *t = trial.data() + static_cast<size_t>(f) * row_bytes;
+        ApplyFilter(static_cast<PngFilter>(f), cur.data(), prev.data(),
+                    row_bytes, bpp, t);
+        const uint64_t cost = FilterCost(t, row_bytes);
+        if (cost < best_cost) {
+          best_cost = cost;
+          best = f;
+        }
+      }
+      dst[0] = static_cast<uint8_t>(best);
+      memcpy(dst + 1, trial.data() + static_cast<size_t>(best) * row_bytes,
+             row_bytes);
+    } else {
+      dst[0] = plan.fixed;
+      ApplyFilter(plan.fixed, cur.data(), prev.data(), row_bytes, bpp,
+                  dst + 1);
+    }
+    dst += row_bytes + 1;
+    prev.swap(cur);
+  }
+}
+
+struct Stripe {
+  int y0 = 0;
+  int y1 = 0;
+  uint32_t adler = 1;
+  uint64_t raw_size = 0;
+  // A complete IDAT chunk once finished: 8 header bytes, the stripe's part
+  // of the zlib stream, then the CRC.
+  std::vector<uint8_t> chunk;
+};
+
+// Filters and compresses one stripe. The rows just above the stripe are
+// filtered again and used as deflate history, so matches can reach back
+// across the stripe boundary just like in a single-threaded stream.
+void EncodeStripe(const uint8_t *const *rows, int width,
+                  const PixelPacking &packing, const LevelSettings &settings,
+                  bool first, bool last, Stripe *s) {
+  const size_t line = static_cast<size_t>(width) * packing.bpp + 1;
+  const int history_rows =
+      std::min(s->y0, static_cast<int>((kDeflateWindow + line - 1) / line));
+  const int h0 = s->y0 - history_rows;
+
+  std::vector<uint8_t> buf(line * static_cast<size_t>(s->y1 - h0));
+  FilterRows(rows, width, packing, settings.filter, h0, s->y1, buf.data());
+
+  const size_t history = line * static_cast<size_t>(history_rows);
+  const uint8_t *data = buf.data() + history;
+  s->raw_size = buf.size() - history;
+  s->adler = Adler32(1, data, s->raw_size);
+  s->chunk.reserve(s->raw_size / 4 + 64);
+  s->chunk.resize(8);
+  if (first) {
+    AppendZlibHeader(settings.deflate, &s->chunk);
+  }
+  DeflateSegment(data, s->raw_size, history, last, settings.deflate,
+                 &s->chunk);
+}
+
+// Fills in the reserved chunk header and appends the CRC.
+void FinishChunk(const char *type, std::vector<uint8_t> *chunk) {
+  PutBe32(static_cast<uint32_t>(chunk->size() - 8), chunk->data());
+  memcpy(chunk->data() + 4, type, 4);
+  uint8_t crc[4];
+  PutBe32(Crc32(0, chunk->data() + 4, chunk->size() - 4), crc);
+  chunk->insert(chunk->end(), crc, crc + 4);
+}
+
+int ResolveThreads(int requested, int tasks) {
+  int n = requested;
+  if (n <= 0) {
+    n = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  return std::clamp(n, 1, std::max(tasks, 1));
+}
+
+} // namespace
+
+struct PngRowEncoder::Job {
+  Stripe stripe;
+  TaskGroup done{&EncodeTaskPool()};
+};
+
+PngRowEncoder::PngRowEncoder(const PngOptions &opt, ByteSink *out)
+    : opt_(opt), out_(out) {}
+
+PngRowEncoder::~PngRowEncoder() {
+  in_flight_.clear(); // waits for stripes still being compressed
+}
+
+bool PngRowEncoder::BeginImage(const RowImageInfo &info, ErrorInfo *err) {
+  if (info.width <= 0 || info.height <= 0) {
+    *err = ErrorInfo{"invalid image size", "PngRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  const int colour_type = ColourType(opt_.pixel_format);
+  if (colour_type < 0) {
+    *err = ErrorInfo{std::string("png cannot store ") +
+                         PixelFormatName(opt_.pixel_format),
+                     "PngRowEncoder", std::nullopt, std::nullopt};
+    return false;
+  }
+  pack_ = ConvertRowKernel(info.format, opt_.pixel_format, ActiveSimdLevel());
+  if (!pack_) {
+    *err = ErrorInfo{std::string("png cannot store ") +
+                         PixelFormatName(info.format) + " rows as " +
+                         PixelFormatName(opt_.pixel_format),
+                     "PngRowEncoder", std::nullopt, std::nullopt};
+    return false;
+  }
+  width_ = info.width;
+  height_ = info.height;
+  bpp_ = static_cast<size_t>(PixelFormatBytes(opt_.pixel_format));
+  rows_.assign(static_cast<size_t>(height_), nullptr);
+  next_row_ = 0;
+  next_stripe_ = 0;
+  adler_ = 1;
+
+  const size_t line = static_cast<size_t>(width_) * bpp_ + 1;
+  rows_per_stripe_ =
+      static_cast<int>(std::max<size_t>(1, kStripeBytes / line));
+  const int stripes = (height_ + rows_per_stripe_ - 1) / rows_per_stripe_;
+  threads_ = ResolveThreads(opt_.threads, stripes);
+
+  static const uint8_t kSignature[8] = {0x89, 'P',  'N',  'G',
+                                        0x0D, 0x0A, 0x1A, 0x0A};
+  std::vector<uint8_t> head(kSignature, kSignature + 8);
+  uint8_t ihdr[13];
+  PutBe32(static_cast<uint32_t>(width_), ihdr);
+  PutBe32(static_cast<uint32_t>(height_), ihdr + 4);
+  ihdr[8] = opt_.pixel_format == PixelFormat::kRgba16 ? 16 : 8; // bit depth
+  ihdr[9] = static_cast<uint8_t>(colour_type);
+  ihdr[10] = 0; // deflate
+  ihdr[11] = 0; // adaptive filtering
+  ihdr[12] = 0; // no interlace
+  AppendChunk("IHDR", ihdr, sizeof(ihdr), &head);
+  return out_->WriteOwned(std::move(head), err);
+}
+
+bool PngRowEncoder::WriteRows(int y, int count, const uint8_t *rows,
+                              size_t stride, ErrorInfo *err) {
+  if (y != next_row_ || count < 0 || y + count > height_) {
+    *err = ErrorInfo{"rows out of order", "PngRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  for (int i = 0; i < count; ++i) {
+    rows_[static_cast<size_t>(y + i)] = rows + static_cast<size_t>(i) * stride;
+  }
+  next_row_ += count;
+  while (next_stripe_ < height_ &&
+         next_row_ >= std::min(height_, next_stripe_ + rows_per_stripe_)) {
+    if (!LaunchStripe(err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Queues the next stripe for compression. At most `threads_` stripes are in
+// flight; beyond that the oldest is waited for and written first, which
+// also keeps the IDAT chunks in order.
+bool PngRowEncoder::LaunchStripe(ErrorInfo *err) {
+  if (static_cast<int>(in_flight_.size()) >= threads_ &&
+      !WriteOldest(err)) {
+    return false;
+  }
+  auto job = std::make_unique<Job>();
+  job->stripe.y0 = next_stripe_;
+  job->stripe.y1 = std::min(height_, next_stripe_ + rows_per_stripe_);
+  next_stripe_ = job->stripe.y1;
+
+  const bool first = job->stripe.y0 == 0;
+  const bool last = job->stripe.y1 == height_;
+  Stripe *stripe = &job->stripe;
+  auto run = [this, stripe, first, last]() {
+    EncodeStripe(rows_.data(), width_, PixelPacking{pack_, bpp_},
+                 SettingsForLevel(opt_.level), first, last, stripe);
+  };
+  if (threads_ == 1) {
+    run();
+  } else {
+    job->done.Run(run);
+  }
+  in_flight_.push_back(std::move(job));
+  return true;
+}
+
+// Every stripe but the last ends on a byte-aligned sync point, so the IDAT
+// payloads concatenate into one valid zlib stream.
+bool PngRowEncoder::WriteOldest(ErrorInfo *err) {
+  std::unique_ptr<Job> job = std::move(in_flight_.front());
+  in_flight_.pop_front();
+  job->done.Wait();
+  Stripe &s = job->stripe;
+  adler_ = Adler32Combine(adler_, s.adler, s.raw_size);
+  if (s.y1 == height_) {
+    AppendZlibTrailer(adler_, &s.chunk);
+  }
+  FinishChunk("IDAT", &s.chunk);
+  return out_->WriteOwned(std::move(s.chunk), err);
+}
+
+bool PngRowEncoder::Finish(ErrorInfo *err) {
+  if (next_row_ != height_ || height_ == 0) {
+    *err = ErrorInfo{"image rows incomplete", "PngRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  while (!in_flight_.empty()) {
+    if (!WriteOldest(err)) {
+      return false;
+    }
+  }
+  std::vector<uint8_t> tail;
+  AppendChunk("IEND", nullptr, 0, &tail);
+  return out_->WriteOwned(std::move(tail), err);
+}
+
+bool EncodePng(const ImageView &img, const PngOptions &opt, ByteSink *sink,
+               ErrorInfo *err) {
+  PngRowEncoder enc(opt, sink);
+  return WriteImageRows(img, &enc, err);
+}
+
+bool EncodePng(const ImageView &img, const PngOptions &opt,
+               std::vector<uint8_t> *out, ErrorInfo *err) {
+  out->clear();
+  VectorSink sink(out);
+  return EncodePng(img, opt, &sink, err);
+}
+
+bool ParsePngLevel(const std::string &s, PngLevel *out) {
+  if (s == "store") {
+    *out = PngLevel::kStore;
+  } else if (s == "fast") {
+    *out = PngLevel::kFast;
+  } else if (s == "default") {
+    *out = PngLevel::kDefault;
+  } else if (s == "max") {
+    *out = PngLevel::kMax;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *PngLevelName(PngLevel level) {
+  switch (level) {
+  case PngLevel::kStore:
+    return "store";
+  case PngLevel::kFast:
+    return "fast";
+  case PngLevel::kDefault:
+    return "default";
+  case PngLevel::kMax:
+    return "max";
+  }
+  return "default";
+}
+
+bool SavePng(const ImageView &img, const PngOptions &opt,
+             const std::string &out_path, bool overwrite, ErrorInfo *err) {
+  OutputFile file;
+  if (!file.Open(out_path, overwrite, err)) {
+    return false;
+  }
+  if (!EncodePng(img, opt, &file, err)) {
+    return false;
+  }
+  return file.Close(err);
+}
+
+} // namespace sc
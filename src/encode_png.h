@@ -0,0 +1,76 @@
+#pragma once
+
+#include "output_file.h"
+#include "pixel_format.h"
+#include "row_sink.h"
+#include "types.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+// Speed/size presets.
+//   store:   no filtering, stored deflate blocks
+//   fast:    Up filter, greedy single-probe matching
+//   default: per-row adaptive filter, lazy matching
+//   max:     per-row adaptive filter, deep lazy matching
+enum class PngLevel { kStore, kFast, kDefault, kMax };
+
+struct PngOptions {
+  PngLevel level = PngLevel::kDefault;
+  // Stripes filtered and compressed at once; 0 = one per core.
+  int threads = 0;
+  // Stored layout: rgba8, rgb8 (alpha dropped), gray8 (BT.709 luma) or
+  // rgba16.
+  PixelFormat pixel_format = PixelFormat::kRgba8;
+};
+
+// Encodes BGRA rows, or rows already in the stored layout, as an 8-bit
+// RGBA, RGB or greyscale PNG or a 16-bit RGBA one without any OS codec. The
+// image is split into row stripes; each stripe is converted, filtered and
+// deflated as a task on the encode pool as soon as its rows have arrived,
+// becomes one IDAT chunk, and is written to `out` once the stripes before
+// it have been.
+class PngRowEncoder : public RowSink {
+public:
+  PngRowEncoder(const PngOptions &opt, ByteSink *out);
+  ~PngRowEncoder() override;
+  bool BeginImage(const RowImageInfo &info, ErrorInfo *err) override;
+  bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                 ErrorInfo *err) override;
+  bool Finish(ErrorInfo *err) override;
+
+private:
+  struct Job;
+  bool LaunchStripe(ErrorInfo *err);
+  bool WriteOldest(ErrorInfo *err);
+
+  PngOptions opt_;
+  ByteSink *out_;
+  int width_ = 0;
+  int height_ = 0;
+  int rows_per_stripe_ = 1;
+  int threads_ = 1;
+  PackRowFn pack_ = nullptr;
+  size_t bpp_ = 4;
+  std::vector<const uint8_t *> rows_;
+  int next_row_ = 0;
+  int next_stripe_ = 0; // first row not yet handed to a stripe
+  uint32_t adler_ = 1;
+  std::deque<std::unique_ptr<Job>> in_flight_;
+};
+
+bool EncodePng(const ImageView &img, const PngOptions &opt, ByteSink *sink,
+               ErrorInfo *err);
+bool EncodePng(const ImageView &img, const PngOptions &opt,
+               std::vector<uint8_t> *out, ErrorInfo *err);
+bool ParsePngLevel(const std::string &s, PngLevel *out);
+const char *PngLevelName(PngLevel level);
+bool SavePng(const ImageView &img, const PngOptions &opt,
+             const std::string &out_path, bool overwrite, ErrorInfo *err);
+
+} // namespace sc
@@ -0,0 +1,298 @@
+#include "encode_qoi.h"
+
+#include <cstring>
+#include <utility>
+
+namespace sc {
+
+namespace {
+
+constexpr uint8_t kOpIndex = 0x00;
+constexpr uint8_t kOpDiff = 0x40;
+constexpr uint8_t kOpLuma = 0x80;
+constexpr uint8_t kOpRun = 0xC0;
+constexpr uint8_t kOpRgb = 0xFE;
+constexpr uint8_t kOpRgba = 0xFF;
+constexpr uint8_t kMask2 = 0xC0;
+constexpr int kHeaderSize = 14;
+constexpr uint8_t kEndMarker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+// Guards against headers that would need absurd allocations.
+constexpr uint64_t kMaxPixels = 400000000ull;
+
+struct Px {
+  uint8_t r = 0;
+  uint8_t g = 0;
+  uint8_t b = 0;
+  uint8_t a = 0;
+
+  bool operator==(const Px &o) const {
+    return r == o.r && g == o.g && b == o.b && a == o.a;
+  }
+};
+
+inline int HashIndex(const Px &p) {
+  return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) % 64;
+}
+
+inline void PutBe32(uint32_t v, uint8_t *p) {
+  p[0] = static_cast<uint8_t>(v >> 24);
+  p[1] = static_cast<uint8_t>(v >> 16);
+  p[2] = static_cast<uint8_t>(v >> 8);
+  p[3] = static_cast<uint8_t>(v);
+}
+
+inline uint32_t GetBe32(const uint8_t *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+} // namespace
+
+struct QoiRowEncoder::State {
+  Px index[64] = {};
+  Px prev{0, 0, 0, 255};
+  int run = 0;
+};
+
+QoiRowEncoder::QoiRowEncoder(ByteSink *out, PixelFormat pixel_format)
+    : out_(out), pixel_format_(pixel_format),
+      state_(std::make_unique<State>()) {}
+
+QoiRowEncoder::~QoiRowEncoder() = default;
+
+bool QoiRowEncoder::BeginImage(const RowImageInfo &info, ErrorInfo *err) {
+  if (info.width <= 0 || info.height <= 0) {
+    *err = ErrorInfo{"invalid image size", "QoiRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  if (pixel_format_ != PixelFormat::kRgba8 &&
+      pixel_format_ != PixelFormat::kRgb8) {
+    *err = ErrorInfo{std::string("qoi cannot store ") +
+                         PixelFormatName(pixel_format_),
+                     "QoiRowEncoder", std::nullopt, std::nullopt};
+    return false;
+  }
+  if (info.format != PixelFormat::kBgra8) {
+    *err = ErrorInfo{std::string("qoi cannot encode ") +
+                         PixelFormatName(info.format) + " rows",
+                     "QoiRowEncoder", std::nullopt, std::nullopt};
+    return false;
+  }
+  width_ = info.width;
+  height_ = info.height;
+  next_row_ = 0;
+  *state_ = State{};
+
+  std::vector<uint8_t> header(kHeaderSize);
+  memcpy(header.data(), "qoif", 4);
+  PutBe32(static_cast<uint32_t>(width_), header.data() + 4);
+  PutBe32(static_cast<uint32_t>(height_), header.data() + 8);
+  header[12] = pixel_format_ == PixelFormat::kRgb8 ? 3 : 4; // channels
+  header[13] = 0; // sRGB with linear alpha
+  return out_->WriteOwned(std::move(header), err);
+}
+
+// QOI is one sequential stream, so each band is encoded on the calling
+// thread and carries the index, previous pixel and run into the next.
+bool QoiRowEncoder::WriteRows(int y, int count, const uint8_t *rows,
+                              size_t stride, ErrorInfo *err) {
+  if (y != next_row_ || count < 0 || y + count > height_) {
+    *err = ErrorInfo{"rows out of order", "QoiRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  next_row_ += count;
+
+  std::vector<uint8_t> buf(static_cast<size_t>(width_) * count * 5);
+  uint8_t *o = buf.data();
+  Px *index = state_->index;
+  Px prev = state_->prev;
+  int run = state_->run;
+  // Three channels: every pixel is stored opaque, so alpha never costs an
+  // RGBA op.
+  const uint8_t alpha_or = pixel_format_ == PixelFormat::kRgb8 ? 0xFF : 0;
+  for (int i = 0; i < count; ++i) {
+    const uint8_t *row = rows + static_cast<size_t>(i) * stride;
+    for (int x = 0; x < width_; ++x) {
+      const Px px{row[x * 4 + 2], row[x * 4 + 1], row[x * 4 + 0],
+                  static_cast<uint8_t>(row[x * 4 + 3] | alpha_or)};
+      if (px == prev) {
+        if (++run == 62) {
+          *o++ = static_cast<uint8_t>(kOpRun | (run - 1));
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0) {
+        *o++ = static_cast<uint8_t>(kOpRun | (run - 1));
+        run = 0;
+      }
+
+      const int h = HashIndex(px);
+      if (index[h] == px) {
+        *o++ = static_cast<uint8_t>(kOpIndex | h);
+      } else {
+        index[h] = px;
+        if (px.a == prev.a) {
+          const int8_t vr = static_cast<int8_t>(px.r - prev.r);
+          const int8_t vg = static_cast<int8_t>(px.g - prev.g);
+          const int8_t vb = static_cast<int8_t>(px.b - prev.b);
+          const int8_t vg_r = static_cast<int8_t>(vr - vg);
+          const int8_t vg_b = static_cast<int8_t>(vb - vg);
+          if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+            *o++ = static_cast<uint8_t>(kOpDiff | ((vr + 2) << 4) |
+                                        ((vg + 2) << 2) | (vb + 2));
+          } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                     vg_b > -9 && vg_b < 8) {
+            *o++ = static_cast<uint8_t>(kOpLuma | (vg + 32));
+            *o++ = static_cast<uint8_t>(((vg_r + 8) << 4) | (vg_b + 8));
+          } else {
+            *o++ = kOpRgb;
+            *o++ = px.r;
+            *o++ = px.g;
+            *o++ = px.b;
+          }
+        } else {
+          *o++ = kOpRgba;
+          *o++ = px.r;
+          *o++ = px.g;
+          *o++ = px.b;
+          *o++ = px.a;
+        }
+      }
+      prev = px;
+    }
+  }
+  state_->prev = prev;
+  state_->run = run;
+  buf.resize(static_cast<size_t>(o - buf.data()));
+  return out_->WriteOwned(std::move(buf), err);
+}
+
+bool QoiRowEncoder::Finish(ErrorInfo *err) {
+  if (next_row_ != height_ || height_ == 0) {
+    *err = ErrorInfo{"image rows incomplete", "QoiRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  const size_t run_op = state_->run > 0 ? 1 : 0;
+  std::vector<uint8_t> tail(run_op + sizeof(kEndMarker));
+  if (run_op) {
+    tail[0] = static_cast<uint8_t>(kOpRun | (state_->run - 1));
+    state_->run = 0;
+  }
+  memcpy(tail.data() + run_op, kEndMarker, sizeof(kEndMarker));
+  return out_->WriteOwned(std::move(tail), err);
+}
+
+bool EncodeQoi(const ImageView &img, std::vector<uint8_t> *out,
+               ErrorInfo *err) {
+  out->clear();
+  VectorSink sink(out);
+  return EncodeQoi(img, &sink, err);
+}
+
+bool DecodeQoi(const uint8_t *data, size_t size, ImageBuffer *out,
+               ErrorInfo *err) {
+  auto fail = [&](const char *msg) {
+    *err = ErrorInfo{msg, "DecodeQoi", std::nullopt, std::nullopt};
+    return false;
+  };
+  if (size < kHeaderSize + sizeof(kEndMarker) ||
+      memcmp(data, "qoif", 4) != 0) {
+    return fail("not a QOI stream");
+  }
+  const uint32_t w = GetBe32(data + 4);
+  const uint32_t h = GetBe32(data + 8);
+  const uint8_t channels = data[12];
+  if (w == 0 || h == 0 || w > 0x7FFFFFFF / 4 || h > 0x7FFFFFFF ||
+      static_cast<uint64_t>(w) * h > kMaxPixels ||
+      (channels != 3 && channels != 4)) {
+    return fail("invalid QOI header");
+  }
+
+  out->width = static_cast<int>(w);
+  out->height = static_cast<int>(h);
+  out->row_pitch = static_cast<int>(w) * 4;
+  out->origin_x = 0;
+  out->origin_y = 0;
+  const size_t pixels = static_cast<size_t>(w) * h;
+  out->bgra.Allocate(pixels * 4);
+
+  const uint8_t *p = data + kHeaderSize;
+  const uint8_t *end = data + size - sizeof(kEndMarker);
+  Px index[64] = {};
+  Px px{0, 0, 0, 255};
+  int run = 0;
+  uint8_t *dst = out->bgra.data();
+  for (size_t i = 0; i < pixels; ++i) {
+    if (run > 0) {
+      --run;
+    } else {
+      if (p >= end) {
+        return fail("truncated QOI stream");
+      }
+      const uint8_t op = *p++;
+      if (op == kOpRgb) {
+        if (end - p < 3) {
+          return fail("truncated QOI stream");
+        }
+        px.r = p[0];
+        px.g = p[1];
+        px.b = p[2];
+        p += 3;
+      } else if (op == kOpRgba) {
+        if (end - p < 4) {
+          return fail("truncated QOI stream");
+        }
+        px.r = p[0];
+        px.g = p[1];
+        px.b = p[2];
+        px.a = p[3];
+        p += 4;
+      } else if ((op & kMask2) == kOpIndex) {
+        px = index[op];
+      } else if ((op & kMask2) == kOpDiff) {
+        px.r = static_cast<uint8_t>(px.r + ((op >> 4) & 0x03) - 2);
+        px.g = static_cast<uint8_t>(px.g + ((op >> 2) & 0x03) - 2);
+        px.b = static_cast<uint8_t>(px.b + (op & 0x03) - 2);
+      } else if ((op & kMask2) == kOpLuma) {
+        if (p >= end) {
+          return fail("truncated QOI stream");
+        }
+        const uint8_t b2 = *p++;
+        const int vg = (op & 0x3F) - 32;
+        px.r = static_cast<uint8_t>(px.r + vg - 8 + ((b2 >> 4) & 0x0F));
+        px.g = static_cast<uint8_t>(px.g + vg);
+        px.b = static_cast<uint8_t>(px.b + vg - 8 + (b2 & 0x0F));
+      } else {
+        run = op & 0x3F;
+      }
+      index[HashIndex(px)] = px;
+    }
+    dst[0] = px.b;
+    dst[1] = px.g;
+    dst[2] = px.r;
+    dst[3] = px.a;
+    dst += 4;
+  }
+  return true;
+}
+
+bool EncodeQoi(const ImageView &img, ByteSink *sink, ErrorInfo *err) {
+  QoiRowEncoder enc(sink);
+  return WriteImageRows(img, &enc, err);
+}
+
+bool SaveQoi(const ImageView &img, const std::string &out_path,
+             bool overwrite, ErrorInfo *err) {
+  std::vector<uint8_t> qoi;
+  if (!EncodeQoi(img, &qoi, err)) {
+    return false;
+  }
+  return WriteFileBytes(out_path, overwrite, qoi.data(), qoi.size(), err);
+}
+
+} // namespace sc
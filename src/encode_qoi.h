@@ -0,0 +1,49 @@
+#pragma once
+
+#include "output_file.h"
+#include "pixel_format.h"
+#include "row_sink.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+// QOI ("Quite OK Image") lossless encoding straight from BGRA rows.
+// Much cheaper than PNG when save latency matters more than compatibility.
+// `pixel_format` is rgba8, or rgb8 to store a 3-channel image with alpha
+// dropped.
+class QoiRowEncoder : public RowSink {
+public:
+  explicit QoiRowEncoder(ByteSink *out,
+                         PixelFormat pixel_format = PixelFormat::kRgba8);
+  ~QoiRowEncoder() override;
+  bool BeginImage(const RowImageInfo &info, ErrorInfo *err) override;
+  bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                 ErrorInfo *err) override;
+  bool Finish(ErrorInfo *err) override;
+
+private:
+  struct State;
+  ByteSink *out_;
+  PixelFormat pixel_format_;
+  std::unique_ptr<State> state_;
+  int width_ = 0;
+  int height_ = 0;
+  int next_row_ = 0;
+};
+
+bool EncodeQoi(const ImageView &img, std::vector<uint8_t> *out,
+               ErrorInfo *err);
+bool EncodeQoi(const ImageView &img, ByteSink *sink, ErrorInfo *err);
+// Decodes a 3- or 4-channel QOI stream into a tightly packed BGRA buffer.
+bool DecodeQoi(const uint8_t *data, size_t size, ImageBuffer *out,
+               ErrorInfo *err);
+bool SaveQoi(const ImageView &img, const std::string &out_path,
+             bool overwrite, ErrorInfo *err);
+
+} // namespace sc
@@ -0,0 +1,391 @@
+#include "encode_raw.h"
+
+#include "parallel.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace sc {
+
+namespace {
+
+std::string PnmHeader(int width, int height, bool pam) {
+  std::ostringstream oss;
+  if (pam) {
+    oss << "P7\nWIDTH " << width << "\nHEIGHT " << height
+        << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  } else {
+    oss << "P6\n" << width << ' ' << height << "\n255\n";
+  }
+  return oss.str();
+}
+
+// Paths are UTF-8 on every platform.
+std::filesystem::path PathFromUtf8(const std::string &s) {
+  return std::filesystem::path(std::u8string(s.begin(), s.end()));
+}
+
+// Finds `"key":` in a flat JSON object and returns the offset of its value.
+bool FindJsonValue(const std::string &json, const char *key, size_t *pos) {
+  const std::string needle = std::string("\"") + key + "\":";
+  const size_t at = json.find(needle);
+  if (at == std::string::npos) {
+    return false;
+  }
+  *pos = json.find_first_not_of(" \t\r\n", at + needle.size());
+  return *pos != std::string::npos;
+}
+
+bool JsonInt(const std::string &json, const char *key, long long *out) {
+  size_t pos = 0;
+  if (!FindJsonValue(json, key, &pos)) {
+    return false;
+  }
+  char *end = nullptr;
+  *out = strtoll(json.c_str() + pos, &end, 10);
+  return end != json.c_str() + pos;
+}
+
+bool JsonString(const std::string &json, const char *key, std::string *out) {
+  size_t pos = 0;
+  if (!FindJsonValue(json, key, &pos) || json[pos] != '"') {
+    return false;
+  }
+  const size_t end = json.find('"', pos + 1);
+  if (end == std::string::npos) {
+    return false;
+  }
+  *out = json.substr(pos + 1, end - pos - 1);
+  return true;
+}
+
+} // namespace
+
+bool IsRawFormat(const std::string &format) {
+  return format == "raw" || format == "pam" || format == "ppm";
+}
+
+PixelFormat RawLayoutOf(const std::string &format, PixelFormat pixel_format) {
+  if (format == "pam") {
+    return PixelFormat::kRgba8;
+  }
+  if (format == "ppm") {
+    return PixelFormat::kRgb8;
+  }
+  return pixel_format;
+}
+
+RawRowEncoder::RawRowEncoder(const std::string &format, ByteSink *out,
+                             RawFrameInfo *info, PixelFormat pixel_format,
+                             const YuvOptions &yuv)
+    : format_(format), out_(out), info_(info), pixel_format_(pixel_format),
+      yuv_(yuv) {}
+
+bool RawRowEncoder::BeginImage(const RowImageInfo &info, ErrorInfo *err) {
+  if (!IsRawFormat(format_)) {
+    *err = ErrorInfo{"unknown raw format: " + format_, "RawRowEncoder",
+                     std::nullopt, std::nullopt};
+    return false;
+  }
+  if (info.width <= 0 || info.height <= 0) {
+    *err = ErrorInfo{"invalid image size", "RawRowEncoder", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  layout_ = RawLayoutOf(format_, pixel_format_);
+  source_ = info.format;
+  convert_ = IsYuv420(layout_)
+                 ? nullptr
+                 : ConvertRowKernel(source_, layout_, ActiveSimdLevel());
+  if (IsYuv420(layout_) ? source_ != PixelFormat::kBgra8 : !convert_) {
+    *err = ErrorInfo{std::string("cannot write ") + PixelFormatName(source_) +
+                         " rows as " + PixelFormatName(layout_),
+                     "RawRowEncoder", std::nullopt, std::nullopt};
+    return false;
+  }
+  width_ = info.width;
+  height_ = info.height;
+  planes_ = PlaneLayoutOf(layout_, width_, height_);
+  pending_ = nullptr;
+  *info_ = RawFrameInfo{};
+  info_->width = info.width;
+  info_->height = info.height;
+  info_->origin_x = info.origin_x;
+  info_->origin_y = info.origin_y;
+  info_->pitch = static_cast<int>(planes_.luma_pitch);
+  info_->pixel_layout = PixelFormatName(layout_);
+  if (IsYuv420(layout_)) {
+    chroma_.assign(planes_.size - planes_.u_offset, 0);
+    info_->chroma_pitch = static_cast<int>(planes_.chroma_pitch);
+    info_->u_offset = planes_.u_offset;
+    info_->v_offset = planes_.v_offset;
+    info_->yuv_matrix = YuvMatrixName(yuv_.matrix);
+    info_->yuv_range = YuvRangeName(yuv_.range);
+  }
+  if (format_ == "raw") {
+    return true;
+  }
+  const std::string header =
+      PnmHeader(info.width, info.height, format_ == "pam");
+  info_->data_offset = header.size();
+  return out_->Write(header.data(), header.size(), err);
+}
+
+bool RawRowEncoder::WriteRows(int y, int count, const uint8_t *rows,
+                              size_t stride, ErrorInfo *err) {
+  if (IsYuv420(layout_)) {
+    return WriteYuvRows(y, count, rows, stride, err);
+  }
+  const size_t row_bytes =
+      static_cast<size_t>(width_) * PixelFormatBytes(source_);
+  if (layout_ == source_ && stride == row_bytes) {
+    // Already the file layout: write the band straight from the source.
+    return out_->Write(rows, row_bytes * static_cast<size_t>(count), err);
+  }
+
+  const size_t pitch = planes_.luma_pitch;
+  std::vector<uint8_t> band(pitch * static_cast<size_t>(count));
+  ParallelForRows(count, row_bytes, [&](int part, int y0, int y1) {
+    (void)part;
+    for (int i = y0; i < y1; ++i) {
+      convert_(rows + static_cast<size_t>(i) * stride, width_,
+               band.data() + static_cast<size_t>(i) * pitch);
+    }
+  });
+  return out_->WriteOwned(std::move(band), err);
+}
+
+// Luma rows go out with each band; a pair's chroma lands in chroma_. A band
+// ending on the first row of a pair leaves it in pending_ (rows stay valid
+// until Finish) and its luma is written with the next band.
+bool RawRowEncoder::WriteYuvRows(int y, int count, const uint8_t *rows,
+                                 size_t stride, ErrorInfo *err) {
+  std::vector<const uint8_t *> src;
+  src.reserve(static_cast<size_t>(count) + 1);
+  int first = y;
+  if (pending_) {
+    src.push_back(pending_);
+    pending_ = nullptr;
+    --first;
+  }
+  for (int i = 0; i < count; ++i) {
+    src.push_back(rows + static_cast<size_t>(i) * stride);
+  }
+  const bool last_band = y + count == height_;
+  if (src.size() % 2 != 0 && !last_band) {
+    pending_ = src.back();
+    src.pop_back();
+  }
+  if (src.empty()) {
+    return true;
+  }
+
+  const int n = static_cast<int>(src.size());
+  const int pairs = (n + 1) / 2;
+  const size_t pitch = planes_.luma_pitch;
+  const size_t cpitch = planes_.chroma_pitch;
+  const bool nv12 = layout_ == PixelFormat::kNv12;
+  uint8_t *const u_plane = chroma_.data();
+  uint8_t *const v_plane = nv12 ? u_plane + 1
+                                : u_plane + planes_.v_offset -
+                                      planes_.u_offset;
+  std::vector<uint8_t> band(pitch * static_cast<size_t>(n));
+  const size_t pair_bytes = static_cast<size_t>(width_) * 8;
+  ParallelForRows(pairs, pair_bytes, [&](int part, int p0, int p1) {
+    (void)part;
+    for (int p = p0; p < p1; ++p) {
+      const int i = p * 2;
+      const bool odd = i + 1 == n;
+      const size_t crow = static_cast<size_t>((first + i) / 2) * cpitch;
+      uint8_t *luma = band.data() + static_cast<size_t>(i) * pitch;
+      ConvertYuv420Rows(src[i], src[odd ? i : i + 1], width_, yuv_, luma,
+                        odd ? nullptr : luma + pitch, u_plane + crow,
+                        v_plane + crow, nv12 ? 2 : 1);
+    }
+  });
+  return out_->WriteOwned(std::move(band), err);
+}
+
+bool RawRowEncoder::Finish(ErrorInfo *err) {
+  if (!IsYuv420(layout_)) {
+    return true;
+  }
+  return out_->WriteOwned(std::move(chroma_), err);
+}
+
+bool WriteRawFrame(const ImageView &img, const std::string &format,
+                   ByteSink *sink, RawFrameInfo *info, ErrorInfo *err) {
+  RawRowEncoder enc(format, sink, info);
+  return WriteImageRows(img, &enc, err);
+}
+
+bool WriteRawSidecar(const std::string &out_path, bool overwrite,
+                     const RawFrameInfo &info, ErrorInfo *err) {
+  const std::string sidecar = RawFrameInfoJson(info) + "\n";
+  return WriteFileBytes(RawSidecarPath(out_path), overwrite, sidecar.data(),
+                        sidecar.size(), err);
+}
+
+bool SaveRawFrame(const ImageView &img, const std::string &format,
+                  const std::string &out_path, bool overwrite,
+                  RawFrameInfo *info, ErrorInfo *err) {
+  OutputFile file;
+  if (!file.Open(out_path, overwrite, err)) {
+    return false;
+  }
+  if (!WriteRawFrame(img, format, &file, info, err) || !file.Close(err)) {
+    return false;
+  }
+  if (format != "raw") {
+    return true;
+  }
+  return WriteRawSidecar(out_path, overwrite, *info, err);
+}
+
+std::string RawSidecarPath(const std::string &out_path) {
+  return out_path + ".json";
+}
+
+std::string RawFrameInfoJson(const RawFrameInfo &info) {
+  std::ostringstream oss;
+  oss << "{\"width\":" << info.width << ",\"height\":" << info.height
+      << ",\"pitch\":" << info.pitch << ",\"origin_x\":" << info.origin_x
+      << ",\"origin_y\":" << info.origin_y << ",\"pixel_layout\":\""
+      << info.pixel_layout << "\",\"data_offset\":" << info.data_offset;
+  if (info.chroma_pitch > 0) {
+    oss << ",\"chroma_pitch\":" << info.chroma_pitch
+        << ",\"u_offset\":" << info.u_offset
+        << ",\"v_offset\":" << info.v_offset << ",\"yuv_matrix\":\""
+        << info.yuv_matrix << "\",\"yuv_range\":\"" << info.yuv_range
+        << '"';
+  }
+  oss << '}';
+  return oss.str();
+}
+
+bool ParseRawFrameInfoJson(const std::string &json, RawFrameInfo *info,
+                           ErrorInfo *err) {
+  long long width = 0;
+  long long height = 0;
+  long long pitch = 0;
+  long long origin_x = 0;
+  long long origin_y = 0;
+  long long data_offset = 0;
+  RawFrameInfo r;
+  if (!JsonInt(json, "width", &width) || !JsonInt(json, "height", &height) ||
+      !JsonInt(json, "pitch", &pitch) ||
+      !JsonInt(json, "origin_x", &origin_x) ||
+      !JsonInt(json, "origin_y", &origin_y) ||
+      !JsonString(json, "pixel_layout", &r.pixel_layout) ||
+      !JsonInt(json, "data_offset", &data_offset)) {
+    *err = ErrorInfo{"malformed raw sidecar", "ParseRawFrameInfoJson",
+                     std::nullopt, std::nullopt};
+    return false;
+  }
+  constexpr long long kMaxDim = 1 << 16;
+  PixelFormat layout = PixelFormat::kBgra8;
+  if (!ParsePixelFormat(r.pixel_layout.c_str(), &layout) || width <= 0 ||
+      height <= 0 || width > kMaxDim || height > kMaxDim ||
+      pitch < width * PixelFormatBytes(layout) || data_offset < 0) {
+    *err = ErrorInfo{"invalid raw sidecar layout", "ParseRawFrameInfoJson",
+                     std::nullopt, std::nullopt};
+    return false;
+  }
+  r.width = static_cast<int>(width);
+  r.height = static_cast<int>(height);
+  r.pitch = static_cast<int>(pitch);
+  r.origin_x = static_cast<int>(origin_x);
+  r.origin_y = static_cast<int>(origin_y);
+  r.data_offset = static_cast<size_t>(data_offset);
+  if (IsYuv420(layout)) {
+    long long chroma_pitch = 0;
+    long long u_offset = 0;
+    long long v_offset = 0;
+    if (!JsonInt(json, "chroma_pitch", &chroma_pitch) ||
+        !JsonInt(json, "u_offset", &u_offset) ||
+        !JsonInt(json, "v_offset", &v_offset) || chroma_pitch <= 0 ||
+        u_offset < 0 || v_offset < 0) {
+      *err = ErrorInfo{"invalid raw sidecar chroma layout",
+                       "ParseRawFrameInfoJson", std::nullopt, std::nullopt};
+      return false;
+    }
+    r.chroma_pitch = static_cast<int>(chroma_pitch);
+    r.u_offset = static_cast<size_t>(u_offset);
+    r.v_offset = static_cast<size_t>(v_offset);
+    JsonString(json, "yuv_matrix", &r.yuv_matrix);
+    JsonString(json, "yuv_range", &r.yuv_range);
+  }
+  *info = std::move(r);
+  return true;
+}
+
+bool ReadRawFrame(const std::string &path, ImageBuffer *img,
+                  RawFrameInfo *info, ErrorInfo *err) {
+  std::ifstream sidecar(PathFromUtf8(RawSidecarPath(path)), std::ios::binary);
+  if (!sidecar) {
+    *err = ErrorInfo{"cannot open sidecar: " + RawSidecarPath(path),
+                     "ReadRawFrame", std::nullopt, std::nullopt};
+    return false;
+  }
+  const std::string json((std::istreambuf_iterator<char>(sidecar)),
+                         std::istreambuf_iterator<char>());
+  if (!ParseRawFrameInfoJson(json, info, err)) {
+    return false;
+  }
+  if (info->pixel_layout != "bgra8") {
+    *err = ErrorInfo{"unsupported pixel_layout: " + info->pixel_layout,
+                     "ReadRawFrame", std::nullopt, std::nullopt};
+    return false;
+  }
+
+  std::ifstream in(PathFromUtf8(path), std::ios::binary);
+  if (!in) {
+    *err = ErrorInfo{"cannot open: " + path, "ReadRawFrame", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  // The sidecar is not trusted to size the allocation: the layout it
+  // describes must fit in the data file before any pixels are allocated.
+  const size_t row_bytes = static_cast<size_t>(info->width) * 4;
+  in.seekg(0, std::ios::end);
+  const std::streamoff file_size = in.tellg();
+  const uint64_t needed =
+      static_cast<uint64_t>(info->height - 1) *
+          static_cast<uint64_t>(info->pitch) +
+      row_bytes;
+  if (file_size < 0 ||
+      info->data_offset > static_cast<uint64_t>(file_size) ||
+      needed > static_cast<uint64_t>(file_size) - info->data_offset) {
+    *err = ErrorInfo{"raw frame is shorter than its sidecar says",
+                     "ReadRawFrame", std::nullopt, std::nullopt};
+    return false;
+  }
+  AllocateImage(info->width, info->height, img);
+  img->origin_x = info->origin_x;
+  img->origin_y = info->origin_y;
+  const std::streamoff gap =
+      static_cast<std::streamoff>(info->pitch) -
+      static_cast<std::streamoff>(row_bytes);
+  in.seekg(static_cast<std::streamoff>(info->data_offset));
+  for (int y = 0; y < info->height; ++y) {
+    if (y > 0 && gap > 0) {
+      in.seekg(gap, std::ios::cur);
+    }
+    in.read(reinterpret_cast<char *>(img->bgra.data()) +
+                static_cast<size_t>(y) * img->row_pitch,
+            static_cast<std::streamsize>(row_bytes));
+    if (!in) {
+      *err = ErrorInfo{"raw frame is shorter than its sidecar says",
+                       "ReadRawFrame", std::nullopt, std::nullopt};
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace sc
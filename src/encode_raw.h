@@ -0,0 +1,101 @@
+#pragma once
+
+#include "output_file.h"
+#include "pixel_format.h"
+#include "row_sink.h"
+#include "types.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+// Layout of an uncompressed frame file, reported so consumers can mmap the
+// file and index pixels without parsing it.
+struct RawFrameInfo {
+  int width = 0;
+  int height = 0;
+  int pitch = 0; // bytes between rows in the file (luma rows for 4:2:0)
+  int origin_x = 0;
+  int origin_y = 0;
+  std::string pixel_layout; // a PixelFormatName
+  size_t data_offset = 0;   // first pixel byte in the file
+  // nv12 and i420 only: where the chroma follows the luma plane (offsets
+  // from data_offset; v_offset is u_offset + 1 in interleaved nv12) and
+  // how it was derived.
+  int chroma_pitch = 0;
+  size_t u_offset = 0;
+  size_t v_offset = 0;
+  std::string yuv_matrix;
+  std::string yuv_range;
+};
+
+bool IsRawFormat(const std::string &format);
+
+// Writes rows in one of the uncompressed formats, band by band:
+//   raw: tightly packed rows in `pixel_format` (bands that are already
+//        packed in it are written straight from the source); for nv12 and i420
+//        the luma rows are streamed and the chroma planes, filled in as row
+//        pairs arrive, are written by Finish
+//   pam: P7 RGB_ALPHA
+//   ppm: P6 RGB, alpha dropped
+// Each band is converted on the parallel row pool as it arrives. `info` is
+// filled in by BeginImage.
+class RawRowEncoder : public RowSink {
+public:
+  RawRowEncoder(const std::string &format, ByteSink *out, RawFrameInfo *info,
+                PixelFormat pixel_format = PixelFormat::kBgra8,
+                const YuvOptions &yuv = YuvOptions{});
+  bool BeginImage(const RowImageInfo &info, ErrorInfo *err) override;
+  bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                 ErrorInfo *err) override;
+  bool Finish(ErrorInfo *err) override;
+
+private:
+  bool WriteYuvRows(int y, int count, const uint8_t *rows, size_t stride,
+                    ErrorInfo *err);
+
+  std::string format_;
+  ByteSink *out_;
+  RawFrameInfo *info_;
+  PixelFormat pixel_format_;
+  YuvOptions yuv_;
+  PixelFormat layout_ = PixelFormat::kBgra8; // what the file holds
+  PixelFormat source_ = PixelFormat::kBgra8; // what WriteRows receives
+  PackRowFn convert_ = nullptr;
+  int width_ = 0;
+  int height_ = 0;
+  PlaneLayout planes_;
+  std::vector<uint8_t> chroma_;
+  const uint8_t *pending_ = nullptr; // 4:2:0 row still waiting for its pair
+};
+
+// Pixel layout `format` stores: `pixel_format` for raw, rgba8 for pam and
+// rgb8 for ppm.
+PixelFormat RawLayoutOf(const std::string &format, PixelFormat pixel_format);
+
+// Saves `img` to `out_path`; "raw" also gets a "<out_path>.json" sidecar
+// describing the layout.
+bool SaveRawFrame(const ImageView &img, const std::string &format,
+                  const std::string &out_path, bool overwrite,
+                  RawFrameInfo *info, ErrorInfo *err);
+// Writes just the frame bytes to `sink`; no sidecar is produced, the caller
+// reports `info` instead.
+bool WriteRawFrame(const ImageView &img, const std::string &format,
+                   ByteSink *sink, RawFrameInfo *info, ErrorInfo *err);
+
+bool WriteRawSidecar(const std::string &out_path, bool overwrite,
+                     const RawFrameInfo &info, ErrorInfo *err);
+std::string RawSidecarPath(const std::string &out_path);
+std::string RawFrameInfoJson(const RawFrameInfo &info);
+// Reads a sidecar written by RawFrameInfoJson.
+bool ParseRawFrameInfoJson(const std::string &json, RawFrameInfo *info,
+                           ErrorInfo *err);
+
+// Loads a bgra8 "raw" frame written by SaveRawFrame, using its sidecar for
+// the layout, into `img` (origin included).
+bool ReadRawFrame(const std::string &path, ImageBuffer *img,
+                  RawFrameInfo *info, ErrorInfo *err);
+
+} // namespace sc
@@ -6,8 +6,45 @@
 
 namespace sc {
 
-bool SavePngWic(const ImageBuffer &img, const std::wstring &out_path,
+namespace {
+
+struct WicFactory {
+  HRESULT hr = S_OK;
+  const char *what = nullptr; // the call that failed
+  Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+};
+
+// The factory is free-threaded and costs more to create than a small PNG
+// takes to encode, so one is kept for the process. The COM reference taken
+// with it is never released, which keeps it valid after callers
+// uninitialise COM.
+const WicFactory &GetWicFactory() {
+  static const WicFactory wic = [] {
+    WicFactory w;
+    w.hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    if (FAILED(w.hr) && w.hr != RPC_E_CHANGED_MODE) {
+      w.what = "CoInitializeEx failed";
+      return w;
+    }
+    w.hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr,
+                            CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&w.factory));
+    if (FAILED(w.hr)) {
+      w.what = "CoCreateInstance IWICImagingFactory failed";
+    }
+    return w;
+  }();
+  return wic;
+}
+
+} // namespace
+
+bool SavePngWic(const ImageView &img, const std::wstring &out_path,
                 bool overwrite, ErrorInfo *err) {
+  if (!img.Valid()) {
+    *err = ErrorInfo{"invalid image buffer", "SavePngWic", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
   if (!overwrite) {
     DWORD attrs = GetFileAttributesW(out_path.c_str());
     if (attrs != INVALID_FILE_ATTRIBUTES) {
@@ -29,16 +66,15 @@ bool SavePngWic(const ImageBuffer &img, const std::wstring &out_path,
     return false;
   }
 
-  Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
-  hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
-                        IID_PPV_ARGS(&factory));
-  if (FAILED(hr)) {
-    *err = ErrorInfo{"CoCreateInstance IWICImagingFactory failed", "SavePngWic",
-                     static_cast<uint32_t>(hr), std::nullopt};
+  const WicFactory &wic = GetWicFactory();
+  if (wic.what) {
+    *err = ErrorInfo{wic.what, "SavePngWic", static_cast<uint32_t>(wic.hr),
+                     std::nullopt};
     if (need_uninit)
       CoUninitialize();
     return false;
   }
+  IWICImagingFactory *const factory = wic.factory.Get();
 
   Microsoft::WRL::ComPtr<IWICStream> stream;
   hr = factory->CreateStream(&stream);
@@ -118,9 +154,12 @@ bool SavePngWic(const ImageBuffer &img, const std::wstring &out_path,
     return false;
   }
 
-  hr = frame->WritePixels(
-      static_cast<UINT>(img.height), static_cast<UINT>(img.row_pitch),
-      static_cast<UINT>(img.bgra.size()), const_cast<BYTE *>(img.bgra.data()));
+  // Row by row, so a cropped view's parent stride never reaches WIC.
+  const UINT row_bytes = static_cast<UINT>(img.width) * 4;
+  for (int y = 0; y < img.height && SUCCEEDED(hr); ++y) {
+    hr = frame->WritePixels(1, row_bytes, row_bytes,
+                            const_cast<BYTE *>(img.Row(y)));
+  }
   if (FAILED(hr)) {
     *err = ErrorInfo{"WritePixels failed", "SavePngWic",
                      static_cast<uint32_t>(hr), std::nullopt};
@@ -4,7 +4,7 @@
 
 namespace sc {
 
-bool SavePngWic(const ImageBuffer &img, const std::wstring &out_path,
+bool SavePngWic(const ImageView &img, const std::wstring &out_path,
                 bool overwrite, ErrorInfo *err);
 
 } // namespace sc
@@ -0,0 +1,111 @@
+#include "frame_copy.h"
+
+#include "cpu_features.h"
+#include "parallel.h"
+
+#include <cstring>
+#include <vector>
+
+namespace sc {
+
+void CopyPixels(const ImageView &src, AlphaPolicy alpha, uint8_t *dst,
+                size_t dst_pitch, StatsAccum *stats, FullStatsAccum *full) {
+  const uint32_t alpha_or = alpha == AlphaPolicy::kForceOpaque ? 0xFF000000u
+                                                               : 0u;
+  const size_t row_bytes = static_cast<size_t>(src.width) * 4;
+  const CopyStatsRowFn kernel = CopyStatsRowKernel(ActiveSimdLevel());
+  const size_t bands = static_cast<size_t>(ParallelThreads());
+  std::vector<StatsAccum> parts(stats ? bands : 0);
+  std::vector<FullStatsAccum> full_parts(full ? bands : 0);
+  ParallelForRows(src.height, row_bytes, [&](int band, int y0, int y1) {
+    for (int y = y0; y < y1; ++y) {
+      uint8_t *row = dst + static_cast<size_t>(y) * dst_pitch;
+      if (stats) {
+        kernel(src.Row(y), src.width, alpha_or, row,
+               &parts[static_cast<size_t>(band)]);
+      } else {
+        memcpy(row, src.Row(y), row_bytes);
+        if (alpha_or) {
+          for (size_t x = 3; x < row_bytes; x += 4) {
+            row[x] = 0xFF;
+          }
+        }
+      }
+      // The row was just written and is still in L1.
+      if (full) {
+        FullStatsRow(row, src.width, &full_parts[static_cast<size_t>(band)]);
+      }
+    }
+  });
+  for (const StatsAccum &part : parts) {
+    AddStats(part, stats);
+  }
+  for (const FullStatsAccum &part : full_parts) {
+    AddFullStats(part, full);
+  }
+}
+
+bool DeliverFrame(const ImageView &src, AlphaPolicy alpha, FrameSink *sink,
+                  ImageBuffer *out, ErrorInfo *err) {
+  if (!src.Valid()) {
+    *err = ErrorInfo{"invalid frame", "DeliverFrame", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  if (sink) {
+    return sink->ReceiveFrame(src, alpha, err);
+  }
+  AllocateImage(src.width, src.height, out);
+  out->origin_x = src.origin_x;
+  out->origin_y = src.origin_y;
+  CopyPixels(src, alpha, out->bgra.data(),
+             static_cast<size_t>(out->row_pitch), nullptr, nullptr);
+  return true;
+}
+
+bool FrameSink::ReceiveHdrFrame(const HalfImageView &src,
+                                const ToneMapOptions &tone, ErrorInfo *err) {
+  ImageBuffer sdr;
+  ToneMapImage(src, tone, &sdr);
+  return ReceiveFrame(sdr, AlphaPolicy::kKeep, err);
+}
+
+bool DeliverHdrFrame(const HalfImageView &src, const ToneMapOptions &tone,
+                     FrameSink *sink, ImageBuffer *out, ErrorInfo *err) {
+  if (!src.Valid()) {
+    *err = ErrorInfo{"invalid frame", "DeliverHdrFrame", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  if (sink) {
+    return sink->ReceiveHdrFrame(src, tone, err);
+  }
+  ToneMapImage(src, tone, out);
+  return true;
+}
+
+ImageView MappedView(const void *data, size_t stride, int width, int height,
+                     int origin_x, int origin_y) {
+  ImageView v;
+  v.data = static_cast<const uint8_t *>(data);
+  v.width = width;
+  v.height = height;
+  v.stride = stride;
+  v.origin_x = origin_x;
+  v.origin_y = origin_y;
+  return v;
+}
+
+HalfImageView MappedHalfView(const void *data, size_t stride, int width,
+                             int height, int origin_x, int origin_y) {
+  HalfImageView v;
+  v.data = static_cast<const uint8_t *>(data);
+  v.width = width;
+  v.height = height;
+  v.stride = stride;
+  v.origin_x = origin_x;
+  v.origin_y = origin_y;
+  return v;
+}
+
+} // namespace sc
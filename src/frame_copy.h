@@ -0,0 +1,58 @@
+#pragma once
+
+#include "image_stats.h"
+#include "tone_map.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sc {
+
+enum class AlphaPolicy {
+  kKeep,        // copy alpha as captured
+  kForceOpaque, // set every alpha byte to 255
+};
+
+// Copies `src` into `dst` (`dst_pitch` bytes between rows, sized for
+// src.width x src.height) in one pass: alpha is fixed up on the way and the
+// copied pixels are added to `stats` and `full`, each optional. Crop by
+// passing a SubView of the source. Large copies are split across the
+// parallel row pool.
+void CopyPixels(const ImageView &src, AlphaPolicy alpha, uint8_t *dst,
+                size_t dst_pitch, StatsAccum *stats, FullStatsAccum *full);
+
+// Receives a captured frame while the backend still has it mapped. The sink
+// copies what it needs before returning; `src` is the whole captured
+// surface at its screen origin.
+class FrameSink {
+public:
+  virtual ~FrameSink() = default;
+  virtual bool ReceiveFrame(const ImageView &src, AlphaPolicy alpha,
+                            ErrorInfo *err) = 0;
+  // An scRGB frame from an HDR capture. The default tone-maps all of it to
+  // BGRA and hands that to ReceiveFrame; sinks that can crop first or keep
+  // 16 bits override it.
+  virtual bool ReceiveHdrFrame(const HalfImageView &src,
+                               const ToneMapOptions &tone, ErrorInfo *err);
+};
+
+// Hands the mapped frame `src` to `sink` when there is one, else copies it
+// whole into `out`.
+bool DeliverFrame(const ImageView &src, AlphaPolicy alpha, FrameSink *sink,
+                  ImageBuffer *out, ErrorInfo *err);
+
+// DeliverFrame for scRGB frames: ReceiveHdrFrame on `sink`, else the
+// tone-mapped frame in `out`.
+bool DeliverHdrFrame(const HalfImageView &src, const ToneMapOptions &tone,
+                     FrameSink *sink, ImageBuffer *out, ErrorInfo *err);
+
+// A view of `height` rows at `data`, `stride` bytes apart, at the given
+// screen origin.
+ImageView MappedView(const void *data, size_t stride, int width, int height,
+                     int origin_x, int origin_y);
+// The same for a mapped R16G16B16A16_FLOAT surface.
+HalfImageView MappedHalfView(const void *data, size_t stride, int width,
+                             int height, int origin_x, int origin_y);
+
+} // namespace sc
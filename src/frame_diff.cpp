@@ -0,0 +1,285 @@
+#include "frame_diff.h"
+
+#include "cpu_features.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#ifdef SC_X86
+#include <immintrin.h>
+#endif
+
+namespace sc {
+
+namespace {
+
+using CountEqualFn = int (*)(const uint8_t *a, const uint8_t *b, int width);
+
+int CountEqualScalar(const uint8_t *a, const uint8_t *b, int x, int width) {
+  int equal = 0;
+  for (; x < width; ++x) {
+    uint32_t pa;
+    uint32_t pb;
+    memcpy(&pa, a + x * 4, 4);
+    memcpy(&pb, b + x * 4, 4);
+    equal += pa == pb;
+  }
+  return equal;
+}
+
+int CountEqualRowScalar(const uint8_t *a, const uint8_t *b, int width) {
+  return CountEqualScalar(a, b, 0, width);
+}
+
+#ifdef SC_X86
+
+// The compare masks (-1 per equal pixel) are subtracted into per-lane
+// counters; a lane gains at most width / 4, far below overflow.
+SC_TARGET("sse2")
+int CountEqualRowSse2(const uint8_t *a, const uint8_t *b, int width) {
+  __m128i count = _mm_setzero_si128();
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i va =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x * 4));
+    const __m128i vb =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x * 4));
+    count = _mm_sub_epi32(count, _mm_cmpeq_epi32(va, vb));
+  }
+  alignas(16) int32_t lanes[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), count);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         CountEqualScalar(a, b, x, width);
+}
+
+SC_TARGET("avx2")
+int CountEqualRowAvx2(const uint8_t *a, const uint8_t *b, int width) {
+  __m256i count = _mm256_setzero_si256();
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m256i va =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + x * 4));
+    const __m256i vb =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + x * 4));
+    count = _mm256_sub_epi32(count, _mm256_cmpeq_epi32(va, vb));
+  }
+  alignas(32) int32_t lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), count);
+  int equal = 0;
+  for (int32_t l : lanes) {
+    equal += l;
+  }
+  return equal + CountEqualScalar(a, b, x, width);
+}
+
+#endif
+
+CountEqualFn CountEqualRowKernel(SimdLevel level) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kAvx2) {
+    return CountEqualRowAvx2;
+  }
+  if (level >= SimdLevel::kSse2) {
+    return CountEqualRowSse2;
+  }
+#else
+  (void)level;
+#endif
+  return CountEqualRowScalar;
+}
+
+Rect Intersect(const Rect &a, const Rect &b) {
+  Rect r{std::max(a.left, b.left), std::max(a.top, b.top),
+         std::min(a.right, b.right), std::min(a.bottom, b.bottom)};
+  return IsValidRect(r) ? r : Rect{};
+}
+
+uint64_t Area(const Rect &r) {
+  return IsValidRect(r) ? static_cast<uint64_t>(Width(r)) *
+                              static_cast<uint64_t>(Height(r))
+                        : 0;
+}
+
+// Merges dirty tiles into rectangles: runs of dirty tiles within a tile row,
+// extended downwards while the row below has a run with the same span.
+std::vector<Rect> MergeDirtyTiles(const std::vector<uint64_t> &changed,
+                                  int tiles_x, int tiles_y, int tile,
+                                  const Rect &area) {
+  struct Open {
+    int x0, x1, y0;
+    bool extended;
+  };
+  std::vector<Rect> rects;
+  std::vector<Open> open;
+  auto close = [&](const Open &o, int y1) {
+    rects.push_back(Rect{area.left + o.x0 * tile, area.top + o.y0 * tile,
+                         std::min(area.left + o.x1 * tile, area.right),
+                         std::min(area.top + y1 * tile, area.bottom)});
+  };
+  for (int ty = 0; ty <= tiles_y; ++ty) {
+    for (Open &o : open) {
+      o.extended = false;
+    }
+    std::vector<Open> started;
+    for (int tx = 0; ty < tiles_y && tx < tiles_x;) {
+      if (changed[static_cast<size_t>(ty) * tiles_x + tx] == 0) {
+        ++tx;
+        continue;
+      }
+      const int x0 = tx;
+      while (tx < tiles_x &&
+             changed[static_cast<size_t>(ty) * tiles_x + tx] != 0) {
+        ++tx;
+      }
+      auto it = std::find_if(open.begin(), open.end(), [&](const Open &o) {
+        return o.x0 == x0 && o.x1 == tx;
+      });
+      if (it != open.end()) {
+        it->extended = true;
+      } else {
+        started.push_back(Open{x0, tx, ty, true});
+      }
+    }
+    std::vector<Open> kept;
+    for (const Open &o : open) {
+      if (o.extended) {
+        kept.push_back(o);
+      } else {
+        close(o, ty);
+      }
+    }
+    kept.insert(kept.end(), started.begin(), started.end());
+    open = std::move(kept);
+  }
+  std::stable_sort(rects.begin(), rects.end(), [](const Rect &l, const Rect &r) {
+    return l.top != r.top ? l.top < r.top : l.left < r.left;
+  });
+  return rects;
+}
+
+} // namespace
+
+bool DiffFrames(const ImageView &a, const ImageView &b, const DiffOptions &opt,
+                FrameDiff *out, ErrorInfo *err) {
+  if (!a.Valid() || !b.Valid()) {
+    *err = ErrorInfo{"invalid frame", "DiffFrames", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  if (opt.tile_size <= 0) {
+    *err = ErrorInfo{"invalid tile size", "DiffFrames", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  const int ax = opt.ignore_origin ? 0 : a.origin_x;
+  const int ay = opt.ignore_origin ? 0 : a.origin_y;
+  const int bx = opt.ignore_origin ? 0 : b.origin_x;
+  const int by = opt.ignore_origin ? 0 : b.origin_y;
+  const Rect ra{ax, ay, ax + a.width, ay + a.height};
+  const Rect rb{bx, by, bx + b.width, by + b.height};
+  const Rect area{std::min(ra.left, rb.left), std::min(ra.top, rb.top),
+                  std::max(ra.right, rb.right),
+                  std::max(ra.bottom, rb.bottom)};
+  const Rect common = Intersect(ra, rb);
+  const int tile = opt.tile_size;
+
+  FrameDiff d;
+  d.area = area;
+  d.tile_size = tile;
+  d.tiles_x = (Width(area) + tile - 1) / tile;
+  d.tiles_y = (Height(area) + tile - 1) / tile;
+  d.total_pixels = Area(ra) + Area(rb) - Area(common);
+
+  // Changed pixels per tile, starting with those only one frame covers.
+  std::vector<uint64_t> changed(static_cast<size_t>(d.tiles_x) * d.tiles_y);
+  for (int ty = 0; ty < d.tiles_y; ++ty) {
+    for (int tx = 0; tx < d.tiles_x; ++tx) {
+      const Rect t{area.left + tx * tile, area.top + ty * tile,
+                   area.left + (tx + 1) * tile, area.top + (ty + 1) * tile};
+      changed[static_cast<size_t>(ty) * d.tiles_x + tx] =
+          Area(Intersect(t, ra)) + Area(Intersect(t, rb)) -
+          2 * Area(Intersect(t, common));
+    }
+  }
+
+  if (IsValidRect(common)) {
+    const CountEqualFn count_equal = CountEqualRowKernel(ActiveSimdLevel());
+    const size_t common_bytes = static_cast<size_t>(Width(common)) * 4;
+    const int tx0 = (common.left - area.left) / tile;
+    const int tx1 = (common.right - area.left + tile - 1) / tile;
+    const int ty0 = (common.top - area.top) / tile;
+    const int ty1 = (common.bottom - area.top + tile - 1) / tile;
+    // Each band owns whole tile rows, so the counts need no merging.
+    ParallelForRows(
+        ty1 - ty0, common_bytes * 2 * static_cast<size_t>(tile),
+        [&](int band, int r0, int r1) {
+          (void)band;
+          for (int ty = ty0 + r0; ty < ty0 + r1; ++ty) {
+            uint64_t *row_changed =
+                changed.data() + static_cast<size_t>(ty) * d.tiles_x;
+            const int y0 = std::max(area.top + ty * tile, common.top);
+            const int y1 = std::min(area.top + (ty + 1) * tile, common.bottom);
+            for (int y = y0; y < y1; ++y) {
+              const uint8_t *pa = a.Row(y - ay) +
+                                  static_cast<size_t>(common.left - ax) * 4;
+              const uint8_t *pb = b.Row(y - by) +
+                                  static_cast<size_t>(common.left - bx) * 4;
+              if (memcmp(pa, pb, common_bytes) == 0) {
+                continue;
+              }
+              for (int tx = tx0; tx < tx1; ++tx) {
+                const int x0 = std::max(area.left + tx * tile, common.left);
+                const int x1 =
+                    std::min(area.left + (tx + 1) * tile, common.right);
+                const size_t off = static_cast<size_t>(x0 - common.left) * 4;
+                const size_t len = static_cast<size_t>(x1 - x0) * 4;
+                if (memcmp(pa + off, pb + off, len) != 0) {
+                  row_changed[tx] += static_cast<uint64_t>(
+                      (x1 - x0) - count_equal(pa + off, pb + off, x1 - x0));
+                }
+              }
+            }
+          }
+        });
+  }
+
+  for (uint64_t c : changed) {
+    d.changed_pixels += c;
+    d.dirty_tiles += c != 0;
+  }
+  d.changed_ratio = d.total_pixels
+                        ? static_cast<double>(d.changed_pixels) /
+                              static_cast<double>(d.total_pixels)
+                        : 0.0;
+  d.dirty_rects = MergeDirtyTiles(changed, d.tiles_x, d.tiles_y, tile, area);
+  *out = std::move(d);
+  return true;
+}
+
+std::string FrameDiffJson(const FrameDiff &diff) {
+  auto rect_json = [](std::ostringstream &oss, const Rect &r) {
+    oss << "{\"left\":" << r.left << ",\"top\":" << r.top
+        << ",\"right\":" << r.right << ",\"bottom\":" << r.bottom << '}';
+  };
+  std::ostringstream oss;
+  oss << "{\"identical\":" << (diff.identical() ? "true" : "false")
+      << ",\"area\":";
+  rect_json(oss, diff.area);
+  oss << ",\"tile_size\":" << diff.tile_size << ",\"tiles_x\":" << diff.tiles_x
+      << ",\"tiles_y\":" << diff.tiles_y
+      << ",\"dirty_tiles\":" << diff.dirty_tiles
+      << ",\"changed_pixels\":" << diff.changed_pixels
+      << ",\"total_pixels\":" << diff.total_pixels
+      << ",\"changed_ratio\":" << diff.changed_ratio << ",\"dirty_rects\":[";
+  for (size_t i = 0; i < diff.dirty_rects.size(); ++i) {
+    if (i)
+      oss << ',';
+    rect_json(oss, diff.dirty_rects[i]);
+  }
+  oss << "]}";
+  return oss.str();
+}
+
+} // namespace sc
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+constexpr int kDiffTileSize = 32;
+
+struct DiffOptions {
+  int tile_size = kDiffTileSize;
+  // Align the frames by their top-left corners instead of by origin_x/y,
+  // e.g. for two captures of a window that moved in between.
+  bool ignore_origin = false;
+};
+
+// What changed between two BGRA frames. The frames are placed in a shared
+// coordinate space (the desktop, via origin_x/y, unless ignore_origin) and
+// `area`, the bounding box of both, is split into tiles. Pixels covered by
+// only one of the frames count as changed.
+struct FrameDiff {
+  Rect area;
+  int tile_size = 0;
+  int tiles_x = 0;
+  int tiles_y = 0;
+  int dirty_tiles = 0;
+  uint64_t changed_pixels = 0;
+  uint64_t total_pixels = 0; // pixels covered by either frame
+  double changed_ratio = 0.0;
+  // Dirty tiles merged into rectangles (same coordinates as `area`, clipped
+  // to it), top to bottom.
+  std::vector<Rect> dirty_rects;
+
+  bool identical() const { return changed_pixels == 0; }
+};
+
+// Compares `a` and `b` tile by tile. Rows of a tile are checked with memcmp
+// and only differing rows are counted pixel by pixel, so identical regions
+// cost one streaming read of each frame. Tile rows are spread over the
+// parallel row pool.
+bool DiffFrames(const ImageView &a, const ImageView &b, const DiffOptions &opt,
+                FrameDiff *out, ErrorInfo *err);
+
+std::string FrameDiffJson(const FrameDiff &diff);
+
+} // namespace sc
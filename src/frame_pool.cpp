@@ -0,0 +1,268 @@
+#include "frame_pool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace sc {
+
+namespace {
+
+// How a block was obtained, stored in PixelBuffer::kind_.
+enum BlockKind : uint8_t {
+  kNone = 0,
+  kHeap = 1,       // aligned operator new
+  kMapped = 2,     // mmap / VirtualAlloc, page granular
+  kLargePages = 3, // VirtualAlloc(MEM_LARGE_PAGES)
+};
+
+// Blocks at least this big are mapped straight from the OS, rounded to
+// this granularity so that frames of nearly the same size share blocks.
+constexpr size_t kMapThreshold = size_t{2} << 20;
+
+// A cached block is reused for a request that needs at least this share of
+// it; smaller requests would pin too much memory.
+constexpr size_t kReuseSlackDivisor = 2;
+
+struct Block {
+  uint8_t *data = nullptr;
+  size_t capacity = 0;
+  uint8_t kind = kNone;
+};
+
+size_t RoundUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+#ifdef _WIN32
+
+size_t LargePageSize() {
+  static const size_t size = GetLargePageMinimum();
+  return size;
+}
+
+// MEM_LARGE_PAGES needs SeLockMemoryPrivilege enabled in the process token.
+bool EnableLockMemoryPrivilege() {
+  HANDLE token = nullptr;
+  if (!OpenProcessToken(GetCurrentProcess(),
+                        TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+    return false;
+  }
+  TOKEN_PRIVILEGES tp{};
+  tp.PrivilegeCount = 1;
+  tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+  bool ok = LookupPrivilegeValueW(nullptr, L"SeLockMemoryPrivilege",
+                                  &tp.Privileges[0].Luid) &&
+            AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) &&
+            GetLastError() == ERROR_SUCCESS;
+  CloseHandle(token);
+  return ok;
+}
+
+#endif
+
+class FramePool {
+public:
+  void Configure(const FramePoolOptions &opt) {
+    std::lock_guard<std::mutex> lock(mu_);
+    opt_ = opt;
+#ifdef _WIN32
+    large_pages_ok_ =
+        opt.huge_pages && LargePageSize() != 0 && EnableLockMemoryPrivilege();
+#endif
+    TrimLocked(opt_.max_cached_bytes);
+  }
+
+  Block Acquire(size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      // Best fit among cached blocks that are not oversized for `size`.
+      size_t best = free_.size();
+      for (size_t i = 0; i < free_.size(); ++i) {
+        const size_t cap = free_[i].capacity;
+        if (cap >= size && cap / kReuseSlackDivisor <= size &&
+            (best == free_.size() || cap < free_[best].capacity)) {
+          best = i;
+        }
+      }
+      if (best != free_.size()) {
+        Block b = free_[best];
+        free_[best] = free_.back();
+        free_.pop_back();
+        cached_bytes_ -= b.capacity;
+        return b;
+      }
+    }
+    return AllocateFromOs(size);
+  }
+
+  void Release(Block b) {
+    if (!b.data) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (b.capacity <= opt_.max_cached_bytes) {
+        TrimLocked(opt_.max_cached_bytes - b.capacity);
+        free_.push_back(b);
+        cached_bytes_ += b.capacity;
+        return;
+      }
+    }
+    FreeToOs(b);
+  }
+
+private:
+  // Drops cached blocks, oldest first, until at most `limit` bytes remain.
+  void TrimLocked(size_t limit) {
+    size_t drop = 0;
+    while (cached_bytes_ > limit && drop < free_.size()) {
+      cached_bytes_ -= free_[drop].capacity;
+      FreeToOs(free_[drop]);
+      ++drop;
+    }
+    free_.erase(free_.begin(), free_.begin() + static_cast<ptrdiff_t>(drop));
+  }
+
+  Block AllocateFromOs(size_t size) {
+    Block b;
+    if (size < kMapThreshold) {
+      b.capacity = RoundUp(std::max<size_t>(size, 1), kPixelAlignment);
+      b.data = static_cast<uint8_t *>(
+          ::operator new(b.capacity, std::align_val_t{kPixelAlignment}));
+      b.kind = kHeap;
+      return b;
+    }
+    b.capacity = RoundUp(size, kMapThreshold);
+#ifdef _WIN32
+    bool large = false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      large = large_pages_ok_;
+    }
+    if (large) {
+      const size_t cap = RoundUp(size, LargePageSize());
+      void *p = VirtualAlloc(nullptr, cap,
+                             MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                             PAGE_READWRITE);
+      if (p) {
+        b.data = static_cast<uint8_t *>(p);
+        b.capacity = cap;
+        b.kind = kLargePages;
+        return b;
+      }
+    }
+    void *p = VirtualAlloc(nullptr, b.capacity, MEM_RESERVE | MEM_COMMIT,
+                           PAGE_READWRITE);
+    if (!p) {
+      throw std::bad_alloc();
+    }
+#else
+    void *p = mmap(nullptr, b.capacity, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    bool huge = false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      huge = opt_.huge_pages;
+    }
+    if (huge) {
+      madvise(p, b.capacity, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+    b.data = static_cast<uint8_t *>(p);
+    b.kind = kMapped;
+    return b;
+  }
+
+  static void FreeToOs(const Block &b) {
+    switch (b.kind) {
+    case kHeap:
+      ::operator delete(b.data, std::align_val_t{kPixelAlignment});
+      break;
+    case kMapped:
+    case kLargePages:
+#ifdef _WIN32
+      VirtualFree(b.data, 0, MEM_RELEASE);
+#else
+      munmap(b.data, b.capacity);
+#endif
+      break;
+    default:
+      break;
+    }
+  }
+
+  std::mutex mu_;
+  FramePoolOptions opt_;
+  bool large_pages_ok_ = false;
+  std::vector<Block> free_; // oldest first
+  size_t cached_bytes_ = 0;
+};
+
+// Never destroyed: buffers in static storage may be released after main.
+FramePool &Pool() {
+  static FramePool *pool = new FramePool();
+  return *pool;
+}
+
+} // namespace
+
+void ConfigureFramePool(const FramePoolOptions &opt) { Pool().Configure(opt); }
+
+PixelBuffer::PixelBuffer(PixelBuffer &&other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      capacity_(std::exchange(other.capacity_, 0)),
+      kind_(std::exchange(other.kind_, kNone)) {}
+
+PixelBuffer &PixelBuffer::operator=(PixelBuffer &&other) noexcept {
+  if (this != &other) {
+    Reset();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    capacity_ = std::exchange(other.capacity_, 0);
+    kind_ = std::exchange(other.kind_, kNone);
+  }
+  return *this;
+}
+
+PixelBuffer::~PixelBuffer() { Reset(); }
+
+void PixelBuffer::Allocate(size_t size) {
+  if (data_ && capacity_ >= size && capacity_ / kReuseSlackDivisor <= size) {
+    size_ = size;
+    return;
+  }
+  Reset();
+  if (size == 0) {
+    return;
+  }
+  const Block b = Pool().Acquire(size);
+  data_ = b.data;
+  size_ = size;
+  capacity_ = b.capacity;
+  kind_ = b.kind;
+}
+
+void PixelBuffer::Reset() {
+  Pool().Release(Block{data_, capacity_, kind_});
+  data_ = nullptr;
+  size_ = 0;
+  capacity_ = 0;
+  kind_ = kNone;
+}
+
+} // namespace sc
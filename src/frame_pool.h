@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sc {
+
+// Start of every pixel buffer and of every row inside it.
+constexpr size_t kPixelAlignment = 64;
+
+struct FramePoolOptions {
+  // Back large buffers with huge pages where the OS allows it: transparent
+  // huge pages on Linux, MEM_LARGE_PAGES on Windows (needs the "Lock pages
+  // in memory" privilege). Falls back to normal pages silently.
+  bool huge_pages = false;
+  // Freed buffers kept for reuse; beyond this they go back to the OS.
+  size_t max_cached_bytes = size_t{512} << 20;
+};
+
+void ConfigureFramePool(const FramePoolOptions &opt);
+
+// Move-only pixel storage from the frame pool. Allocate() hands out
+// 64-byte-aligned memory that is NOT initialised, so capture paths pay
+// neither for zero-filling nor, once the pool is warm, for page faults.
+// The memory returns to the pool when the buffer is destroyed or replaced.
+class PixelBuffer {
+public:
+  PixelBuffer() = default;
+  PixelBuffer(const PixelBuffer &) = delete;
+  PixelBuffer &operator=(const PixelBuffer &) = delete;
+  PixelBuffer(PixelBuffer &&other) noexcept;
+  PixelBuffer &operator=(PixelBuffer &&other) noexcept;
+  ~PixelBuffer();
+
+  void Allocate(size_t size);
+  void Reset();
+
+  uint8_t *data() { return data_; }
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+private:
+  uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+  uint8_t kind_ = 0; // how the block was allocated, see frame_pool.cpp
+};
+
+// Bytes per row for `width` BGRA pixels, padded so every row starts on a
+// kPixelAlignment boundary.
+inline int AlignedRowPitch(int width) {
+  const size_t a = kPixelAlignment;
+  return static_cast<int>((static_cast<size_t>(width) * 4 + a - 1) / a * a);
+}
+
+} // namespace sc
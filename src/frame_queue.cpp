@@ -0,0 +1,139 @@
+#include "frame_queue.h"
+
+#include <algorithm>
+
+namespace sc {
+
+FrameQueue::FrameQueue(int capacity)
+    : capacity_(static_cast<size_t>(std::max(capacity, 1))),
+      cell_count_(std::max<size_t>(capacity_, 2)),
+      cells_(new Cell[cell_count_]) {
+  for (size_t i = 0; i < cell_count_; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+// A cell is free for the push at `pos` when its sequence equals `pos`, and
+// holds the frame for the pop at `pos` when it equals `pos + 1`. A pop
+// hands the cell on to the push one lap later by setting it to
+// `pos + cell_count_`.
+bool FrameQueue::TryPush(StagedFrame *frame) {
+  size_t pos = tail_.load(std::memory_order_relaxed);
+  Cell *cell = nullptr;
+  for (;;) {
+    cell = &cells_[pos % cell_count_];
+    const size_t seq = cell->sequence.load(std::memory_order_acquire);
+    const auto diff =
+        static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      // Only a queue with a spare cell can have a free cell while full.
+      if (cell_count_ > capacity_ &&
+          pos - head_.load(std::memory_order_acquire) >= capacity_) {
+        return false;
+      }
+      if (tail_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false; // the pop a lap behind has not freed the cell yet
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+  cell->frame = frame;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  RecordDepth();
+  pushed_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_all();
+  return true;
+}
+
+StagedFrame *FrameQueue::TryPop() {
+  size_t pos = head_.load(std::memory_order_relaxed);
+  Cell *cell = nullptr;
+  for (;;) {
+    cell = &cells_[pos % cell_count_];
+    const size_t seq = cell->sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::ptrdiff_t>(seq) -
+                      static_cast<std::ptrdiff_t>(pos + 1);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return nullptr; // nothing pushed here yet
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+  StagedFrame *frame = cell->frame;
+  cell->sequence.store(pos + cell_count_, std::memory_order_release);
+  popped_.fetch_add(1, std::memory_order_release);
+  popped_.notify_all();
+  return frame;
+}
+
+// Both waits read the counter before trying, so a pop or push that lands
+// between the failed try and the wait changes it and the wait returns.
+bool FrameQueue::Push(StagedFrame *frame) {
+  for (;;) {
+    const uint32_t seen = popped_.load(std::memory_order_acquire);
+    if (closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (TryPush(frame)) {
+      return true;
+    }
+    popped_.wait(seen, std::memory_order_acquire);
+  }
+}
+
+StagedFrame *FrameQueue::Pop() {
+  for (;;) {
+    const uint32_t seen = pushed_.load(std::memory_order_acquire);
+    if (StagedFrame *frame = TryPop()) {
+      return frame;
+    }
+    if (closed_.load(std::memory_order_acquire)) {
+      return TryPop();
+    }
+    pushed_.wait(seen, std::memory_order_acquire);
+  }
+}
+
+void FrameQueue::Close() {
+  closed_.store(true, std::memory_order_release);
+  pushed_.fetch_add(1, std::memory_order_release);
+  popped_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_all();
+  popped_.notify_all();
+}
+
+int FrameQueue::depth() const {
+  const size_t tail = tail_.load(std::memory_order_acquire);
+  const size_t head = head_.load(std::memory_order_acquire);
+  return tail > head ? static_cast<int>(std::min(tail - head, capacity_)) : 0;
+}
+
+double FrameQueue::mean_depth() const {
+  const int64_t samples = depth_samples_.load(std::memory_order_relaxed);
+  if (samples == 0) {
+    return 0.0;
+  }
+  return static_cast<double>(depth_sum_.load(std::memory_order_relaxed)) /
+         static_cast<double>(samples);
+}
+
+void FrameQueue::RecordDepth() {
+  const int d = depth();
+  depth_sum_.fetch_add(d, std::memory_order_relaxed);
+  depth_samples_.fetch_add(1, std::memory_order_relaxed);
+  int prev = max_depth_.load(std::memory_order_relaxed);
+  while (d > prev && !max_depth_.compare_exchange_weak(
+                         prev, d, std::memory_order_relaxed)) {
+  }
+}
+
+} // namespace sc
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace sc {
+
+// One frame on its way through the stages of a StagePipeline, with the
+// buffers each stage fills. Frames are recycled rather than freed, so the
+// pixel buffers and the encoded bytes keep their memory from one frame to
+// the next. Callers derive from it to carry their own per-frame state.
+struct StagedFrame {
+  virtual ~StagedFrame() = default;
+
+  int64_t slot = 0;
+  std::chrono::steady_clock::time_point due{};
+  ImageBuffer captured;          // the whole frame from the capture session
+  ImageBuffer processed;         // cropped and scaled
+  std::vector<uint8_t> encoded;  // the output file's bytes
+  bool encode_skipped = false;   // went straight from process to write
+};
+
+// Bounded lock-free ring of frames. Each cell carries a sequence number
+// that says whether it is free for the push or ready for the pop at a given
+// position, so producers and consumers only contend on one atomic each.
+// Pops may run on any number of threads; pushes may too, although every
+// stage link has a single producer unless frames are rerouted (dropped or
+// sent past a full queue). Capacity is exact, not rounded to a power of two.
+// A ring of one cell cannot tell a full cell from one free for the next
+// lap, so a capacity of 1 gets two cells and pushes check the depth.
+class FrameQueue {
+public:
+  explicit FrameQueue(int capacity);
+  FrameQueue(const FrameQueue &) = delete;
+  FrameQueue &operator=(const FrameQueue &) = delete;
+
+  // Fails when the queue is full.
+  bool TryPush(StagedFrame *frame);
+  // nullptr when the queue is empty.
+  StagedFrame *TryPop();
+  // Waits while the queue is full; false once it has been closed.
+  bool Push(StagedFrame *frame);
+  // Waits while the queue is empty; nullptr once it is closed and empty.
+  StagedFrame *Pop();
+  // Wakes every waiter; frames already queued can still be popped.
+  void Close();
+
+  int capacity() const { return static_cast<int>(capacity_); }
+  // Frames waiting right now; a snapshot while other threads run.
+  int depth() const;
+  // Deepest the queue has been, and the mean depth, both as seen by each
+  // push right after it landed.
+  int max_depth() const { return max_depth_.load(std::memory_order_relaxed); }
+  double mean_depth() const;
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    StagedFrame *frame = nullptr;
+  };
+
+  void RecordDepth();
+
+  const size_t capacity_;
+  const size_t cell_count_; // capacity_, but at least 2
+  std::unique_ptr<Cell[]> cells_;
+  alignas(64) std::atomic<size_t> head_{0}; // next position to pop
+  alignas(64) std::atomic<size_t> tail_{0}; // next position to push
+  // Bumped after every push and pop so that blocked callers can wait on
+  // them without a lost wake-up.
+  alignas(64) std::atomic<uint32_t> pushed_{0};
+  std::atomic<uint32_t> popped_{0};
+  std::atomic<bool> closed_{false};
+  std::atomic<int> max_depth_{0};
+  std::atomic<int64_t> depth_sum_{0};
+  std::atomic<int64_t> depth_samples_{0};
+};
+
+} // namespace sc
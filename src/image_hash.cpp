@@ -0,0 +1,222 @@
+#include "image_hash.h"
+
+#include "image_stats.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace sc {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+ImageHasher::Axis MakeAxis(int pixels, int cells) {
+  ImageHasher::Axis a;
+  a.begin.resize(static_cast<size_t>(cells));
+  a.end.resize(static_cast<size_t>(cells));
+  for (int c = 0; c < cells; ++c) {
+    const int b = static_cast<int>(static_cast<int64_t>(pixels) * c / cells);
+    const int e =
+        static_cast<int>(static_cast<int64_t>(pixels) * (c + 1) / cells);
+    a.begin[static_cast<size_t>(c)] = std::min(b, pixels - 1);
+    a.end[static_cast<size_t>(c)] = std::max(e, b + 1);
+  }
+  return a;
+}
+
+// Adds the column-cell sums of one luma row to every grid row covering `y`.
+template <size_t N>
+void AddToGrid(int y, const std::vector<uint32_t> &col_sums,
+               const ImageHasher::Axis &ys, std::array<uint64_t, N> *grid) {
+  const int cols = static_cast<int>(col_sums.size());
+  for (size_t r = 0; r < ys.begin.size(); ++r) {
+    if (y < ys.begin[r] || y >= ys.end[r]) {
+      continue;
+    }
+    uint64_t *dst = grid->data() + r * static_cast<size_t>(cols);
+    for (int c = 0; c < cols; ++c) {
+      dst[c] += col_sums[static_cast<size_t>(c)];
+    }
+  }
+}
+
+void ColumnSums(const std::vector<uint16_t> &luma, const ImageHasher::Axis &xs,
+                std::vector<uint32_t> *out) {
+  out->assign(xs.begin.size(), 0);
+  for (size_t c = 0; c < xs.begin.size(); ++c) {
+    uint32_t s = 0;
+    for (int x = xs.begin[c]; x < xs.end[c]; ++x) {
+      s += luma[static_cast<size_t>(x)];
+    }
+    (*out)[c] = s;
+  }
+}
+
+template <size_t N>
+std::array<double, N> Means(const std::array<uint64_t, N> &sums,
+                            const ImageHasher::Axis &xs,
+                            const ImageHasher::Axis &ys) {
+  std::array<double, N> m{};
+  const size_t cols = xs.begin.size();
+  for (size_t i = 0; i < N; ++i) {
+    const size_t r = i / cols;
+    const size_t c = i % cols;
+    const double area = static_cast<double>(xs.end[c] - xs.begin[c]) *
+                        static_cast<double>(ys.end[r] - ys.begin[r]);
+    m[i] = static_cast<double>(sums[i]) / area;
+  }
+  return m;
+}
+
+double Median64(std::array<double, 64> v) {
+  std::sort(v.begin(), v.end());
+  return (v[31] + v[32]) / 2.0;
+}
+
+uint64_t BitsAboveMedian(const std::array<double, 64> &v) {
+  const double med = Median64(v);
+  uint64_t h = 0;
+  for (double x : v) {
+    h = (h << 1) | (x > med ? 1u : 0u);
+  }
+  return h;
+}
+
+} // namespace
+
+void ImageHasher::Begin(int width, int height) {
+  width_ = width;
+  height_ = height;
+  sums_ = Sums{};
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  dx_ = MakeAxis(width, kDGridW);
+  dy_ = MakeAxis(height, kDGridH);
+  px_ = MakeAxis(width, kPGrid);
+  py_ = MakeAxis(height, kPGrid);
+  bx_ = MakeAxis(width, kBGrid);
+  by_ = MakeAxis(height, kBGrid);
+}
+
+void ImageHasher::AddRow(int y, const uint8_t *row, std::vector<uint16_t> *luma,
+                         Sums *sums) const {
+  luma->resize(static_cast<size_t>(width_));
+  for (int x = 0; x < width_; ++x) {
+    uint32_t px;
+    memcpy(&px, row + x * 4, 4);
+    (*luma)[static_cast<size_t>(x)] = static_cast<uint16_t>(
+        Luma8(px & 0xFF, (px >> 8) & 0xFF, (px >> 16) & 0xFF));
+  }
+  std::vector<uint32_t> cols;
+  ColumnSums(*luma, dx_, &cols);
+  AddToGrid(y, cols, dy_, &sums->d);
+  ColumnSums(*luma, px_, &cols);
+  AddToGrid(y, cols, py_, &sums->p);
+  ColumnSums(*luma, bx_, &cols);
+  AddToGrid(y, cols, by_, &sums->b);
+}
+
+void ImageHasher::AddRows(int y, const ImageView &rows) {
+  if (width_ <= 0 || !rows.Valid() || rows.width != width_) {
+    return;
+  }
+  std::vector<Sums> parts(static_cast<size_t>(ParallelThreads()));
+  ParallelForRows(rows.height, static_cast<size_t>(rows.width) * 4,
+                  [&](int band, int y0, int y1) {
+                    std::vector<uint16_t> luma;
+                    Sums &sums = parts[static_cast<size_t>(band)];
+                    for (int i = y0; i < y1; ++i) {
+                      AddRow(y + i, rows.Row(i), &luma, &sums);
+                    }
+                  });
+  for (const Sums &part : parts) {
+    for (size_t i = 0; i < sums_.d.size(); ++i)
+      sums_.d[i] += part.d[i];
+    for (size_t i = 0; i < sums_.p.size(); ++i)
+      sums_.p[i] += part.p[i];
+    for (size_t i = 0; i < sums_.b.size(); ++i)
+      sums_.b[i] += part.b[i];
+  }
+}
+
+ImageHashes ImageHasher::Finish() const {
+  ImageHashes h;
+  if (width_ <= 0 || height_ <= 0) {
+    return h;
+  }
+
+  const auto d = Means(sums_.d, dx_, dy_);
+  for (int r = 0; r < kDGridH; ++r) {
+    for (int c = 0; c + 1 < kDGridW; ++c) {
+      const double left = d[static_cast<size_t>(r * kDGridW + c)];
+      const double right = d[static_cast<size_t>(r * kDGridW + c + 1)];
+      h.dhash = (h.dhash << 1) | (left > right ? 1u : 0u);
+    }
+  }
+
+  // Unnormalised separable DCT-II, only the 8x8 lowest frequencies.
+  const auto p = Means(sums_.p, px_, py_);
+  double cosines[8][kPGrid];
+  for (int u = 0; u < 8; ++u) {
+    for (int x = 0; x < kPGrid; ++x) {
+      cosines[u][x] = std::cos(kPi * (2 * x + 1) * u / (2.0 * kPGrid));
+    }
+  }
+  double rows_dct[kPGrid][8];
+  for (int y = 0; y < kPGrid; ++y) {
+    for (int u = 0; u < 8; ++u) {
+      double s = 0.0;
+      for (int x = 0; x < kPGrid; ++x) {
+        s += p[static_cast<size_t>(y * kPGrid + x)] * cosines[u][x];
+      }
+      rows_dct[y][u] = s;
+    }
+  }
+  std::array<double, 64> low{};
+  for (int v = 0; v < 8; ++v) {
+    for (int u = 0; u < 8; ++u) {
+      double s = 0.0;
+      for (int y = 0; y < kPGrid; ++y) {
+        s += rows_dct[y][u] * cosines[v][y];
+      }
+      low[static_cast<size_t>(v * 8 + u)] = s;
+    }
+  }
+  h.phash = BitsAboveMedian(low);
+
+  const auto b = Means(sums_.b, bx_, by_);
+  h.block_mean = BitsAboveMedian(b);
+  return h;
+}
+
+ImageHashes ComputeImageHashes(const ImageView &img) {
+  ImageHasher hasher;
+  if (!img.Valid()) {
+    return ImageHashes{};
+  }
+  hasher.Begin(img.width, img.height);
+  hasher.AddRows(0, img);
+  return hasher.Finish();
+}
+
+std::string HashHex(uint64_t h) {
+  char buf[17] = {};
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+  return std::string(buf);
+}
+
+std::string ImageHashesJson(const ImageHashes &h) {
+  std::ostringstream oss;
+  oss << "{\"dhash\":\"" << HashHex(h.dhash) << "\",\"phash\":\""
+      << HashHex(h.phash) << "\",\"block_mean\":\"" << HashHex(h.block_mean)
+      << "\"}";
+  return oss.str();
+}
+
+} // namespace sc
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "types.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+// 64-bit perceptual hashes of a BGRA image, computed on rounded BT.709
+// luma. Bits are taken row-major from the hash grid, first cell in the most
+// significant bit, so near-duplicates differ in few bits (compare with
+// popcount of the XOR).
+struct ImageHashes {
+  uint64_t dhash = 0;      // 9x8 area means, each cell > its right neighbour
+  uint64_t phash = 0;      // 8x8 lowest DCT-II terms of 32x32 means > median
+  uint64_t block_mean = 0; // 8x8 block means > their median
+};
+
+// Accumulates the area means behind ImageHashes as rows arrive, so hashing
+// can follow a copy while the rows are still in cache.
+class ImageHasher {
+public:
+  void Begin(int width, int height);
+  // Adds rows [y, y + rows.height) of the image; `rows` must have the width
+  // given to Begin. Large bands are split across the parallel row pool.
+  void AddRows(int y, const ImageView &rows);
+  ImageHashes Finish() const;
+
+  static constexpr int kDGridW = 9;
+  static constexpr int kDGridH = 8;
+  static constexpr int kPGrid = 32;
+  static constexpr int kBGrid = 8;
+
+  // Luma sums per grid cell, row-major.
+  struct Sums {
+    std::array<uint64_t, kDGridW * kDGridH> d{};
+    std::array<uint64_t, kPGrid * kPGrid> p{};
+    std::array<uint64_t, kBGrid * kBGrid> b{};
+  };
+
+  // Pixel range [begin, end) covered by each cell along one axis. Cells of
+  // an axis shorter than the grid share pixels.
+  struct Axis {
+    std::vector<int> begin;
+    std::vector<int> end;
+  };
+
+private:
+  void AddRow(int y, const uint8_t *row, std::vector<uint16_t> *luma,
+              Sums *sums) const;
+
+  int width_ = 0;
+  int height_ = 0;
+  Axis dx_, dy_, px_, py_, bx_, by_;
+  Sums sums_;
+};
+
+ImageHashes ComputeImageHashes(const ImageView &img);
+std::string HashHex(uint64_t h);
+std::string ImageHashesJson(const ImageHashes &h);
+
+} // namespace sc
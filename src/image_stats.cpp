@@ -1,40 +1,566 @@
 #include "image_stats.h"
 
+#include "cpu_features.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#ifdef SC_X86
+#include <immintrin.h>
+#endif
+
 namespace sc {
 
-ImageStats ComputeImageStats(const ImageBuffer &img) {
-  ImageStats s;
-  if (img.width <= 0 || img.height <= 0 || img.bgra.empty()) {
-    return s;
+namespace {
+
+constexpr double kLumaScale = 32768.0;
+
+// Vector iterations between widening the 32-bit luma lanes to 64 bits. A
+// lane gains at most 2 * 255 * (kLumaB + kLumaG) per iteration.
+constexpr int kLumaSpillIters = 128;
+
+// Every kernel has two forms. Without kCopy it only reads `row`. With
+// kCopy it also ORs `alpha_or` into each pixel, stores the result to `dst`
+// and measures the stored pixels, so a frame is copied and measured in the
+// same pass.
+template <bool kCopy>
+void StatsRowScalar(const uint8_t *row, int x, int width, uint32_t alpha_or,
+                    uint8_t *dst, StatsAccum *acc) {
+  for (; x < width; ++x) {
+    uint32_t px;
+    memcpy(&px, row + x * 4, 4);
+    if constexpr (kCopy) {
+      px |= alpha_or;
+      memcpy(dst + x * 4, &px, 4);
+    }
+    const uint32_t b = px & 0xFF;
+    const uint32_t g = (px >> 8) & 0xFF;
+    const uint32_t r = (px >> 16) & 0xFF;
+    const uint32_t a = px >> 24;
+    if (r == 0 && g == 0 && b == 0)
+      ++acc->black;
+    if (a == 0)
+      ++acc->transparent;
+    acc->luma += static_cast<uint64_t>(kLumaR * r + kLumaG * g + kLumaB * b);
+  }
+}
+
+#ifdef SC_X86
+
+// SSE2-only CPUs may lack popcnt, so the compare masks (-1 per match) are
+// subtracted into per-lane counters instead.
+template <bool kCopy>
+SC_TARGET("sse2")
+void StatsRowSse2(const uint8_t *row, int width, uint32_t alpha_or,
+                  uint8_t *dst, StatsAccum *acc) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(alpha_or));
+  const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i weights =
+      _mm_setr_epi16(kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG, kLumaR, 0);
+  __m128i luma64 = zero;
+  __m128i counts64 = zero; // black in the low lane, transparent in the high
+  int x = 0;
+  while (x + 4 <= width) {
+    __m128i luma32 = zero;
+    __m128i black32 = zero;
+    __m128i clear32 = zero;
+    for (int it = 0; it < kLumaSpillIters && x + 4 <= width; ++it, x += 4) {
+      __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x * 4));
+      if constexpr (kCopy) {
+        v = _mm_or_si128(v, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), v);
+      }
+      black32 = _mm_sub_epi32(
+          black32, _mm_cmpeq_epi32(_mm_and_si128(v, rgb_mask), zero));
+      clear32 = _mm_sub_epi32(
+          clear32, _mm_cmpeq_epi32(_mm_srli_epi32(v, 24), zero));
+      luma32 = _mm_add_epi32(
+          luma32, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights));
+      luma32 = _mm_add_epi32(
+          luma32, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights));
+    }
+    luma64 = _mm_add_epi64(luma64, _mm_unpacklo_epi32(luma32, zero));
+    luma64 = _mm_add_epi64(luma64, _mm_unpackhi_epi32(luma32, zero));
+    // psadbw sums the bytes of each 64-bit half; the lane counts are at
+    // most kLumaSpillIters, so they fit a byte.
+    const __m128i counts8 =
+        _mm_packus_epi16(_mm_packs_epi32(black32, clear32), zero);
+    counts64 = _mm_add_epi64(
+        counts64, _mm_sad_epu8(_mm_unpacklo_epi32(counts8, zero), zero));
+  }
+  alignas(16) uint64_t lanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), luma64);
+  acc->luma += lanes[0] + lanes[1];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), counts64);
+  acc->black += lanes[0];
+  acc->transparent += lanes[1];
+  StatsRowScalar<kCopy>(row, x, width, alpha_or, dst, acc);
+}
+
+template <bool kCopy>
+SC_TARGET("avx2,popcnt")
+void StatsRowAvx2(const uint8_t *row, int width, uint32_t alpha_or,
+                  uint8_t *dst, StatsAccum *acc) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi32(static_cast<int>(alpha_or));
+  const __m256i rgb_mask = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i weights = _mm256_setr_epi16(
+      kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG,
+      kLumaR, 0, kLumaB, kLumaG, kLumaR, 0);
+  __m256i luma64 = zero;
+  int x = 0;
+  while (x + 8 <= width) {
+    __m256i luma32 = zero;
+    for (int it = 0; it < kLumaSpillIters && x + 8 <= width; ++it, x += 8) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x * 4));
+      if constexpr (kCopy) {
+        v = _mm256_or_si256(v, alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4), v);
+      }
+      const __m256i black =
+          _mm256_cmpeq_epi32(_mm256_and_si256(v, rgb_mask), zero);
+      const __m256i clear =
+          _mm256_cmpeq_epi32(_mm256_srli_epi32(v, 24), zero);
+      acc->black += static_cast<uint64_t>(
+          std::popcount(static_cast<unsigned>(
+              _mm256_movemask_ps(_mm256_castsi256_ps(black)))));
+      acc->transparent += static_cast<uint64_t>(
+          std::popcount(static_cast<unsigned>(
+              _mm256_movemask_ps(_mm256_castsi256_ps(clear)))));
+      luma32 = _mm256_add_epi32(
+          luma32, _mm256_madd_epi16(_mm256_unpacklo_epi8(v, zero), weights));
+      luma32 = _mm256_add_epi32(
+          luma32, _mm256_madd_epi16(_mm256_unpackhi_epi8(v, zero), weights));
+    }
+    luma64 = _mm256_add_epi64(luma64, _mm256_unpacklo_epi32(luma32, zero));
+    luma64 = _mm256_add_epi64(luma64, _mm256_unpackhi_epi32(luma32, zero));
+  }
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), luma64);
+  acc->luma += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  StatsRowScalar<kCopy>(row, x, width, alpha_or, dst, acc);
+}
+
+// GCC 12 sees the undefined merge source that the unmasked AVX-512
+// intrinsics (and the extract inside _mm512_reduce_add_epi64) pass with an
+// all-ones mask, which is never read, and warns that it is uninitialised.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+template <bool kCopy>
+SC_TARGET("avx512f,avx512bw,popcnt")
+void StatsRowAvx512(const uint8_t *row, int width, uint32_t alpha_or,
+                    uint8_t *dst, StatsAccum *acc) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i alpha = _mm512_set1_epi32(static_cast<int>(alpha_or));
+  const __m512i rgb_mask = _mm512_set1_epi32(0x00FFFFFF);
+  const __m512i weights = _mm512_set1_epi64(
+      static_cast<long long>(kLumaB) | (static_cast<long long>(kLumaG) << 16) |
+      (static_cast<long long>(kLumaR) << 32));
+  __m512i luma64 = zero;
+  int x = 0;
+  while (x + 16 <= width) {
+    __m512i luma32 = zero;
+    for (int it = 0; it < kLumaSpillIters && x + 16 <= width; ++it, x += 16) {
+      __m512i v = _mm512_loadu_si512(row + x * 4);
+      if constexpr (kCopy) {
+        v = _mm512_or_si512(v, alpha);
+        _mm512_storeu_si512(dst + x * 4, v);
+      }
+      acc->black += static_cast<uint64_t>(std::popcount(
+          static_cast<unsigned>(_mm512_testn_epi32_mask(v, rgb_mask))));
+      acc->transparent += static_cast<uint64_t>(std::popcount(
+          static_cast<unsigned>(_mm512_cmpeq_epi32_mask(
+              _mm512_srli_epi32(v, 24), zero))));
+      luma32 = _mm512_add_epi32(
+          luma32, _mm512_madd_epi16(_mm512_unpacklo_epi8(v, zero), weights));
+      luma32 = _mm512_add_epi32(
+          luma32, _mm512_madd_epi16(_mm512_unpackhi_epi8(v, zero), weights));
+    }
+    luma64 = _mm512_add_epi64(luma64, _mm512_unpacklo_epi32(luma32, zero));
+    luma64 = _mm512_add_epi64(luma64, _mm512_unpackhi_epi32(luma32, zero));
+  }
+  acc->luma += static_cast<uint64_t>(_mm512_reduce_add_epi64(luma64));
+  StatsRowScalar<kCopy>(row, x, width, alpha_or, dst, acc);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+template <bool kCopy>
+void StatsRowPortable(const uint8_t *row, int width, uint32_t alpha_or,
+                      uint8_t *dst, StatsAccum *acc) {
+  StatsRowScalar<kCopy>(row, 0, width, alpha_or, dst, acc);
+}
+
+template <bool kCopy>
+auto KernelFor(SimdLevel level) {
+#ifdef SC_X86
+  switch (level) {
+  case SimdLevel::kAvx512:
+    return StatsRowAvx512<kCopy>;
+  case SimdLevel::kAvx2:
+    return StatsRowAvx2<kCopy>;
+  case SimdLevel::kSse2:
+    return StatsRowSse2<kCopy>;
+  case SimdLevel::kScalar:
+    break;
   }
+#else
+  (void)level;
+#endif
+  return StatsRowPortable<kCopy>;
+}
+
+// Each level's measuring kernel, adapted to the StatsRowFn signature.
+template <SimdLevel kLevel>
+void MeasureRow(const uint8_t *row, int width, StatsAccum *acc) {
+  KernelFor<false>(kLevel)(row, width, 0, nullptr, acc);
+}
+
+// murmur3 finaliser: spreads RGB values over the sketch registers.
+inline uint32_t HashColor(uint32_t rgb) {
+  rgb ^= rgb >> 16;
+  rgb *= 0x85EBCA6Bu;
+  rgb ^= rgb >> 13;
+  rgb *= 0xC2B2AE35u;
+  rgb ^= rgb >> 16;
+  return rgb;
+}
+
+inline void SketchColor(uint32_t rgb, FullStatsAccum *acc) {
+  const uint32_t h = HashColor(rgb);
+  const size_t reg = h >> (32 - kColorSketchBits);
+  const uint32_t rest = (h << kColorSketchBits) | (1u << (kColorSketchBits - 1));
+  const uint8_t rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+  acc->color_sketch[reg] = std::max(acc->color_sketch[reg], rank);
+}
+
+// Histogram and sketch updates are scatters and stay scalar. A pixel with
+// the same RGB as its left neighbour cannot change the sketch, which skips
+// hashing across the flat runs typical of UI content.
+void FullStatsScalar(const uint8_t *row, int x, int width,
+                     FullStatsAccum *acc) {
+  uint32_t prev_rgb = 0xFFFFFFFFu;
+  for (; x < width; ++x) {
+    uint32_t px;
+    memcpy(&px, row + x * 4, 4);
+    const uint32_t c[4] = {px & 0xFF, (px >> 8) & 0xFF, (px >> 16) & 0xFF,
+                           px >> 24};
+    for (int i = 0; i < 4; ++i) {
+      acc->min[i] = std::min(acc->min[i], static_cast<uint8_t>(c[i]));
+      acc->max[i] = std::max(acc->max[i], static_cast<uint8_t>(c[i]));
+      acc->sum[i] += c[i];
+      acc->sum_sq[i] += c[i] * c[i];
+    }
+    ++acc->luma_histogram[Luma8(c[0], c[1], c[2])];
+    const uint32_t rgb = px & 0x00FFFFFF;
+    if (rgb != prev_rgb) {
+      SketchColor(rgb, acc);
+      prev_rgb = rgb;
+    }
+  }
+}
+
+#ifdef SC_X86
+
+// Channel min/max, sums and squares in vector lanes; luma is computed four
+// pixels at a time and only the histogram and sketch updates are scalar.
+SC_TARGET("sse2")
+void FullStatsSse2(const uint8_t *row, int width, FullStatsAccum *acc) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i byte_mask = _mm_set1_epi32(0xFF);
+  const __m128i round = _mm_set1_epi32(1 << 14);
+  const __m128i weights =
+      _mm_setr_epi16(kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG, kLumaR, 0);
+  __m128i vmin = _mm_set1_epi8(static_cast<char>(0xFF));
+  __m128i vmax = zero;
+  __m128i sum64[4] = {zero, zero, zero, zero};
+  __m128i sq64[4] = {zero, zero, zero, zero};
+  alignas(16) uint32_t luma[4];
+  uint32_t prev_rgb = 0xFFFFFFFFu;
+  int x = 0;
+  while (x + 4 <= width) {
+    __m128i sum32[4] = {zero, zero, zero, zero};
+    __m128i sq32[4] = {zero, zero, zero, zero};
+    for (int it = 0; it < kLumaSpillIters && x + 4 <= width; ++it, x += 4) {
+      const __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x * 4));
+      vmin = _mm_min_epu8(vmin, v);
+      vmax = _mm_max_epu8(vmax, v);
+      for (int c = 0; c < 4; ++c) {
+        const __m128i ch = _mm_and_si128(_mm_srli_epi32(v, 8 * c), byte_mask);
+        sum32[c] = _mm_add_epi32(sum32[c], ch);
+        sq32[c] = _mm_add_epi32(sq32[c], _mm_madd_epi16(ch, ch));
+      }
+      // pmaddwd leaves B*wb+G*wg and R*wr per pixel; pair them up.
+      const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights);
+      const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights);
+      const __m128i even = _mm_castps_si128(_mm_shuffle_ps(
+          _mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+      const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(
+          _mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+      _mm_store_si128(
+          reinterpret_cast<__m128i *>(luma),
+          _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), round), 15));
+      for (int i = 0; i < 4; ++i) {
+        ++acc->luma_histogram[luma[i]];
+        uint32_t px;
+        memcpy(&px, row + (x + i) * 4, 4);
+        const uint32_t rgb = px & 0x00FFFFFF;
+        if (rgb != prev_rgb) {
+          SketchColor(rgb, acc);
+          prev_rgb = rgb;
+        }
+      }
+    }
+    for (int c = 0; c < 4; ++c) {
+      sum64[c] = _mm_add_epi64(sum64[c], _mm_unpacklo_epi32(sum32[c], zero));
+      sum64[c] = _mm_add_epi64(sum64[c], _mm_unpackhi_epi32(sum32[c], zero));
+      sq64[c] = _mm_add_epi64(sq64[c], _mm_unpacklo_epi32(sq32[c], zero));
+      sq64[c] = _mm_add_epi64(sq64[c], _mm_unpackhi_epi32(sq32[c], zero));
+    }
+  }
+  alignas(16) uint8_t mins[16];
+  alignas(16) uint8_t maxs[16];
+  _mm_store_si128(reinterpret_cast<__m128i *>(mins), vmin);
+  _mm_store_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+  alignas(16) uint64_t lanes[2];
+  for (int c = 0; c < 4; ++c) {
+    for (int i = c; i < 16; i += 4) {
+      acc->min[c] = std::min(acc->min[c], mins[i]);
+      acc->max[c] = std::max(acc->max[c], maxs[i]);
+    }
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sum64[c]);
+    acc->sum[c] += lanes[0] + lanes[1];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sq64[c]);
+    acc->sum_sq[c] += lanes[0] + lanes[1];
+  }
+  FullStatsScalar(row, x, width, acc);
+}
+
+#endif
 
-  const size_t pixels =
-      static_cast<size_t>(img.width) * static_cast<size_t>(img.height);
-  size_t black = 0;
-  size_t transparent = 0;
-  double luma_sum = 0.0;
-
-  for (int y = 0; y < img.height; ++y) {
-    const uint8_t *row =
-        img.bgra.data() + static_cast<size_t>(y * img.row_pitch);
-    for (int x = 0; x < img.width; ++x) {
-      const uint8_t b = row[x * 4 + 0];
-      const uint8_t g = row[x * 4 + 1];
-      const uint8_t r = row[x * 4 + 2];
-      const uint8_t a = row[x * 4 + 3];
-      if (r == 0 && g == 0 && b == 0)
-        ++black;
-      if (a == 0)
-        ++transparent;
-      luma_sum += (0.2126 * r + 0.7152 * g + 0.0722 * b);
-    }
-  }
-
-  s.black_ratio = static_cast<double>(black) / static_cast<double>(pixels);
-  s.transparent_ratio =
-      static_cast<double>(transparent) / static_cast<double>(pixels);
-  s.avg_luma = luma_sum / static_cast<double>(pixels);
+double ColorSketchEstimate(const FullStatsAccum &acc) {
+  const double m = static_cast<double>(kColorSketchSize);
+  double inv_sum = 0.0;
+  size_t zeros = 0;
+  for (uint8_t reg : acc.color_sketch) {
+    inv_sum += std::ldexp(1.0, -static_cast<int>(reg));
+    zeros += reg == 0;
+  }
+  const double alpha = 0.7213 / (1.0 + 1.079 / m);
+  const double estimate = alpha * m * m / inv_sum;
+  if (estimate <= 2.5 * m && zeros > 0) {
+    // Linear counting is more accurate for small cardinalities.
+    return m * std::log(m / static_cast<double>(zeros));
+  }
+  return estimate;
+}
+
+ChannelStats ChannelFrom(const FullStatsAccum &acc, int c, double n) {
+  ChannelStats s;
+  s.min = acc.min[static_cast<size_t>(c)];
+  s.max = acc.max[static_cast<size_t>(c)];
+  s.mean = static_cast<double>(acc.sum[static_cast<size_t>(c)]) / n;
+  const double var =
+      static_cast<double>(acc.sum_sq[static_cast<size_t>(c)]) / n -
+      s.mean * s.mean;
+  s.stddev = std::sqrt(std::max(var, 0.0));
   return s;
 }
 
+std::string ChannelJson(const ChannelStats &c) {
+  std::ostringstream oss;
+  oss << "{\"min\":" << c.min << ",\"max\":" << c.max
+      << ",\"mean\":" << c.mean << ",\"stddev\":" << c.stddev << '}';
+  return oss.str();
+}
+
+} // namespace
+
+void AddFullStats(const FullStatsAccum &part, FullStatsAccum *acc) {
+  for (size_t i = 0; i < part.luma_histogram.size(); ++i) {
+    acc->luma_histogram[i] += part.luma_histogram[i];
+  }
+  for (size_t c = 0; c < 4; ++c) {
+    acc->min[c] = std::min(acc->min[c], part.min[c]);
+    acc->max[c] = std::max(acc->max[c], part.max[c]);
+    acc->sum[c] += part.sum[c];
+    acc->sum_sq[c] += part.sum_sq[c];
+  }
+  for (size_t i = 0; i < kColorSketchSize; ++i) {
+    acc->color_sketch[i] = std::max(acc->color_sketch[i], part.color_sketch[i]);
+  }
+}
+
+void FullStatsRow(const uint8_t *row, int width, FullStatsAccum *acc) {
+#ifdef SC_X86
+  if (ActiveSimdLevel() >= SimdLevel::kSse2) {
+    FullStatsSse2(row, width, acc);
+    return;
+  }
+#endif
+  FullStatsScalar(row, 0, width, acc);
+}
+
+FullImageStats FullStatsFromAccum(const FullStatsAccum &acc, size_t pixels) {
+  FullImageStats s;
+  if (pixels == 0) {
+    return s;
+  }
+  const double n = static_cast<double>(pixels);
+  s.luma_histogram = acc.luma_histogram;
+  s.b = ChannelFrom(acc, 0, n);
+  s.g = ChannelFrom(acc, 1, n);
+  s.r = ChannelFrom(acc, 2, n);
+  s.a = ChannelFrom(acc, 3, n);
+  for (uint64_t count : acc.luma_histogram) {
+    if (count > 0) {
+      const double p = static_cast<double>(count) / n;
+      s.luma_entropy -= p * std::log2(p);
+    }
+  }
+  s.solid_color = s.b.min == s.b.max && s.g.min == s.g.max &&
+                  s.r.min == s.r.max && s.a.min == s.a.max;
+  s.distinct_colors =
+      s.solid_color ? 1
+                    : static_cast<uint64_t>(std::llround(std::clamp(
+                          ColorSketchEstimate(acc), 1.0,
+                          std::min(n, static_cast<double>(1 << 24)))));
+  return s;
+}
+
+std::string FullImageStatsJsonFields(const FullImageStats &s) {
+  std::ostringstream oss;
+  oss << "\"luma_histogram\":[";
+  for (size_t i = 0; i < s.luma_histogram.size(); ++i) {
+    if (i)
+      oss << ',';
+    oss << s.luma_histogram[i];
+  }
+  oss << "],\"channels\":{\"b\":" << ChannelJson(s.b)
+      << ",\"g\":" << ChannelJson(s.g) << ",\"r\":" << ChannelJson(s.r)
+      << ",\"a\":" << ChannelJson(s.a)
+      << "},\"luma_entropy\":" << s.luma_entropy
+      << ",\"distinct_colors\":" << s.distinct_colors
+      << ",\"solid_color\":" << (s.solid_color ? "true" : "false");
+  return oss.str();
+}
+
+StatsRowFn StatsRowKernel(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::kAvx512:
+    return MeasureRow<SimdLevel::kAvx512>;
+  case SimdLevel::kAvx2:
+    return MeasureRow<SimdLevel::kAvx2>;
+  case SimdLevel::kSse2:
+    return MeasureRow<SimdLevel::kSse2>;
+  case SimdLevel::kScalar:
+    break;
+  }
+  return MeasureRow<SimdLevel::kScalar>;
+}
+
+CopyStatsRowFn CopyStatsRowKernel(SimdLevel level) {
+  return KernelFor<true>(level);
+}
+
+ImageStats StatsFromAccum(const StatsAccum &acc, size_t pixels) {
+  ImageStats stats;
+  if (pixels == 0) {
+    return stats;
+  }
+  const double n = static_cast<double>(pixels);
+  stats.black_ratio = static_cast<double>(acc.black) / n;
+  stats.transparent_ratio = static_cast<double>(acc.transparent) / n;
+  stats.avg_luma = static_cast<double>(acc.luma) / kLumaScale / n;
+  return stats;
+}
+
+bool StatsRowSink::BeginImage(const RowImageInfo &info, ErrorInfo *err) {
+  if (info.format != PixelFormat::kBgra8) {
+    *err = ErrorInfo{"stats need bgra8 rows", "StatsRowSink", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  width_ = info.width;
+  pixels_ = static_cast<size_t>(info.width) * static_cast<size_t>(info.height);
+  acc_ = StatsAccum{};
+  kernel_ = StatsRowKernel(ActiveSimdLevel());
+  stats_ = ImageStats{};
+  return true;
+}
+
+bool StatsRowSink::WriteRows(int y, int count, const uint8_t *rows,
+                             size_t stride, ErrorInfo *err) {
+  (void)y;
+  (void)err;
+  for (int i = 0; i < count; ++i) {
+    kernel_(rows + static_cast<size_t>(i) * stride, width_, &acc_);
+  }
+  return true;
+}
+
+bool StatsRowSink::Finish(ErrorInfo *err) {
+  (void)err;
+  stats_ = StatsFromAccum(acc_, pixels_);
+  return true;
+}
+
+ImageStats ComputeImageStats(const ImageView &img) {
+  if (!img.Valid()) {
+    return ImageStats{};
+  }
+  const StatsRowFn kernel = StatsRowKernel(ActiveSimdLevel());
+  std::vector<StatsAccum> parts(static_cast<size_t>(ParallelThreads()));
+  ParallelForRows(img.height, static_cast<size_t>(img.width) * 4,
+                  [&](int band, int y0, int y1) {
+                    StatsAccum &acc = parts[static_cast<size_t>(band)];
+                    for (int y = y0; y < y1; ++y) {
+                      kernel(img.Row(y), img.width, &acc);
+                    }
+                  });
+  StatsAccum total;
+  for (const StatsAccum &part : parts) {
+    AddStats(part, &total);
+  }
+  return StatsFromAccum(total, static_cast<size_t>(img.width) *
+                                   static_cast<size_t>(img.height));
+}
+
+FullImageStats ComputeFullImageStats(const ImageView &img) {
+  if (!img.Valid()) {
+    return FullImageStats{};
+  }
+  std::vector<FullStatsAccum> parts(static_cast<size_t>(ParallelThreads()));
+  ParallelForRows(img.height, static_cast<size_t>(img.width) * 4,
+                  [&](int band, int y0, int y1) {
+                    FullStatsAccum &acc = parts[static_cast<size_t>(band)];
+                    for (int y = y0; y < y1; ++y) {
+                      FullStatsRow(img.Row(y), img.width, &acc);
+                    }
+                  });
+  FullStatsAccum total;
+  for (const FullStatsAccum &part : parts) {
+    AddFullStats(part, &total);
+  }
+  return FullStatsFromAccum(total, static_cast<size_t>(img.width) *
+                                       static_cast<size_t>(img.height));
+}
+
 } // namespace sc
@@ -1,9 +1,116 @@
 #pragma once
 
-#include "common.h"
+#include "cpu_features.h"
+#include "row_sink.h"
+#include "types.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 
 namespace sc {
 
-ImageStats ComputeImageStats(const ImageBuffer &img);
+// BT.709 luma weights in 1/32768 units; they sum to exactly 32768 and each
+// fits a signed 16-bit lane for pmaddwd.
+constexpr int kLumaR = 6966;
+constexpr int kLumaG = 23436;
+constexpr int kLumaB = 2366;
+
+// Rounded 8-bit luma, consistent with avg_luma.
+inline uint32_t Luma8(uint32_t b, uint32_t g, uint32_t r) {
+  return (kLumaR * r + kLumaG * g + kLumaB * b + (1u << 14)) >> 15;
+}
+
+// Integer partial sums behind ImageStats. Luma is in 1/32768 units, so the
+// sums are exact and independent of the kernel or of how rows are split.
+struct StatsAccum {
+  uint64_t black = 0;
+  uint64_t transparent = 0;
+  uint64_t luma = 0;
+};
+
+inline void AddStats(const StatsAccum &part, StatsAccum *acc) {
+  acc->black += part.black;
+  acc->transparent += part.transparent;
+  acc->luma += part.luma;
+}
+
+// Adds one row of `width` BGRA pixels to `acc`.
+using StatsRowFn = void (*)(const uint8_t *row, int width, StatsAccum *acc);
+
+// Copies one row of `width` BGRA pixels to `dst`, ORing `alpha_or` into
+// each pixel, and adds the copied pixels to `acc`.
+using CopyStatsRowFn = void (*)(const uint8_t *row, int width,
+                                uint32_t alpha_or, uint8_t *dst,
+                                StatsAccum *acc);
+
+// The row kernels for `level`; every level produces identical sums.
+StatsRowFn StatsRowKernel(SimdLevel level);
+CopyStatsRowFn CopyStatsRowKernel(SimdLevel level);
+ImageStats StatsFromAccum(const StatsAccum &acc, size_t pixels);
+
+// Registers of the HyperLogLog sketch behind the distinct-colour estimate
+// (about 1.6% standard error).
+constexpr int kColorSketchBits = 12;
+constexpr size_t kColorSketchSize = size_t{1} << kColorSketchBits;
+
+// Partial sums behind FullImageStats (--stats full). Channels are in
+// memory order B, G, R, A. Merging partials is exact, so the result does
+// not depend on how rows were split.
+struct FullStatsAccum {
+  std::array<uint64_t, 256> luma_histogram{};
+  std::array<uint8_t, 4> min{255, 255, 255, 255};
+  std::array<uint8_t, 4> max{};
+  std::array<uint64_t, 4> sum{};
+  std::array<uint64_t, 4> sum_sq{};
+  std::array<uint8_t, kColorSketchSize> color_sketch{};
+};
+
+void AddFullStats(const FullStatsAccum &part, FullStatsAccum *acc);
+
+// Adds one row of `width` BGRA pixels to `acc`; vectorised where the CPU
+// allows, except for the histogram and sketch updates.
+void FullStatsRow(const uint8_t *row, int width, FullStatsAccum *acc);
+
+struct ChannelStats {
+  int min = 0;
+  int max = 0;
+  double mean = 0.0;
+  double stddev = 0.0;
+};
+
+struct FullImageStats {
+  std::array<uint64_t, 256> luma_histogram{}; // rounded BT.709 luma
+  ChannelStats b, g, r, a;
+  double luma_entropy = 0.0; // bits, from the histogram
+  uint64_t distinct_colors = 0; // estimate, RGB only
+  bool solid_color = false; // every pixel has the same BGRA value
+};
+
+FullImageStats FullStatsFromAccum(const FullStatsAccum &acc, size_t pixels);
+std::string FullImageStatsJsonFields(const FullImageStats &stats);
+
+// Accumulates ImageStats over rows as they stream past, using the kernel
+// for ActiveSimdLevel().
+class StatsRowSink : public RowSink {
+public:
+  bool BeginImage(const RowImageInfo &info, ErrorInfo *err) override;
+  bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                 ErrorInfo *err) override;
+  bool Finish(ErrorInfo *err) override;
+  const ImageStats &stats() const { return stats_; }
+
+private:
+  int width_ = 0;
+  size_t pixels_ = 0;
+  StatsAccum acc_;
+  StatsRowFn kernel_ = nullptr;
+  ImageStats stats_;
+};
+
+// Splits large images across the parallel row pool.
+ImageStats ComputeImageStats(const ImageView &img);
+FullImageStats ComputeFullImageStats(const ImageView &img);
 
 } // namespace sc
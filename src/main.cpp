@@ -1,16 +1,28 @@
 #include "capture.h"
 #include "cli.h"
 #include "crop.h"
+#include "encode_png.h"
+#include "encode_qoi.h"
+#include "encode_raw.h"
 #include "encode_wic_png.h"
+#include "frame_diff.h"
+#include "image_hash.h"
 #include "image_stats.h"
 #include "logging.h"
 #include "monitor_enum.h"
+#include "output_file.h"
+#include "parallel.h"
+#include "record.h"
+#include "resample.h"
+#include "tone_map.h"
 #include "window_enum.h"
 
 #include <shellscalingapi.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 namespace sc {
@@ -191,6 +203,49 @@ RunResult RunListMonitors(const ParsedArgs &parsed) {
   return rr;
 }
 
+// Compares two raw captures without decoding or re-encoding them.
+RunResult RunDiff(const ParsedArgs &parsed) {
+  RunResult rr;
+  const DiffArgs &args = parsed.diff;
+  ImageBuffer a;
+  ImageBuffer b;
+  RawFrameInfo a_info;
+  RawFrameInfo b_info;
+  FrameDiff diff;
+  if (!ReadRawFrame(args.a_path, &a, &a_info, &rr.err) ||
+      !ReadRawFrame(args.b_path, &b, &b_info, &rr.err) ||
+      !DiffFrames(a, b, args.options, &diff, &rr.err)) {
+    return rr;
+  }
+  rr.ok = true;
+  rr.exit_code = 0;
+
+  std::ostringstream oss;
+  oss << "{\"ok\":true,\"command\":\"diff\",\"timestamp\":\""
+      << Iso8601NowLocal() << "\",\"a\":{\"path\":\""
+      << JsonEscape(args.a_path) << "\",\"frame\":" << RawFrameInfoJson(a_info)
+      << "},\"b\":{\"path\":\"" << JsonEscape(args.b_path)
+      << "\",\"frame\":" << RawFrameInfoJson(b_info)
+      << "},\"ignore_origin\":"
+      << (args.options.ignore_origin ? "true" : "false")
+      << ",\"diff\":" << FrameDiffJson(diff) << '}';
+  rr.json = oss.str();
+
+  if (!parsed.common.json) {
+    std::cout << "identical=" << diff.identical()
+              << " changed_pixels=" << diff.changed_pixels
+              << " total_pixels=" << diff.total_pixels
+              << " changed_ratio=" << diff.changed_ratio
+              << " dirty_tiles=" << diff.dirty_tiles << '/'
+              << diff.tiles_x * diff.tiles_y << "\n";
+    for (const Rect &r : diff.dirty_rects) {
+      std::cout << "rect=" << r.left << ',' << r.top << ',' << r.right << ','
+                << r.bottom << "\n";
+    }
+  }
+  return rr;
+}
+
 Rect VirtualScreenRect() {
   int l = GetSystemMetrics(SM_XVIRTUALSCREEN);
   int t = GetSystemMetrics(SM_YVIRTUALSCREEN);
@@ -199,34 +254,322 @@ Rect VirtualScreenRect() {
   return Rect{l, t, l + w, t + h};
 }
 
-RunResult RunCap(const ParsedArgs &parsed, Logger *logger,
-                 const std::string &dpi_applied) {
-  RunResult rr;
-  const auto start = std::chrono::steady_clock::now();
+// The --format encoder, streaming into `out`. Not for --png-encoder wic,
+// which takes a whole frame instead of rows.
+std::unique_ptr<RowSink> MakeEncoder(const CapOptions &cap, ByteSink *out,
+                                     RawFrameInfo *frame_info) {
+  const PixelFormat pixel_format = CapPixelFormat(cap);
+  if (IsRawFormat(cap.format)) {
+    return std::make_unique<RawRowEncoder>(cap.format, out, frame_info,
+                                           pixel_format, cap.yuv);
+  }
+  if (cap.format == "qoi") {
+    return std::make_unique<QoiRowEncoder>(out, pixel_format);
+  }
+  PngOptions png_opt;
+  png_opt.level = cap.png_level;
+  png_opt.threads = cap.png_threads;
+  png_opt.pixel_format = pixel_format;
+  return std::make_unique<PngRowEncoder>(png_opt, out);
+}
+
+// Crop, scaling, stats and encoder behind the capture backend. While the
+// backend still has the frame mapped, only the cropped part is copied into
+// `frame` (resampled straight from the mapped rows first when --scale or
+// --max-size shrinks it), one chunk at a time, by the fused copy kernel
+// that also fixes alpha and accumulates stats; each chunk then goes to the
+// perceptual hasher and to the encoder, which converts it to the
+// --pixel-format layout while it is still in cache. A chunk holds a band
+// per parallel thread, so large crops are copied on all of them.
+class CapPipeline : public FrameSink {
+public:
+  CapPipeline(const ParsedArgs &parsed, const CaptureContext &ctx,
+              CropMode crop_mode, std::string out_path, ImageBuffer *frame)
+      : parsed_(parsed), ctx_(ctx), crop_mode_(crop_mode),
+        out_path_(std::move(out_path)), frame_(frame) {}
+
+  bool ReceiveFrame(const ImageView &src, AlphaPolicy alpha,
+                    ErrorInfo *err) override {
+    const Rect crop_rect = BeginFrame(src.origin_x, src.origin_y, src.width,
+                                      src.height, err);
+    ImageView view = src;
+    if (!IsValidRect(crop_rect) || !CropView(crop_rect, &view, err)) {
+      return false;
+    }
+    return EmitFrame(view, alpha, nullptr, ToneMapOptions{}, err);
+  }
+
+  // Only the crop is tone-mapped. For rgba16 output it is tone-mapped a
+  // second time at 16 bits, band by band, and the encoder takes those rows;
+  // stats and hashes still come from the 8-bit frame.
+  bool ReceiveHdrFrame(const HalfImageView &src, const ToneMapOptions &tone,
+                       ErrorInfo *err) override {
+    const Rect crop_rect = BeginFrame(src.origin_x, src.origin_y, src.width,
+                                      src.height, err);
+    if (!IsValidRect(crop_rect)) {
+      return false;
+    }
+    const HalfImageView view = HalfSubView(src, crop_rect);
+    if (!view.Valid()) {
+      *err = ErrorInfo{"crop does not overlap image",
+                       "CapPipeline::ReceiveHdrFrame", std::nullopt,
+                       std::nullopt};
+      return false;
+    }
+    hdr_ = true;
+    ImageBuffer sdr;
+    ToneMapImage(view, tone, &sdr);
+    const AlphaPolicy alpha = parsed_.cap.force_alpha_255
+                                  ? AlphaPolicy::kForceOpaque
+                                  : AlphaPolicy::kKeep;
+    return EmitFrame(sdr, alpha, &view, tone, err);
+  }
+
+  // Completes the output once the backend has released the source frame.
+  bool Finish(ErrorInfo *err) {
+    const CapOptions &cap = parsed_.cap;
+    if (!received_) {
+      *err = ErrorInfo{"capture delivered no frame", "CapPipeline::Finish",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    if (UsesWic()) {
+      return SavePngWic(*frame_, WideFromUtf8(out_path_),
+                        parsed_.common.overwrite, err);
+    }
+    if (!encoder_->Finish(err) || !out_.Close(err)) {
+      return false;
+    }
+    if (cap.format == "raw" && !cap.to_stdout) {
+      return WriteRawSidecar(out_path_, parsed_.common.overwrite,
+                             frame_info_, err);
+    }
+    return true;
+  }
+
+  // Only crops and scales the frame into `frame`; encoding and writing are
+  // left to later record stages, and Finish is not called.
+  void DeferEncode() { defer_encode_ = true; }
+  // Copies without image stats and hashes, for callers that report
+  // neither; stats() and hashes() then stay empty.
+  void SkipMeasure() { measure_ = false; }
+
+  bool received() const { return received_; }
+  int source_width() const { return source_width_; }
+  int source_height() const { return source_height_; }
+  const Rect &crop() const { return crop_; }
+  bool scaled() const { return scaled_; }
+  // An scRGB frame arrived and was tone-mapped here.
+  bool hdr() const { return hdr_; }
+  const ImageStats &stats() const { return stats_; }
+  const std::optional<FullImageStats> &full_stats() const {
+    return full_stats_;
+  }
+  const ImageHashes &hashes() const { return hashes_; }
+  std::optional<RawFrameInfo> frame_info() const {
+    if (!IsRawFormat(parsed_.cap.format)) {
+      return std::nullopt;
+    }
+    return frame_info_;
+  }
+
+private:
+  // Records the source size and resolves the crop for a frame at the given
+  // screen position; an invalid rect means `err` is set.
+  Rect BeginFrame(int origin_x, int origin_y, int width, int height,
+                  ErrorInfo *err) {
+    received_ = true;
+    source_width_ = width;
+    source_height_ = height;
+    const Rect img_rect{origin_x, origin_y, origin_x + width,
+                        origin_y + height};
+    return ResolveCropRectScreen(
+        crop_mode_, parsed_.cap.crop_rect,
+        ctx_.window.has_value() ? &ctx_.window.value() : nullptr, img_rect,
+        parsed_.cap.pad, err);
+  }
+
+  // Scales the cropped frame if asked to, then copies it into frame_ band
+  // by band, feeding stats, hashes and the encoder as each band lands.
+  // `hdr` is the scRGB crop `view` was tone-mapped from, if any.
+  bool EmitFrame(ImageView view, AlphaPolicy alpha, const HalfImageView *hdr,
+                 const ToneMapOptions &tone, ErrorInfo *err) {
+    if (!OpenEncoder(err)) {
+      return false;
+    }
+    crop_ = Rect{view.origin_x, view.origin_y, view.origin_x + view.width,
+                 view.origin_y + view.height};
+
+    const CapOptions &cap = parsed_.cap;
+    int out_w = view.width;
+    int out_h = view.height;
+    ScaledSize(view.width, view.height, cap.scale, cap.max_width,
+               cap.max_height, &out_w, &out_h);
+    ImageBuffer scaled;
+    if (out_w != view.width || out_h != view.height) {
+      ResampleImage(view, alpha, cap.scale_filter, out_w, out_h, &scaled);
+      view = scaled;
+      alpha = AlphaPolicy::kKeep;
+      scaled_ = true;
+    }
+
+    AllocateImage(view.width, view.height, frame_);
+    frame_->origin_x = view.origin_x;
+    frame_->origin_y = view.origin_y;
+    RowImageInfo info = RowInfoOf(*frame_);
+    const bool rows16 = hdr && !scaled_ &&
+                        CapPixelFormat(cap) == PixelFormat::kRgba16;
+    const size_t pitch16 = static_cast<size_t>(view.width) * 8;
+    if (rows16) {
+      info.format = PixelFormat::kRgba16;
+      hdr_rows_.resize(pitch16 * static_cast<size_t>(view.height));
+    }
+    if (encoder_ && !encoder_->BeginImage(info, err)) {
+      return false;
+    }
+    const size_t pitch = static_cast<size_t>(frame_->row_pitch);
+    const int chunk_rows = kRowBandRows * ParallelThreads();
+    StatsAccum acc;
+    std::unique_ptr<FullStatsAccum> full;
+    if (measure_ && parsed_.cap.stats_mode == StatsMode::kFull) {
+      full = std::make_unique<FullStatsAccum>();
+    }
+    ImageHasher hasher;
+    if (measure_) {
+      hasher.Begin(view.width, view.height);
+    }
+    for (int y = 0; y < view.height; y += chunk_rows) {
+      ImageView chunk = view;
+      chunk.data = view.Row(y);
+      chunk.height = std::min(chunk_rows, view.height - y);
+      uint8_t *dst = frame_->bgra.data() + static_cast<size_t>(y) * pitch;
+      CopyPixels(chunk, alpha, dst, pitch, measure_ ? &acc : nullptr,
+                 full.get());
+      if (measure_) {
+        hasher.AddRows(y, MappedView(dst, pitch, chunk.width, chunk.height,
+                                     chunk.origin_x, chunk.origin_y));
+      }
+      if (rows16) {
+        HalfImageView band = *hdr;
+        band.data = hdr->Row(y);
+        band.height = chunk.height;
+        uint8_t *dst16 = hdr_rows_.data() + static_cast<size_t>(y) * pitch16;
+        ToneMapImage16(band, tone, dst16, pitch16);
+        if (encoder_ &&
+            !encoder_->WriteRows(y, chunk.height, dst16, pitch16, err)) {
+          return false;
+        }
+      } else if (encoder_ &&
+                 !encoder_->WriteRows(y, chunk.height, dst, pitch, err)) {
+        return false;
+      }
+    }
+    if (!measure_) {
+      return true;
+    }
+    const size_t pixels =
+        static_cast<size_t>(view.width) * static_cast<size_t>(view.height);
+    stats_ = StatsFromAccum(acc, pixels);
+    if (full) {
+      full_stats_ = FullStatsFromAccum(*full, pixels);
+    }
+    hashes_ = hasher.Finish();
+    return true;
+  }
+
+
+  bool UsesWic() const {
+    return parsed_.cap.format == "png" && parsed_.cap.png_encoder == "wic";
+  }
+
+  // Opens --out (or stdout) and the encoder that streams into it. WIC
+  // cannot take rows; it encodes the cropped frame in Finish.
+  bool OpenEncoder(ErrorInfo *err) {
+    const CapOptions &cap = parsed_.cap;
+    if (UsesWic() || defer_encode_) {
+      return true;
+    }
+    const bool opened = cap.to_stdout
+                            ? out_.OpenStdout(err)
+                            : out_.Open(out_path_,
+                                        parsed_.common.overwrite, err);
+    if (!opened) {
+      return false;
+    }
+    encoder_ = MakeEncoder(cap, &out_, &frame_info_);
+    return true;
+  }
+
+  const ParsedArgs &parsed_;
+  const CaptureContext &ctx_;
+  CropMode crop_mode_;
+  std::string out_path_; // --out, or one frame's name when recording
+  ImageBuffer *frame_;
+  bool defer_encode_ = false;
+  bool measure_ = true;
+  bool received_ = false;
+  int source_width_ = 0;
+  int source_height_ = 0;
+  Rect crop_{};
+  bool scaled_ = false;
+  bool hdr_ = false;
+  ImageStats stats_;
+  std::optional<FullImageStats> full_stats_;
+  ImageHashes hashes_;
+  OutputFile out_;
+  RawFrameInfo frame_info_;
+  std::unique_ptr<RowSink> encoder_;
+  std::vector<uint8_t> hdr_rows_; // 16-bit rows, read by encoder_ until Finish
+};
 
+// The ,"window":{...} and ,"monitor":{...} members for a resolved target.
+std::string TargetJsonFields(const CaptureContext &ctx) {
+  std::ostringstream js;
+  if (ctx.window.has_value()) {
+    const auto &w = ctx.window.value();
+    js << ",\"window\":{\"hwnd\":" << reinterpret_cast<uintptr_t>(w.hwnd)
+       << ",\"pid\":" << w.pid << ",\"title\":\"" << JsonEscape(w.title)
+       << "\",\"class\":\"" << JsonEscape(w.class_name)
+       << "\",\"rect\":" << RectJson(w.rect)
+       << ",\"client_rect_screen\":" << RectJson(w.client_rect_screen)
+       << ",\"visible\":" << (w.visible ? "true" : "false")
+       << ",\"iconic\":" << (w.iconic ? "true" : "false")
+       << ",\"cloaked\":" << (w.cloaked ? "true" : "false") << '}';
+  }
+
+  if (ctx.monitor.has_value()) {
+    const auto &m = ctx.monitor.value();
+    js << ",\"monitor\":{\"index\":" << m.index
+       << ",\"desktop\":" << RectJson(m.desktop)
+       << ",\"primary\":" << (m.primary ? "true" : "false") << '}';
+  }
+  return js.str();
+}
+
+// Resolves the window and monitor `method` captures and applies the
+// process-wide pass settings; shared by cap and record.
+bool PrepareCapture(const ParsedArgs &parsed, const CaptureMethodInfo &method,
+                    Logger *logger, CaptureContext *ctx, CropMode *crop_mode,
+                    ErrorInfo *err) {
   auto windows = EnumerateWindows();
   auto monitors = EnumerateMonitors();
 
-  CaptureContext ctx;
-  ctx.method = parsed.cap.method;
-  ctx.cap = parsed.cap;
-  ctx.common = parsed.common;
+  ctx->method = parsed.cap.method;
+  ctx->cap = parsed.cap;
+  ctx->common = parsed.common;
 
   std::string resolve_reason;
-  if (parsed.cap.target == TargetType::kWindow ||
-      parsed.cap.method.find("window") != std::string::npos ||
-      parsed.cap.method.find("printwindow") != std::string::npos ||
-      parsed.cap.method.find("client") != std::string::npos ||
-      parsed.cap.method.find("windowdc") != std::string::npos) {
+  // Methods that take no target (synthetic-*) skip resolution entirely.
+  if (method.caps.window &&
+      (parsed.cap.target == TargetType::kWindow ||
+       parsed.cap.method.find("window") != std::string::npos ||
+       parsed.cap.method.find("client") != std::string::npos)) {
     WindowInfo w;
-    ErrorInfo err;
     if (!ResolveWindowTarget(parsed.cap.window_query, windows, &w,
-                             &resolve_reason, logger, &err)) {
-      rr.err = err;
-      rr.exit_code = 1;
-      return rr;
+                             &resolve_reason, logger, err)) {
+      return false;
     }
-    ctx.window = w;
+    ctx->window = w;
     if (logger) {
       logger->Log(LogLevel::kInfo,
                   "resolved window hwnd=" + HwndToString(w.hwnd) +
@@ -242,35 +585,35 @@ RunResult RunCap(const ParsedArgs &parsed, Logger *logger,
     }
   }
 
-  if (parsed.cap.target == TargetType::kScreen ||
-      parsed.cap.method.find("monitor") != std::string::npos ||
-      parsed.cap.method == "dxgi-window") {
+  if (method.caps.monitor &&
+      (parsed.cap.target == TargetType::kScreen ||
+       parsed.cap.method.find("monitor") != std::string::npos ||
+       parsed.cap.method == "dxgi-window")) {
     if (parsed.cap.screen_query.virtual_screen) {
-      ctx.capture_rect_screen = VirtualScreenRect();
+      ctx->capture_rect_screen = VirtualScreenRect();
     } else if (parsed.cap.screen_query.monitor.has_value()) {
       auto mon =
           FindMonitorByToken(monitors, parsed.cap.screen_query.monitor.value());
       if (!mon.has_value()) {
-        rr.err = ErrorInfo{"monitor not found", "RunCap", std::nullopt,
-                           std::nullopt};
-        rr.exit_code = 1;
-        return rr;
+        *err = ErrorInfo{"monitor not found", "PrepareCapture", std::nullopt,
+                         std::nullopt};
+        return false;
       }
-      ctx.monitor = mon.value();
-      ctx.capture_rect_screen = mon->desktop;
-    } else if (ctx.window.has_value()) {
+      ctx->monitor = mon.value();
+      ctx->capture_rect_screen = mon->desktop;
+    } else if (ctx->window.has_value()) {
       HMONITOR h =
-          MonitorFromWindow(ctx.window->hwnd, MONITOR_DEFAULTTONEAREST);
+          MonitorFromWindow(ctx->window->hwnd, MONITOR_DEFAULTTONEAREST);
       for (const auto &m : monitors) {
         if (m.hmon == h) {
-          ctx.monitor = m;
-          ctx.capture_rect_screen = m.desktop;
+          ctx->monitor = m;
+          ctx->capture_rect_screen = m.desktop;
           break;
         }
       }
     }
-    if (logger && ctx.monitor.has_value()) {
-      const auto &m = ctx.monitor.value();
+    if (logger && ctx->monitor.has_value()) {
+      const auto &m = ctx->monitor.value();
       logger->Log(LogLevel::kInfo,
                   "resolved monitor index=" + std::to_string(m.index) +
                       " rect=" + std::to_string(m.desktop.left) + "," +
@@ -281,32 +624,78 @@ RunResult RunCap(const ParsedArgs &parsed, Logger *logger,
     }
   }
 
-  if (!IsValidRect(ctx.capture_rect_screen) && ctx.window.has_value()) {
-    ctx.capture_rect_screen = ctx.window->rect;
+  if (!IsValidRect(ctx->capture_rect_screen) && ctx->window.has_value()) {
+    ctx->capture_rect_screen = ctx->window->rect;
+  }
+
+  *crop_mode = parsed.cap.crop_mode;
+  if (*crop_mode == CropMode::kNone && parsed.cap.method == "dxgi-window") {
+    *crop_mode = CropMode::kWindow;
+  }
+  FramePoolOptions pool_opt;
+  pool_opt.huge_pages = parsed.cap.huge_pages;
+  ConfigureFramePool(pool_opt);
+  SetParallelThreads(parsed.cap.threads);
+  if (parsed.cap.simd_cap.has_value()) {
+    SetSimdLevelCap(parsed.cap.simd_cap.value());
+  }
+  return true;
+}
+
+double Milliseconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+RunResult RunCap(const ParsedArgs &parsed, Logger *logger,
+                 const std::string &dpi_applied) {
+  RunResult rr;
+  const auto start = std::chrono::steady_clock::now();
+
+  const CaptureMethodInfo *method = FindCaptureMethod(parsed.cap.method);
+  if (!method) {
+    rr.err = ErrorInfo{"unknown method", "RunCap", std::nullopt, std::nullopt};
+    rr.exit_code = 1;
+    return rr;
+  }
+  CaptureContext ctx;
+  CropMode crop_mode = CropMode::kNone;
+  if (!PrepareCapture(parsed, *method, logger, &ctx, &crop_mode, &rr.err)) {
+    rr.exit_code = 1;
+    return rr;
   }
 
   ImageBuffer img;
+  CapPipeline pipeline(parsed, ctx, crop_mode, parsed.cap.out_path, &img);
+
+  std::unique_ptr<CaptureSession> session = method->create();
+  CaptureRequest request;
+  request.method = parsed.cap.method;
+  request.synthetic = parsed.cap.synthetic;
+  request.replay = parsed.cap.replay;
+  request.context = &ctx;
+
   ErrorInfo cap_err;
-  int adapter_index = -1;
-  int output_index = -1;
   bool cap_ok = false;
+  // Opening a session (devices, duplications, staging surfaces) usually
+  // costs far more than grabbing from it; both are logged apart.
+  std::chrono::steady_clock::duration open_time{};
+  std::chrono::steady_clock::duration grab_time{};
 
   for (int attempt = 0; attempt <= parsed.common.retry; ++attempt) {
-    if (parsed.cap.method.rfind("gdi-", 0) == 0) {
-      cap_ok = CaptureWithGdi(ctx, &img, &cap_err);
-    } else if (parsed.cap.method.rfind("dxgi-", 0) == 0) {
-      cap_ok =
-          CaptureWithDxgi(ctx, &img, &adapter_index, &output_index, &cap_err);
-    } else if (parsed.cap.method.rfind("wgc-", 0) == 0) {
-      cap_ok = CaptureWithWgc(ctx, &img, &cap_err);
-    } else {
-      cap_err =
-          ErrorInfo{"unknown method", "RunCap", std::nullopt, std::nullopt};
-      cap_ok = false;
+    const auto open_start = std::chrono::steady_clock::now();
+    cap_ok = session->Open(request, &cap_err);
+    const auto grab_start = std::chrono::steady_clock::now();
+    open_time = grab_start - open_start;
+    if (cap_ok) {
+      cap_ok = session->Grab(&pipeline, &img, &cap_err);
+      grab_time = std::chrono::steady_clock::now() - grab_start;
     }
 
-    if (cap_ok)
+    // Once rows have reached the pipeline the output is partly written, so
+    // a failure past that point is final.
+    if (cap_ok || pipeline.received())
       break;
+    session->Close();
     if (logger) {
       logger->Log(LogLevel::kWarn,
                   "capture attempt failed attempt=" + std::to_string(attempt) +
@@ -321,93 +710,94 @@ RunResult RunCap(const ParsedArgs &parsed, Logger *logger,
   }
 
   if (logger) {
-    if (parsed.cap.method.rfind("dxgi-", 0) == 0) {
+    logger->Log(LogLevel::kInfo,
+                "capture_session open_ms=" +
+                    std::to_string(Milliseconds(open_time)) +
+                    " grab_ms=" + std::to_string(Milliseconds(grab_time)));
+    const std::string details = session->Details();
+    if (!details.empty()) {
       logger->Log(LogLevel::kInfo,
-                  "DXGI adapter_index=" + std::to_string(adapter_index) +
-                      " output_index=" + std::to_string(output_index) +
-                      " frame_size=" + std::to_string(img.width) + "x" +
-                      std::to_string(img.height) +
+                  details + " frame_size=" +
+                      std::to_string(pipeline.source_width()) + "x" +
+                      std::to_string(pipeline.source_height()) +
                       " row_pitch=" + std::to_string(img.row_pitch));
     }
   }
+  session->Close();
 
-  Rect img_rect{img.origin_x, img.origin_y, img.origin_x + img.width,
-                img.origin_y + img.height};
-  CropMode crop_mode = parsed.cap.crop_mode;
-  if (crop_mode == CropMode::kNone && parsed.cap.method == "dxgi-window") {
-    crop_mode = CropMode::kWindow;
-  }
-  ErrorInfo crop_err;
-  Rect crop_rect = ResolveCropRectScreen(
-      crop_mode, parsed.cap.crop_rect,
-      ctx.window.has_value() ? &ctx.window.value() : nullptr, img_rect,
-      parsed.cap.pad, &crop_err);
-  if (!IsValidRect(crop_rect) ||
-      !CropImageInPlace(crop_rect, &img, &crop_err)) {
-    rr.err = crop_err;
+  ErrorInfo save_err;
+  if (!pipeline.Finish(&save_err)) {
+    rr.err = save_err;
     rr.exit_code = 1;
     return rr;
   }
 
-  ImageStats stats = ComputeImageStats(img);
+  const ImageStats &stats = pipeline.stats();
   if (logger) {
     logger->Log(
         LogLevel::kInfo,
         "image_stats black_ratio=" + std::to_string(stats.black_ratio) +
             " transparent_ratio=" + std::to_string(stats.transparent_ratio));
   }
-
-  ErrorInfo save_err;
-  if (!SavePngWic(img, WideFromUtf8(parsed.cap.out_path),
-                  parsed.common.overwrite, &save_err)) {
-    rr.err = save_err;
-    rr.exit_code = 1;
-    return rr;
-  }
+  const std::optional<RawFrameInfo> frame_info = pipeline.frame_info();
 
   const auto end = std::chrono::steady_clock::now();
   const auto duration_ms = static_cast<int>(
       std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
           .count());
 
-  CropRect crop_out{img.origin_x, img.origin_y, img.width, img.height};
+  const Rect &crop = pipeline.crop();
+  CropRect crop_out{crop.left, crop.top, Width(crop), Height(crop)};
 
   std::ostringstream js;
   js << "{\"ok\":true,\"command\":\"cap\",\"method\":\""
      << JsonEscape(parsed.cap.method) << "\",\"target\":\""
      << TargetTypeName(parsed.cap.target) << "\",\"out_path\":\""
-     << JsonEscape(parsed.cap.out_path)
-     << "\",\"format\":\"png\",\"timestamp\":\"" << Iso8601NowLocal()
+     << JsonEscape(parsed.cap.out_path) << "\",\"format\":\""
+     << JsonEscape(parsed.cap.format) << "\",\"pixel_format\":\""
+     << PixelFormatName(CapPixelFormat(parsed.cap)) << "\",\"timestamp\":\""
+     << Iso8601NowLocal()
      << "\",\"duration_ms\":" << duration_ms << ",\"dpi_mode\":\""
      << JsonEscape(dpi_applied) << "\"";
 
-  if (ctx.window.has_value()) {
-    const auto &w = ctx.window.value();
-    js << ",\"window\":{\"hwnd\":" << reinterpret_cast<uintptr_t>(w.hwnd)
-       << ",\"pid\":" << w.pid << ",\"title\":\"" << JsonEscape(w.title)
-       << "\",\"class\":\"" << JsonEscape(w.class_name)
-       << "\",\"rect\":" << RectJson(w.rect)
-       << ",\"client_rect_screen\":" << RectJson(w.client_rect_screen)
-       << ",\"visible\":" << (w.visible ? "true" : "false")
-       << ",\"iconic\":" << (w.iconic ? "true" : "false")
-       << ",\"cloaked\":" << (w.cloaked ? "true" : "false") << '}';
-  }
-
-  if (ctx.monitor.has_value()) {
-    const auto &m = ctx.monitor.value();
-    js << ",\"monitor\":{\"index\":" << m.index
-       << ",\"desktop\":" << RectJson(m.desktop)
-       << ",\"primary\":" << (m.primary ? "true" : "false") << '}';
-  }
+  js << TargetJsonFields(ctx);
 
   js << ",\"crop\":{\"mode\":\"" << CropModeName(crop_mode)
      << "\",\"rect\":" << CropRectJson(crop_out)
      << ",\"pad\":{\"l\":" << parsed.cap.pad.l << ",\"t\":" << parsed.cap.pad.t
      << ",\"r\":" << parsed.cap.pad.r << ",\"b\":" << parsed.cap.pad.b << "}}";
 
+  js << ",\"scale\":";
+  if (pipeline.scaled()) {
+    js << "{\"filter\":\"" << ScaleFilterName(parsed.cap.scale_filter)
+       << "\",\"width\":" << img.width << ",\"height\":" << img.height
+       << '}';
+  } else {
+    js << "null";
+  }
+
+  js << ",\"hdr\":";
+  if (parsed.cap.hdr.has_value()) {
+    const ToneMapOptions &tone = parsed.cap.hdr.value();
+    js << "{\"operator\":\"" << ToneMapOperatorName(tone.op)
+       << "\",\"sdr_white_nits\":" << tone.sdr_white_nits
+       << ",\"tone_mapped\":" << (pipeline.hdr() ? "true" : "false") << '}';
+  } else {
+    js << "null";
+  }
+
+  js << ",\"frame\":"
+     << (frame_info.has_value() ? RawFrameInfoJson(frame_info.value())
+                                : std::string("null"));
+
   js << ",\"image_stats\":{\"black_ratio\":" << stats.black_ratio
      << ",\"transparent_ratio\":" << stats.transparent_ratio
-     << ",\"avg_luma\":" << stats.avg_luma << "},\"error\":null}";
+     << ",\"avg_luma\":" << stats.avg_luma;
+  if (pipeline.full_stats().has_value()) {
+    js << ',' << FullImageStatsJsonFields(pipeline.full_stats().value());
+  }
+  js << "},\"image_hash\":" << ImageHashesJson(pipeline.hashes())
+     << ",\"error\":null}";
 
   rr.ok = true;
   rr.exit_code = 0;
@@ -420,6 +810,308 @@ RunResult RunCap(const ParsedArgs &parsed, Logger *logger,
   return rr;
 }
 
+// Tallies frame `slot` of a recording as written to `path` just now.
+void TallyRecordFrame(RecordTally *tally, int64_t slot,
+                      const std::string &path,
+                      std::chrono::steady_clock::time_point due,
+                      std::chrono::steady_clock::time_point next_due,
+                      Logger *logger) {
+  tally->Add(path, due, next_due, std::chrono::steady_clock::now());
+  if (logger) {
+    logger->Log(LogLevel::kDebug,
+                "record frame slot=" + std::to_string(slot) +
+                    " latency_ms=" + std::to_string(tally->latency_ms.back()) +
+                    " path=" + path);
+  }
+}
+
+// A recorded frame on its way through the record stages.
+struct RecordFrame : StagedFrame {
+  std::string path;
+  RawFrameInfo frame_info;
+};
+
+// Encode stage: the processed frame into memory, for the write stage. WIC
+// cannot encode into memory, so it writes the file here instead.
+bool EncodeRecordFrame(const ParsedArgs &parsed, RecordFrame *f,
+                       ErrorInfo *err) {
+  const CapOptions &cap = parsed.cap;
+  if (cap.format == "png" && cap.png_encoder == "wic") {
+    return SavePngWic(f->processed, WideFromUtf8(f->path),
+                      parsed.common.overwrite, err);
+  }
+  VectorSink sink(&f->encoded);
+  const std::unique_ptr<RowSink> encoder =
+      MakeEncoder(cap, &sink, &f->frame_info);
+  const ImageBuffer &img = f->processed;
+  return encoder->BeginImage(RowInfoOf(img), err) &&
+         encoder->WriteRows(0, img.height, img.bgra.data(),
+                            static_cast<size_t>(img.row_pitch), err) &&
+         encoder->Finish(err);
+}
+
+// Where a frame whose encode was skipped is written instead of `path`: the
+// same name with a .raw extension, so that it is not taken for a file in
+// the --format the rest of the recording has.
+std::string UnencodedFramePath(const std::string &path) {
+  const size_t slash = path.find_last_of("/\\");
+  const size_t dot = path.rfind('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return path + ".raw";
+  }
+  return path.substr(0, dot) + ".raw";
+}
+
+// Write stage: the encoded bytes, and the sidecar of a raw frame.
+bool WriteRecordFrame(const ParsedArgs &parsed, const RecordFrame &f,
+                      ErrorInfo *err) {
+  const CapOptions &cap = parsed.cap;
+  if (cap.format == "png" && cap.png_encoder == "wic") {
+    return true; // written by the encode stage
+  }
+  const bool overwrite = parsed.common.overwrite;
+  if (!WriteFileBytes(f.path, overwrite, f.encoded.data(), f.encoded.size(),
+                      err)) {
+    return false;
+  }
+  return cap.format != "raw" ||
+         WriteRawSidecar(f.path, overwrite, f.frame_info, err);
+}
+
+// Captures on a fixed frame clock into numbered files, all from one capture
+// session. Frame n is due n / fps after the start and is written to --out
+// with n filled in, so slots dropped because a frame overran leave gaps in
+// the numbering. Latency runs from a frame's due time until its file is
+// complete; a frame is late when that is past the next frame's due time.
+//
+// By default the capture loop only grabs whole frames; crop and scaling,
+// encoding and writing run behind it as a StagePipeline, so a frame is
+// grabbed while earlier ones are still being encoded. Frames that skip-encode
+// sends past a full encode queue are saved as bgra8 raw next to the others.
+// --queue-depth 0 runs every stage inside the grab instead, as cap does;
+// only that path hands the encoder 16-bit rows tone-mapped from an HDR
+// frame. Record reports no image stats or hashes, so neither path computes
+// them.
+RunResult RunRecord(const ParsedArgs &parsed, Logger *logger,
+                    const std::string &dpi_applied) {
+  using Clock = std::chrono::steady_clock;
+  RunResult rr;
+  const auto start = Clock::now();
+
+  const CaptureMethodInfo *method = FindCaptureMethod(parsed.cap.method);
+  if (!method) {
+    rr.err =
+        ErrorInfo{"unknown method", "RunRecord", std::nullopt, std::nullopt};
+    rr.exit_code = 1;
+    return rr;
+  }
+  CaptureContext ctx;
+  CropMode crop_mode = CropMode::kNone;
+  if (!PrepareCapture(parsed, *method, logger, &ctx, &crop_mode, &rr.err)) {
+    rr.exit_code = 1;
+    return rr;
+  }
+
+  std::unique_ptr<CaptureSession> session = method->create();
+  CaptureRequest request;
+  request.method = parsed.cap.method;
+  request.synthetic = parsed.cap.synthetic;
+  request.replay = parsed.cap.replay;
+  request.context = &ctx;
+
+  const auto open_start = Clock::now();
+  if (!session->Open(request, &rr.err)) {
+    rr.exit_code = 1;
+    return rr;
+  }
+  const double open_ms = Milliseconds(Clock::now() - open_start);
+
+  const RecordOptions &opt = parsed.record;
+  FrameScheduler clock(opt.fps, FrameScheduler::SlotsFor(opt), Clock::now());
+  RecordTally tally;
+  tally.latency_ms.reserve(static_cast<size_t>(clock.slots()));
+  std::vector<double> grab_ms;
+  grab_ms.reserve(static_cast<size_t>(clock.slots()));
+
+  // As with cap, --retry reopens the session for a frame that failed
+  // before any of it was written. `pipeline` is null when the grab only
+  // copies the frame out.
+  const auto grab_frame = [&](int64_t slot, CapPipeline *pipeline,
+                              ImageBuffer *img, ErrorInfo *err) {
+    const Clock::time_point grab_start = Clock::now();
+    bool ok = session->Grab(pipeline, img, err);
+    for (int attempt = 0; !ok && !(pipeline && pipeline->received()) &&
+                          attempt < parsed.common.retry;
+         ++attempt) {
+      if (logger) {
+        logger->Log(LogLevel::kWarn,
+                    "record frame failed slot=" + std::to_string(slot) +
+                        " attempt=" + std::to_string(attempt) +
+                        " where=" + err->where);
+      }
+      session->Close();
+      ok = session->Open(request, err) && session->Grab(pipeline, img, err);
+    }
+    grab_ms.push_back(Milliseconds(Clock::now() - grab_start));
+    return ok;
+  };
+
+  // Declared after everything its stages use, so that it is finished
+  // before any of that goes away.
+  std::unique_ptr<StagePipeline> stages;
+  if (opt.pipeline.queue_depth > 0) {
+    StageFunctions fns;
+    fns.make_frame = [] { return std::make_unique<RecordFrame>(); };
+    fns.process = [&](StagedFrame *sf, ErrorInfo *err) {
+      auto *f = static_cast<RecordFrame *>(sf);
+      CapPipeline pipeline(parsed, ctx, crop_mode, f->path, &f->processed);
+      pipeline.DeferEncode();
+      pipeline.SkipMeasure();
+      // The grab has already applied the alpha policy.
+      return pipeline.ReceiveFrame(f->captured, AlphaPolicy::kKeep, err);
+    };
+    fns.encode = [&](StagedFrame *sf, ErrorInfo *err) {
+      return EncodeRecordFrame(parsed, static_cast<RecordFrame *>(sf), err);
+    };
+    fns.write = [&](StagedFrame *sf, ErrorInfo *err) {
+      auto *f = static_cast<RecordFrame *>(sf);
+      const std::string path =
+          f->encode_skipped ? UnencodedFramePath(f->path) : f->path;
+      if (f->encode_skipped
+              ? !SaveRawFrame(f->processed, "raw", path,
+                              parsed.common.overwrite, &f->frame_info, err)
+              : !WriteRecordFrame(parsed, *f, err)) {
+        return false;
+      }
+      TallyRecordFrame(&tally, f->slot, path, f->due,
+                       clock.Deadline(f->slot + 1), logger);
+      return true;
+    };
+    stages = std::make_unique<StagePipeline>(opt.pipeline, std::move(fns));
+  }
+
+  ImageBuffer img; // reused by every frame without stages
+  for (int64_t slot = clock.WaitNext(); slot >= 0; slot = clock.WaitNext()) {
+    const Clock::time_point due = clock.Deadline(slot);
+    const std::string path = FormatFrameName(parsed.cap.out_path, slot);
+    ErrorInfo err;
+    if (stages) {
+      auto *f = static_cast<RecordFrame *>(stages->Acquire());
+      f->slot = slot;
+      f->due = due;
+      f->path = path;
+      if (!grab_frame(slot, nullptr, &f->captured, &err)) {
+        stages->Recycle(f);
+        rr.err = err;
+        rr.exit_code = 1;
+        return rr;
+      }
+      if (!stages->Submit(f)) {
+        break; // a stage failed; Finish reports it
+      }
+      continue;
+    }
+    CapPipeline pipeline(parsed, ctx, crop_mode, path, &img);
+    pipeline.SkipMeasure();
+    if (!grab_frame(slot, &pipeline, &img, &err) || !pipeline.Finish(&err)) {
+      rr.err = err;
+      rr.exit_code = 1;
+      return rr;
+    }
+    TallyRecordFrame(&tally, slot, path, due, clock.Deadline(slot + 1),
+                     logger);
+  }
+  session->Close();
+  if (stages && !stages->Finish(&rr.err)) {
+    rr.exit_code = 1;
+    return rr;
+  }
+
+  const int64_t frames = static_cast<int64_t>(tally.latency_ms.size());
+  // Over the span from the first frame's slot to the last one's.
+  const double span_s =
+      std::chrono::duration<double>(tally.last_due - tally.first_due).count();
+  const double achieved_fps =
+      frames > 1 && span_s > 0.0 ? static_cast<double>(frames - 1) / span_s
+                                 : 0.0;
+  const LatencySummary latency = SummarizeLatency(std::move(tally.latency_ms));
+  const LatencySummary grab = SummarizeLatency(std::move(grab_ms));
+
+  const auto duration_ms = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                            start)
+          .count());
+
+  std::ostringstream js;
+  js << "{\"ok\":true,\"command\":\"record\",\"method\":\""
+     << JsonEscape(parsed.cap.method) << "\",\"target\":\""
+     << TargetTypeName(parsed.cap.target) << "\",\"out_path\":\""
+     << JsonEscape(parsed.cap.out_path) << "\",\"format\":\""
+     << JsonEscape(parsed.cap.format) << "\",\"pixel_format\":\""
+     << PixelFormatName(CapPixelFormat(parsed.cap)) << "\",\"timestamp\":\""
+     << Iso8601NowLocal()
+     << "\",\"duration_ms\":" << duration_ms << ",\"dpi_mode\":\""
+     << JsonEscape(dpi_applied) << "\"";
+  js << TargetJsonFields(ctx);
+  js << ",\"record\":{\"fps\":" << opt.fps
+     << ",\"duration_s\":" << opt.duration_s << ",\"slots\":" << clock.slots()
+     << ",\"frames\":" << frames << ",\"dropped\":" << clock.dropped()
+     << ",\"late\":" << tally.late << ",\"achieved_fps\":" << achieved_fps
+     << ",\"open_ms\":" << open_ms
+     << ",\"grab_ms\":" << LatencySummaryJson(grab)
+     << ",\"latency_ms\":" << LatencySummaryJson(latency)
+     << ",\"first_path\":\"" << JsonEscape(tally.first_path)
+     << "\",\"last_path\":\"" << JsonEscape(tally.last_path)
+     << "\",\"pipeline\":";
+  if (stages) {
+    js << StagePipelineStatsJson(opt.pipeline, stages->stats());
+  } else {
+    js << "null";
+  }
+  js << "},\"error\":null}";
+
+  rr.ok = true;
+  rr.exit_code = 0;
+  rr.json = js.str();
+  if (logger) {
+    logger->Log(LogLevel::kInfo,
+                "record frames=" + std::to_string(frames) + " dropped=" +
+                    std::to_string(clock.dropped()) +
+                    " late=" + std::to_string(tally.late) +
+                    " achieved_fps=" + std::to_string(achieved_fps) +
+                    " latency_p50_ms=" + std::to_string(latency.p50_ms) +
+                    " latency_p99_ms=" + std::to_string(latency.p99_ms) +
+                    " grab_p50_ms=" + std::to_string(grab.p50_ms) +
+                    " open_ms=" + std::to_string(open_ms));
+    if (stages) {
+      const StagePipelineStats st = stages->stats();
+      const auto stage = [](const char *name, const StageStats &s) {
+        return std::string(" ") + name +
+               "_depth_max=" + std::to_string(s.max_depth) + " " + name +
+               "_depth_mean=" + std::to_string(s.mean_depth) + " " + name +
+               "_dropped=" + std::to_string(s.dropped) + " " + name +
+               "_busy_ms=" + std::to_string(s.busy_ms);
+      };
+      logger->Log(LogLevel::kInfo,
+                  std::string("record pipeline drop_policy=") +
+                      DropPolicyName(opt.pipeline.drop) +
+                      " queue_depth=" +
+                      std::to_string(opt.pipeline.queue_depth) +
+                      stage("process", st.process) +
+                      stage("encode", st.encode) + stage("write", st.write) +
+                      " skipped_encodes=" +
+                      std::to_string(st.skipped_encodes) +
+                      " encode_pool_workers=" +
+                      std::to_string(st.encode_pool.workers) +
+                      " encode_pool_tasks=" +
+                      std::to_string(st.encode_pool.tasks) +
+                      " encode_pool_steals=" +
+                      std::to_string(st.encode_pool.steals));
+    }
+  }
+  return rr;
+}
+
 void LogStartup(Logger *logger, const ParsedArgs *parsed,
                 const std::string &dpi_mode) {
   if (!logger)
@@ -427,6 +1119,8 @@ void LogStartup(Logger *logger, const ParsedArgs *parsed,
   logger->Log(LogLevel::kInfo, "version=" + std::string(kVersion));
   logger->Log(LogLevel::kInfo, "build=" + GetBuildStamp());
   logger->Log(LogLevel::kInfo, "os=" + GetOsVersionString());
+  logger->Log(LogLevel::kInfo,
+              "simd=" + std::string(SimdLevelName(DetectSimdLevel())));
   logger->Log(LogLevel::kInfo, "dpi_mode=" + dpi_mode);
   if (parsed) {
     std::ostringstream oss;
@@ -444,20 +1138,49 @@ std::string BuildFailureJson(const std::string &command,
                              const std::string &method,
                              const std::string &target,
                              const std::string &out_path,
+                             const std::string &format,
                              const std::string &dpi_mode, int duration_ms,
                              const ErrorInfo &err) {
   std::ostringstream oss;
   oss << "{\"ok\":false,\"command\":\"" << JsonEscape(command)
       << "\",\"method\":\"" << JsonEscape(method) << "\",\"target\":\""
       << JsonEscape(target) << "\",\"out_path\":\"" << JsonEscape(out_path)
-      << "\",\"format\":\"png\",\"timestamp\":\"" << Iso8601NowLocal()
+      << "\",\"format\":\"" << JsonEscape(format) << "\",\"timestamp\":\""
+      << Iso8601NowLocal()
       << "\",\"duration_ms\":" << duration_ms << ",\"dpi_mode\":\""
       << JsonEscape(dpi_mode)
-      << "\",\"window\":null,\"monitor\":null,\"crop\":null"
-      << ",\"image_stats\":null,\"error\":" << ErrorJson(err) << '}';
+      << "\",\"window\":null,\"monitor\":null,\"crop\":null,\"scale\":null"
+      << ",\"hdr\":null"
+      << ",\"frame\":null,\"image_stats\":null,\"image_hash\":null"
+      << ",\"error\":" << ErrorJson(err)
+      << '}';
   return oss.str();
 }
 
+// Human-readable and JSON reports go to stderr while the image itself is
+// being streamed through stdout.
+std::ostream &ReportStream(const ParsedArgs &parsed) {
+  return IsCaptureCommand(parsed.command) && parsed.cap.to_stdout
+             ? std::cerr
+             : std::cout;
+}
+
+// Writes the result JSON to --json-out when given, else to the report
+// stream.
+void EmitJson(const ParsedArgs &parsed, const std::string &json,
+              Logger *logger) {
+  if (IsCaptureCommand(parsed.command) && !parsed.cap.json_out.empty()) {
+    const std::string line = json + "\n";
+    ErrorInfo err;
+    if (WriteFileBytes(parsed.cap.json_out, true, line.data(), line.size(),
+                       &err)) {
+      return;
+    }
+    logger->Log(LogLevel::kError, "json-out write failed: " + err.message);
+  }
+  ReportStream(parsed) << json << '\n';
+}
+
 bool WaitForHotkey(const ParsedArgs &parsed, Logger *logger, ErrorInfo *err) {
   if (!parsed.cap.hotkey_enabled) {
     return true;
@@ -475,7 +1198,8 @@ bool WaitForHotkey(const ParsedArgs &parsed, Logger *logger, ErrorInfo *err) {
     logger->Log(LogLevel::kInfo, "hotkey waiting spec=" + parsed.cap.hotkey_spec);
   }
   if (!parsed.common.json) {
-    std::cout << "waiting hotkey: " << parsed.cap.hotkey_spec << "\n";
+    ReportStream(parsed) << "waiting hotkey: " << parsed.cap.hotkey_spec
+                         << "\n";
   }
 
   MSG msg{};
@@ -500,7 +1224,7 @@ bool WaitForHotkey(const ParsedArgs &parsed, Logger *logger, ErrorInfo *err) {
 
   UnregisterHotKey(nullptr, kHotkeyId);
   if (ok && !parsed.common.json) {
-    std::cout << "hotkey pressed\n";
+    ReportStream(parsed) << "hotkey pressed\n";
   }
   return ok;
 }
@@ -529,7 +1253,8 @@ int main(int argc, char **argv) {
     logger.Log(LogLevel::kError, "parse error: " + parsed.error);
     if (boot.json) {
       ErrorInfo err{parsed.error, "ParseArgs", std::nullopt, std::nullopt};
-      std::cout << BuildFailureJson("unknown", "", "", "", dpi_applied, 0, err)
+      std::cout << BuildFailureJson("unknown", "", "", "", "png", dpi_applied,
+                                    0, err)
                 << '\n';
     } else {
       std::cerr << "Error: " << parsed.error << "\n\n" << BuildHelpText();
@@ -548,7 +1273,11 @@ int main(int argc, char **argv) {
     rr = RunListWindows(parsed.args);
   } else if (parsed.args.command == CommandType::kListMonitors) {
     rr = RunListMonitors(parsed.args);
+  } else if (parsed.args.command == CommandType::kDiff) {
+    rr = RunDiff(parsed.args);
   } else {
+    const auto run = parsed.args.command == CommandType::kRecord ? RunRecord
+                                                                 : RunCap;
     if (run_args.cap.hotkey_enabled) {
       ErrorInfo wait_err;
       if (!WaitForHotkey(run_args, &logger, &wait_err)) {
@@ -559,32 +1288,33 @@ int main(int argc, char **argv) {
           run_args.cap.window_query = TargetWindowQuery{};
           run_args.cap.window_query.foreground = true;
         }
-        rr = RunCap(run_args, &logger, dpi_applied);
+        rr = run(run_args, &logger, dpi_applied);
       }
     } else {
-      rr = RunCap(run_args, &logger, dpi_applied);
+      rr = run(run_args, &logger, dpi_applied);
     }
   }
 
   if (rr.ok) {
     logger.Log(LogLevel::kInfo, "result=success");
     if (parsed.args.common.json) {
-      std::cout << rr.json << '\n';
-    } else if (parsed.args.command == CommandType::kCap) {
-      std::cout << "ok: " << parsed.args.cap.out_path << '\n';
+      EmitJson(parsed.args, rr.json, &logger);
+    } else if (IsCaptureCommand(parsed.args.command)) {
+      ReportStream(parsed.args) << "ok: " << parsed.args.cap.out_path << '\n';
     }
     return rr.exit_code;
   }
 
   logger.Log(LogLevel::kError, "result=failure where=" + rr.err.where +
                                    " message=" + rr.err.message);
-  if (parsed.args.common.json || parsed.args.command == CommandType::kCap) {
-    std::cout << BuildFailureJson(
-                     parsed.args.command == CommandType::kCap ? "cap" : "list",
-                     parsed.args.cap.method,
-                     TargetTypeName(parsed.args.cap.target),
-                     parsed.args.cap.out_path, dpi_applied, 0, rr.err)
-              << '\n';
+  if (parsed.args.common.json || IsCaptureCommand(parsed.args.command)) {
+    EmitJson(parsed.args,
+             BuildFailureJson(
+                 CommandName(parsed.args.command),
+                 parsed.args.cap.method, TargetTypeName(parsed.args.cap.target),
+                 parsed.args.cap.out_path, parsed.args.cap.format, dpi_applied,
+                 0, rr.err),
+             &logger);
   } else {
     std::cerr << "Error: " << rr.err.message << " (" << rr.err.where << ")\n";
   }
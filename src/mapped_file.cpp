@@ -0,0 +1,150 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include "common.h"
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace sc {
+
+MappedFile::~MappedFile() { Close(); }
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string &path_utf8, ErrorInfo *err) {
+  Close();
+  HANDLE file = CreateFileW(WideFromUtf8(path_utf8).c_str(), GENERIC_READ,
+                            FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    *err = ErrorInfo{"cannot open: " + path_utf8, "MappedFile::Open",
+                     std::nullopt, static_cast<uint32_t>(GetLastError())};
+    return false;
+  }
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file, &size)) {
+    *err = ErrorInfo{"GetFileSizeEx failed", "MappedFile::Open", std::nullopt,
+                     static_cast<uint32_t>(GetLastError())};
+    CloseHandle(file);
+    return false;
+  }
+  file_ = file;
+  path_ = path_utf8;
+  if (size.QuadPart == 0) {
+    return true; // empty files cannot be mapped
+  }
+  HANDLE mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    *err = ErrorInfo{"CreateFileMappingW failed", "MappedFile::Open",
+                     std::nullopt, static_cast<uint32_t>(GetLastError())};
+    Close();
+    return false;
+  }
+  mapping_ = mapping;
+  const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    *err = ErrorInfo{"MapViewOfFile failed", "MappedFile::Open", std::nullopt,
+                     static_cast<uint32_t>(GetLastError())};
+    Close();
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(view);
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    CloseHandle(static_cast<HANDLE>(mapping_));
+  }
+  if (file_) {
+    CloseHandle(static_cast<HANDLE>(file_));
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapping_ = nullptr;
+  file_ = nullptr;
+  path_.clear();
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const {
+  if (!data_ || offset >= size_) {
+    return;
+  }
+  WIN32_MEMORY_RANGE_ENTRY range{};
+  range.VirtualAddress = const_cast<uint8_t *>(data_ + offset);
+  range.NumberOfBytes = std::min(size, size_ - offset);
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+bool MappedFile::Open(const std::string &path_utf8, ErrorInfo *err) {
+  Close();
+  const int fd = open(path_utf8.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *err = ErrorInfo{"cannot open: " + path_utf8, "MappedFile::Open",
+                     std::nullopt, static_cast<uint32_t>(errno)};
+    return false;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    *err = ErrorInfo{"fstat failed", "MappedFile::Open", std::nullopt,
+                     static_cast<uint32_t>(errno)};
+    close(fd);
+    return false;
+  }
+  path_ = path_utf8;
+  if (st.st_size == 0) {
+    close(fd);
+    return true; // empty files cannot be mapped
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file referenced.
+  close(fd);
+  if (p == MAP_FAILED) {
+    *err = ErrorInfo{"mmap failed", "MappedFile::Open", std::nullopt,
+                     static_cast<uint32_t>(errno)};
+    path_.clear();
+    return false;
+  }
+  madvise(p, size, MADV_SEQUENTIAL);
+  data_ = static_cast<const uint8_t *>(p);
+  size_ = size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  path_.clear();
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const {
+  if (!data_ || offset >= size_) {
+    return;
+  }
+  static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t begin = offset / page * page;
+  const size_t end = std::min(size_, offset + std::min(size, size_ - offset));
+  madvise(const_cast<uint8_t *>(data_ + begin), end - begin, MADV_WILLNEED);
+}
+
+#endif
+
+} // namespace sc
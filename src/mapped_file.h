@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sc {
+
+// A whole file mapped read-only. Pages are read in by the OS on first
+// touch, so frames can be viewed in place without a read into a buffer.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  bool Open(const std::string &path_utf8, ErrorInfo *err);
+  void Close();
+
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  const std::string &path() const { return path_; }
+
+  // Asks the OS to start reading [offset, offset + size) in the
+  // background, ahead of the frame that will need it.
+  void Prefetch(size_t offset, size_t size) const;
+
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  std::string path_;
+#ifdef _WIN32
+  void *file_ = nullptr;
+  void *mapping_ = nullptr;
+#endif
+};
+
+} // namespace sc
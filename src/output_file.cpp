@@ -0,0 +1,282 @@
+#include "output_file.h"
+
+#ifdef _WIN32
+#include "common.h"
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <cstdint>
+
+namespace sc {
+
+#ifndef _WIN32
+namespace {
+
+// Most bytes kept alive for vmsplice at once. The pipe holds far less than
+// this, so it is only reached when the unread count cannot be queried;
+// buffers past it are copied into the pipe instead.
+constexpr size_t kMaxSplicedBytes = size_t{8} << 20;
+
+} // namespace
+#endif
+
+bool VectorSink::Write(const void *data, size_t size, ErrorInfo *err) {
+  (void)err;
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  out_->insert(out_->end(), p, p + size);
+  return true;
+}
+
+OutputFile::~OutputFile() {
+  ErrorInfo ignored;
+  Close(&ignored);
+}
+
+#ifdef _WIN32
+
+bool OutputFile::Open(const std::string &path_utf8, bool overwrite,
+                      ErrorInfo *err) {
+  HANDLE h = CreateFileW(WideFromUtf8(path_utf8).c_str(), GENERIC_WRITE, 0,
+                         nullptr, overwrite ? CREATE_ALWAYS : CREATE_NEW,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (h == INVALID_HANDLE_VALUE) {
+    const DWORD code = GetLastError();
+    if (code == ERROR_FILE_EXISTS) {
+      *err = ErrorInfo{"output exists (use --overwrite)", "OutputFile::Open",
+                       std::nullopt, std::nullopt};
+    } else {
+      *err = ErrorInfo{"CreateFileW failed", "OutputFile::Open", std::nullopt,
+                       static_cast<uint32_t>(code)};
+    }
+    return false;
+  }
+  handle_ = h;
+  owns_ = true;
+  return true;
+}
+
+bool OutputFile::OpenStdout(ErrorInfo *err) {
+  HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+  if (h == INVALID_HANDLE_VALUE || h == nullptr) {
+    *err = ErrorInfo{"GetStdHandle(STD_OUTPUT_HANDLE) failed",
+                     "OutputFile::OpenStdout", std::nullopt,
+                     static_cast<uint32_t>(GetLastError())};
+    return false;
+  }
+  handle_ = h;
+  owns_ = false;
+  return true;
+}
+
+bool OutputFile::WriteOwned(std::vector<uint8_t> &&buf, ErrorInfo *err) {
+  return Write(buf.data(), buf.size(), err);
+}
+
+bool OutputFile::Write(const void *data, size_t size, ErrorInfo *err) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    const DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+    DWORD written = 0;
+    if (!WriteFile(static_cast<HANDLE>(handle_), p, chunk, &written,
+                   nullptr)) {
+      *err = ErrorInfo{"WriteFile failed", "OutputFile::Write", std::nullopt,
+                       static_cast<uint32_t>(GetLastError())};
+      return false;
+    }
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool OutputFile::Close(ErrorInfo *err) {
+  if (!handle_) {
+    return true;
+  }
+  const BOOL ok = owns_ ? CloseHandle(static_cast<HANDLE>(handle_)) : TRUE;
+  handle_ = nullptr;
+  if (!ok) {
+    *err = ErrorInfo{"CloseHandle failed", "OutputFile::Close", std::nullopt,
+                     static_cast<uint32_t>(GetLastError())};
+    return false;
+  }
+  return true;
+}
+
+#else
+
+bool OutputFile::Open(const std::string &path_utf8, bool overwrite,
+                      ErrorInfo *err) {
+  const int flags =
+      O_WRONLY | O_CREAT | O_CLOEXEC | (overwrite ? O_TRUNC : O_EXCL);
+  const int fd = open(path_utf8.c_str(), flags, 0644);
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      *err = ErrorInfo{"output exists (use --overwrite)", "OutputFile::Open",
+                       std::nullopt, std::nullopt};
+    } else {
+      *err = ErrorInfo{std::string("open failed: ") + strerror(errno),
+                       "OutputFile::Open", std::nullopt, std::nullopt};
+    }
+    return false;
+  }
+  fd_ = fd;
+  owns_ = true;
+  splice_ = false;
+  written_ = 0;
+  return true;
+}
+
+bool OutputFile::OpenStdout(ErrorInfo *err) {
+  (void)err;
+  fd_ = STDOUT_FILENO;
+  owns_ = false;
+  splice_ = false;
+  written_ = 0;
+#ifdef __linux__
+  struct stat st {};
+  if (fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode)) {
+    splice_ = true;
+    // Fewer, larger pipe transfers; failure just keeps the default size.
+    fcntl(fd_, F_SETPIPE_SZ, 1 << 20);
+  }
+#endif
+  return true;
+}
+
+bool OutputFile::WriteOwned(std::vector<uint8_t> &&buf, ErrorInfo *err) {
+  if (!splice_) {
+    return Write(buf.data(), buf.size(), err);
+  }
+  ReleaseConsumed();
+  if (spliced_bytes_ + buf.size() > kMaxSplicedBytes) {
+    return Write(buf.data(), buf.size(), err);
+  }
+  spliced_bytes_ += buf.size();
+  spliced_.push_back(SplicedBuffer{std::move(buf), 0});
+  SplicedBuffer &kept = spliced_.back();
+  const bool ok = Splice(kept.bytes.data(), kept.bytes.size(), err);
+  kept.end = written_;
+  return ok;
+}
+
+bool OutputFile::Splice(const uint8_t *data, size_t size, ErrorInfo *err) {
+#ifdef __linux__
+  while (size > 0) {
+    iovec iov{const_cast<uint8_t *>(data), size};
+    const ssize_t n = vmsplice(fd_, &iov, 1, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EINVAL || errno == ENOSYS) {
+        splice_ = false;
+        return Write(data, size, err);
+      }
+      *err = ErrorInfo{std::string("vmsplice failed: ") + strerror(errno),
+                       "OutputFile::Splice", std::nullopt, std::nullopt};
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+    written_ += static_cast<uint64_t>(n);
+  }
+  return true;
+#else
+  return Write(data, size, err);
+#endif
+}
+
+// The pipe is FIFO, so whatever is still unread is the last `pending`
+// bytes written; every buffer that ends before them has been consumed and
+// its pages are no longer referenced.
+void OutputFile::ReleaseConsumed() {
+  int pending = 0;
+  if (spliced_.empty() || ioctl(fd_, FIONREAD, &pending) != 0 ||
+      pending < 0) {
+    return;
+  }
+  const uint64_t unread = static_cast<uint64_t>(pending);
+  const uint64_t consumed = written_ > unread ? written_ - unread : 0;
+  while (!spliced_.empty() && spliced_.front().end <= consumed) {
+    spliced_bytes_ -= spliced_.front().bytes.size();
+    spliced_.pop_front();
+  }
+}
+
+void OutputFile::ReleaseSpliced() {
+  while (!spliced_.empty()) {
+    int pending = 0;
+    if (ioctl(fd_, FIONREAD, &pending) != 0 || pending <= 0) {
+      break;
+    }
+    pollfd p{fd_, 0, 0};
+    if (poll(&p, 1, 0) < 0 || (p.revents & (POLLERR | POLLHUP)) != 0) {
+      break; // reader is gone
+    }
+    usleep(1000);
+  }
+  spliced_.clear();
+  spliced_bytes_ = 0;
+}
+
+bool OutputFile::Write(const void *data, size_t size, ErrorInfo *err) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    const ssize_t n = write(fd_, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *err = ErrorInfo{std::string("write failed: ") + strerror(errno),
+                       "OutputFile::Write", std::nullopt, std::nullopt};
+      return false;
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+    written_ += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+bool OutputFile::Close(ErrorInfo *err) {
+  if (fd_ < 0) {
+    return true;
+  }
+  ReleaseSpliced();
+  const int rc = owns_ ? close(fd_) : 0;
+  fd_ = -1;
+  if (rc != 0) {
+    *err = ErrorInfo{std::string("close failed: ") + strerror(errno),
+                     "OutputFile::Close", std::nullopt, std::nullopt};
+    return false;
+  }
+  return true;
+}
+
+#endif
+
+bool WriteFileBytes(const std::string &path_utf8, bool overwrite,
+                    const void *data, size_t size, ErrorInfo *err) {
+  OutputFile f;
+  if (!f.Open(path_utf8, overwrite, err)) {
+    return false;
+  }
+  if (!f.Write(data, size, err)) {
+    return false;
+  }
+  return f.Close(err);
+}
+
+} // namespace sc
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+// Destination for encoded bytes. Encoders write to a sink as data becomes
+// ready instead of building the whole file in memory first.
+class ByteSink {
+public:
+  virtual ~ByteSink() = default;
+  virtual bool Write(const void *data, size_t size, ErrorInfo *err) = 0;
+  // Hands over a buffer the caller no longer needs, which lets a sink keep
+  // it alive instead of copying it.
+  virtual bool WriteOwned(std::vector<uint8_t> &&buf, ErrorInfo *err) {
+    return Write(buf.data(), buf.size(), err);
+  }
+};
+
+class VectorSink : public ByteSink {
+public:
+  explicit VectorSink(std::vector<uint8_t> *out) : out_(out) {}
+  bool Write(const void *data, size_t size, ErrorInfo *err) override;
+
+private:
+  std::vector<uint8_t> *out_;
+};
+
+class OutputFile : public ByteSink {
+public:
+  OutputFile() = default;
+  OutputFile(const OutputFile &) = delete;
+  OutputFile &operator=(const OutputFile &) = delete;
+  ~OutputFile() override;
+
+  // Without `overwrite` the file is created atomically and opening fails if
+  // it already exists, so there is no window between check and create.
+  bool Open(const std::string &path_utf8, bool overwrite, ErrorInfo *err);
+  // Writes to the process's standard output. On Linux, when stdout is a
+  // pipe, owned buffers are spliced into it with vmsplice instead of copied.
+  bool OpenStdout(ErrorInfo *err);
+  bool Write(const void *data, size_t size, ErrorInfo *err) override;
+  bool WriteOwned(std::vector<uint8_t> &&buf, ErrorInfo *err) override;
+  bool Close(ErrorInfo *err);
+
+private:
+#ifdef _WIN32
+  void *handle_ = nullptr;
+#else
+  struct SplicedBuffer {
+    std::vector<uint8_t> bytes;
+    uint64_t end = 0; // written_ just after its last byte
+  };
+
+  bool Splice(const uint8_t *data, size_t size, ErrorInfo *err);
+  // Frees the spliced buffers the reader has consumed.
+  void ReleaseConsumed();
+  void ReleaseSpliced();
+
+  int fd_ = -1;
+  bool splice_ = false;
+  uint64_t written_ = 0; // bytes handed to fd_ so far, spliced or copied
+  // Pages given to vmsplice stay referenced by the pipe until the reader
+  // consumes them, so they must not be reused before then.
+  std::deque<SplicedBuffer> spliced_;
+  size_t spliced_bytes_ = 0; // held in spliced_
+#endif
+  bool owns_ = true;
+};
+
+bool WriteFileBytes(const std::string &path_utf8, bool overwrite,
+                    const void *data, size_t size, ErrorInfo *err);
+
+} // namespace sc
@@ -0,0 +1,168 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sc {
+
+namespace {
+
+// Set on pool workers and on a thread while it runs a pass, so that nested
+// passes run inline instead of waiting on a busy pool.
+thread_local bool t_in_pass = false;
+
+int ResolveThreads(int threads) {
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  return std::clamp(threads, 1, 256);
+}
+
+// Fixed set of workers that, together with the caller, run the tasks of one
+// job at a time.
+class ThreadPool {
+public:
+  explicit ThreadPool(int threads) {
+    for (int i = 1; i < threads; ++i) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &t : workers_) {
+      t.join();
+    }
+  }
+
+  int threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  void Run(int tasks, const std::function<void(int)> &fn) {
+    std::lock_guard<std::mutex> run_lock(run_mu_);
+    uint64_t gen = 0;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      fn_ = &fn;
+      tasks_ = tasks;
+      next_ = 0;
+      done_ = 0;
+      gen = ++generation_;
+    }
+    wake_.notify_all();
+    RunTasks(gen);
+    std::unique_lock<std::mutex> lock(mu_);
+    finished_.wait(lock, [this] { return done_ == tasks_; });
+    fn_ = nullptr;
+  }
+
+private:
+  void WorkerLoop() {
+    t_in_pass = true;
+    uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+      }
+      RunTasks(seen);
+    }
+  }
+
+  // Claims and runs tasks of job `gen` until none are left. Claims are made
+  // under the lock so a late worker cannot take a task of a newer job.
+  void RunTasks(uint64_t gen) {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (generation_ == gen && fn_ && next_ < tasks_) {
+      const std::function<void(int)> *fn = fn_;
+      const int i = next_++;
+      lock.unlock();
+      (*fn)(i);
+      lock.lock();
+      if (++done_ == tasks_) {
+        finished_.notify_all();
+      }
+    }
+  }
+
+  std::mutex run_mu_; // one job at a time
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::condition_variable finished_;
+  std::vector<std::thread> workers_;
+  const std::function<void(int)> *fn_ = nullptr;
+  int tasks_ = 0;
+  int done_ = 0;
+  int next_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+};
+
+std::mutex g_config_mu;
+int g_threads = 0; // resolved lazily
+std::unique_ptr<ThreadPool> *g_pool = new std::unique_ptr<ThreadPool>();
+
+ThreadPool *Pool(int threads) {
+  std::lock_guard<std::mutex> lock(g_config_mu);
+  if (!*g_pool || (*g_pool)->threads() != threads) {
+    g_pool->reset();
+    *g_pool = std::make_unique<ThreadPool>(threads);
+  }
+  return g_pool->get();
+}
+
+} // namespace
+
+void SetParallelThreads(int threads) {
+  std::lock_guard<std::mutex> lock(g_config_mu);
+  g_threads = ResolveThreads(threads);
+}
+
+int ParallelThreads() {
+  std::lock_guard<std::mutex> lock(g_config_mu);
+  if (g_threads == 0) {
+    g_threads = ResolveThreads(0);
+  }
+  return g_threads;
+}
+
+void ParallelForRows(
+    int rows, size_t row_bytes,
+    const std::function<void(int band, int y0, int y1)> &body) {
+  if (rows <= 0) {
+    return;
+  }
+  const int threads = ParallelThreads();
+  const size_t bytes = static_cast<size_t>(rows) * row_bytes;
+  const int bands = std::min(threads, rows);
+  if (t_in_pass || bands <= 1 || bytes < kParallelMinBytes) {
+    const bool outer = t_in_pass;
+    t_in_pass = true;
+    body(0, 0, rows);
+    t_in_pass = outer;
+    return;
+  }
+  auto run_band = [&](int band) {
+    const int y0 = static_cast<int>(static_cast<int64_t>(rows) * band / bands);
+    const int y1 =
+        static_cast<int>(static_cast<int64_t>(rows) * (band + 1) / bands);
+    body(band, y0, y1);
+  };
+  t_in_pass = true;
+  Pool(threads)->Run(bands, run_band);
+  t_in_pass = false;
+}
+
+} // namespace sc
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace sc {
+
+// Passes over fewer bytes than this run on the calling thread; waking the
+// workers would cost more than it saves.
+constexpr size_t kParallelMinBytes = size_t{1} << 20;
+
+// Threads used by the image passes (copy, stats, swizzle), the calling
+// thread included; 0 = one per core. Set it before any pass starts. The
+// worker threads are created on the first parallel pass and kept for the
+// rest of the process.
+void SetParallelThreads(int threads);
+int ParallelThreads();
+
+// Splits rows [0, rows) into at most ParallelThreads() contiguous bands and
+// runs body(band, y0, y1) for each, on the workers and the calling thread,
+// returning once all are done. `band` is below ParallelThreads(), and the
+// split depends only on `rows` and the thread count, so per-band partial
+// results merged in band order are deterministic. A pass under
+// kParallelMinBytes (rows * row_bytes) runs as a single band 0, as does a
+// pass started from inside another one.
+void ParallelForRows(int rows, size_t row_bytes,
+                     const std::function<void(int band, int y0, int y1)> &body);
+
+} // namespace sc
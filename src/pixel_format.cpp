@@ -0,0 +1,667 @@
+#include "pixel_format.h"
+
+#include "image_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef SC_X86
+#include <immintrin.h>
+#endif
+
+namespace sc {
+
+namespace {
+
+// Fixed-point conversion weights, in 1/32768 units and ordered b, g, r to
+// match the bytes of a BGRA pixel. Chroma is computed from the sum of a
+// 2x2 block, hence its extra two bits of shift.
+constexpr int kLumaShift = 15;
+constexpr int kChromaShift = 17;
+
+struct YuvCoeffs {
+  int16_t y[3];
+  int16_t u[3];
+  int16_t v[3];
+  int32_t y_bias; // offset plus rounding, pre-shift
+  int32_t c_bias;
+};
+
+YuvCoeffs MakeYuvCoeffs(YuvMatrix matrix, YuvRange range) {
+  const double kr = matrix == YuvMatrix::kBt601 ? 0.299 : 0.2126;
+  const double kb = matrix == YuvMatrix::kBt601 ? 0.114 : 0.0722;
+  const bool full = range == YuvRange::kFull;
+  const double y_scale = full ? 1.0 : 219.0 / 255.0;
+  const double c_scale = full ? 1.0 : 224.0 / 255.0;
+  auto fix = [](double w) {
+    return static_cast<int>(std::lround(w * (1 << kLumaShift)));
+  };
+  YuvCoeffs c{};
+  // The middle weight absorbs the rounding so white maps exactly to the
+  // top of the range and greys to neutral chroma.
+  const int y_sum = fix(y_scale);
+  const int yb = fix(kb * y_scale);
+  const int yr = fix(kr * y_scale);
+  c.y[0] = static_cast<int16_t>(yb);
+  c.y[1] = static_cast<int16_t>(y_sum - yb - yr);
+  c.y[2] = static_cast<int16_t>(yr);
+  const int ub = fix(0.5 * c_scale);
+  const int ur = fix(-kr / (2.0 * (1.0 - kb)) * c_scale);
+  c.u[0] = static_cast<int16_t>(ub);
+  c.u[1] = static_cast<int16_t>(-ub - ur);
+  c.u[2] = static_cast<int16_t>(ur);
+  const int vr = fix(0.5 * c_scale);
+  const int vb = fix(-kb / (2.0 * (1.0 - kr)) * c_scale);
+  c.v[0] = static_cast<int16_t>(vb);
+  c.v[1] = static_cast<int16_t>(-vr - vb);
+  c.v[2] = static_cast<int16_t>(vr);
+  c.y_bias = ((full ? 0 : 16) << kLumaShift) + (1 << (kLumaShift - 1));
+  c.c_bias = (128 << kChromaShift) + (1 << (kChromaShift - 1));
+  return c;
+}
+
+const YuvCoeffs &CoeffsFor(const YuvOptions &opt) {
+  static const YuvCoeffs table[2][2] = {
+      {MakeYuvCoeffs(YuvMatrix::kBt601, YuvRange::kLimited),
+       MakeYuvCoeffs(YuvMatrix::kBt601, YuvRange::kFull)},
+      {MakeYuvCoeffs(YuvMatrix::kBt709, YuvRange::kLimited),
+       MakeYuvCoeffs(YuvMatrix::kBt709, YuvRange::kFull)},
+  };
+  return table[opt.matrix == YuvMatrix::kBt709][opt.range == YuvRange::kFull];
+}
+
+constexpr int16_t kGrayWeights[3] = {kLumaB, kLumaG, kLumaR};
+constexpr int32_t kGrayBias = 1 << (kLumaShift - 1);
+
+inline uint8_t Clamp8(int v) {
+  return static_cast<uint8_t>(std::clamp(v, 0, 255));
+}
+
+// Weighted sum of b, g, r per pixel: luma for YUV and for gray8.
+void LumaRowScalar(const uint8_t *bgra, int x, int width, const int16_t *w,
+                   int32_t bias, uint8_t *dst) {
+  for (; x < width; ++x) {
+    const uint8_t *p = bgra + x * 4;
+    dst[x] = Clamp8((w[0] * p[0] + w[1] * p[1] + w[2] * p[2] + bias) >>
+                    kLumaShift);
+  }
+}
+
+void ChromaScalar(const uint8_t *row0, const uint8_t *row1, int x, int width,
+                  const YuvCoeffs &c, uint8_t *u, uint8_t *v, int uv_step) {
+  for (; x < width; x += 2) {
+    const int x1 = std::min(x + 1, width - 1);
+    int s[3];
+    for (int ch = 0; ch < 3; ++ch) {
+      s[ch] = row0[x * 4 + ch] + row0[x1 * 4 + ch] + row1[x * 4 + ch] +
+              row1[x1 * 4 + ch];
+    }
+    const size_t i = static_cast<size_t>(x / 2) * uv_step;
+    u[i] = Clamp8((c.u[0] * s[0] + c.u[1] * s[1] + c.u[2] * s[2] + c.c_bias) >>
+                  kChromaShift);
+    v[i] = Clamp8((c.v[0] * s[0] + c.v[1] * s[1] + c.v[2] * s[2] + c.c_bias) >>
+                  kChromaShift);
+  }
+}
+
+template <int Bytes>
+void CopyRow(const uint8_t *src, int width, uint8_t *dst) {
+  memcpy(dst, src, static_cast<size_t>(width) * Bytes);
+}
+
+void RgbaRowScalarFrom(const uint8_t *bgra, int x, int width, uint8_t *dst) {
+  for (; x < width; ++x) {
+    uint32_t v;
+    memcpy(&v, bgra + x * 4, 4);
+    v = (v & 0xFF00FF00u) | ((v >> 16) & 0xFFu) | ((v & 0xFFu) << 16);
+    memcpy(dst + x * 4, &v, 4);
+  }
+}
+
+// Byte v becomes the 16-bit sample v * 257, i.e. the byte twice.
+void Rgba16RowScalarFrom(const uint8_t *bgra, int x, int width, uint8_t *dst) {
+  for (; x < width; ++x) {
+    const uint8_t *p = bgra + x * 4;
+    uint8_t *o = dst + x * 8;
+    o[0] = o[1] = p[2];
+    o[2] = o[3] = p[1];
+    o[4] = o[5] = p[0];
+    o[6] = o[7] = p[3];
+  }
+}
+
+void RgbRowScalarFrom(const uint8_t *bgra, int x, int width, uint8_t *dst) {
+  for (; x < width; ++x) {
+    dst[x * 3 + 0] = bgra[x * 4 + 2];
+    dst[x * 3 + 1] = bgra[x * 4 + 1];
+    dst[x * 3 + 2] = bgra[x * 4 + 0];
+  }
+}
+
+void RgbaRowScalar(const uint8_t *bgra, int width, uint8_t *dst) {
+  RgbaRowScalarFrom(bgra, 0, width, dst);
+}
+
+void Rgba16RowScalar(const uint8_t *bgra, int width, uint8_t *dst) {
+  Rgba16RowScalarFrom(bgra, 0, width, dst);
+}
+
+void RgbRowScalar(const uint8_t *bgra, int width, uint8_t *dst) {
+  RgbRowScalarFrom(bgra, 0, width, dst);
+}
+
+void GrayRowScalar(const uint8_t *bgra, int width, uint8_t *dst) {
+  LumaRowScalar(bgra, 0, width, kGrayWeights, kGrayBias, dst);
+}
+
+using LumaRowFn = void (*)(const uint8_t *bgra, int width, const int16_t *w,
+                           int32_t bias, uint8_t *dst);
+using ChromaRowFn = void (*)(const uint8_t *row0, const uint8_t *row1,
+                             int width, const YuvCoeffs &c, uint8_t *u,
+                             uint8_t *v, int uv_step);
+
+void LumaRowScalarAll(const uint8_t *bgra, int width, const int16_t *w,
+                      int32_t bias, uint8_t *dst) {
+  LumaRowScalar(bgra, 0, width, w, bias, dst);
+}
+
+void ChromaRowScalar(const uint8_t *row0, const uint8_t *row1, int width,
+                     const YuvCoeffs &c, uint8_t *u, uint8_t *v,
+                     int uv_step) {
+  ChromaScalar(row0, row1, 0, width, c, u, v, uv_step);
+}
+
+#ifdef SC_X86
+
+// madd leaves [bg, r] partial sums per pixel in adjacent 32-bit lanes; the
+// float shuffles gather the even and odd lanes of two registers so one add
+// finishes four pixels.
+SC_TARGET("sse2")
+inline __m128i SumLanePairs(__m128i lo, __m128i hi) {
+  const __m128 l = _mm_castsi128_ps(lo);
+  const __m128 h = _mm_castsi128_ps(hi);
+  return _mm_add_epi32(
+      _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0))),
+      _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+SC_TARGET("sse2")
+void LumaRowSse2(const uint8_t *bgra, int width, const int16_t *w,
+                 int32_t bias, uint8_t *dst) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i k = _mm_setr_epi16(w[0], w[1], w[2], 0, w[0], w[1], w[2], 0);
+  const __m128i b = _mm_set1_epi32(bias);
+  auto four = [&](__m128i px) {
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), k);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), k);
+    return _mm_srai_epi32(_mm_add_epi32(SumLanePairs(lo, hi), b), kLumaShift);
+  };
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m128i p0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + x * 4));
+    const __m128i p1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + x * 4 + 16));
+    const __m128i y16 = _mm_packs_epi32(four(p0), four(p1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x),
+                     _mm_packus_epi16(y16, y16));
+  }
+  LumaRowScalar(bgra, x, width, w, bias, dst);
+}
+
+// Eight pixels of two rows give four chroma samples: vertical sums in
+// 16 bits, then adjacent pixels added to [b, g, r, a] block sums.
+SC_TARGET("sse2")
+void ChromaRowSse2(const uint8_t *row0, const uint8_t *row1, int width,
+                   const YuvCoeffs &c, uint8_t *u, uint8_t *v, int uv_step) {
+  if (uv_step != 1 && uv_step != 2) {
+    ChromaScalar(row0, row1, 0, width, c, u, v, uv_step);
+    return;
+  }
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ku =
+      _mm_setr_epi16(c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0);
+  const __m128i kv =
+      _mm_setr_epi16(c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0);
+  const __m128i bias = _mm_set1_epi32(c.c_bias);
+  auto blocks = [&](const uint8_t *p0, const uint8_t *p1) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1));
+    const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                      _mm_unpacklo_epi8(b, zero));
+    const __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                      _mm_unpackhi_epi8(b, zero));
+    return _mm_add_epi16(_mm_unpacklo_epi64(s01, s23),
+                         _mm_unpackhi_epi64(s01, s23));
+  };
+  auto chroma = [&](__m128i q0, __m128i q1, __m128i k) {
+    const __m128i s =
+        SumLanePairs(_mm_madd_epi16(q0, k), _mm_madd_epi16(q1, k));
+    return _mm_srai_epi32(_mm_add_epi32(s, bias), kChromaShift);
+  };
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m128i q0 = blocks(row0 + x * 4, row1 + x * 4);
+    const __m128i q1 = blocks(row0 + x * 4 + 16, row1 + x * 4 + 16);
+    const __m128i cu = chroma(q0, q1, ku);
+    const __m128i cv = chroma(q0, q1, kv);
+    const size_t i = static_cast<size_t>(x / 2);
+    if (uv_step == 2) {
+      const __m128i uv16 = _mm_packs_epi32(_mm_unpacklo_epi32(cu, cv),
+                                           _mm_unpackhi_epi32(cu, cv));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(u + i * 2),
+                       _mm_packus_epi16(uv16, uv16));
+    } else {
+      const __m128i uv16 = _mm_packs_epi32(cu, cv);
+      const __m128i uv8 = _mm_packus_epi16(uv16, uv16);
+      const uint32_t u4 = static_cast<uint32_t>(_mm_cvtsi128_si32(uv8));
+      const uint32_t v4 =
+          static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(uv8, 4)));
+      memcpy(u + i, &u4, 4);
+      memcpy(v + i, &v4, 4);
+    }
+  }
+  ChromaScalar(row0, row1, x, width, c, u, v, uv_step);
+}
+
+SC_TARGET("sse2")
+void RgbaRowSse2(const uint8_t *bgra, int width, uint8_t *dst) {
+  const __m128i keep = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+  const __m128i low = _mm_set1_epi32(0xFF);
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i p =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + x * 4));
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+    const __m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                     _mm_or_si128(_mm_and_si128(p, keep), _mm_or_si128(r, b)));
+  }
+  RgbaRowScalarFrom(bgra, x, width, dst);
+}
+
+// The RGBA swizzle above, then every byte unpacked next to itself.
+SC_TARGET("sse2")
+void Rgba16RowSse2(const uint8_t *bgra, int width, uint8_t *dst) {
+  const __m128i keep = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+  const __m128i low = _mm_set1_epi32(0xFF);
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i p =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + x * 4));
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+    const __m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+    const __m128i rgba =
+        _mm_or_si128(_mm_and_si128(p, keep), _mm_or_si128(r, b));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 8),
+                     _mm_unpacklo_epi8(rgba, rgba));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 8 + 16),
+                     _mm_unpackhi_epi8(rgba, rgba));
+  }
+  Rgba16RowScalarFrom(bgra, x, width, dst);
+}
+
+SC_TARGET("sse2")
+void GrayRowSse2(const uint8_t *bgra, int width, uint8_t *dst) {
+  LumaRowSse2(bgra, width, kGrayWeights, kGrayBias, dst);
+}
+
+SC_TARGET("avx2")
+void RgbaRowAvx2(const uint8_t *bgra, int width, uint8_t *dst) {
+  const __m256i shuf = _mm256_setr_epi8(
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, //
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m256i p =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bgra + x * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4),
+                        _mm256_shuffle_epi8(p, shuf));
+  }
+  RgbaRowScalarFrom(bgra, x, width, dst);
+}
+
+// Each 128-bit lane packs four pixels into its low 12 bytes. The lanes are
+// stored 12 bytes apart, the 4 spare bytes of each store being overwritten
+// by the next one, so the loop stops while a full store still fits.
+SC_TARGET("avx2")
+void RgbRowAvx2(const uint8_t *bgra, int width, uint8_t *dst) {
+  const __m256i shuf = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, //
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  int x = 0;
+  for (; x + 10 <= width; x += 8) {
+    const __m256i p = _mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bgra + x * 4)),
+        shuf);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 3),
+                     _mm256_castsi256_si128(p));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 3 + 12),
+                     _mm256_extracti128_si256(p, 1));
+  }
+  RgbRowScalarFrom(bgra, x, width, dst);
+}
+
+#endif
+
+LumaRowFn LumaRowKernel(SimdLevel level) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kSse2) {
+    return LumaRowSse2;
+  }
+#else
+  (void)level;
+#endif
+  return LumaRowScalarAll;
+}
+
+ChromaRowFn ChromaRowKernel(SimdLevel level) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kSse2) {
+    return ChromaRowSse2;
+  }
+#else
+  (void)level;
+#endif
+  return ChromaRowScalar;
+}
+
+void RgbToBgraRow(const uint8_t *src, int width, uint8_t *bgra) {
+  for (int x = 0; x < width; ++x) {
+    const uint8_t *p = src + x * 3;
+    uint8_t *d = bgra + x * 4;
+    d[0] = p[2];
+    d[1] = p[1];
+    d[2] = p[0];
+    d[3] = 255;
+  }
+}
+
+void GrayToBgraRow(const uint8_t *src, int width, uint8_t *bgra) {
+  for (int x = 0; x < width; ++x) {
+    const uint32_t g = src[x];
+    const uint32_t v = 0xFF000000u | g << 16 | g << 8 | g;
+    memcpy(bgra + x * 4, &v, 4);
+  }
+}
+
+// Big-endian samples: the first byte of each is the high one.
+void Rgba16ToBgraRow(const uint8_t *src, int width, uint8_t *bgra) {
+  for (int x = 0; x < width; ++x) {
+    const uint8_t *p = src + x * 8;
+    uint8_t *d = bgra + x * 4;
+    d[0] = p[4];
+    d[1] = p[2];
+    d[2] = p[0];
+    d[3] = p[6];
+  }
+}
+
+// YUV to RGB weights in 1/65536 units, for samples already offset by the
+// range's black level and 128.
+constexpr int kRgbShift = 16;
+
+struct RgbCoeffs {
+  int32_t y;    // luma scale
+  int32_t v_r;  // V into R
+  int32_t u_g;  // U into G (subtracted)
+  int32_t v_g;  // V into G (subtracted)
+  int32_t u_b;  // U into B
+  int32_t y_offset;
+};
+
+RgbCoeffs MakeRgbCoeffs(YuvMatrix matrix, YuvRange range) {
+  const double kr = matrix == YuvMatrix::kBt601 ? 0.299 : 0.2126;
+  const double kb = matrix == YuvMatrix::kBt601 ? 0.114 : 0.0722;
+  const double kg = 1.0 - kr - kb;
+  const bool full = range == YuvRange::kFull;
+  const double y_scale = full ? 1.0 : 255.0 / 219.0;
+  const double c_scale = full ? 1.0 : 255.0 / 224.0;
+  auto fix = [](double w) {
+    return static_cast<int32_t>(std::lround(w * (1 << kRgbShift)));
+  };
+  RgbCoeffs c{};
+  c.y = fix(y_scale);
+  c.v_r = fix(2.0 * (1.0 - kr) * c_scale);
+  c.u_g = fix(2.0 * kb * (1.0 - kb) / kg * c_scale);
+  c.v_g = fix(2.0 * kr * (1.0 - kr) / kg * c_scale);
+  c.u_b = fix(2.0 * (1.0 - kb) * c_scale);
+  c.y_offset = full ? 0 : 16;
+  return c;
+}
+
+const RgbCoeffs &RgbCoeffsFor(const YuvOptions &opt) {
+  static const RgbCoeffs table[2][2] = {
+      {MakeRgbCoeffs(YuvMatrix::kBt601, YuvRange::kLimited),
+       MakeRgbCoeffs(YuvMatrix::kBt601, YuvRange::kFull)},
+      {MakeRgbCoeffs(YuvMatrix::kBt709, YuvRange::kLimited),
+       MakeRgbCoeffs(YuvMatrix::kBt709, YuvRange::kFull)},
+  };
+  return table[opt.matrix == YuvMatrix::kBt709][opt.range == YuvRange::kFull];
+}
+
+} // namespace
+
+const char *PixelFormatName(PixelFormat f) {
+  switch (f) {
+  case PixelFormat::kBgra8:
+    return "bgra8";
+  case PixelFormat::kRgba8:
+    return "rgba8";
+  case PixelFormat::kRgb8:
+    return "rgb8";
+  case PixelFormat::kGray8:
+    return "gray8";
+  case PixelFormat::kRgba16:
+    return "rgba16";
+  case PixelFormat::kNv12:
+    return "nv12";
+  case PixelFormat::kI420:
+    return "i420";
+  }
+  return "bgra8";
+}
+
+bool ParsePixelFormat(const char *s, PixelFormat *out) {
+  static const PixelFormat kAll[] = {
+      PixelFormat::kBgra8, PixelFormat::kRgba8,  PixelFormat::kRgb8,
+      PixelFormat::kGray8, PixelFormat::kRgba16, PixelFormat::kNv12,
+      PixelFormat::kI420};
+  for (PixelFormat f : kAll) {
+    if (strcmp(s, PixelFormatName(f)) == 0) {
+      *out = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsYuv420(PixelFormat f) {
+  return f == PixelFormat::kNv12 || f == PixelFormat::kI420;
+}
+
+int PixelFormatBytes(PixelFormat f) {
+  switch (f) {
+  case PixelFormat::kBgra8:
+  case PixelFormat::kRgba8:
+    return 4;
+  case PixelFormat::kRgba16:
+    return 8;
+  case PixelFormat::kRgb8:
+    return 3;
+  case PixelFormat::kGray8:
+  case PixelFormat::kNv12:
+  case PixelFormat::kI420:
+    return 1;
+  }
+  return 4;
+}
+
+const char *YuvMatrixName(YuvMatrix m) {
+  return m == YuvMatrix::kBt601 ? "bt601" : "bt709";
+}
+
+bool ParseYuvMatrix(const char *s, YuvMatrix *out) {
+  if (strcmp(s, "bt601") == 0) {
+    *out = YuvMatrix::kBt601;
+  } else if (strcmp(s, "bt709") == 0) {
+    *out = YuvMatrix::kBt709;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *YuvRangeName(YuvRange r) {
+  return r == YuvRange::kFull ? "full" : "limited";
+}
+
+bool ParseYuvRange(const char *s, YuvRange *out) {
+  if (strcmp(s, "limited") == 0) {
+    *out = YuvRange::kLimited;
+  } else if (strcmp(s, "full") == 0) {
+    *out = YuvRange::kFull;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+PackRowFn PackRowKernel(PixelFormat to, SimdLevel level) {
+  switch (to) {
+  case PixelFormat::kRgba8:
+#ifdef SC_X86
+    if (level >= SimdLevel::kAvx2) {
+      return RgbaRowAvx2;
+    }
+    if (level >= SimdLevel::kSse2) {
+      return RgbaRowSse2;
+    }
+#endif
+    return RgbaRowScalar;
+  case PixelFormat::kRgb8:
+    // SSE2 has no byte shuffle; the scalar loop is as fast as shifts.
+#ifdef SC_X86
+    if (level >= SimdLevel::kAvx2) {
+      return RgbRowAvx2;
+    }
+#endif
+    return RgbRowScalar;
+  case PixelFormat::kGray8:
+#ifdef SC_X86
+    if (level >= SimdLevel::kSse2) {
+      return GrayRowSse2;
+    }
+#endif
+    return GrayRowScalar;
+  case PixelFormat::kRgba16:
+#ifdef SC_X86
+    if (level >= SimdLevel::kSse2) {
+      return Rgba16RowSse2;
+    }
+#endif
+    return Rgba16RowScalar;
+  case PixelFormat::kBgra8:
+  case PixelFormat::kNv12:
+  case PixelFormat::kI420:
+    break;
+  }
+  (void)level;
+  return CopyRow<4>;
+}
+
+PackRowFn ConvertRowKernel(PixelFormat from, PixelFormat to,
+                           SimdLevel level) {
+  if (from == PixelFormat::kBgra8) {
+    return PackRowKernel(to, level);
+  }
+  if (from != to || IsYuv420(from)) {
+    return nullptr;
+  }
+  switch (PixelFormatBytes(from)) {
+  case 8:
+    return CopyRow<8>;
+  case 4:
+    return CopyRow<4>;
+  case 3:
+    return CopyRow<3>;
+  default:
+    return CopyRow<1>;
+  }
+}
+
+UnpackRowFn UnpackRowKernel(PixelFormat from, SimdLevel level) {
+  switch (from) {
+  case PixelFormat::kRgba8:
+    // Swapping R and B is its own inverse.
+    return PackRowKernel(PixelFormat::kRgba8, level);
+  case PixelFormat::kRgb8:
+    return RgbToBgraRow;
+  case PixelFormat::kGray8:
+    return GrayToBgraRow;
+  case PixelFormat::kRgba16:
+    return Rgba16ToBgraRow;
+  case PixelFormat::kBgra8:
+  case PixelFormat::kNv12:
+  case PixelFormat::kI420:
+    break;
+  }
+  return nullptr;
+}
+
+void YuvRowToBgra(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                  int uv_step, int chroma_shift, int width,
+                  const YuvOptions &opt, uint8_t *bgra) {
+  const RgbCoeffs &c = RgbCoeffsFor(opt);
+  constexpr int32_t kRound = 1 << (kRgbShift - 1);
+  for (int x = 0; x < width; ++x) {
+    const size_t i = static_cast<size_t>(x >> chroma_shift) * uv_step;
+    const int32_t yy = (y[x] - c.y_offset) * c.y + kRound;
+    const int32_t uu = u[i] - 128;
+    const int32_t vv = v[i] - 128;
+    uint8_t *d = bgra + x * 4;
+    d[0] = Clamp8((yy + c.u_b * uu) >> kRgbShift);
+    d[1] = Clamp8((yy - c.u_g * uu - c.v_g * vv) >> kRgbShift);
+    d[2] = Clamp8((yy + c.v_r * vv) >> kRgbShift);
+    d[3] = 255;
+  }
+}
+
+void ConvertYuv420Rows(const uint8_t *row0, const uint8_t *row1, int width,
+                       const YuvOptions &opt, uint8_t *y0, uint8_t *y1,
+                       uint8_t *u, uint8_t *v, int uv_step) {
+  const SimdLevel level = ActiveSimdLevel();
+  const YuvCoeffs &c = CoeffsFor(opt);
+  const LumaRowFn luma = LumaRowKernel(level);
+  luma(row0, width, c.y, c.y_bias, y0);
+  if (y1) {
+    luma(row1, width, c.y, c.y_bias, y1);
+  }
+  ChromaRowKernel(level)(row0, row1, width, c, u, v, uv_step);
+}
+
+PlaneLayout PlaneLayoutOf(PixelFormat f, int width, int height) {
+  PlaneLayout l;
+  l.luma_pitch = static_cast<size_t>(width) * PixelFormatBytes(f);
+  const size_t luma_size = l.luma_pitch * static_cast<size_t>(height);
+  l.size = luma_size;
+  if (!IsYuv420(f)) {
+    return l;
+  }
+  l.chroma_width = (width + 1) / 2;
+  l.chroma_height = (height + 1) / 2;
+  const size_t plane = static_cast<size_t>(l.chroma_width) * l.chroma_height;
+  l.u_offset = luma_size;
+  if (f == PixelFormat::kNv12) {
+    l.chroma_pitch = static_cast<size_t>(l.chroma_width) * 2;
+    l.v_offset = l.u_offset + 1;
+  } else {
+    l.chroma_pitch = static_cast<size_t>(l.chroma_width);
+    l.v_offset = l.u_offset + plane;
+  }
+  l.size = luma_size + plane * 2;
+  return l;
+}
+
+} // namespace sc
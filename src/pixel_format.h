@@ -0,0 +1,93 @@
+#pragma once
+
+#include "cpu_features.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sc {
+
+// Pixel layouts frames can be converted to from BGRA. The packed formats
+// keep one row per image row; the 4:2:0 formats are a full-size luma plane
+// followed by chroma at half width and height (rounded up): interleaved
+// U,V for nv12, separate U then V planes for i420. rgba16 has big-endian
+// samples, as PNG stores them; HDR captures fill it with full precision,
+// 8-bit sources widen each byte v to v * 257.
+enum class PixelFormat {
+  kBgra8,
+  kRgba8,
+  kRgb8,
+  kGray8, // BT.709 luma, full range, as used by the image stats
+  kRgba16,
+  kNv12,
+  kI420,
+};
+
+const char *PixelFormatName(PixelFormat f);
+bool ParsePixelFormat(const char *s, PixelFormat *out);
+bool IsYuv420(PixelFormat f);
+// Bytes per pixel of a packed format; 1 (the luma plane) for 4:2:0.
+int PixelFormatBytes(PixelFormat f);
+
+enum class YuvMatrix { kBt601, kBt709 };
+enum class YuvRange {
+  kLimited, // Y 16-235, chroma 16-240 (video levels)
+  kFull,    // 0-255
+};
+
+struct YuvOptions {
+  YuvMatrix matrix = YuvMatrix::kBt709;
+  YuvRange range = YuvRange::kLimited;
+};
+
+const char *YuvMatrixName(YuvMatrix m);
+bool ParseYuvMatrix(const char *s, YuvMatrix *out);
+const char *YuvRangeName(YuvRange r);
+bool ParseYuvRange(const char *s, YuvRange *out);
+
+// Converts `width` BGRA pixels into a packed format (not 4:2:0). Alpha is
+// carried into rgba8 unchanged and dropped otherwise.
+using PackRowFn = void (*)(const uint8_t *bgra, int width, uint8_t *dst);
+PackRowFn PackRowKernel(PixelFormat to, SimdLevel level);
+
+// Converts rows handed over in `from` to the packed format `to`: the pack
+// kernel for BGRA sources, a plain copy when both match, nullptr for any
+// other pair.
+PackRowFn ConvertRowKernel(PixelFormat from, PixelFormat to, SimdLevel level);
+
+// The reverse, for reading stored frames back: converts `width` pixels of
+// a packed format to BGRA. rgb8 and gray8 come out opaque and rgba16 keeps
+// the high byte of each sample; nullptr for bgra8 and 4:2:0.
+using UnpackRowFn = void (*)(const uint8_t *src, int width, uint8_t *bgra);
+UnpackRowFn UnpackRowKernel(PixelFormat from, SimdLevel level);
+
+// Converts a row of luma and its chroma to opaque BGRA. Pixel x takes
+// chroma sample x >> chroma_shift from u[i * uv_step] and v[i * uv_step]:
+// shift 1 for 4:2:0, 0 for 4:4:4.
+void YuvRowToBgra(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                  int uv_step, int chroma_shift, int width,
+                  const YuvOptions &opt, uint8_t *bgra);
+
+// Converts a pair of BGRA rows into two luma rows and one row of chroma:
+// (width + 1) / 2 samples written to u[i * uv_step] and v[i * uv_step], so
+// nv12 passes uv, uv + 1 and a step of 2. Each chroma sample is the mean of
+// a 2x2 block; a trailing odd column or row (row1 == row0, y1 == nullptr)
+// is averaged with itself. Every SIMD level gives the same bytes.
+void ConvertYuv420Rows(const uint8_t *row0, const uint8_t *row1, int width,
+                       const YuvOptions &opt, uint8_t *y0, uint8_t *y1,
+                       uint8_t *u, uint8_t *v, int uv_step);
+
+// Plane geometry of a converted frame. Packed formats use only luma_pitch.
+struct PlaneLayout {
+  size_t luma_pitch = 0;
+  int chroma_width = 0;
+  int chroma_height = 0;
+  size_t chroma_pitch = 0; // bytes per chroma row (one plane for i420)
+  size_t u_offset = 0;     // from the start of the frame
+  size_t v_offset = 0;
+  size_t size = 0; // whole frame
+};
+
+PlaneLayout PlaneLayoutOf(PixelFormat f, int width, int height);
+
+} // namespace sc
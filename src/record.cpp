@@ -0,0 +1,199 @@
+#include "record.h"
+
+#ifdef _WIN32
+#include "common.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace sc {
+
+namespace {
+
+// Spun rather than slept at the end of a wait; wider than the scheduler
+// jitter of a high-resolution sleep.
+constexpr auto kSpin = std::chrono::milliseconds(1);
+
+#ifdef _WIN32
+
+// Plain sleeps on Windows round up to the 15.6 ms system tick. A
+// high-resolution waitable timer (Windows 10 1803 and later) does not; one
+// is kept per thread.
+void CoarseSleep(std::chrono::steady_clock::duration d) {
+  thread_local HANDLE timer = CreateWaitableTimerExW(
+      nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+      TIMER_ALL_ACCESS);
+  using HundredNs = std::chrono::duration<int64_t, std::ratio<1, 10000000>>;
+  const int64_t hundred_ns =
+      std::chrono::duration_cast<HundredNs>(d).count();
+  if (timer) {
+    LARGE_INTEGER due{};
+    due.QuadPart = -hundred_ns; // negative: relative to now
+    if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+      WaitForSingleObject(timer, INFINITE);
+      return;
+    }
+  }
+  std::this_thread::sleep_for(d);
+}
+
+#else
+
+void CoarseSleep(std::chrono::steady_clock::duration d) {
+  std::this_thread::sleep_for(d);
+}
+
+#endif
+
+} // namespace
+
+FrameScheduler::FrameScheduler(double fps, int64_t slots,
+                               Clock::time_point start, SchedulerClock clock)
+    : fps_(fps), slots_(slots), start_(start), clock_(std::move(clock)) {}
+
+int64_t FrameScheduler::SlotsFor(const RecordOptions &opt) {
+  // The small margin keeps 3 s at 10 fps from rounding up to 31 slots.
+  const double slots = std::ceil(opt.duration_s * opt.fps - 1e-9);
+  return std::max<int64_t>(1, static_cast<int64_t>(slots));
+}
+
+FrameScheduler::Clock::time_point FrameScheduler::Deadline(int64_t slot) const {
+  return start_ + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double>(slot / fps_));
+}
+
+int64_t FrameScheduler::WaitNext() {
+  const Clock::time_point now = clock_.now();
+  if (now >= Deadline(next_ + 1)) {
+    // The slot now running; never behind next_, whatever the rounding.
+    const double elapsed = std::chrono::duration<double>(now - start_).count();
+    const int64_t current =
+        std::max(next_, static_cast<int64_t>(std::floor(elapsed * fps_)));
+    const int64_t skip_to = std::min(current, slots_);
+    dropped_ += skip_to - next_;
+    next_ = skip_to;
+  }
+  if (next_ >= slots_) {
+    return -1;
+  }
+  clock_.sleep_until(Deadline(next_));
+  return next_++;
+}
+
+void SleepUntil(std::chrono::steady_clock::time_point deadline) {
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point now = Clock::now();
+  if (deadline - now > kSpin) {
+    CoarseSleep(deadline - now - kSpin);
+  }
+  while (Clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
+
+void RecordTally::Add(const std::string &path, Clock::time_point due,
+                      Clock::time_point next_due, Clock::time_point done) {
+  latency_ms.push_back(
+      std::chrono::duration<double, std::milli>(done - due).count());
+  if (done > next_due) {
+    ++late;
+  }
+  // Several encode workers can finish frames out of order.
+  if (latency_ms.size() == 1 || due < first_due) {
+    first_due = due;
+    first_path = path;
+  }
+  if (latency_ms.size() == 1 || due > last_due) {
+    last_due = due;
+    last_path = path;
+  }
+}
+
+LatencySummary SummarizeLatency(std::vector<double> samples_ms) {
+  LatencySummary s;
+  if (samples_ms.empty()) {
+    return s;
+  }
+  std::sort(samples_ms.begin(), samples_ms.end());
+  const size_t n = samples_ms.size();
+  const auto rank = [&](double p) {
+    const size_t r =
+        static_cast<size_t>(std::ceil(p * static_cast<double>(n)));
+    return samples_ms[std::clamp<size_t>(r, 1, n) - 1];
+  };
+  s.p50_ms = rank(0.50);
+  s.p90_ms = rank(0.90);
+  s.p99_ms = rank(0.99);
+  s.max_ms = samples_ms.back();
+  double sum = 0.0;
+  for (double v : samples_ms) {
+    sum += v;
+  }
+  s.mean_ms = sum / static_cast<double>(n);
+  return s;
+}
+
+std::string LatencySummaryJson(const LatencySummary &s) {
+  std::ostringstream oss;
+  oss << "{\"p50\":" << s.p50_ms << ",\"p90\":" << s.p90_ms
+      << ",\"p99\":" << s.p99_ms << ",\"max\":" << s.max_ms
+      << ",\"mean\":" << s.mean_ms << '}';
+  return oss.str();
+}
+
+namespace {
+
+// Finds the next "{n}" or "{n:W}" at or after `from`; sets its length and
+// pad width.
+size_t FindFrameField(const std::string &p, size_t from, size_t *length,
+                      int *width) {
+  for (size_t i = p.find("{n", from); i != std::string::npos;
+       i = p.find("{n", i + 1)) {
+    if (i + 2 < p.size() && p[i + 2] == '}') {
+      *length = 3;
+      *width = 0;
+      return i;
+    }
+    if (i + 4 < p.size() && p[i + 2] == ':' && p[i + 3] >= '1' &&
+        p[i + 3] <= '9' && p[i + 4] == '}') {
+      *length = 5;
+      *width = p[i + 3] - '0';
+      return i;
+    }
+  }
+  return std::string::npos;
+}
+
+} // namespace
+
+bool IsFrameNamePattern(const std::string &pattern) {
+  size_t length = 0;
+  int width = 0;
+  return FindFrameField(pattern, 0, &length, &width) != std::string::npos;
+}
+
+std::string FormatFrameName(const std::string &pattern, int64_t index) {
+  std::string out;
+  size_t pos = 0;
+  size_t length = 0;
+  int width = 0;
+  for (size_t at = FindFrameField(pattern, 0, &length, &width);
+       at != std::string::npos;
+       at = FindFrameField(pattern, pos, &length, &width)) {
+    out.append(pattern, pos, at - pos);
+    const std::string digits = std::to_string(index);
+    if (static_cast<int>(digits.size()) < width) {
+      out.append(static_cast<size_t>(width) - digits.size(), '0');
+    }
+    out += digits;
+    pos = at + length;
+  }
+  out.append(pattern, pos, std::string::npos);
+  return out;
+}
+
+} // namespace sc
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "stage_pipeline.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+struct RecordOptions {
+  double fps = 1.0;        // frames due per second
+  double duration_s = 0.0; // no frame is started after this
+  // Stages behind the capture loop. A queue depth of 0 runs every stage
+  // back to back on the capture thread instead.
+  StagePipelineOptions pipeline;
+};
+
+// Blocks until `deadline`: sleeps for most of the wait and spins for the
+// last stretch, since a plain sleep can overshoot by a whole timer tick.
+void SleepUntil(std::chrono::steady_clock::time_point deadline);
+
+// Where a FrameScheduler reads the time and how it waits for a deadline;
+// tests substitute a fake clock.
+struct SchedulerClock {
+  using Clock = std::chrono::steady_clock;
+
+  std::function<Clock::time_point()> now = [] { return Clock::now(); };
+  std::function<void(Clock::time_point)> sleep_until = SleepUntil;
+};
+
+// Frame slots of a recording, due at fixed times from the start. Each
+// deadline is computed from the start and the slot number, never by adding
+// a period to the previous one, so rounding and late frames cannot make the
+// schedule drift.
+class FrameScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // `slots` frames, the first due at `start`.
+  FrameScheduler(double fps, int64_t slots, Clock::time_point start,
+                 SchedulerClock clock = SchedulerClock{});
+
+  // Slots due within `duration_s`, at least one.
+  static int64_t SlotsFor(const RecordOptions &opt);
+
+  Clock::time_point Deadline(int64_t slot) const;
+  // Waits for the next slot that can still be served and returns it, or -1
+  // once every slot has been served or dropped. A slot whose whole interval
+  // has already passed is skipped and counted as dropped, so a slow frame
+  // costs the slots it overran instead of a burst of catch-up frames.
+  int64_t WaitNext();
+  int64_t slots() const { return slots_; }
+  int64_t dropped() const { return dropped_; }
+
+private:
+  double fps_;
+  int64_t slots_;
+  Clock::time_point start_;
+  SchedulerClock clock_;
+  int64_t next_ = 0;
+  int64_t dropped_ = 0;
+};
+
+// Completed frames of a recording, tallied by whichever thread finishes
+// them: the capture loop, or the write stage when the stages are pipelined.
+// Latency runs from a frame's due time until its file is complete; a frame
+// is late when that is past the next frame's due time.
+struct RecordTally {
+  using Clock = std::chrono::steady_clock;
+
+  // The frame due at `due` was written to `path` at `done`.
+  void Add(const std::string &path, Clock::time_point due,
+           Clock::time_point next_due, Clock::time_point done);
+
+  std::vector<double> latency_ms;
+  int64_t late = 0;
+  std::string first_path;
+  std::string last_path;
+  Clock::time_point first_due{};
+  Clock::time_point last_due{};
+};
+
+struct LatencySummary {
+  double p50_ms = 0.0;
+  double p90_ms = 0.0;
+  double p99_ms = 0.0;
+  double max_ms = 0.0;
+  double mean_ms = 0.0;
+};
+
+// Nearest-rank percentiles of `samples_ms`; all zero when there are none.
+LatencySummary SummarizeLatency(std::vector<double> samples_ms);
+std::string LatencySummaryJson(const LatencySummary &s);
+
+// Output names for numbered frames: "{n}" in `pattern` becomes the frame
+// number and "{n:W}" the number zero-padded to W digits (1-9).
+bool IsFrameNamePattern(const std::string &pattern);
+std::string FormatFrameName(const std::string &pattern, int64_t index);
+
+} // namespace sc
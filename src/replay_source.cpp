@@ -0,0 +1,710 @@
+#include "replay_source.h"
+
+#include "capture_source.h"
+#include "encode_qoi.h"
+#include "encode_raw.h"
+#include "frame_copy.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace sc {
+
+namespace {
+
+using Kind = ReplayFrameLayout::Kind;
+
+constexpr int kMaxDim = 1 << 16;
+
+// Paths are UTF-8 on every platform.
+std::filesystem::path PathFromUtf8(const std::string &s) {
+  return std::filesystem::path(std::u8string(s.begin(), s.end()));
+}
+
+std::string Utf8FromPath(const std::filesystem::path &p) {
+  const std::u8string s = p.u8string();
+  return std::string(s.begin(), s.end());
+}
+
+ErrorInfo OpenError(const std::string &message) {
+  return ErrorInfo{message, "ReplayReader::Open", std::nullopt, std::nullopt};
+}
+
+bool StartsWith(const uint8_t *data, size_t size, const char *magic) {
+  const size_t n = strlen(magic);
+  return size >= n && memcmp(data, magic, n) == 0;
+}
+
+bool ParseDim(const std::string &s, int *out) {
+  if (s.empty() || s.size() > 6 ||
+      !std::all_of(s.begin(), s.end(),
+                   [](char c) { return isdigit(static_cast<unsigned char>(c)); })) {
+    return false;
+  }
+  *out = atoi(s.c_str());
+  return *out > 0 && *out <= kMaxDim;
+}
+
+// Whitespace-separated header tokens of a PNM image; '#' starts a comment
+// that runs to the end of the line.
+class PnmTokens {
+public:
+  PnmTokens(const uint8_t *data, size_t size, size_t pos)
+      : data_(data), size_(size), pos_(pos) {}
+
+  std::string Next() {
+    for (;;) {
+      while (pos_ < size_ && isspace(data_[pos_])) {
+        ++pos_;
+      }
+      if (pos_ >= size_ || data_[pos_] != '#') {
+        break;
+      }
+      while (pos_ < size_ && data_[pos_] != '\n') {
+        ++pos_;
+      }
+    }
+    const size_t begin = pos_;
+    while (pos_ < size_ && !isspace(data_[pos_])) {
+      ++pos_;
+    }
+    return std::string(reinterpret_cast<const char *>(data_ + begin),
+                       pos_ - begin);
+  }
+
+  // The pixels start after the single whitespace byte ending the header.
+  size_t DataStart() const { return pos_ + 1; }
+
+private:
+  const uint8_t *data_;
+  size_t size_;
+  size_t pos_;
+};
+
+// One P7, P6 or P5 image at `pos` of `data`; `*next` is set past it.
+bool ParsePnm(const uint8_t *data, size_t size, size_t pos,
+              ReplayFrameLayout *f, size_t *next, std::string *error) {
+  PnmTokens tok(data, size, pos);
+  const std::string magic = tok.Next();
+  int depth = 0;
+  int maxval = 0;
+  if (magic == "P7") {
+    for (std::string key = tok.Next(); key != "ENDHDR"; key = tok.Next()) {
+      if (key.empty()) {
+        *error = "unterminated PAM header";
+        return false;
+      }
+      const std::string value = tok.Next();
+      bool ok = true;
+      if (key == "WIDTH") {
+        ok = ParseDim(value, &f->width);
+      } else if (key == "HEIGHT") {
+        ok = ParseDim(value, &f->height);
+      } else if (key == "DEPTH") {
+        ok = ParseDim(value, &depth);
+      } else if (key == "MAXVAL") {
+        ok = ParseDim(value, &maxval);
+      } else if (key == "TUPLTYPE") {
+        // DEPTH alone decides the layout.
+      } else {
+        ok = false;
+      }
+      if (!ok) {
+        *error = "invalid PAM header field " + key;
+        return false;
+      }
+    }
+  } else if (magic == "P6" || magic == "P5") {
+    depth = magic == "P6" ? 3 : 1;
+    if (!ParseDim(tok.Next(), &f->width) || !ParseDim(tok.Next(), &f->height) ||
+        !ParseDim(tok.Next(), &maxval)) {
+      *error = "invalid " + magic + " header";
+      return false;
+    }
+  } else {
+    *error = "not a PAM/PPM/PGM image";
+    return false;
+  }
+  if (maxval == 255 && depth == 4) {
+    f->layout = PixelFormat::kRgba8;
+  } else if (maxval == 255 && depth == 3) {
+    f->layout = PixelFormat::kRgb8;
+  } else if (maxval == 255 && depth == 1) {
+    f->layout = PixelFormat::kGray8;
+  } else if (maxval == 65535 && depth == 4) {
+    f->layout = PixelFormat::kRgba16;
+  } else {
+    *error = "unsupported PNM depth " + std::to_string(depth) + " maxval " +
+             std::to_string(maxval);
+    return false;
+  }
+  f->kind = Kind::kPacked;
+  f->offset = tok.DataStart();
+  f->pitch = static_cast<size_t>(f->width) * PixelFormatBytes(f->layout);
+  f->bytes = f->pitch * static_cast<size_t>(f->height);
+  if (f->offset > size || size - f->offset < f->bytes) {
+    *error = "truncated PNM image";
+    return false;
+  }
+  *next = f->offset + f->bytes;
+  return true;
+}
+
+bool IndexPnm(const uint8_t *data, size_t size, size_t file,
+              std::vector<ReplayFrameLayout> *frames, std::string *error) {
+  size_t pos = 0;
+  while (pos < size) {
+    ReplayFrameLayout f;
+    f.file = file;
+    if (!ParsePnm(data, size, pos, &f, &pos, error)) {
+      return false;
+    }
+    frames->push_back(f);
+    // Trailing whitespace after the last image is tolerated.
+    while (pos < size && isspace(data[pos])) {
+      ++pos;
+    }
+  }
+  return true;
+}
+
+bool IndexY4m(const uint8_t *data, size_t size, size_t file,
+              std::vector<ReplayFrameLayout> *frames, std::string *error) {
+  const uint8_t *end = static_cast<const uint8_t *>(memchr(data, '\n', size));
+  if (!end) {
+    *error = "unterminated y4m header";
+    return false;
+  }
+  const std::string header(reinterpret_cast<const char *>(data),
+                           static_cast<size_t>(end - data));
+  ReplayFrameLayout f;
+  f.file = file;
+  f.yuv.matrix = YuvMatrix::kBt601;
+  f.yuv.range = YuvRange::kLimited;
+  std::string colorspace = "420";
+  double fps = 0.0;
+  size_t at = header.find(' ');
+  while (at != std::string::npos) {
+    const size_t next = header.find(' ', at + 1);
+    const std::string tok = header.substr(
+        at + 1, next == std::string::npos ? std::string::npos : next - at - 1);
+    at = next;
+    if (tok.empty()) {
+      continue;
+    }
+    const std::string value = tok.substr(1);
+    if (tok[0] == 'W' && !ParseDim(value, &f.width)) {
+      *error = "invalid y4m width";
+      return false;
+    }
+    if (tok[0] == 'H' && !ParseDim(value, &f.height)) {
+      *error = "invalid y4m height";
+      return false;
+    }
+    if (tok[0] == 'F') {
+      const double num = atof(value.c_str());
+      const size_t colon = value.find(':');
+      const double den =
+          colon == std::string::npos ? 0.0 : atof(value.c_str() + colon + 1);
+      fps = den > 0.0 ? num / den : 0.0;
+    }
+    if (tok[0] == 'C') {
+      colorspace = value;
+    }
+    if (tok == "XCOLORRANGE=FULL") {
+      f.yuv.range = YuvRange::kFull;
+    }
+  }
+  if (f.width == 0 || f.height == 0) {
+    *error = "y4m header lacks W or H";
+    return false;
+  }
+  const size_t w = static_cast<size_t>(f.width);
+  const size_t h = static_cast<size_t>(f.height);
+  f.pitch = w;
+  if (colorspace == "420" || colorspace == "420jpeg" ||
+      colorspace == "420mpeg2" || colorspace == "420paldv") {
+    // These differ only in chroma siting, which is ignored.
+    f.kind = Kind::kYuv;
+    f.chroma_shift = 1;
+    f.chroma_pitch = (w + 1) / 2;
+    f.u_offset = w * h;
+    f.v_offset = f.u_offset + f.chroma_pitch * ((h + 1) / 2);
+    f.bytes = f.v_offset + f.chroma_pitch * ((h + 1) / 2);
+  } else if (colorspace == "444") {
+    f.kind = Kind::kYuv;
+    f.chroma_shift = 0;
+    f.chroma_pitch = w;
+    f.u_offset = w * h;
+    f.v_offset = 2 * w * h;
+    f.bytes = 3 * w * h;
+  } else if (colorspace == "mono") {
+    f.kind = Kind::kPacked;
+    f.layout = PixelFormat::kGray8;
+    f.bytes = w * h;
+  } else {
+    *error = "unsupported y4m colorspace C" + colorspace;
+    return false;
+  }
+
+  size_t pos = static_cast<size_t>(end - data) + 1;
+  int index = 0;
+  while (pos < size) {
+    if (!StartsWith(data + pos, size - pos, "FRAME")) {
+      *error = "y4m frame header expected";
+      return false;
+    }
+    const void *nl = memchr(data + pos, '\n', size - pos);
+    if (!nl) {
+      *error = "unterminated y4m frame header";
+      return false;
+    }
+    f.offset = static_cast<size_t>(static_cast<const uint8_t *>(nl) - data) + 1;
+    if (size - f.offset < f.bytes) {
+      *error = "truncated y4m frame";
+      return false;
+    }
+    if (fps > 0.0) {
+      f.time = index / fps;
+    }
+    frames->push_back(f);
+    pos = f.offset + f.bytes;
+    ++index;
+  }
+  return true;
+}
+
+bool IndexQoi(const uint8_t *data, size_t size, size_t file,
+              std::vector<ReplayFrameLayout> *frames, std::string *error) {
+  if (size < 14) {
+    *error = "truncated QOI header";
+    return false;
+  }
+  auto be32 = [](const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+           static_cast<uint32_t>(p[2]) << 8 | p[3];
+  };
+  const uint32_t w = be32(data + 4);
+  const uint32_t h = be32(data + 8);
+  if (w == 0 || h == 0 || w > kMaxDim || h > kMaxDim) {
+    *error = "invalid QOI size";
+    return false;
+  }
+  ReplayFrameLayout f;
+  f.file = file;
+  f.kind = Kind::kQoi;
+  f.width = static_cast<int>(w);
+  f.height = static_cast<int>(h);
+  f.bytes = size;
+  frames->push_back(f);
+  return true;
+}
+
+// Frames written by SaveRawFrame: the sidecar describes the first, any
+// more follow back to back.
+bool IndexRaw(const std::string &path, size_t size, size_t file,
+              std::vector<ReplayFrameLayout> *frames, std::string *error) {
+  std::ifstream sidecar(PathFromUtf8(RawSidecarPath(path)), std::ios::binary);
+  if (!sidecar) {
+    *error = "cannot open sidecar: " + RawSidecarPath(path);
+    return false;
+  }
+  const std::string json((std::istreambuf_iterator<char>(sidecar)),
+                         std::istreambuf_iterator<char>());
+  RawFrameInfo info;
+  ErrorInfo parse_err;
+  if (!ParseRawFrameInfoJson(json, &info, &parse_err)) {
+    *error = parse_err.message + ": " + RawSidecarPath(path);
+    return false;
+  }
+  PixelFormat layout = PixelFormat::kBgra8;
+  ParsePixelFormat(info.pixel_layout.c_str(), &layout);
+  ReplayFrameLayout f;
+  f.file = file;
+  f.width = info.width;
+  f.height = info.height;
+  f.pitch = static_cast<size_t>(info.pitch);
+  f.origin_x = info.origin_x;
+  f.origin_y = info.origin_y;
+  f.layout = layout;
+  if (IsYuv420(layout)) {
+    f.kind = Kind::kYuv;
+    f.chroma_shift = 1;
+    f.chroma_pitch = static_cast<size_t>(info.chroma_pitch);
+    f.u_offset = info.u_offset;
+    f.v_offset = info.v_offset;
+    f.uv_step = layout == PixelFormat::kNv12 ? 2 : 1;
+    ParseYuvMatrix(info.yuv_matrix.c_str(), &f.yuv.matrix);
+    ParseYuvRange(info.yuv_range.c_str(), &f.yuv.range);
+    // Each chroma plane ends just past its last sample.
+    const size_t last = f.chroma_pitch * (static_cast<size_t>(f.height - 1) / 2) +
+                        static_cast<size_t>((f.width - 1) / 2 * f.uv_step) + 1;
+    f.bytes = std::max({f.pitch * static_cast<size_t>(f.height),
+                        f.u_offset + last, f.v_offset + last});
+  } else {
+    f.kind = Kind::kPacked;
+    f.bytes = f.pitch * static_cast<size_t>(f.height - 1) +
+              static_cast<size_t>(f.width) * PixelFormatBytes(layout);
+  }
+  // Frames are spaced a full frame apart, padding of the last row included.
+  const size_t stride =
+      f.kind == Kind::kPacked ? f.pitch * static_cast<size_t>(f.height)
+                              : f.bytes;
+  if (info.data_offset > size || size - info.data_offset < f.bytes) {
+    *error = "raw frame is shorter than its sidecar says";
+    return false;
+  }
+  for (size_t at = info.data_offset; size - at >= f.bytes; at += stride) {
+    f.offset = at;
+    frames->push_back(f);
+    if (size - at < stride) {
+      break;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+const char *ReplayPacingName(ReplayPacing p) {
+  return p == ReplayPacing::kOriginal ? "original" : "fast";
+}
+
+bool ParseReplayPacing(const char *s, ReplayPacing *out) {
+  if (strcmp(s, "fast") == 0) {
+    *out = ReplayPacing::kFast;
+  } else if (strcmp(s, "original") == 0) {
+    *out = ReplayPacing::kOriginal;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ReplayReader::Open(const std::string &path, ErrorInfo *err) {
+  Close();
+  std::error_code ec;
+  const std::filesystem::path p = PathFromUtf8(path);
+  if (!std::filesystem::is_directory(p, ec)) {
+    if (!IndexFile(path, err)) {
+      return false;
+    }
+  } else {
+    static const char *const kExtensions[] = {".raw", ".pam", ".ppm",
+                                              ".pgm", ".y4m", ".qoi"};
+    std::vector<std::filesystem::path> entries;
+    for (const auto &e : std::filesystem::directory_iterator(p, ec)) {
+      const std::string ext = Utf8FromPath(e.path().extension());
+      if (e.is_regular_file() &&
+          std::any_of(std::begin(kExtensions), std::end(kExtensions),
+                      [&](const char *x) { return ext == x; })) {
+        entries.push_back(e.path());
+      }
+    }
+    if (ec) {
+      *err = OpenError("cannot list " + path + ": " + ec.message());
+      return false;
+    }
+    std::sort(entries.begin(), entries.end());
+    for (const std::filesystem::path &e : entries) {
+      if (!IndexFile(Utf8FromPath(e), err)) {
+        return false;
+      }
+    }
+    // Frames dumped one per file keep their capture times in the files'
+    // modification times.
+    if (frames_.size() == files_.size() && !frames_.empty()) {
+      const auto first = std::filesystem::last_write_time(entries[0], ec);
+      for (size_t i = 0; i < entries.size() && !ec; ++i) {
+        const auto t = std::filesystem::last_write_time(entries[i], ec);
+        frames_[i].time =
+            std::chrono::duration<double>(t - first).count();
+      }
+      if (ec) {
+        for (ReplayFrameLayout &f : frames_) {
+          f.time.reset();
+        }
+      }
+    }
+  }
+  map_.Close();
+  if (frames_.empty()) {
+    *err = OpenError("no frames in " + path);
+    return false;
+  }
+  return true;
+}
+
+bool ReplayReader::IndexFile(const std::string &path, ErrorInfo *err) {
+  const size_t file = files_.size();
+  files_.push_back(path);
+  if (!Map(file, err)) {
+    return false;
+  }
+  const uint8_t *data = map_.data();
+  const size_t size = map_.size();
+  std::string error;
+  bool ok = false;
+  if (StartsWith(data, size, "YUV4MPEG2 ")) {
+    ok = IndexY4m(data, size, file, &frames_, &error);
+  } else if (StartsWith(data, size, "qoif")) {
+    ok = IndexQoi(data, size, file, &frames_, &error);
+  } else if (StartsWith(data, size, "P7\n") || StartsWith(data, size, "P6") ||
+             StartsWith(data, size, "P5")) {
+    ok = IndexPnm(data, size, file, &frames_, &error);
+  } else {
+    ok = IndexRaw(path, size, file, &frames_, &error);
+  }
+  if (!ok) {
+    *err = OpenError(error + ": " + path);
+  }
+  return ok;
+}
+
+bool ReplayReader::Map(size_t file, ErrorInfo *err) {
+  if (map_.data() && mapped_ == file) {
+    return true;
+  }
+  mapped_ = file;
+  return map_.Open(files_[file], err);
+}
+
+void ReplayReader::Close() {
+  files_.clear();
+  frames_.clear();
+  map_.Close();
+  mapped_ = 0;
+  scratch_ = ImageBuffer{};
+}
+
+std::optional<double> ReplayReader::timestamp(int index) const {
+  return frames_[static_cast<size_t>(index)].time;
+}
+
+bool ReplayReader::ZeroCopy(int index) const {
+  const ReplayFrameLayout &f = frames_[static_cast<size_t>(index)];
+  return f.kind == Kind::kPacked && f.layout == PixelFormat::kBgra8;
+}
+
+bool ReplayReader::Frame(int index, ImageView *out, ErrorInfo *err) {
+  if (index < 0 || index >= frame_count()) {
+    *err = ErrorInfo{"frame index out of range", "ReplayReader::Frame",
+                     std::nullopt, std::nullopt};
+    return false;
+  }
+  const ReplayFrameLayout &f = frames_[static_cast<size_t>(index)];
+  if (!Map(f.file, err)) {
+    return false;
+  }
+  if (map_.size() < f.offset || map_.size() - f.offset < f.bytes) {
+    *err = ErrorInfo{"replay file shrank: " + files_[f.file],
+                     "ReplayReader::Frame", std::nullopt, std::nullopt};
+    return false;
+  }
+  // Have the OS read the next frame while this one is being processed.
+  if (static_cast<size_t>(index) + 1 < frames_.size()) {
+    const ReplayFrameLayout &n = frames_[static_cast<size_t>(index) + 1];
+    if (n.file == f.file) {
+      map_.Prefetch(n.offset, n.bytes);
+    }
+  }
+  const uint8_t *base = map_.data() + f.offset;
+
+  if (f.kind == Kind::kPacked && f.layout == PixelFormat::kBgra8) {
+    *out = MappedView(base, f.pitch, f.width, f.height, f.origin_x,
+                      f.origin_y);
+    return true;
+  }
+  if (f.kind == Kind::kQoi) {
+    if (!DecodeQoi(base, f.bytes, &scratch_, err)) {
+      return false;
+    }
+  } else {
+    AllocateImage(f.width, f.height, &scratch_);
+    uint8_t *const dst = scratch_.bgra.data();
+    const size_t dst_pitch = static_cast<size_t>(scratch_.row_pitch);
+    const UnpackRowFn unpack =
+        f.kind == Kind::kPacked ? UnpackRowKernel(f.layout, ActiveSimdLevel())
+                                : nullptr;
+    ParallelForRows(
+        f.height, static_cast<size_t>(f.width) * 4,
+        [&](int band, int y0, int y1) {
+          (void)band;
+          for (int y = y0; y < y1; ++y) {
+            uint8_t *row = dst + static_cast<size_t>(y) * dst_pitch;
+            const uint8_t *src = base + static_cast<size_t>(y) * f.pitch;
+            if (unpack) {
+              unpack(src, f.width, row);
+              continue;
+            }
+            const size_t chroma =
+                static_cast<size_t>(y >> f.chroma_shift) * f.chroma_pitch;
+            YuvRowToBgra(src, base + f.u_offset + chroma,
+                         base + f.v_offset + chroma, f.uv_step,
+                         f.chroma_shift, f.width, f.yuv, row);
+          }
+        });
+  }
+  scratch_.origin_x = f.origin_x;
+  scratch_.origin_y = f.origin_y;
+  *out = scratch_;
+  return true;
+}
+
+namespace {
+
+// Replays a recording as if it were being captured: each Capture hands out
+// the next frame, straight from the mapped file when it is stored as BGRA.
+class ReplaySession : public CaptureSession {
+public:
+  ~ReplaySession() override { Close(); }
+
+  // Indexes the recording, so grabs only map, convert and pace frames.
+  bool Open(const CaptureRequest &req, ErrorInfo *err) override {
+    Close();
+    const ReplayOptions &opt = req.replay;
+    if (opt.path.empty()) {
+      *err = ErrorInfo{"replay needs a recording path", "ReplaySession",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    if (!reader_.Open(opt.path, err)) {
+      return false;
+    }
+    if (opt.start < 0 || opt.start >= reader_.frame_count()) {
+      *err = ErrorInfo{"replay start is past the last frame (" +
+                           std::to_string(reader_.frame_count()) + " frames)",
+                       "ReplaySession", std::nullopt, std::nullopt};
+      Close();
+      return false;
+    }
+    if (opt.pacing == ReplayPacing::kOriginal && opt.fps <= 0.0) {
+      for (int i = 0; i < reader_.frame_count(); ++i) {
+        if (!reader_.timestamp(i).has_value()) {
+          *err = ErrorInfo{"recording has no frame times (give a frame rate)",
+                           "ReplaySession", std::nullopt, std::nullopt};
+          Close();
+          return false;
+        }
+      }
+    }
+    opt_ = opt;
+    next_ = opt.start;
+    open_ = true;
+    return true;
+  }
+
+  bool Grab(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) override {
+    if (!open_) {
+      *err = ErrorInfo{"session is not open", "ReplaySession", std::nullopt,
+                       std::nullopt};
+      return false;
+    }
+    if (next_ >= reader_.frame_count()) {
+      if (!opt_.loop) {
+        *err = ErrorInfo{"end of replay", "ReplaySession", std::nullopt,
+                         std::nullopt};
+        return false;
+      }
+      Rewind(opt_);
+    }
+    const int index = next_++;
+    if (opt_.pacing == ReplayPacing::kOriginal) {
+      WaitFor(opt_, index);
+    }
+    ImageView view;
+    if (!reader_.Frame(index, &view, err)) {
+      return false;
+    }
+    current_ = index;
+    return DeliverFrame(view, AlphaPolicy::kKeep, sink, out, err);
+  }
+
+  void Close() override {
+    reader_.Close();
+    open_ = false;
+    next_ = 0;
+    current_ = -1;
+    first_ = -1;
+  }
+
+  std::string Details() const override {
+    if (current_ < 0) {
+      return {};
+    }
+    return "replay frame=" + std::to_string(current_) +
+           " frames=" + std::to_string(reader_.frame_count()) +
+           " zero_copy=" + (reader_.ZeroCopy(current_) ? "1" : "0");
+  }
+
+private:
+  double FrameTime(const ReplayOptions &opt, int index) const {
+    return opt.fps > 0.0 ? index / opt.fps : reader_.timestamp(index).value();
+  }
+
+  // Starts the next pass one average frame interval after the last frame,
+  // so looping keeps the recorded rate.
+  void Rewind(const ReplayOptions &opt) {
+    const int last = reader_.frame_count() - 1;
+    if (first_ >= 0 && opt.pacing == ReplayPacing::kOriginal) {
+      const double span = FrameTime(opt, last) - FrameTime(opt, first_);
+      const double interval =
+          last > 0 ? (FrameTime(opt, last) - FrameTime(opt, 0)) / last : 0.0;
+      epoch_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(std::max(0.0, span + interval)));
+      first_ = 0;
+    }
+    next_ = 0;
+  }
+
+  // Sleeps until frame `index` is due, counting from when the first frame
+  // of this pass went out.
+  void WaitFor(const ReplayOptions &opt, int index) {
+    const auto now = std::chrono::steady_clock::now();
+    if (first_ < 0) {
+      first_ = index;
+      epoch_ = now;
+      return;
+    }
+    const double offset = FrameTime(opt, index) - FrameTime(opt, first_);
+    const auto due =
+        epoch_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double>(std::max(0.0, offset)));
+    if (due > now) {
+      std::this_thread::sleep_until(due);
+    }
+  }
+
+  ReplayReader reader_;
+  ReplayOptions opt_;
+  bool open_ = false;
+  int next_ = 0;
+  int current_ = -1;
+  int first_ = -1; // frame the pacing clock started at
+  std::chrono::steady_clock::time_point epoch_;
+};
+
+std::unique_ptr<CaptureSession> CreateReplay() {
+  return std::make_unique<ReplaySession>();
+}
+
+CaptureCaps ReplayCaps() {
+  CaptureCaps caps;
+  caps.alpha = true; // bgra8 and rgba recordings keep theirs
+  return caps;
+}
+
+const bool kRegistered =
+    RegisterCaptureMethod({"replay", ReplayCaps(), CreateReplay});
+
+} // namespace
+
+} // namespace sc
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "pixel_format.h"
+#include "types.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+enum class ReplayPacing {
+  kFast,     // every frame as soon as it is asked for
+  kOriginal, // frames at their recorded times (or --replay-fps)
+};
+
+const char *ReplayPacingName(ReplayPacing p);
+bool ParseReplayPacing(const char *s, ReplayPacing *out);
+
+struct ReplayOptions {
+  std::string path; // a recording, or a directory of them
+  ReplayPacing pacing = ReplayPacing::kFast;
+  // Frames per second for original pacing; replaces the recorded times.
+  double fps = 0.0;
+  int start = 0;     // index of the first frame replayed
+  bool loop = false; // start over after the last frame
+};
+
+// Where one frame of a recording lives and how it is stored.
+struct ReplayFrameLayout {
+  enum class Kind { kPacked, kYuv, kQoi };
+
+  size_t file = 0;   // index into the reader's file list
+  size_t offset = 0; // first byte of the frame in its file
+  size_t bytes = 0;  // the whole frame, every plane included
+  Kind kind = Kind::kPacked;
+  PixelFormat layout = PixelFormat::kBgra8; // kPacked
+  int width = 0;
+  int height = 0;
+  size_t pitch = 0; // packed or luma rows
+  // kYuv: chroma planes, from `offset`.
+  size_t u_offset = 0;
+  size_t v_offset = 0;
+  size_t chroma_pitch = 0;
+  int uv_step = 1;
+  int chroma_shift = 1; // 1 for 4:2:0, 0 for 4:4:4, in x and y
+  YuvOptions yuv;
+  int origin_x = 0;
+  int origin_y = 0;
+  std::optional<double> time; // seconds after the first frame
+};
+
+// Frames of a recording, read through a memory map. Understands
+//   raw:  frames written by SaveRawFrame (layout from the .json sidecar),
+//         one or more back to back in the file
+//   pam, ppm, pgm: 8-bit P7/P6/P5 images (16-bit rgb_alpha P7 too), one or
+//         more concatenated
+//   y4m:  8-bit 4:2:0, 4:4:4 or mono YUV4MPEG2, BT.601 as is usual for it
+//   qoi
+// and a directory of such files, replayed in file-name order. A y4m file
+// carries its frame times; a directory of one-frame files takes them from
+// the files' modification times.
+class ReplayReader {
+public:
+  bool Open(const std::string &path, ErrorInfo *err);
+  void Close();
+
+  int frame_count() const { return static_cast<int>(frames_.size()); }
+  // Seconds after the first frame, when the recording has them.
+  std::optional<double> timestamp(int index) const;
+
+  // Points `out` at frame `index`. bgra8 raw frames are viewed in place in
+  // the mapped file; anything else is converted or decoded into a buffer
+  // owned by the reader. The view is valid until the next call.
+  bool Frame(int index, ImageView *out, ErrorInfo *err);
+  // Whether frame `index` is handed out without a copy.
+  bool ZeroCopy(int index) const;
+
+private:
+  bool IndexFile(const std::string &path, ErrorInfo *err);
+  bool Map(size_t file, ErrorInfo *err);
+
+  std::vector<std::string> files_;
+  std::vector<ReplayFrameLayout> frames_;
+  MappedFile map_; // the file of the frame handed out last
+  size_t mapped_ = 0;
+  ImageBuffer scratch_;
+};
+
+} // namespace sc
@@ -0,0 +1,375 @@
+#include "resample.h"
+
+#include "cpu_features.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#ifdef SC_X86
+#include <immintrin.h>
+#endif
+
+namespace sc {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+double Support(ScaleFilter filter) {
+  switch (filter) {
+  case ScaleFilter::kBox:
+    return 0.5;
+  case ScaleFilter::kBilinear:
+    return 1.0;
+  case ScaleFilter::kLanczos3:
+    return 3.0;
+  }
+  return 1.0;
+}
+
+double Sinc(double x) {
+  if (x == 0.0) {
+    return 1.0;
+  }
+  x *= kPi;
+  return std::sin(x) / x;
+}
+
+double Kernel(ScaleFilter filter, double x) {
+  switch (filter) {
+  case ScaleFilter::kBox:
+    return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+  case ScaleFilter::kBilinear:
+    x = std::fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+  case ScaleFilter::kLanczos3:
+    return x > -3.0 && x < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+  }
+  return 0.0;
+}
+
+// Source range and normalised weights for every output index along one
+// axis. When shrinking, the filter is widened by the scale factor so every
+// source pixel contributes.
+struct Taps {
+  int max_count = 0;
+  std::vector<int> begin;
+  std::vector<int> count;
+  std::vector<float> weights; // max_count per output index
+
+  const float *Weights(int i) const {
+    return weights.data() + static_cast<size_t>(i) * max_count;
+  }
+};
+
+Taps MakeTaps(int in_size, int out_size, ScaleFilter filter) {
+  const double scale = static_cast<double>(in_size) / out_size;
+  const double filter_scale = std::max(scale, 1.0);
+  const double support = Support(filter) * filter_scale;
+  Taps t;
+  t.max_count = static_cast<int>(std::ceil(support)) * 2 + 1;
+  t.begin.resize(static_cast<size_t>(out_size));
+  t.count.resize(static_cast<size_t>(out_size));
+  t.weights.assign(static_cast<size_t>(out_size) * t.max_count, 0.0f);
+  std::vector<double> w(static_cast<size_t>(t.max_count));
+  for (int i = 0; i < out_size; ++i) {
+    const double center = (i + 0.5) * scale;
+    // Source k sits at k + 0.5. Every k the support reaches is taken, ends
+    // included: a box tap centred on a pixel edge covers only the pixel to
+    // its left.
+    const int lo = std::max(
+        static_cast<int>(std::floor(center - support - 0.5)), 0);
+    const int hi = std::min(
+        static_cast<int>(std::floor(center + support - 0.5)) + 1, in_size);
+    const int n = std::min(hi - lo, t.max_count);
+    double sum = 0.0;
+    for (int k = 0; k < n; ++k) {
+      w[static_cast<size_t>(k)] =
+          Kernel(filter, (k + lo - center + 0.5) / filter_scale);
+      sum += w[static_cast<size_t>(k)];
+    }
+    float *dst = t.weights.data() + static_cast<size_t>(i) * t.max_count;
+    for (int k = 0; k < n; ++k) {
+      dst[k] = static_cast<float>(sum != 0.0 ? w[static_cast<size_t>(k)] / sum
+                                             : 0.0);
+    }
+    t.begin[static_cast<size_t>(i)] = lo;
+    t.count[static_cast<size_t>(i)] = n;
+  }
+  return t;
+}
+
+// Row kernels. Pixels are held as four floats in BGRA order: colour times
+// (alpha + 1) / 256, then alpha.
+struct ResampleKernels {
+  // `width` BGRA pixels, `alpha_or` ORed in, to weighted floats.
+  void (*weigh)(const uint8_t *src, int width, uint32_t alpha_or,
+                float *out);
+  // out[i] = sum of taps.Weights(i)[k] * in[taps.begin[i] + k].
+  void (*horizontal)(const float *in, const Taps &taps, int out_width,
+                     float *out);
+  // acc = sum of weights[k] * rows[k], then back to BGRA bytes in `dst`.
+  void (*vertical)(const float *const *rows, const float *weights, int count,
+                   int width, float *acc, uint8_t *dst);
+};
+
+void WeighScalar(const uint8_t *src, int width, uint32_t alpha_or,
+                 float *out) {
+  for (int x = 0; x < width; ++x) {
+    uint32_t px;
+    memcpy(&px, src + x * 4, 4);
+    px |= alpha_or;
+    const float a = static_cast<float>(px >> 24);
+    const float wgt = (a + 1.0f) * (1.0f / 256.0f);
+    out[x * 4 + 0] = static_cast<float>(px & 0xFF) * wgt;
+    out[x * 4 + 1] = static_cast<float>((px >> 8) & 0xFF) * wgt;
+    out[x * 4 + 2] = static_cast<float>((px >> 16) & 0xFF) * wgt;
+    out[x * 4 + 3] = a;
+  }
+}
+
+void HorizontalScalar(const float *in, const Taps &taps, int out_width,
+                      float *out) {
+  for (int i = 0; i < out_width; ++i) {
+    const float *w = taps.Weights(i);
+    const float *p = in + static_cast<size_t>(taps.begin[i]) * 4;
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int k = 0; k < taps.count[i]; ++k) {
+      for (int c = 0; c < 4; ++c) {
+        acc[c] += w[k] * p[k * 4 + c];
+      }
+    }
+    memcpy(out + static_cast<size_t>(i) * 4, acc, sizeof(acc));
+  }
+}
+
+uint8_t ToByte(float v) {
+  return static_cast<uint8_t>(std::clamp(std::nearbyint(v), 0.0f, 255.0f));
+}
+
+// Undoes the (alpha + 1) / 256 weighting of pixels [x, width) of `acc`.
+void UnweighScalar(const float *acc, int x, int width, uint8_t *dst) {
+  for (; x < width; ++x) {
+    const float *p = acc + static_cast<size_t>(x) * 4;
+    const float inv = 256.0f / (std::max(p[3], 0.0f) + 1.0f);
+    dst[x * 4 + 0] = ToByte(p[0] * inv);
+    dst[x * 4 + 1] = ToByte(p[1] * inv);
+    dst[x * 4 + 2] = ToByte(p[2] * inv);
+    dst[x * 4 + 3] = ToByte(p[3]);
+  }
+}
+
+void VerticalScalar(const float *const *rows, const float *weights, int count,
+                    int width, float *acc, uint8_t *dst) {
+  const size_t n = static_cast<size_t>(width) * 4;
+  for (size_t i = 0; i < n; ++i) {
+    acc[i] = weights[0] * rows[0][i];
+  }
+  for (int k = 1; k < count; ++k) {
+    for (size_t i = 0; i < n; ++i) {
+      acc[i] += weights[k] * rows[k][i];
+    }
+  }
+  UnweighScalar(acc, 0, width, dst);
+}
+
+#ifdef SC_X86
+
+// One pixel per vector. The multiplies and adds are the scalar ones in the
+// same order, so every level produces the same bytes.
+SC_TARGET("sse2")
+__m128 WeighPixelSse2(__m128i px32) {
+  const __m128 rgb_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  const __m128 alpha_one = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+  const __m128 v = _mm_cvtepi32_ps(px32);
+  const __m128 a = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+  const __m128 wgt = _mm_mul_ps(_mm_add_ps(a, _mm_set1_ps(1.0f)),
+                                _mm_set1_ps(1.0f / 256.0f));
+  return _mm_mul_ps(v, _mm_or_ps(_mm_and_ps(wgt, rgb_mask), alpha_one));
+}
+
+SC_TARGET("sse2")
+void WeighSse2(const uint8_t *src, int width, uint32_t alpha_or, float *out) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(alpha_or));
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i v = _mm_or_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4)),
+        alpha);
+    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+    float *o = out + static_cast<size_t>(x) * 4;
+    _mm_storeu_ps(o + 0, WeighPixelSse2(_mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_ps(o + 4, WeighPixelSse2(_mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_ps(o + 8, WeighPixelSse2(_mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_ps(o + 12, WeighPixelSse2(_mm_unpackhi_epi16(hi, zero)));
+  }
+  WeighScalar(src + x * 4, width - x, alpha_or,
+              out + static_cast<size_t>(x) * 4);
+}
+
+SC_TARGET("sse2")
+void HorizontalSse2(const float *in, const Taps &taps, int out_width,
+                    float *out) {
+  for (int i = 0; i < out_width; ++i) {
+    const float *w = taps.Weights(i);
+    const float *p = in + static_cast<size_t>(taps.begin[i]) * 4;
+    __m128 acc = _mm_setzero_ps();
+    for (int k = 0; k < taps.count[i]; ++k) {
+      acc = _mm_add_ps(acc,
+                       _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(p + k * 4)));
+    }
+    _mm_storeu_ps(out + static_cast<size_t>(i) * 4, acc);
+  }
+}
+
+SC_TARGET("sse2")
+__m128i UnweighPixelSse2(const float *p) {
+  const __m128 rgb_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  const __m128 alpha_one = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+  const __m128 v = _mm_loadu_ps(p);
+  const __m128 a = _mm_max_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)),
+                              _mm_setzero_ps());
+  const __m128 inv =
+      _mm_div_ps(_mm_set1_ps(256.0f), _mm_add_ps(a, _mm_set1_ps(1.0f)));
+  // Round to nearest even, as nearbyint does; the packs below saturate.
+  return _mm_cvtps_epi32(
+      _mm_mul_ps(v, _mm_or_ps(_mm_and_ps(inv, rgb_mask), alpha_one)));
+}
+
+SC_TARGET("sse2")
+void VerticalSse2(const float *const *rows, const float *weights, int count,
+                  int width, float *acc, uint8_t *dst) {
+  const size_t n = static_cast<size_t>(width) * 4;
+  const __m128 w0 = _mm_set1_ps(weights[0]);
+  for (size_t i = 0; i < n; i += 4) {
+    _mm_storeu_ps(acc + i, _mm_mul_ps(w0, _mm_loadu_ps(rows[0] + i)));
+  }
+  for (int k = 1; k < count; ++k) {
+    const __m128 w = _mm_set1_ps(weights[k]);
+    const float *row = rows[k];
+    for (size_t i = 0; i < n; i += 4) {
+      _mm_storeu_ps(acc + i,
+                    _mm_add_ps(_mm_loadu_ps(acc + i),
+                               _mm_mul_ps(w, _mm_loadu_ps(row + i))));
+    }
+  }
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const float *p = acc + static_cast<size_t>(x) * 4;
+    const __m128i p01 =
+        _mm_packs_epi32(UnweighPixelSse2(p), UnweighPixelSse2(p + 4));
+    const __m128i p23 =
+        _mm_packs_epi32(UnweighPixelSse2(p + 8), UnweighPixelSse2(p + 12));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                     _mm_packus_epi16(p01, p23));
+  }
+  UnweighScalar(acc, x, width, dst);
+}
+
+#endif
+
+ResampleKernels KernelsFor(SimdLevel level) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kSse2) {
+    return {WeighSse2, HorizontalSse2, VerticalSse2};
+  }
+#else
+  (void)level;
+#endif
+  return {WeighScalar, HorizontalScalar, VerticalScalar};
+}
+
+} // namespace
+
+const char *ScaleFilterName(ScaleFilter filter) {
+  switch (filter) {
+  case ScaleFilter::kBox:
+    return "box";
+  case ScaleFilter::kBilinear:
+    return "bilinear";
+  case ScaleFilter::kLanczos3:
+    return "lanczos3";
+  }
+  return "box";
+}
+
+bool ParseScaleFilter(const char *s, ScaleFilter *out) {
+  for (ScaleFilter f :
+       {ScaleFilter::kBox, ScaleFilter::kBilinear, ScaleFilter::kLanczos3}) {
+    if (strcmp(s, ScaleFilterName(f)) == 0) {
+      *out = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ScaledSize(int width, int height, double scale, int max_width,
+                int max_height, int *out_width, int *out_height) {
+  double s = std::min(scale, 1.0);
+  if (max_width > 0) {
+    s = std::min(s, static_cast<double>(max_width) / width);
+  }
+  if (max_height > 0) {
+    s = std::min(s, static_cast<double>(max_height) / height);
+  }
+  int w = static_cast<int>(std::lround(width * s));
+  int h = static_cast<int>(std::lround(height * s));
+  w = std::clamp(w, 1, max_width > 0 ? std::min(width, max_width) : width);
+  h = std::clamp(h, 1, max_height > 0 ? std::min(height, max_height) : height);
+  *out_width = w;
+  *out_height = h;
+}
+
+void ResampleImage(const ImageView &src, AlphaPolicy alpha, ScaleFilter filter,
+                   int out_width, int out_height, ImageBuffer *dst) {
+  AllocateImage(out_width, out_height, dst);
+  dst->origin_x = src.origin_x;
+  dst->origin_y = src.origin_y;
+  const uint32_t alpha_or = alpha == AlphaPolicy::kForceOpaque ? 0xFF000000u
+                                                               : 0u;
+  const Taps h = MakeTaps(src.width, out_width, filter);
+  const Taps v = MakeTaps(src.height, out_height, filter);
+  const ResampleKernels kernels = KernelsFor(ActiveSimdLevel());
+  const size_t row_floats = static_cast<size_t>(out_width) * 4;
+  // Each output row costs about src.height / out_height source rows.
+  const size_t row_cost = static_cast<size_t>(src.width) * 4 *
+                          std::max(1, src.height / out_height);
+  ParallelForRows(out_height, row_cost, [&](int band, int y0, int y1) {
+    (void)band;
+    // Source row r, filtered horizontally, lives in ring slot r % ring_rows
+    // until row r + ring_rows replaces it; the vertical taps of one output
+    // row never span more than ring_rows rows.
+    const int ring_rows = v.max_count;
+    std::vector<float> weighed(static_cast<size_t>(src.width) * 4);
+    std::vector<float> ring(static_cast<size_t>(ring_rows) * row_floats);
+    std::vector<float> acc(row_floats);
+    std::vector<const float *> rows(static_cast<size_t>(ring_rows));
+    int next = v.begin[static_cast<size_t>(y0)];
+    for (int y = y0; y < y1; ++y) {
+      const int begin = v.begin[static_cast<size_t>(y)];
+      const int count = v.count[static_cast<size_t>(y)];
+      for (int r = std::max(next, begin); r < begin + count; ++r) {
+        kernels.weigh(src.Row(r), src.width, alpha_or, weighed.data());
+        kernels.horizontal(weighed.data(), h, out_width,
+                           ring.data() + (r % ring_rows) * row_floats);
+      }
+      next = std::max(next, begin + count);
+      for (int k = 0; k < count; ++k) {
+        rows[static_cast<size_t>(k)] =
+            ring.data() + ((begin + k) % ring_rows) * row_floats;
+      }
+      kernels.vertical(rows.data(), v.Weights(y), count, out_width,
+                       acc.data(),
+                       dst->bgra.data() +
+                           static_cast<size_t>(y) * dst->row_pitch);
+    }
+  });
+}
+
+} // namespace sc
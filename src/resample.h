@@ -0,0 +1,36 @@
+#pragma once
+
+#include "frame_copy.h"
+#include "types.h"
+
+namespace sc {
+
+enum class ScaleFilter {
+  kBox,      // area average when shrinking
+  kBilinear, // triangle
+  kLanczos3, // windowed sinc, 3 lobes
+};
+
+const char *ScaleFilterName(ScaleFilter filter);
+bool ParseScaleFilter(const char *s, ScaleFilter *out);
+
+// Size of a width x height image scaled by `scale` and then shrunk to fit
+// max_width x max_height (0 = no limit) with its aspect ratio kept. Never
+// larger than the input nor smaller than 1x1.
+void ScaledSize(int width, int height, double scale, int max_width,
+                int max_height, int *out_width, int *out_height);
+
+// Resamples `src` into `dst` at out_width x out_height with a separable
+// filter: each output band filters its source rows horizontally into a
+// small ring of float rows, then filters the ring vertically, so no full
+// size intermediate is kept. Bands run on the parallel row pool.
+//
+// Colour is weighted by (alpha + 1) / 256 while filtering, so translucent
+// edges do not bleed the colour of transparent pixels, and an image whose
+// alpha is uniform (including 0, as some captures leave it) is filtered as
+// plain colour. `alpha` is applied to the source pixels first. dst keeps
+// src's origin.
+void ResampleImage(const ImageView &src, AlphaPolicy alpha, ScaleFilter filter,
+                   int out_width, int out_height, ImageBuffer *dst);
+
+} // namespace sc
@@ -0,0 +1,234 @@
+#include "rotate.h"
+
+#include "cpu_features.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifdef SC_X86
+#include <immintrin.h>
+#endif
+
+namespace sc {
+
+namespace {
+
+// Pixels per side of the tiles a transpose walks; a 64x64 tile of each
+// side is 16 KiB, so both stay in L1/L2 while the tile is done.
+constexpr int kTile = 64;
+constexpr int kBlock = 8;
+
+// dst(r, c) = src(c, r) for an 8x8 block of 32-bit pixels. Strides are in
+// bytes and may be negative, which turns the transpose into a rotation.
+using Transpose8Fn = void (*)(const uint8_t *src, ptrdiff_t src_stride,
+                              uint8_t *dst, ptrdiff_t dst_stride);
+// Reverses the order of `width` pixels.
+using ReverseRowFn = void (*)(const uint8_t *src, int width, uint8_t *dst);
+
+void TransposeScalar(const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst,
+                     ptrdiff_t dst_stride, int rows, int cols) {
+  for (int r = 0; r < rows; ++r) {
+    uint8_t *d = dst + r * dst_stride;
+    for (int c = 0; c < cols; ++c) {
+      memcpy(d + c * 4, src + c * src_stride + r * 4, 4);
+    }
+  }
+}
+
+void Transpose8Scalar(const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst,
+                      ptrdiff_t dst_stride) {
+  TransposeScalar(src, src_stride, dst, dst_stride, kBlock, kBlock);
+}
+
+void ReverseRowScalar(const uint8_t *src, int width, uint8_t *dst) {
+  for (int x = 0; x < width; ++x) {
+    memcpy(dst + x * 4, src + (width - 1 - x) * 4, 4);
+  }
+}
+
+#ifdef SC_X86
+
+// Four 4x4 transposes with epi32/epi64 unpacks. Wider registers do not
+// help: with the tiling the pass runs at memory bandwidth.
+SC_TARGET("sse2")
+void Transpose8Sse2(const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst,
+                    ptrdiff_t dst_stride) {
+  for (int bc = 0; bc < kBlock; bc += 4) {
+    for (int br = 0; br < kBlock; br += 4) {
+      const uint8_t *s = src + bc * src_stride + br * 4;
+      const __m128i r0 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+      const __m128i r1 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + src_stride));
+      const __m128i r2 = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(s + 2 * src_stride));
+      const __m128i r3 = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(s + 3 * src_stride));
+      const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+      const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+      const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+      const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+      uint8_t *d = dst + br * dst_stride + bc * 4;
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+                       _mm_unpacklo_epi64(t0, t1));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(d + dst_stride),
+                       _mm_unpackhi_epi64(t0, t1));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 2 * dst_stride),
+                       _mm_unpacklo_epi64(t2, t3));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 3 * dst_stride),
+                       _mm_unpackhi_epi64(t2, t3));
+    }
+  }
+}
+
+SC_TARGET("sse2")
+void ReverseRowSse2(const uint8_t *src, int width, uint8_t *dst) {
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i v = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(src + (width - 4 - x) * 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                     _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+  }
+  ReverseRowScalar(src, width - x, dst + x * 4);
+}
+
+#endif
+
+Transpose8Fn Transpose8Kernel(SimdLevel level) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kSse2) {
+    return Transpose8Sse2;
+  }
+#else
+  (void)level;
+#endif
+  return Transpose8Scalar;
+}
+
+ReverseRowFn ReverseRowKernel(SimdLevel level) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kSse2) {
+    return ReverseRowSse2;
+  }
+#else
+  (void)level;
+#endif
+  return ReverseRowScalar;
+}
+
+// dst(r, c) = src(c, r) for r < rows, c < cols, through signed strides:
+// tile by tile, 8x8 blocks inside a tile, scalar at the ragged edges.
+// Output rows are split across the row pool.
+void Transpose(const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst,
+               ptrdiff_t dst_stride, int rows, int cols) {
+  const Transpose8Fn kernel = Transpose8Kernel(ActiveSimdLevel());
+  const int tile_rows = (rows + kTile - 1) / kTile;
+  ParallelForRows(
+      tile_rows, static_cast<size_t>(cols) * 4 * kTile,
+      [&](int band, int t0, int t1) {
+        (void)band;
+        for (int r0 = t0 * kTile; r0 < std::min(t1 * kTile, rows);
+             r0 += kTile) {
+          const int r1 = std::min(r0 + kTile, rows);
+          for (int c0 = 0; c0 < cols; c0 += kTile) {
+            const int c1 = std::min(c0 + kTile, cols);
+            for (int r = r0; r < r1; r += kBlock) {
+              for (int c = c0; c < c1; c += kBlock) {
+                const uint8_t *s = src + c * src_stride + r * 4;
+                uint8_t *d = dst + r * dst_stride + c * 4;
+                if (r + kBlock <= r1 && c + kBlock <= c1) {
+                  kernel(s, src_stride, d, dst_stride);
+                } else {
+                  TransposeScalar(s, src_stride, d, dst_stride,
+                                  std::min(kBlock, r1 - r),
+                                  std::min(kBlock, c1 - c));
+                }
+              }
+            }
+          }
+        }
+      });
+}
+
+} // namespace
+
+const char *OrientationName(Orientation o) {
+  switch (o) {
+  case Orientation::kIdentity:
+    return "identity";
+  case Orientation::kRotate90:
+    return "rotate90";
+  case Orientation::kRotate180:
+    return "rotate180";
+  case Orientation::kRotate270:
+    return "rotate270";
+  case Orientation::kFlipH:
+    return "flip-h";
+  case Orientation::kFlipV:
+    return "flip-v";
+  }
+  return "identity";
+}
+
+void OrientedSize(int width, int height, Orientation o, int *out_width,
+                  int *out_height) {
+  const bool swap = o == Orientation::kRotate90 || o == Orientation::kRotate270;
+  *out_width = swap ? height : width;
+  *out_height = swap ? width : height;
+}
+
+void OrientImage(const ImageView &src, Orientation o, ImageBuffer *dst) {
+  int w = 0;
+  int h = 0;
+  OrientedSize(src.width, src.height, o, &w, &h);
+  AllocateImage(w, h, dst);
+  dst->origin_x = src.origin_x;
+  dst->origin_y = src.origin_y;
+  if (!src.Valid()) {
+    return;
+  }
+  const ptrdiff_t src_stride = static_cast<ptrdiff_t>(src.stride);
+  const ptrdiff_t dst_stride = dst->row_pitch;
+  uint8_t *const out = dst->bgra.data();
+  const size_t row_bytes = static_cast<size_t>(w) * 4;
+
+  switch (o) {
+  case Orientation::kRotate90:
+    // dst(y, x) = src(H-1-x, y): transpose the source read bottom-up.
+    Transpose(src.Row(src.height - 1), -src_stride, out, dst_stride, h, w);
+    return;
+  case Orientation::kRotate270:
+    // dst(y, x) = src(x, W-1-y): transpose into the output written
+    // bottom-up.
+    Transpose(src.data, src_stride, out + (h - 1) * dst_stride, -dst_stride,
+              h, w);
+    return;
+  case Orientation::kIdentity:
+  case Orientation::kFlipV:
+    ParallelForRows(h, row_bytes, [&](int band, int y0, int y1) {
+      (void)band;
+      for (int y = y0; y < y1; ++y) {
+        const int sy = o == Orientation::kFlipV ? h - 1 - y : y;
+        memcpy(out + y * dst_stride, src.Row(sy), row_bytes);
+      }
+    });
+    return;
+  case Orientation::kRotate180:
+  case Orientation::kFlipH: {
+    const ReverseRowFn reverse = ReverseRowKernel(ActiveSimdLevel());
+    ParallelForRows(h, row_bytes, [&](int band, int y0, int y1) {
+      (void)band;
+      for (int y = y0; y < y1; ++y) {
+        const int sy = o == Orientation::kRotate180 ? h - 1 - y : y;
+        reverse(src.Row(sy), w, out + y * dst_stride);
+      }
+    });
+    return;
+  }
+  }
+}
+
+} // namespace sc
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "types.h"
+
+namespace sc {
+
+enum class Orientation {
+  kIdentity,
+  kRotate90,  // clockwise
+  kRotate180,
+  kRotate270, // clockwise, i.e. 90 counter-clockwise
+  kFlipH,     // mirror left-right
+  kFlipV,     // mirror top-bottom
+};
+
+const char *OrientationName(Orientation o);
+
+// Size of a width x height image after `o`; 90 and 270 swap the sides.
+void OrientedSize(int width, int height, Orientation o, int *out_width,
+                  int *out_height);
+
+// Writes `src` turned by `o` into `dst`, allocated here; dst keeps src's
+// origin. Quarter turns are transposes done in cache-sized tiles of 8x8
+// SIMD blocks, so neither side is walked down a column of a large frame.
+// Output rows are split across the parallel row pool.
+void OrientImage(const ImageView &src, Orientation o, ImageBuffer *dst);
+
+} // namespace sc
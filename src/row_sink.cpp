@@ -0,0 +1,92 @@
+#include "row_sink.h"
+
+#include <algorithm>
+
+namespace sc {
+
+bool TeeRowSink::BeginImage(const RowImageInfo &info, ErrorInfo *err) {
+  for (RowSink *s : sinks_) {
+    if (!s->BeginImage(info, err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TeeRowSink::WriteRows(int y, int count, const uint8_t *rows,
+                           size_t stride, ErrorInfo *err) {
+  for (RowSink *s : sinks_) {
+    if (!s->WriteRows(y, count, rows, stride, err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TeeRowSink::Finish(ErrorInfo *err) {
+  for (RowSink *s : sinks_) {
+    if (!s->Finish(err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CropRowSink::BeginImage(const RowImageInfo &info, ErrorInfo *err) {
+  const Rect img_rect{info.origin_x, info.origin_y, info.origin_x + info.width,
+                      info.origin_y + info.height};
+  applied_ = Rect{std::max(crop_.left, img_rect.left),
+                  std::max(crop_.top, img_rect.top),
+                  std::min(crop_.right, img_rect.right),
+                  std::min(crop_.bottom, img_rect.bottom)};
+  if (!IsValidRect(applied_)) {
+    *err = ErrorInfo{"crop does not overlap image", "CropRowSink",
+                     std::nullopt, std::nullopt};
+    return false;
+  }
+  y0_ = applied_.top - info.origin_y;
+  x_offset_ = static_cast<size_t>(applied_.left - info.origin_x) *
+              PixelFormatBytes(info.format);
+  return next_->BeginImage(RowImageInfo{Width(applied_), Height(applied_),
+                                        applied_.left, applied_.top,
+                                        info.format},
+                           err);
+}
+
+bool CropRowSink::WriteRows(int y, int count, const uint8_t *rows,
+                            size_t stride, ErrorInfo *err) {
+  const int first = std::max(y, y0_);
+  const int last = std::min(y + count, y0_ + Height(applied_));
+  if (first >= last) {
+    return true;
+  }
+  const uint8_t *p =
+      rows + static_cast<size_t>(first - y) * stride + x_offset_;
+  return next_->WriteRows(first - y0_, last - first, p, stride, err);
+}
+
+bool CropRowSink::Finish(ErrorInfo *err) { return next_->Finish(err); }
+
+RowImageInfo RowInfoOf(const ImageView &img) {
+  return RowImageInfo{img.width, img.height, img.origin_x, img.origin_y};
+}
+
+bool WriteImageRows(const ImageView &img, RowSink *sink, ErrorInfo *err) {
+  if (!img.Valid()) {
+    *err = ErrorInfo{"invalid image buffer", "WriteImageRows", std::nullopt,
+                     std::nullopt};
+    return false;
+  }
+  if (!sink->BeginImage(RowInfoOf(img), err)) {
+    return false;
+  }
+  for (int y = 0; y < img.height; y += kRowBandRows) {
+    const int n = std::min(kRowBandRows, img.height - y);
+    if (!sink->WriteRows(y, n, img.Row(y), img.stride, err)) {
+      return false;
+    }
+  }
+  return sink->Finish(err);
+}
+
+} // namespace sc
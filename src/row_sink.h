@@ -0,0 +1,81 @@
+#pragma once
+
+#include "pixel_format.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sc {
+
+// Rows producers hand over at a time: small enough that consumers read them
+// while they are still in cache, large enough to keep call overhead low.
+constexpr int kRowBandRows = 32;
+
+struct RowImageInfo {
+  int width = 0;
+  int height = 0;
+  int origin_x = 0;
+  int origin_y = 0;
+  // Layout of the rows. Everything but the encoders takes only BGRA; the
+  // encoders also take rows already in the layout they store.
+  PixelFormat format = PixelFormat::kBgra8;
+};
+
+// Consumer of rows, top to bottom. A producer calls BeginImage once,
+// WriteRows for consecutive bands as soon as they are available, then
+// Finish. Rows passed to WriteRows must stay valid and unchanged until
+// Finish returns, so sinks may keep pointers to them instead of copying.
+class RowSink {
+public:
+  virtual ~RowSink() = default;
+  virtual bool BeginImage(const RowImageInfo &info, ErrorInfo *err) = 0;
+  // `rows` points at row `y`; successive rows are `stride` bytes apart.
+  virtual bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                         ErrorInfo *err) = 0;
+  virtual bool Finish(ErrorInfo *err) = 0;
+};
+
+// Passes every call on to each sink in order.
+class TeeRowSink : public RowSink {
+public:
+  explicit TeeRowSink(std::vector<RowSink *> sinks)
+      : sinks_(std::move(sinks)) {}
+  bool BeginImage(const RowImageInfo &info, ErrorInfo *err) override;
+  bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                 ErrorInfo *err) override;
+  bool Finish(ErrorInfo *err) override;
+
+private:
+  std::vector<RowSink *> sinks_;
+};
+
+// Forwards only the part of the image inside `crop_screen` (screen
+// coordinates). Rows are passed on as offset pointers; nothing is copied.
+class CropRowSink : public RowSink {
+public:
+  CropRowSink(const Rect &crop_screen, RowSink *next)
+      : crop_(crop_screen), next_(next) {}
+  bool BeginImage(const RowImageInfo &info, ErrorInfo *err) override;
+  bool WriteRows(int y, int count, const uint8_t *rows, size_t stride,
+                 ErrorInfo *err) override;
+  bool Finish(ErrorInfo *err) override;
+  // The crop after clipping to the image; valid once BeginImage succeeded.
+  const Rect &applied() const { return applied_; }
+
+private:
+  Rect crop_;
+  RowSink *next_;
+  Rect applied_{};
+  int y0_ = 0; // first forwarded row, in source image rows
+  size_t x_offset_ = 0;
+};
+
+RowImageInfo RowInfoOf(const ImageView &img);
+
+// Feeds a complete image to `sink` in bands, BeginImage to Finish.
+bool WriteImageRows(const ImageView &img, RowSink *sink, ErrorInfo *err);
+
+} // namespace sc
@@ -0,0 +1,282 @@
+#include "stage_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <sstream>
+
+namespace sc {
+
+namespace {
+
+std::string StageStatsJson(const StageStats &s) {
+  std::ostringstream oss;
+  oss << "{\"capacity\":" << s.capacity << ",\"max_depth\":" << s.max_depth
+      << ",\"mean_depth\":" << s.mean_depth << ",\"frames\":" << s.frames
+      << ",\"dropped\":" << s.dropped << ",\"busy_ms\":" << s.busy_ms << '}';
+  return oss.str();
+}
+
+} // namespace
+
+const char *DropPolicyName(DropPolicy p) {
+  switch (p) {
+  case DropPolicy::kDropOldest:
+    return "drop-oldest";
+  case DropPolicy::kSkipEncode:
+    return "skip-encode";
+  case DropPolicy::kBlock:
+    break;
+  }
+  return "block";
+}
+
+bool ParseDropPolicy(const char *s, DropPolicy *out) {
+  if (strcmp(s, "block") == 0) {
+    *out = DropPolicy::kBlock;
+  } else if (strcmp(s, "drop-oldest") == 0) {
+    *out = DropPolicy::kDropOldest;
+  } else if (strcmp(s, "skip-encode") == 0) {
+    *out = DropPolicy::kSkipEncode;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string StagePipelineStatsJson(const StagePipelineOptions &opt,
+                                   const StagePipelineStats &s) {
+  std::ostringstream oss;
+  oss << "{\"queue_depth\":" << opt.queue_depth << ",\"drop_policy\":\""
+      << DropPolicyName(opt.drop)
+      << "\",\"encode_workers\":" << opt.encode_workers
+      << ",\"skipped_encodes\":" << s.skipped_encodes
+      << ",\"stages\":{\"process\":" << StageStatsJson(s.process)
+      << ",\"encode\":" << StageStatsJson(s.encode)
+      << ",\"write\":" << StageStatsJson(s.write)
+      << "},\"encode_pool\":{\"workers\":" << s.encode_pool.workers
+      << ",\"tasks\":" << s.encode_pool.tasks
+      << ",\"steals\":" << s.encode_pool.steals << "}}";
+  return oss.str();
+}
+
+// Every frame is always in exactly one place: with the capture loop, in a
+// queue, in a stage, or in free_. Besides the queues that is one frame per
+// stage thread and per encode job, plus the oldest frame a drop-oldest push
+// holds for a moment, so free_ should always take back whatever exists.
+// Should that count ever be wrong, frames that do not fit go on spill_
+// instead of being lost to Acquire.
+StagePipeline::StagePipeline(const StagePipelineOptions &opt,
+                             StageFunctions fns)
+    : opt_(opt), fns_(std::move(fns)), process_q_(opt.queue_depth),
+      encode_q_(opt.queue_depth), write_q_(opt.queue_depth),
+      free_(3 * std::max(opt.queue_depth, 1) +
+            std::max(opt.encode_workers, 1) + 5),
+      pool_start_(EncodeTaskPool().stats()) {
+  process_thread_ = std::thread([this] { ProcessLoop(); });
+  encode_thread_ = std::thread([this] { EncodeLoop(); });
+  write_thread_ = std::thread([this] { WriteLoop(); });
+}
+
+StagePipeline::~StagePipeline() {
+  ErrorInfo ignored;
+  Finish(&ignored);
+}
+
+StagedFrame *StagePipeline::Acquire() {
+  if (StagedFrame *frame = free_.TryPop()) {
+    return frame;
+  }
+  {
+    std::lock_guard<std::mutex> lock(spill_mu_);
+    if (!spill_.empty()) {
+      StagedFrame *frame = spill_.back();
+      spill_.pop_back();
+      return frame;
+    }
+  }
+  frames_.push_back(fns_.make_frame ? fns_.make_frame()
+                                    : std::make_unique<StagedFrame>());
+  return frames_.back().get();
+}
+
+bool StagePipeline::Submit(StagedFrame *frame) {
+  if (failed_.load(std::memory_order_acquire)) {
+    Recycle(frame);
+    return false;
+  }
+  return Forward(&process_q_, frame, &process_);
+}
+
+void StagePipeline::Recycle(StagedFrame *frame) {
+  frame->encode_skipped = false;
+  frame->encoded.clear(); // keeps its capacity for the next frame
+  if (!free_.TryPush(frame)) {
+    std::lock_guard<std::mutex> lock(spill_mu_);
+    spill_.push_back(frame);
+  }
+}
+
+bool StagePipeline::Finish(ErrorInfo *err) {
+  if (!finished_) {
+    finished_ = true;
+    // Each queue closes once everything that pushes into it has stopped,
+    // so no frame is left behind in it.
+    process_q_.Close();
+    process_thread_.join();
+    encode_q_.Close();
+    encode_thread_.join();
+    write_q_.Close();
+    write_thread_.join();
+  }
+  if (failed_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(err_mu_);
+    *err = err_;
+    return false;
+  }
+  return true;
+}
+
+StagePipelineStats StagePipeline::stats() const {
+  const auto fill = [](const FrameQueue &q, const Counters &c) {
+    StageStats s;
+    s.capacity = q.capacity();
+    s.max_depth = q.max_depth();
+    s.mean_depth = q.mean_depth();
+    s.frames = c.frames.load(std::memory_order_relaxed);
+    s.dropped = c.dropped.load(std::memory_order_relaxed);
+    s.busy_ms =
+        static_cast<double>(c.busy_ns.load(std::memory_order_relaxed)) / 1e6;
+    return s;
+  };
+  StagePipelineStats s;
+  s.process = fill(process_q_, process_);
+  s.encode = fill(encode_q_, encode_);
+  s.write = fill(write_q_, write_);
+  s.skipped_encodes = skipped_encodes_.load(std::memory_order_relaxed);
+  const TaskPoolStats pool = EncodeTaskPool().stats();
+  s.encode_pool.workers = pool.workers;
+  s.encode_pool.tasks = pool.tasks - pool_start_.tasks;
+  s.encode_pool.steals = pool.steals - pool_start_.steals;
+  return s;
+}
+
+void StagePipeline::ProcessLoop() {
+  while (StagedFrame *frame = process_q_.Pop()) {
+    if (!Run(fns_.process, frame, &process_)) {
+      Recycle(frame);
+      continue;
+    }
+    if (opt_.drop != DropPolicy::kSkipEncode) {
+      Forward(&encode_q_, frame, &encode_);
+    } else if (!encode_q_.TryPush(frame)) {
+      frame->encode_skipped = true;
+      skipped_encodes_.fetch_add(1, std::memory_order_relaxed);
+      Forward(&write_q_, frame, &write_);
+    }
+  }
+}
+
+// Encode jobs run as tasks on the encode pool, up to encode_workers at a
+// time, so that the stripes of one large frame and the jobs of small ones
+// share its workers. This thread only hands them out and, while it waits
+// for the oldest, runs queued tasks too. Encoded frames go on to write in
+// the order they were captured. Under skip-encode, frames that bypass
+// encode reach write straight from process and so may be written before
+// older frames still queued or running here; holding them back would keep
+// them waiting on the very backlog they skip. Each frame has its own slot
+// and file, so only the order of the writes changes.
+void StagePipeline::EncodeLoop() {
+  struct Job {
+    StagedFrame *frame = nullptr;
+    bool ok = false;
+    TaskGroup done{&EncodeTaskPool()};
+  };
+  std::deque<std::unique_ptr<Job>> in_flight;
+  const auto write_oldest = [&] {
+    std::unique_ptr<Job> job = std::move(in_flight.front());
+    in_flight.pop_front();
+    job->done.Wait();
+    // Encoded work is never thrown away; write always blocks.
+    if (!job->ok || !write_q_.Push(job->frame)) {
+      Recycle(job->frame);
+    }
+  };
+  const size_t max_jobs = static_cast<size_t>(std::max(opt_.encode_workers, 1));
+  for (;;) {
+    StagedFrame *frame =
+        in_flight.empty() ? encode_q_.Pop() : encode_q_.TryPop();
+    if (!frame) {
+      if (in_flight.empty()) {
+        return; // closed and drained
+      }
+      write_oldest();
+      continue;
+    }
+    if (in_flight.size() >= max_jobs) {
+      write_oldest();
+    }
+    auto job = std::make_unique<Job>();
+    job->frame = frame;
+    Job *j = job.get();
+    j->done.Run([this, j] { j->ok = Run(fns_.encode, j->frame, &encode_); });
+    in_flight.push_back(std::move(job));
+  }
+}
+
+void StagePipeline::WriteLoop() {
+  while (StagedFrame *frame = write_q_.Pop()) {
+    Run(fns_.write, frame, &write_);
+    Recycle(frame);
+  }
+}
+
+bool StagePipeline::Run(
+    const std::function<bool(StagedFrame *, ErrorInfo *)> &fn,
+    StagedFrame *frame, Counters *counters) {
+  if (failed_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  ErrorInfo err;
+  const bool ok = fn(frame, &err);
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  counters->busy_ns.fetch_add(ns, std::memory_order_relaxed);
+  counters->frames.fetch_add(1, std::memory_order_relaxed);
+  if (!ok) {
+    Fail(err);
+  }
+  return ok;
+}
+
+bool StagePipeline::Forward(FrameQueue *queue, StagedFrame *frame,
+                            Counters *counters) {
+  if (opt_.drop == DropPolicy::kDropOldest) {
+    while (!queue->TryPush(frame)) {
+      // The consumer may take the oldest first; then the push has room.
+      if (StagedFrame *oldest = queue->TryPop()) {
+        counters->dropped.fetch_add(1, std::memory_order_relaxed);
+        Recycle(oldest);
+      }
+    }
+    return true;
+  }
+  if (queue->Push(frame)) {
+    return true;
+  }
+  Recycle(frame);
+  return false;
+}
+
+void StagePipeline::Fail(const ErrorInfo &err) {
+  std::lock_guard<std::mutex> lock(err_mu_);
+  if (!failed_.load(std::memory_order_relaxed)) {
+    err_ = err;
+    failed_.store(true, std::memory_order_release);
+  }
+}
+
+} // namespace sc
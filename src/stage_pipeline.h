@@ -0,0 +1,139 @@
+#pragma once
+
+#include "frame_queue.h"
+#include "task_pool.h"
+#include "types.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sc {
+
+// What a stage does with a frame when the next stage's queue is full.
+enum class DropPolicy {
+  kBlock,      // wait for room; capture falls behind and drops slots
+  kDropOldest, // discard the oldest queued frame to make room
+  kSkipEncode, // past a full encode queue, frames go to write unencoded
+};
+
+const char *DropPolicyName(DropPolicy p);
+bool ParseDropPolicy(const char *s, DropPolicy *out);
+
+struct StagePipelineOptions {
+  int queue_depth = 4; // frames each stage's input queue holds
+  DropPolicy drop = DropPolicy::kBlock;
+  int encode_workers = 1; // frames encoded at once on the encode pool
+};
+
+// The work of each stage. Each returns false and fills `err` to stop the
+// pipeline; frames still queued are then recycled without being run.
+struct StageFunctions {
+  std::function<std::unique_ptr<StagedFrame>()> make_frame;
+  std::function<bool(StagedFrame *, ErrorInfo *)> process;
+  // Runs as a task on EncodeTaskPool(), for several frames at once.
+  std::function<bool(StagedFrame *, ErrorInfo *)> encode;
+  // Runs on one thread, for every frame that got past process, including
+  // those whose encode was skipped, which it writes some other way.
+  // Encoded frames arrive in capture order; skipped ones can overtake
+  // frames still being encoded.
+  std::function<bool(StagedFrame *, ErrorInfo *)> write;
+};
+
+struct StageStats {
+  int capacity = 0;        // of the stage's input queue
+  int max_depth = 0;       // most frames waiting in it
+  double mean_depth = 0.0; // frames waiting, as each one arrived
+  int64_t frames = 0;      // frames the stage ran on
+  int64_t dropped = 0;     // frames discarded from its queue
+  double busy_ms = 0.0;    // time in the stage function, all threads
+};
+
+struct StagePipelineStats {
+  StageStats process;
+  StageStats encode;
+  StageStats write;
+  int64_t skipped_encodes = 0;
+  // The encode pool while the pipeline ran; its tasks include PNG stripes.
+  TaskPoolStats encode_pool;
+};
+
+// {"queue_depth":..,"drop_policy":..,"encode_workers":..,
+//  "skipped_encodes":..,"stages":{"process":{..},"encode":{..},
+//  "write":{..}},"encode_pool":{"workers":..,"tasks":..,"steals":..}}
+std::string StagePipelineStatsJson(const StagePipelineOptions &opt,
+                                   const StagePipelineStats &s);
+
+// Process, encode and write stages, each on its own thread(s), behind the
+// caller's capture loop. Bounded FrameQueues connect them, so a slow stage
+// pushes back on the ones before it (or drops, as the policy says) instead
+// of letting frames pile up, and throughput is bounded by the slowest
+// stage rather than by the sum of all of them.
+class StagePipeline {
+public:
+  StagePipeline(const StagePipelineOptions &opt, StageFunctions fns);
+  StagePipeline(const StagePipeline &) = delete;
+  StagePipeline &operator=(const StagePipeline &) = delete;
+  ~StagePipeline();
+
+  // A frame for the capture stage to fill: a recycled one, or a new one
+  // from make_frame. Call from one thread only.
+  StagedFrame *Acquire();
+  // Queues a filled frame for processing; false once a stage has failed.
+  bool Submit(StagedFrame *frame);
+  // Hands back an acquired frame that will not be submitted.
+  void Recycle(StagedFrame *frame);
+  // Runs every queued frame through to the end and joins the threads;
+  // false with the first stage error, if any.
+  bool Finish(ErrorInfo *err);
+
+  // Frames waiting for each stage right now.
+  int process_depth() const { return process_q_.depth(); }
+  int encode_depth() const { return encode_q_.depth(); }
+  int write_depth() const { return write_q_.depth(); }
+  StagePipelineStats stats() const;
+
+private:
+  struct Counters {
+    std::atomic<int64_t> frames{0};
+    std::atomic<int64_t> dropped{0};
+    std::atomic<int64_t> busy_ns{0};
+  };
+
+  void ProcessLoop();
+  void EncodeLoop();
+  void WriteLoop();
+  bool Run(const std::function<bool(StagedFrame *, ErrorInfo *)> &fn,
+           StagedFrame *frame, Counters *counters);
+  // Pushes per the drop policy; false if the frame was recycled instead.
+  bool Forward(FrameQueue *queue, StagedFrame *frame, Counters *counters);
+  void Fail(const ErrorInfo &err);
+
+  const StagePipelineOptions opt_;
+  const StageFunctions fns_;
+  FrameQueue process_q_;
+  FrameQueue encode_q_;
+  FrameQueue write_q_;
+  FrameQueue free_; // recycled frames
+  std::mutex spill_mu_;
+  std::vector<StagedFrame *> spill_; // recycled frames free_ had no room for
+  Counters process_;
+  Counters encode_;
+  Counters write_;
+  std::atomic<int64_t> skipped_encodes_{0};
+  std::vector<std::unique_ptr<StagedFrame>> frames_; // every frame made
+  TaskPoolStats pool_start_;
+  std::thread process_thread_;
+  std::thread encode_thread_; // hands encode jobs to the pool
+  std::thread write_thread_;
+  std::atomic<bool> failed_{false};
+  std::mutex err_mu_;
+  ErrorInfo err_;
+  bool finished_ = false;
+};
+
+} // namespace sc
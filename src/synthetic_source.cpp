@@ -0,0 +1,315 @@
+#include "synthetic_source.h"
+
+#include "capture_source.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace sc {
+
+namespace {
+
+// Text lines are 20 rows of 8-pixel cells; a glyph is a 3x5 bitmap drawn
+// at twice the size, starting 5 rows into the line.
+constexpr int kLineHeight = 20;
+constexpr int kCellWidth = 8;
+constexpr int kGlyphTop = 5;
+
+inline uint32_t Mix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16;
+  return x;
+}
+
+inline void Put(uint8_t *row, int x, int b, int g, int r) {
+  uint8_t *p = row + static_cast<size_t>(x) * 4;
+  p[0] = static_cast<uint8_t>(b);
+  p[1] = static_cast<uint8_t>(g);
+  p[2] = static_cast<uint8_t>(r);
+  p[3] = 255;
+}
+
+inline void Fill(uint8_t *row, int x0, int x1, int b, int g, int r) {
+  for (int x = x0; x < x1; ++x) {
+    Put(row, x, b, g, r);
+  }
+}
+
+const uint8_t *SineTable() {
+  static const auto table = [] {
+    std::array<uint8_t, 256> t{};
+    for (int i = 0; i < 256; ++i) {
+      t[static_cast<size_t>(i)] = static_cast<uint8_t>(
+          std::lround(127.5 + 127.5 * std::sin(i * 6.283185307179586 / 256)));
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+// The spans below fill [x0, x1) of one row of `area`, in its coordinates.
+void GradientSpan(const Rect &area, int y, int x0, int x1, uint8_t *row) {
+  const int w = std::max(1, Width(area) - 1);
+  const int h = std::max(1, Height(area) - 1);
+  const int g = (y - area.top) * 255 / h;
+  for (int x = x0; x < x1; ++x) {
+    const int b = (x - area.left) * 255 / w;
+    Put(row, x, b, g, (b + 255 - g) / 2);
+  }
+}
+
+void TextSpan(const Rect &area, uint32_t seed, int y, int x0, int x1,
+              uint8_t *row) {
+  const int ly = y - area.top;
+  const uint32_t line = static_cast<uint32_t>(ly / kLineHeight);
+  const int gy = (ly % kLineHeight - kGlyphTop) / 2;
+  const int cols = std::max(1, Width(area) / kCellWidth);
+  // Ragged right margin; every seventh line is left empty as a paragraph
+  // break.
+  const uint32_t line_hash = Mix(seed ^ Mix(line + 0x9E37u));
+  const uint32_t spread = static_cast<uint32_t>(cols - cols / 4) + 1;
+  const int length =
+      line % 7 == 6 ? 0 : cols / 4 + static_cast<int>(line_hash % spread);
+  Fill(row, x0, x1, 250, 250, 250);
+  if (ly % kLineHeight < kGlyphTop || gy >= 5) {
+    return;
+  }
+  for (int x = x0; x < x1; ++x) {
+    const int lx = x - area.left;
+    const int col = lx / kCellWidth;
+    const int gx = (lx % kCellWidth - 1) / 2;
+    if (col >= length || lx % kCellWidth == 0 || gx >= 3) {
+      continue;
+    }
+    const uint32_t glyph = Mix(line_hash ^ static_cast<uint32_t>(col));
+    if ((glyph & 7u) == 0) {
+      continue; // a space between words
+    }
+    if ((glyph >> (3 + gy * 3 + gx)) & 1u) {
+      Put(row, x, 40, 36, 32);
+    }
+  }
+}
+
+void VideoSpan(const Rect &area, uint32_t seed, uint64_t frame, int y, int x0,
+               int x1, uint8_t *row) {
+  const uint8_t *sine = SineTable();
+  const int t = static_cast<int>(frame & 0xFFFF);
+  const int ly = y - area.top;
+  const int v2 = sine[(ly * 3 / 2 - t * 2) & 255];
+  const uint32_t row_seed =
+      Mix(seed ^ static_cast<uint32_t>(ly) * 0x9E3779B1u ^
+          static_cast<uint32_t>(t) * 0x85EBCA77u);
+  for (int x = x0; x < x1; ++x) {
+    const int lx = x - area.left;
+    const int v1 = sine[(lx + t * 3) & 255];
+    const int v3 = sine[((lx + ly) / 2 + t) & 255];
+    const int noise =
+        static_cast<int>(Mix(row_seed ^ static_cast<uint32_t>(lx)) & 15u) - 8;
+    Put(row, x, std::clamp((v1 + v2) / 2 + noise, 0, 255),
+        std::clamp((v2 + v3) / 2 + noise, 0, 255),
+        std::clamp((v1 + v3) / 2 + noise, 0, 255));
+  }
+}
+
+// Desktop layout, in proportions of the frame so every size looks alike.
+struct DesktopLayout {
+  Rect text_window;
+  Rect video_window;
+  int title_height = 0;
+  int taskbar_top = 0;
+};
+
+DesktopLayout LayoutFor(int w, int h) {
+  DesktopLayout l;
+  l.text_window = Rect{w * 6 / 100, h * 8 / 100, w * 56 / 100, h * 82 / 100};
+  l.video_window = Rect{w * 60 / 100, h * 18 / 100, w * 95 / 100, h * 66 / 100};
+  l.title_height = std::max(1, h / 34);
+  l.taskbar_top = h - std::max(1, h / 22);
+  return l;
+}
+
+// A window: title bar, then `body` content below it.
+template <typename Body>
+void WindowSpan(const Rect &window, int title_height, int y, uint8_t *row,
+                Body body) {
+  if (y < window.top || y >= window.bottom || !IsValidRect(window)) {
+    return;
+  }
+  if (y < window.top + title_height) {
+    Fill(row, window.left, window.right, 154, 87, 43);
+    return;
+  }
+  const Rect client{window.left, window.top + title_height, window.right,
+                    window.bottom};
+  body(client, y, window.left, window.right, row);
+}
+
+void RenderRow(SyntheticPattern pattern, const SyntheticOptions &opt,
+               uint64_t frame, int y, uint8_t *row) {
+  const Rect all{0, 0, opt.width, opt.height};
+  switch (pattern) {
+  case SyntheticPattern::kGradient:
+    GradientSpan(all, y, 0, opt.width, row);
+    return;
+  case SyntheticPattern::kText:
+    TextSpan(all, opt.seed, y, 0, opt.width, row);
+    return;
+  case SyntheticPattern::kVideo:
+    VideoSpan(all, opt.seed, frame, y, 0, opt.width, row);
+    return;
+  case SyntheticPattern::kDesktop:
+    break;
+  }
+  const DesktopLayout l = LayoutFor(opt.width, opt.height);
+  if (y >= l.taskbar_top) {
+    Fill(row, 0, opt.width, 40, 36, 32);
+    return;
+  }
+  GradientSpan(all, y, 0, opt.width, row);
+  WindowSpan(l.text_window, l.title_height, y, row,
+             [&](const Rect &c, int cy, int x0, int x1, uint8_t *r) {
+               TextSpan(c, opt.seed, cy, x0, x1, r);
+             });
+  WindowSpan(l.video_window, l.title_height, y, row,
+             [&](const Rect &c, int cy, int x0, int x1, uint8_t *r) {
+               VideoSpan(c, opt.seed, frame, cy, x0, x1, r);
+             });
+}
+
+bool IsStatic(SyntheticPattern p) {
+  return p == SyntheticPattern::kGradient || p == SyntheticPattern::kText;
+}
+
+// Stands in for a capture API: Open pays the setup cost and renders static
+// patterns once, as a real backend sets up its surfaces; each Grab waits
+// out the configured latency, renders the next frame when the pattern
+// moves and hands it over like a mapped surface.
+class SyntheticSession : public CaptureSession {
+public:
+  explicit SyntheticSession(SyntheticPattern pattern) : pattern_(pattern) {}
+  ~SyntheticSession() override { Close(); }
+
+  bool Open(const CaptureRequest &req, ErrorInfo *err) override {
+    Close();
+    const SyntheticOptions &opt = req.synthetic;
+    if (opt.width <= 0 || opt.height <= 0) {
+      *err = ErrorInfo{"invalid synthetic frame size", "SyntheticSession",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    if (opt.setup_ms > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(opt.setup_ms));
+    }
+    opt_ = opt;
+    RenderSynthetic(pattern_, opt_, 0, &surface_);
+    open_ = true;
+    return true;
+  }
+
+  bool Grab(FrameSink *sink, ImageBuffer *out, ErrorInfo *err) override {
+    if (!open_) {
+      *err = ErrorInfo{"session is not open", "SyntheticSession",
+                       std::nullopt, std::nullopt};
+      return false;
+    }
+    if (opt_.latency_ms > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(opt_.latency_ms));
+    }
+    const uint64_t frame = frame_++;
+    if (frame > 0 && !IsStatic(pattern_)) {
+      RenderSynthetic(pattern_, opt_, frame, &surface_);
+    }
+    return DeliverFrame(surface_, AlphaPolicy::kKeep, sink, out, err);
+  }
+
+  void Close() override {
+    open_ = false;
+    frame_ = 0;
+    surface_ = ImageBuffer{};
+  }
+
+private:
+  SyntheticPattern pattern_;
+  SyntheticOptions opt_;
+  bool open_ = false;
+  uint64_t frame_ = 0;
+  ImageBuffer surface_;
+};
+
+template <SyntheticPattern P>
+std::unique_ptr<CaptureSession> CreateSynthetic() {
+  return std::make_unique<SyntheticSession>(P);
+}
+
+CaptureMethodInfo SyntheticMethod(SyntheticPattern p,
+                                  CaptureSessionFactory create) {
+  return CaptureMethodInfo{std::string("synthetic-") + SyntheticPatternName(p),
+                           CaptureCaps{}, create};
+}
+
+const bool kRegistered =
+    RegisterCaptureMethod(
+        SyntheticMethod(SyntheticPattern::kGradient,
+                        CreateSynthetic<SyntheticPattern::kGradient>)) &&
+    RegisterCaptureMethod(SyntheticMethod(
+        SyntheticPattern::kText, CreateSynthetic<SyntheticPattern::kText>)) &&
+    RegisterCaptureMethod(SyntheticMethod(
+        SyntheticPattern::kVideo, CreateSynthetic<SyntheticPattern::kVideo>)) &&
+    RegisterCaptureMethod(
+        SyntheticMethod(SyntheticPattern::kDesktop,
+                        CreateSynthetic<SyntheticPattern::kDesktop>));
+
+} // namespace
+
+const char *SyntheticPatternName(SyntheticPattern p) {
+  switch (p) {
+  case SyntheticPattern::kGradient:
+    return "gradient";
+  case SyntheticPattern::kText:
+    return "text";
+  case SyntheticPattern::kVideo:
+    return "video";
+  case SyntheticPattern::kDesktop:
+    return "desktop";
+  }
+  return "desktop";
+}
+
+bool ParseSyntheticPattern(const char *s, SyntheticPattern *out) {
+  for (SyntheticPattern p :
+       {SyntheticPattern::kGradient, SyntheticPattern::kText,
+        SyntheticPattern::kVideo, SyntheticPattern::kDesktop}) {
+    if (strcmp(s, SyntheticPatternName(p)) == 0) {
+      *out = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+void RenderSynthetic(SyntheticPattern pattern, const SyntheticOptions &opt,
+                     uint64_t frame, ImageBuffer *out) {
+  AllocateImage(opt.width, opt.height, out);
+  out->origin_x = 0;
+  out->origin_y = 0;
+  const size_t pitch = static_cast<size_t>(out->row_pitch);
+  uint8_t *const data = out->bgra.data();
+  const size_t row_bytes = static_cast<size_t>(opt.width) * 4;
+  ParallelForRows(opt.height, row_bytes, [&](int band, int y0, int y1) {
+    (void)band;
+    for (int y = y0; y < y1; ++y) {
+      RenderRow(pattern, opt, frame, y, data + static_cast<size_t>(y) * pitch);
+    }
+  });
+}
+
+} // namespace sc
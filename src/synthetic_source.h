@@ -0,0 +1,39 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+
+namespace sc {
+
+// Deterministic test content standing in for a desktop, so the crop, stats
+// and encode passes can be run and timed without a display.
+//   gradient: smooth ramps, the best case for the PNG filters
+//   text:     lines of glyph-like noise on white, like a document or IDE
+//   video:    moving plasma with per-pixel noise, the worst case for
+//             compression; it changes with every frame
+//   desktop:  wallpaper, a text window, a video window and a taskbar
+enum class SyntheticPattern { kGradient, kText, kVideo, kDesktop };
+
+const char *SyntheticPatternName(SyntheticPattern p);
+bool ParseSyntheticPattern(const char *s, SyntheticPattern *out);
+
+struct SyntheticOptions {
+  int width = 1920;
+  int height = 1080;
+  // Waited out before every frame is delivered, standing in for the time a
+  // real API takes to hand over a frame.
+  int latency_ms = 0;
+  // Waited out once when a session is opened, standing in for the device
+  // and surface setup a real API does before its first frame.
+  int setup_ms = 0;
+  uint32_t seed = 1;
+};
+
+// Renders frame number `frame` (only video content depends on it) into
+// `out` at origin (0, 0), opaque. The same options and frame always give
+// the same pixels; rows are split across the parallel row pool.
+void RenderSynthetic(SyntheticPattern pattern, const SyntheticOptions &opt,
+                     uint64_t frame, ImageBuffer *out);
+
+} // namespace sc
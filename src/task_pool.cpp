@@ -0,0 +1,190 @@
+#include "task_pool.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+
+namespace sc {
+
+namespace {
+
+// The pool and deque of the worker running on this thread, if any.
+thread_local TaskPool *t_pool = nullptr;
+thread_local int t_worker = -1;
+
+} // namespace
+
+TaskPool::TaskPool(int workers) {
+  const int n = std::clamp(workers, 0, 256);
+  for (int i = 0; i < n; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (int i = 0; i < n; ++i) {
+    threads_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mu_);
+    stop_ = true;
+  }
+  idle_.notify_all();
+  for (std::thread &t : threads_) {
+    t.join();
+  }
+}
+
+TaskPoolStats TaskPool::stats() const {
+  TaskPoolStats s;
+  s.workers = workers();
+  s.tasks = tasks_.load(std::memory_order_relaxed);
+  s.steals = steals_.load(std::memory_order_relaxed);
+  return s;
+}
+
+// Counted before it is queued, so that a thread woken for it may at worst
+// look once too often, never miss it. Waiters may be waiting for this very
+// task, not just for any work, so every sleeper is woken.
+void TaskPool::Submit(Task task) {
+  queued_.fetch_add(1, std::memory_order_release);
+  if (t_pool == this) {
+    Worker &w = *workers_[static_cast<size_t>(t_worker)];
+    std::lock_guard<std::mutex> lock(w.mu);
+    task.seq = next_seq_.fetch_add(1, std::memory_order_acq_rel);
+    w.tasks.push_front(std::move(task));
+  } else {
+    std::lock_guard<std::mutex> lock(shared_mu_);
+    task.seq = next_seq_.fetch_add(1, std::memory_order_acq_rel);
+    shared_.push_back(std::move(task));
+  }
+  { std::lock_guard<std::mutex> lock(idle_mu_); }
+  idle_.notify_all();
+}
+
+// Own deque first (newest, still in cache), then the shared queue, then
+// the back of the other workers' deques. Each worker's deque runs from
+// newest at the front to oldest at the back and the shared queue the other
+// way, so the oldest task numbered `min_seq` or later is easy to find.
+bool TaskPool::Take(uint64_t min_seq, Task *task) {
+  const int self = t_pool == this ? t_worker : -1;
+  if (self >= 0) {
+    Worker &w = *workers_[static_cast<size_t>(self)];
+    std::lock_guard<std::mutex> lock(w.mu);
+    if (!w.tasks.empty() && w.tasks.front().seq >= min_seq) {
+      *task = std::move(w.tasks.front());
+      w.tasks.pop_front();
+      return true;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(shared_mu_);
+    const auto it =
+        std::find_if(shared_.begin(), shared_.end(),
+                     [min_seq](const Task &t) { return t.seq >= min_seq; });
+    if (it != shared_.end()) {
+      *task = std::move(*it);
+      shared_.erase(it);
+      return true;
+    }
+  }
+  const int n = workers();
+  for (int i = 1; i <= n; ++i) {
+    const int victim = (self + i + n) % n;
+    if (victim == self) {
+      continue;
+    }
+    Worker &w = *workers_[static_cast<size_t>(victim)];
+    std::lock_guard<std::mutex> lock(w.mu);
+    const auto it =
+        std::find_if(w.tasks.rbegin(), w.tasks.rend(),
+                     [min_seq](const Task &t) { return t.seq >= min_seq; });
+    if (it != w.tasks.rend()) {
+      *task = std::move(*it);
+      w.tasks.erase(std::next(it).base());
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TaskPool::RunOne(uint64_t min_seq) {
+  Task task;
+  if (!Take(min_seq, &task)) {
+    return false;
+  }
+  queued_.fetch_sub(1, std::memory_order_acq_rel);
+  task.fn();
+  tasks_.fetch_add(1, std::memory_order_relaxed);
+  Complete(task.group);
+  return true;
+}
+
+// The group may be destroyed as soon as its count reaches zero, so only the
+// pool is touched after that.
+void TaskPool::Complete(TaskGroup *group) {
+  if (group->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    { std::lock_guard<std::mutex> lock(idle_mu_); }
+    idle_.notify_all();
+  }
+}
+
+void TaskPool::WorkerLoop(int index) {
+  t_pool = this;
+  t_worker = index;
+  for (;;) {
+    if (RunOne(0)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mu_);
+    idle_.wait(lock, [this] {
+      return stop_ || queued_.load(std::memory_order_acquire) > 0;
+    });
+    if (stop_ && queued_.load(std::memory_order_acquire) <= 0) {
+      return;
+    }
+  }
+}
+
+TaskGroup::TaskGroup(TaskPool *pool) : pool_(pool) {}
+
+void TaskGroup::Run(std::function<void()> fn) {
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  // The task will be numbered at least this; recorded before it is queued,
+  // so a waiter never sees the task without the bound that lets it run it.
+  const uint64_t floor = pool_->next_seq_.load(std::memory_order_acquire);
+  uint64_t first = first_seq_.load(std::memory_order_relaxed);
+  while (floor < first && !first_seq_.compare_exchange_weak(
+                              first, floor, std::memory_order_release)) {
+  }
+  pool_->Submit(TaskPool::Task{std::move(fn), this});
+}
+
+// Tasks queued before this group's first are left to the workers, however
+// long this thread then has to sleep. A task of this group that is still
+// queued is always numbered first_seq_ or later, so the wait cannot stall
+// on work it is not allowed to run. Sleeps end when a group completes or a
+// task is queued; a task queued after `seen` was read moves the count on.
+void TaskGroup::Wait() {
+  while (pending_.load(std::memory_order_acquire) > 0) {
+    const uint64_t seen = pool_->next_seq_.load(std::memory_order_acquire);
+    if (pool_->RunOne(first_seq_.load(std::memory_order_acquire))) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(pool_->idle_mu_);
+    pool_->idle_.wait(lock, [this, seen] {
+      return pending_.load(std::memory_order_acquire) == 0 ||
+             pool_->next_seq_.load(std::memory_order_acquire) != seen;
+    });
+  }
+}
+
+TaskPool &EncodeTaskPool() {
+  // Never destroyed, like the pass pool: tasks may still be running while
+  // static destructors do.
+  static TaskPool *pool = new TaskPool(ParallelThreads() - 1);
+  return *pool;
+}
+
+} // namespace sc
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sc {
+
+class TaskGroup;
+
+struct TaskPoolStats {
+  int workers = 0;
+  int64_t tasks = 0;  // tasks run, on workers or by waiting threads
+  int64_t steals = 0; // tasks taken from another worker's deque
+};
+
+// Work-stealing pool for jobs of very different sizes, such as encoding a
+// whole virtual screen next to a handful of small window crops. Each worker
+// has its own deque: tasks it spawns go on the front and it takes them back
+// from the front, newest first, while idle workers steal from the back,
+// where the oldest and usually largest pieces of work sit. Tasks from other
+// threads go on a shared queue. A thread waiting on a TaskGroup runs queued
+// tasks meanwhile, so tasks can spawn and wait for subtasks without tying
+// up a worker; but only tasks queued no earlier than the group's first
+// one, so that waiting on a small job never means picking up an older,
+// larger one and being stuck behind it.
+class TaskPool {
+public:
+  // With no workers, tasks run only on threads waiting for them.
+  explicit TaskPool(int workers);
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+  ~TaskPool();
+
+  int workers() const { return static_cast<int>(workers_.size()); }
+  TaskPoolStats stats() const;
+
+private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> fn;
+    TaskGroup *group = nullptr;
+    uint64_t seq = 0; // queueing order, across all queues
+  };
+  struct Worker {
+    std::mutex mu;
+    std::deque<Task> tasks;
+  };
+
+  void Submit(Task task);
+  // Runs one queued task numbered `min_seq` or later, if there is any;
+  // false otherwise.
+  bool RunOne(uint64_t min_seq);
+  bool Take(uint64_t min_seq, Task *task);
+  void Complete(TaskGroup *group);
+  void WorkerLoop(int index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::mutex shared_mu_;
+  std::deque<Task> shared_; // tasks from threads outside the pool
+  std::atomic<int64_t> queued_{0};
+  // Next sequence number; taken under the lock of the queue the task goes
+  // on, so a task is queued by the time a reader sees the count move on.
+  std::atomic<uint64_t> next_seq_{0};
+  std::atomic<int64_t> tasks_{0};
+  std::atomic<int64_t> steals_{0};
+  // Idle workers and waiting groups sleep here until a task is queued or
+  // a group completes.
+  std::mutex idle_mu_;
+  std::condition_variable idle_;
+  bool stop_ = false;
+};
+
+// Tasks that are waited for together.
+class TaskGroup {
+public:
+  explicit TaskGroup(TaskPool *pool);
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+  ~TaskGroup() { Wait(); }
+
+  void Run(std::function<void()> fn);
+  // Returns once every task run through this group has finished, running
+  // queued tasks meanwhile: this group's, its tasks' subtasks, and any
+  // other task queued after this group's first.
+  void Wait();
+
+private:
+  friend class TaskPool;
+
+  TaskPool *pool_;
+  std::atomic<int> pending_{0};
+  std::atomic<uint64_t> first_seq_{UINT64_MAX};
+};
+
+// The process-wide pool for encode jobs and their stripes, created on first
+// use. Its workers and the waiting thread together make ParallelThreads().
+TaskPool &EncodeTaskPool();
+
+} // namespace sc
@@ -0,0 +1,519 @@
+#include "tone_map.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#ifdef SC_X86
+#include <immintrin.h>
+#endif
+
+namespace sc {
+
+namespace {
+
+// Largest finite half; infinities are clamped to it so no curve sees one.
+constexpr float kHalfMax = 65504.0f;
+
+// 8-bit sRGB encoding is a byte table over 14-bit linear values, indexed
+// by truncation. A table step is at most 0.2 of an output level, so the
+// level at the start of a step is either the answer or one short of it; a
+// second table holds, per step, the linear value at which the next level
+// starts, and comparing with it gives the exactly rounded result. Three
+// bytes of padding let the AVX2 path fetch levels with 32-bit gathers.
+constexpr int kSrgb8Steps = 16383;
+// 16-bit encoding interpolates a float table indexed by sqrt(linear), which
+// evens out the steep start of the curve.
+constexpr int kSrgb16Steps = 4096;
+
+double SrgbEncode(double x) {
+  return x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
+}
+
+int Srgb8Exact(float x) {
+  return static_cast<int>(std::lround(255.0 * SrgbEncode(x)));
+}
+
+// Smallest float in [0, 1] for which `pred` holds; `pred` must be monotone
+// and hold at 1. Non-negative floats order like their bit patterns.
+template <typename Pred> float SmallestUnitFloat(Pred pred) {
+  uint32_t lo = 0;
+  uint32_t hi = 0x3F800000u; // 1.0f
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    float f;
+    memcpy(&f, &mid, 4);
+    if (pred(f)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  float f;
+  memcpy(&f, &lo, 4);
+  return f;
+}
+
+struct Srgb8Tables {
+  std::vector<uint8_t> level; // kSrgb8Steps + 1 entries, then padding
+  std::vector<float> next;    // where level + 1 starts; 2 past white
+};
+
+const Srgb8Tables &Srgb8() {
+  static const Srgb8Tables tables = [] {
+    float start[257];
+    for (int k = 0; k < 256; ++k) {
+      start[k] =
+          SmallestUnitFloat([k](float f) { return Srgb8Exact(f) >= k; });
+    }
+    start[256] = 2.0f;
+    Srgb8Tables t;
+    t.level.assign(kSrgb8Steps + 1 + 3, 255);
+    t.next.resize(kSrgb8Steps + 1);
+    for (int i = 0; i <= kSrgb8Steps; ++i) {
+      // The lowest input that truncates to step i, as the kernels compute
+      // the index.
+      const float first = SmallestUnitFloat([i](float f) {
+        return static_cast<int>(f * static_cast<float>(kSrgb8Steps)) >= i;
+      });
+      const int level = Srgb8Exact(first);
+      t.level[static_cast<size_t>(i)] = static_cast<uint8_t>(level);
+      t.next[static_cast<size_t>(i)] = start[level + 1];
+    }
+    return t;
+  }();
+  return tables;
+}
+
+const float *Srgb16Table() {
+  static const std::vector<float> table = [] {
+    std::vector<float> t(kSrgb16Steps + 1);
+    for (int i = 0; i <= kSrgb16Steps; ++i) {
+      const double s = static_cast<double>(i) / kSrgb16Steps;
+      t[static_cast<size_t>(i)] = static_cast<float>(SrgbEncode(s * s));
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+// The curves, one channel at a time. The SIMD versions below use the same
+// operations in the same order, so both round identically.
+inline float Prepare(float x, float scale) {
+  x = x > 0.0f ? x : 0.0f; // also turns NaN into 0, like maxps
+  x = x < kHalfMax ? x : kHalfMax;
+  return x * scale;
+}
+
+template <ToneMapOperator Op> inline float Curve(float x) {
+  if constexpr (Op == ToneMapOperator::kClip) {
+    return x < 1.0f ? x : 1.0f;
+  } else if constexpr (Op == ToneMapOperator::kReinhard) {
+    return x / (1.0f + x);
+  } else {
+    const float y =
+        (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    return y < 1.0f ? y : 1.0f;
+  }
+}
+
+inline float Unit(float a) {
+  a = a > 0.0f ? a : 0.0f;
+  return a < 1.0f ? a : 1.0f;
+}
+
+inline int Srgb16(float c, const float *table) {
+  const float f = std::sqrt(c) * static_cast<float>(kSrgb16Steps);
+  const int i = std::min(static_cast<int>(f), kSrgb16Steps - 1);
+  const float t = f - static_cast<float>(i);
+  const float v = table[i] + t * (table[i + 1] - table[i]);
+  return static_cast<int>(v * 65535.0f + 0.5f);
+}
+
+inline void LoadHalfPixel(const uint8_t *p, float out[4]) {
+  for (int c = 0; c < 4; ++c) {
+    uint16_t h;
+    memcpy(&h, p + c * 2, 2);
+    out[c] = HalfToFloat(h);
+  }
+}
+
+template <ToneMapOperator Op>
+void ToneMapScalarFrom(const uint8_t *src, int x, int width, float scale,
+                       uint8_t *dst) {
+  const Srgb8Tables &srgb = Srgb8();
+  for (; x < width; ++x) {
+    float px[4];
+    LoadHalfPixel(src + x * 8, px);
+    uint8_t *o = dst + x * 4;
+    for (int c = 0; c < 3; ++c) {
+      const float v = Curve<Op>(Prepare(px[c], scale));
+      const int i = static_cast<int>(v * static_cast<float>(kSrgb8Steps));
+      o[2 - c] = static_cast<uint8_t>(srgb.level[i] + (v >= srgb.next[i]));
+    }
+    o[3] = static_cast<uint8_t>(static_cast<int>(Unit(px[3]) * 255.0f + 0.5f));
+  }
+}
+
+template <ToneMapOperator Op>
+void ToneMap16ScalarFrom(const uint8_t *src, int x, int width, float scale,
+                         uint8_t *dst) {
+  const float *table = Srgb16Table();
+  for (; x < width; ++x) {
+    float px[4];
+    LoadHalfPixel(src + x * 8, px);
+    int v[4];
+    for (int c = 0; c < 3; ++c) {
+      v[c] = Srgb16(Curve<Op>(Prepare(px[c], scale)), table);
+    }
+    // A half times 65535 needs 27 bits; a float product could round up to
+    // the next level.
+    v[3] = static_cast<int>(static_cast<double>(Unit(px[3])) * 65535.0 + 0.5);
+    uint8_t *o = dst + x * 8;
+    for (int c = 0; c < 4; ++c) {
+      o[c * 2] = static_cast<uint8_t>(v[c] >> 8);
+      o[c * 2 + 1] = static_cast<uint8_t>(v[c]);
+    }
+  }
+}
+
+template <ToneMapOperator Op>
+void ToneMapRowScalar(const uint8_t *src, int width, float scale,
+                      uint8_t *dst) {
+  ToneMapScalarFrom<Op>(src, 0, width, scale, dst);
+}
+
+template <ToneMapOperator Op>
+void ToneMapRow16Scalar(const uint8_t *src, int width, float scale,
+                        uint8_t *dst) {
+  ToneMap16ScalarFrom<Op>(src, 0, width, scale, dst);
+}
+
+#ifdef SC_X86
+
+// Two pixels per register: F16C widens eight halves, every lane goes
+// through the curve and the alpha lanes (3 and 7) are blended back in.
+template <ToneMapOperator Op>
+SC_TARGET("avx2,f16c")
+inline __m256 CurveAvx2(__m256 x, __m256 scale) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  x = _mm256_max_ps(x, _mm256_setzero_ps());
+  x = _mm256_min_ps(x, _mm256_set1_ps(kHalfMax));
+  x = _mm256_mul_ps(x, scale);
+  if constexpr (Op == ToneMapOperator::kClip) {
+    return _mm256_min_ps(x, one);
+  } else if constexpr (Op == ToneMapOperator::kReinhard) {
+    return _mm256_div_ps(x, _mm256_add_ps(one, x));
+  } else {
+    const __m256 num = _mm256_mul_ps(
+        x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), x),
+                         _mm256_set1_ps(0.03f)));
+    const __m256 den = _mm256_add_ps(
+        _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), x),
+                                       _mm256_set1_ps(0.59f))),
+        _mm256_set1_ps(0.14f));
+    return _mm256_min_ps(_mm256_div_ps(num, den), one);
+  }
+}
+
+SC_TARGET("avx2,f16c")
+inline __m256i UnitScaled8Avx2(__m256 a) {
+  a = _mm256_min_ps(_mm256_max_ps(a, _mm256_setzero_ps()),
+                    _mm256_set1_ps(1.0f));
+  return _mm256_cvttps_epi32(_mm256_add_ps(
+      _mm256_mul_ps(a, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+}
+
+// Alpha times 65535 rounded, in doubles like the scalar path.
+SC_TARGET("avx2,f16c")
+inline __m256i UnitScaled16Avx2(__m256 a) {
+  a = _mm256_min_ps(_mm256_max_ps(a, _mm256_setzero_ps()),
+                    _mm256_set1_ps(1.0f));
+  const __m256d max = _mm256_set1_pd(65535.0);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m128i lo = _mm256_cvttpd_epi32(_mm256_add_pd(
+      _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a)), max), half));
+  const __m128i hi = _mm256_cvttpd_epi32(_mm256_add_pd(
+      _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)), max),
+      half));
+  return _mm256_setr_m128i(lo, hi);
+}
+
+// Two pixels to 8-bit [r, g, b, a] in 32-bit lanes. The level table is
+// read with 32-bit gathers at byte offsets and masked.
+template <ToneMapOperator Op>
+SC_TARGET("avx2,f16c")
+inline __m256i TwoPixels8Avx2(const uint8_t *p, __m256 scale,
+                              const Srgb8Tables &srgb) {
+  const __m256 v =
+      _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  const __m256 c = CurveAvx2<Op>(v, scale);
+  const __m256i idx = _mm256_cvttps_epi32(
+      _mm256_mul_ps(c, _mm256_set1_ps(static_cast<float>(kSrgb8Steps))));
+  const __m256i level = _mm256_and_si256(
+      _mm256_i32gather_epi32(reinterpret_cast<const int *>(srgb.level.data()),
+                             idx, 1),
+      _mm256_set1_epi32(0xFF));
+  const __m256 next = _mm256_i32gather_ps(srgb.next.data(), idx, 4);
+  // The compare mask is -1 where the next level has been reached.
+  const __m256i colour = _mm256_sub_epi32(
+      level, _mm256_castps_si256(_mm256_cmp_ps(c, next, _CMP_GE_OQ)));
+  return _mm256_blend_epi32(colour, UnitScaled8Avx2(v), 0x88);
+}
+
+// Two pixels to 16-bit [r, g, b, a] in 32-bit lanes, interpolating the
+// sqrt-indexed table.
+template <ToneMapOperator Op>
+SC_TARGET("avx2,f16c")
+inline __m256i TwoPixels16Avx2(const uint8_t *p, __m256 scale,
+                               const float *table) {
+  const __m256 v =
+      _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  const __m256 f =
+      _mm256_mul_ps(_mm256_sqrt_ps(CurveAvx2<Op>(v, scale)),
+                    _mm256_set1_ps(static_cast<float>(kSrgb16Steps)));
+  const __m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(f),
+                                     _mm256_set1_epi32(kSrgb16Steps - 1));
+  const __m256 t = _mm256_sub_ps(f, _mm256_cvtepi32_ps(i));
+  const __m256 a = _mm256_i32gather_ps(table, i, 4);
+  const __m256 b = _mm256_i32gather_ps(table + 1, i, 4);
+  const __m256 c = _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+  const __m256i colour = _mm256_cvttps_epi32(_mm256_add_ps(
+      _mm256_mul_ps(c, _mm256_set1_ps(65535.0f)), _mm256_set1_ps(0.5f)));
+  return _mm256_blend_epi32(colour, UnitScaled16Avx2(v), 0x88);
+}
+
+template <ToneMapOperator Op>
+SC_TARGET("avx2,f16c")
+void ToneMapRowAvx2(const uint8_t *src, int width, float scale_f,
+                    uint8_t *dst) {
+  const Srgb8Tables &srgb = Srgb8();
+  const __m256 scale = _mm256_set1_ps(scale_f);
+  const __m128i to_bgra =
+      _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    // Lane 0 of the packs holds pixels 0 and 2, lane 1 pixels 1 and 3.
+    const __m256i w =
+        _mm256_packus_epi32(TwoPixels8Avx2<Op>(src + x * 8, scale, srgb),
+                            TwoPixels8Avx2<Op>(src + x * 8 + 16, scale, srgb));
+    const __m256i b = _mm256_packus_epi16(w, w);
+    const __m128i rgba = _mm_unpacklo_epi32(_mm256_castsi256_si128(b),
+                                            _mm256_extracti128_si256(b, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                     _mm_shuffle_epi8(rgba, to_bgra));
+  }
+  ToneMapScalarFrom<Op>(src, x, width, scale_f, dst);
+}
+
+template <ToneMapOperator Op>
+SC_TARGET("avx2,f16c")
+void ToneMapRow16Avx2(const uint8_t *src, int width, float scale_f,
+                      uint8_t *dst) {
+  const float *table = Srgb16Table();
+  const __m256 scale = _mm256_set1_ps(scale_f);
+  const __m256i swap16 = _mm256_setr_epi8(
+      1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, //
+      1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    // packus leaves pixels 0, 2 | 1, 3 per lane; the permute restores the
+    // order before the samples are made big-endian.
+    const __m256i w = _mm256_packus_epi32(
+        TwoPixels16Avx2<Op>(src + x * 8, scale, table),
+        TwoPixels16Avx2<Op>(src + x * 8 + 16, scale, table));
+    const __m256i ordered =
+        _mm256_permute4x64_epi64(w, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 8),
+                        _mm256_shuffle_epi8(ordered, swap16));
+  }
+  ToneMap16ScalarFrom<Op>(src, x, width, scale_f, dst);
+}
+
+#endif
+
+template <ToneMapOperator Op>
+ToneMapRowFn RowKernelFor(SimdLevel level, bool sixteen) {
+#ifdef SC_X86
+  if (level >= SimdLevel::kAvx2) {
+    return sixteen ? ToneMapRow16Avx2<Op> : ToneMapRowAvx2<Op>;
+  }
+#else
+  (void)level;
+#endif
+  return sixteen ? ToneMapRow16Scalar<Op> : ToneMapRowScalar<Op>;
+}
+
+ToneMapRowFn KernelFor(ToneMapOperator op, SimdLevel level, bool sixteen) {
+  switch (op) {
+  case ToneMapOperator::kClip:
+    return RowKernelFor<ToneMapOperator::kClip>(level, sixteen);
+  case ToneMapOperator::kReinhard:
+    return RowKernelFor<ToneMapOperator::kReinhard>(level, sixteen);
+  case ToneMapOperator::kAcesFit:
+    break;
+  }
+  return RowKernelFor<ToneMapOperator::kAcesFit>(level, sixteen);
+}
+
+} // namespace
+
+const char *ToneMapOperatorName(ToneMapOperator op) {
+  switch (op) {
+  case ToneMapOperator::kClip:
+    return "clip";
+  case ToneMapOperator::kReinhard:
+    return "reinhard";
+  case ToneMapOperator::kAcesFit:
+    return "aces";
+  }
+  return "aces";
+}
+
+bool ParseToneMapOperator(const char *s, ToneMapOperator *out) {
+  if (strcmp(s, "clip") == 0) {
+    *out = ToneMapOperator::kClip;
+  } else if (strcmp(s, "reinhard") == 0) {
+    *out = ToneMapOperator::kReinhard;
+  } else if (strcmp(s, "aces") == 0) {
+    *out = ToneMapOperator::kAcesFit;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+HalfImageView HalfSubView(const HalfImageView &img, const Rect &screen_rect) {
+  const int left = std::max(screen_rect.left, img.origin_x);
+  const int top = std::max(screen_rect.top, img.origin_y);
+  const int right = std::min(screen_rect.right, img.origin_x + img.width);
+  const int bottom = std::min(screen_rect.bottom, img.origin_y + img.height);
+  HalfImageView v;
+  if (!img.Valid() || right <= left || bottom <= top) {
+    return v;
+  }
+  v.data = img.Row(top - img.origin_y) +
+           static_cast<size_t>(left - img.origin_x) * 8;
+  v.width = right - left;
+  v.height = bottom - top;
+  v.stride = img.stride;
+  v.origin_x = left;
+  v.origin_y = top;
+  return v;
+}
+
+float HalfToFloat(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1Fu;
+  uint32_t mant = h & 0x3FFu;
+  uint32_t bits;
+  if (exp == 0x1F) {
+    bits = sign | 0x7F800000u | (mant << 13);
+  } else if (exp != 0) {
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  } else if (mant == 0) {
+    bits = sign;
+  } else {
+    // Subnormal: shift the leading one up to the implicit bit.
+    exp = 113;
+    while (!(mant & 0x400u)) {
+      mant <<= 1;
+      --exp;
+    }
+    bits = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+  }
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+uint16_t FloatToHalf(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+  const uint32_t abs = bits & 0x7FFFFFFFu;
+  if (abs >= 0x7F800000u) {
+    const uint16_t nan = abs > 0x7F800000u ? 0x200u : 0;
+    return static_cast<uint16_t>(sign | 0x7C00u | nan);
+  }
+  if (abs >= 0x477FF000u) { // rounds past 65504
+    return static_cast<uint16_t>(sign | 0x7C00u);
+  }
+  if (abs < 0x38800000u) { // below the smallest normal half
+    if (abs < 0x33000000u) {
+      return sign;
+    }
+    const uint32_t e = abs >> 23;
+    const uint32_t m = (abs & 0x7FFFFFu) | 0x800000u;
+    const uint32_t shift = 126 - e;
+    uint32_t v = m >> shift;
+    const uint32_t rem = m & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (v & 1u))) {
+      ++v;
+    }
+    return static_cast<uint16_t>(sign | v);
+  }
+  uint32_t v = ((abs - 0x38000000u) >> 13);
+  const uint32_t rem = abs & 0x1FFFu;
+  if (rem > 0x1000u || (rem == 0x1000u && (v & 1u))) {
+    ++v;
+  }
+  return static_cast<uint16_t>(sign | v);
+}
+
+ToneMapRowFn ToneMapRowKernel(ToneMapOperator op, SimdLevel level) {
+  return KernelFor(op, level, false);
+}
+
+ToneMapRowFn ToneMapRow16Kernel(ToneMapOperator op, SimdLevel level) {
+  return KernelFor(op, level, true);
+}
+
+float ToneMapScale(const ToneMapOptions &opt) {
+  return opt.sdr_white_nits > 0.0f ? 80.0f / opt.sdr_white_nits : 1.0f;
+}
+
+void ToneMapImage(const HalfImageView &src, const ToneMapOptions &opt,
+                  ImageBuffer *dst) {
+  AllocateImage(src.width, src.height, dst);
+  dst->origin_x = src.origin_x;
+  dst->origin_y = src.origin_y;
+  if (!src.Valid()) {
+    return;
+  }
+  const ToneMapRowFn kernel = ToneMapRowKernel(opt.op, ActiveSimdLevel());
+  const float scale = ToneMapScale(opt);
+  const size_t pitch = static_cast<size_t>(dst->row_pitch);
+  uint8_t *const out = dst->bgra.data();
+  const size_t row_bytes = static_cast<size_t>(src.width) * 8;
+  ParallelForRows(src.height, row_bytes, [&](int band, int y0, int y1) {
+    (void)band;
+    for (int y = y0; y < y1; ++y) {
+      kernel(src.Row(y), src.width, scale,
+             out + static_cast<size_t>(y) * pitch);
+    }
+  });
+}
+
+void ToneMapImage16(const HalfImageView &src, const ToneMapOptions &opt,
+                    uint8_t *dst, size_t dst_pitch) {
+  if (!src.Valid()) {
+    return;
+  }
+  const ToneMapRowFn kernel = ToneMapRow16Kernel(opt.op, ActiveSimdLevel());
+  const float scale = ToneMapScale(opt);
+  const size_t row_bytes = static_cast<size_t>(src.width) * 8;
+  ParallelForRows(src.height, row_bytes, [&](int band, int y0, int y1) {
+    (void)band;
+    for (int y = y0; y < y1; ++y) {
+      kernel(src.Row(y), src.width, scale,
+             dst + static_cast<size_t>(y) * dst_pitch);
+    }
+  });
+}
+
+} // namespace sc
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "cpu_features.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sc {
+
+// Curves that bring scene-referred HDR values down to the 0-1 SDR range.
+enum class ToneMapOperator {
+  kClip,     // everything above SDR white becomes white
+  kReinhard, // x / (1 + x)
+  kAcesFit,  // Narkowicz's fit of the ACES filmic curve
+};
+
+const char *ToneMapOperatorName(ToneMapOperator op);
+bool ParseToneMapOperator(const char *s, ToneMapOperator *out);
+
+struct ToneMapOptions {
+  ToneMapOperator op = ToneMapOperator::kAcesFit;
+  // Luminance that maps to SDR white before the curve. scRGB 1.0 is
+  // 80 nits; HDR desktops show SDR content brighter than that, so raise
+  // this to the display's SDR white level to keep it from blowing out.
+  float sdr_white_nits = 80.0f;
+};
+
+// scRGB pixels: R16G16B16A16_FLOAT, linear with BT.709 primaries, 1.0 =
+// 80 nits and values below 0 or above 1 allowed; 8 bytes per pixel.
+struct HalfImageView {
+  const uint8_t *data = nullptr;
+  int width = 0;
+  int height = 0;
+  size_t stride = 0;
+  int origin_x = 0;
+  int origin_y = 0;
+
+  const uint8_t *Row(int y) const {
+    return data + static_cast<size_t>(y) * stride;
+  }
+  bool Valid() const {
+    return data != nullptr && width > 0 && height > 0 &&
+           stride >= static_cast<size_t>(width) * 8;
+  }
+};
+
+// The part of `img` inside `screen_rect`, or an empty view.
+HalfImageView HalfSubView(const HalfImageView &img, const Rect &screen_rect);
+
+float HalfToFloat(uint16_t h);
+// Round to nearest even; for building synthetic frames.
+uint16_t FloatToHalf(float f);
+
+// Tone-maps `width` scRGB pixels: negative values (out of gamut) are
+// clipped, colour is divided by the SDR white, put through the curve and
+// sRGB-encoded; alpha stays linear. `scale` is 80 / sdr_white_nits. Every
+// SIMD level produces the same bytes. 8-bit colour is the exactly rounded
+// sRGB encoding of the curve's output; 16-bit colour comes from an
+// interpolated table and is within one level of it.
+//   8-bit: BGRA, the layout the rest of the pipeline takes
+//   16-bit: RGBA with big-endian samples, the PNG layout
+using ToneMapRowFn = void (*)(const uint8_t *half, int width, float scale,
+                              uint8_t *dst);
+ToneMapRowFn ToneMapRowKernel(ToneMapOperator op, SimdLevel level);
+ToneMapRowFn ToneMapRow16Kernel(ToneMapOperator op, SimdLevel level);
+
+float ToneMapScale(const ToneMapOptions &opt);
+
+// Tone-maps a whole view to BGRA in `dst` (allocated here, src's origin
+// kept), or to 16-bit RGBA rows at `dst`, `dst_pitch` bytes apart. Rows are
+// split across the parallel row pool.
+void ToneMapImage(const HalfImageView &src, const ToneMapOptions &opt,
+                  ImageBuffer *dst);
+void ToneMapImage16(const HalfImageView &src, const ToneMapOptions &opt,
+                    uint8_t *dst, size_t dst_pitch);
+
+} // namespace sc
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "frame_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace sc {
+
+struct Rect {
+  int left = 0;
+  int top = 0;
+  int right = 0;
+  int bottom = 0;
+};
+
+struct CropRect {
+  int x = 0;
+  int y = 0;
+  int w = 0;
+  int h = 0;
+};
+
+struct Pad {
+  int l = 0;
+  int t = 0;
+  int r = 0;
+  int b = 0;
+};
+
+struct ErrorInfo {
+  std::string message;
+  std::string where;
+  std::optional<uint32_t> hresult;
+  std::optional<uint32_t> win32_error;
+};
+
+// Move-only: the pixels live in a pooled PixelBuffer.
+struct ImageBuffer {
+  int width = 0;
+  int height = 0;
+  int row_pitch = 0;
+  int origin_x = 0;
+  int origin_y = 0;
+  PixelBuffer bgra;
+};
+
+// Sizes `img` for `width` x `height` pixels with 64-byte-aligned rows. The
+// pixels are left uninitialised.
+inline void AllocateImage(int width, int height, ImageBuffer *img) {
+  img->width = width;
+  img->height = height;
+  img->row_pitch = AlignedRowPitch(width);
+  img->bgra.Allocate(static_cast<size_t>(img->row_pitch) *
+                     static_cast<size_t>(height));
+}
+
+// Non-owning view of BGRA pixels, `stride` bytes between rows. Sub-images
+// are made by pointer arithmetic, so cropping a view copies nothing. Views
+// of an ImageBuffer are invalidated by anything that reallocates it.
+struct ImageView {
+  const uint8_t *data = nullptr;
+  int width = 0;
+  int height = 0;
+  size_t stride = 0;
+  int origin_x = 0;
+  int origin_y = 0;
+
+  ImageView() = default;
+  // Implicit so that functions taking a view accept a buffer. A buffer too
+  // small for its declared size yields an empty view.
+  ImageView(const ImageBuffer &img)
+      : width(img.width), height(img.height),
+        stride(static_cast<size_t>(img.row_pitch)), origin_x(img.origin_x),
+        origin_y(img.origin_y) {
+    if (img.width > 0 && img.height > 0 && img.row_pitch >= img.width * 4 &&
+        img.bgra.size() >= stride * (static_cast<size_t>(img.height) - 1) +
+                               static_cast<size_t>(img.width) * 4) {
+      data = img.bgra.data();
+    }
+  }
+
+  const uint8_t *Row(int y) const {
+    return data + static_cast<size_t>(y) * stride;
+  }
+  bool Valid() const {
+    return data != nullptr && width > 0 && height > 0 &&
+           stride >= static_cast<size_t>(width) * 4;
+  }
+};
+
+struct ImageStats {
+  double black_ratio = 0.0;
+  double transparent_ratio = 0.0;
+  double avg_luma = 0.0;
+};
+
+inline int Width(const Rect &r) { return r.right - r.left; }
+inline int Height(const Rect &r) { return r.bottom - r.top; }
+
+inline bool IsValidRect(const Rect &r) { return Width(r) > 0 && Height(r) > 0; }
+
+// The part of `img` inside `screen_rect` (screen coordinates), or an empty
+// view if they do not overlap.
+inline ImageView SubView(const ImageView &img, const Rect &screen_rect) {
+  const int left = std::max(screen_rect.left, img.origin_x);
+  const int top = std::max(screen_rect.top, img.origin_y);
+  const int right = std::min(screen_rect.right, img.origin_x + img.width);
+  const int bottom = std::min(screen_rect.bottom, img.origin_y + img.height);
+  ImageView v;
+  if (!img.Valid() || right <= left || bottom <= top) {
+    return v;
+  }
+  v.data = img.Row(top - img.origin_y) +
+           static_cast<size_t>(left - img.origin_x) * 4;
+  v.width = right - left;
+  v.height = bottom - top;
+  v.stride = img.stride;
+  v.origin_x = left;
+  v.origin_y = top;
+  return v;
+}
+
+} // namespace sc
@@ -0,0 +1,293 @@
+// Round-trips frames through the raw writer and ReadRawFrame, checks the
+// PAM and PPM files byte for byte against their headers and the source
+// pixels, and feeds the sidecar parser both its own output and broken or
+// hostile sidecars, which ReadRawFrame must reject before allocating.
+
+#include "encode_raw.h"
+#include "output_file.h"
+#include "parallel.h"
+#include "test_util.h"
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+bool SameInfo(const RawFrameInfo &a, const RawFrameInfo &b) {
+  return a.width == b.width && a.height == b.height && a.pitch == b.pitch &&
+         a.origin_x == b.origin_x && a.origin_y == b.origin_y &&
+         a.pixel_layout == b.pixel_layout && a.data_offset == b.data_offset &&
+         a.chroma_pitch == b.chroma_pitch && a.u_offset == b.u_offset &&
+         a.v_offset == b.v_offset && a.yuv_matrix == b.yuv_matrix &&
+         a.yuv_range == b.yuv_range;
+}
+
+bool SamePixels(const ImageView &a, const ImageView &b) {
+  if (a.width != b.width || a.height != b.height) {
+    return false;
+  }
+  for (int y = 0; y < a.height; ++y) {
+    if (memcmp(a.Row(y), b.Row(y), static_cast<size_t>(a.width) * 4) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void WriteFile(const std::string &path, const std::string &bytes) {
+  ErrorInfo err;
+  SC_CHECK(WriteFileBytes(path, true, bytes.data(), bytes.size(), &err),
+           "cannot write %s: %s", path.c_str(), err.message.c_str());
+}
+
+// A whole buffer and an offset crop of it (rows further apart than they
+// are long), at a negative origin.
+void CheckRawRoundTrip(const test::TempDir &dir) {
+  ImageBuffer img;
+  test::FillTestImage(53, 31, 5, &img);
+  img.origin_x = -40;
+  img.origin_y = 7;
+  const ImageView crop = SubView(ImageView(img), Rect{-37, 9, 10, 30});
+  for (const ImageView &view : {ImageView(img), crop}) {
+    const std::string path = dir.File("frame.raw");
+    RawFrameInfo saved;
+    ErrorInfo err;
+    if (!SaveRawFrame(view, "raw", path, true, &saved, &err)) {
+      SC_CHECK(false, "SaveRawFrame: %s", err.message.c_str());
+      continue;
+    }
+    SC_CHECK(saved.width == view.width && saved.height == view.height &&
+                 saved.pitch == view.width * 4 && saved.data_offset == 0 &&
+                 saved.pixel_layout == "bgra8" &&
+                 std::filesystem::file_size(path) ==
+                     static_cast<uintmax_t>(saved.pitch) * view.height,
+             "%dx%d: saved %s", view.width, view.height,
+             RawFrameInfoJson(saved).c_str());
+
+    ImageBuffer back;
+    RawFrameInfo read;
+    if (!ReadRawFrame(path, &back, &read, &err)) {
+      SC_CHECK(false, "ReadRawFrame: %s", err.message.c_str());
+      continue;
+    }
+    SC_CHECK(SameInfo(read, saved), "read %s, saved %s",
+             RawFrameInfoJson(read).c_str(), RawFrameInfoJson(saved).c_str());
+    SC_CHECK(back.origin_x == view.origin_x &&
+                 back.origin_y == view.origin_y,
+             "%dx%d: origin %d,%d, want %d,%d", view.width, view.height,
+             back.origin_x, back.origin_y, view.origin_x, view.origin_y);
+    SC_CHECK(SamePixels(ImageView(back), view), "%dx%d: pixels differ",
+             view.width, view.height);
+  }
+}
+
+// A file laid out by hand: a header to skip and padded rows.
+void CheckPaddedFile(const test::TempDir &dir) {
+  ImageBuffer img;
+  test::FillTestImage(9, 6, 8, &img);
+  RawFrameInfo info;
+  info.width = 9;
+  info.height = 6;
+  info.pitch = 9 * 4 + 12;
+  info.origin_x = 3;
+  info.origin_y = -2;
+  info.pixel_layout = "bgra8";
+  info.data_offset = 21;
+  std::string bytes(info.data_offset, 'h');
+  for (int y = 0; y < info.height; ++y) {
+    bytes.append(reinterpret_cast<const char *>(ImageView(img).Row(y)),
+                 static_cast<size_t>(info.width) * 4);
+    if (y + 1 < info.height) {
+      bytes.append(static_cast<size_t>(info.pitch - info.width * 4), 'p');
+    }
+  }
+  const std::string path = dir.File("padded.raw");
+  WriteFile(path, bytes);
+  WriteFile(RawSidecarPath(path), RawFrameInfoJson(info));
+  ImageBuffer back;
+  RawFrameInfo read;
+  ErrorInfo err;
+  SC_CHECK(ReadRawFrame(path, &back, &read, &err) &&
+               SamePixels(ImageView(back), ImageView(img)) &&
+               back.origin_x == 3 && back.origin_y == -2,
+           "padded file: %s", err.message.c_str());
+
+  // One byte short of the last row.
+  WriteFile(path, bytes.substr(0, bytes.size() - 1));
+  err = ErrorInfo{};
+  SC_CHECK(!ReadRawFrame(path, &back, &read, &err) &&
+               err.where == "ReadRawFrame",
+           "a truncated file should be rejected, got \"%s\"",
+           err.message.c_str());
+}
+
+// A sidecar claiming the largest frame it may must not cost an allocation
+// of that size when the data file cannot hold it.
+void CheckHostileSidecar(const test::TempDir &dir) {
+  const std::string path = dir.File("hostile.raw");
+  WriteFile(path, std::string(64, 'x'));
+  const struct {
+    const char *what;
+    const char *json;
+  } cases[] = {
+      {"huge", "{\"width\":65536,\"height\":65536,\"pitch\":262144,"
+               "\"origin_x\":0,\"origin_y\":0,\"pixel_layout\":\"bgra8\","
+               "\"data_offset\":0}"},
+      {"offset past the end",
+       "{\"width\":1,\"height\":1,\"pitch\":4,\"origin_x\":0,"
+       "\"origin_y\":0,\"pixel_layout\":\"bgra8\","
+       "\"data_offset\":9223372036854775807}"},
+      {"huge pitch", "{\"width\":2,\"height\":3,\"pitch\":2147483647,"
+                     "\"origin_x\":0,\"origin_y\":0,"
+                     "\"pixel_layout\":\"bgra8\",\"data_offset\":0}"},
+  };
+  for (const auto &c : cases) {
+    WriteFile(RawSidecarPath(path), c.json);
+    ImageBuffer back;
+    RawFrameInfo read;
+    ErrorInfo err;
+    SC_CHECK(!ReadRawFrame(path, &back, &read, &err) &&
+                 err.where == "ReadRawFrame" && back.bgra.size() == 0,
+             "%s: got \"%s\", %zu bytes allocated", c.what,
+             err.message.c_str(), back.bgra.size());
+  }
+
+  ImageBuffer back;
+  RawFrameInfo read;
+  ErrorInfo err;
+  SC_CHECK(!ReadRawFrame(dir.File("missing.raw"), &back, &read, &err),
+           "a frame without a sidecar should be rejected%s", "");
+}
+
+void CheckPnm() {
+  ImageBuffer img;
+  test::FillTestImage(19, 11, 6, &img);
+  const struct {
+    const char *format;
+    const char *header;
+    int channels;
+  } formats[] = {
+      {"pam",
+       "P7\nWIDTH 19\nHEIGHT 11\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\n"
+       "ENDHDR\n",
+       4},
+      {"ppm", "P6\n19 11\n255\n", 3},
+  };
+  for (const auto &f : formats) {
+    std::vector<uint8_t> out;
+    VectorSink sink(&out);
+    RawFrameInfo info;
+    ErrorInfo err;
+    if (!WriteRawFrame(ImageView(img), f.format, &sink, &info, &err)) {
+      SC_CHECK(false, "%s: %s", f.format, err.message.c_str());
+      continue;
+    }
+    const size_t header = strlen(f.header);
+    const size_t row_bytes = static_cast<size_t>(img.width) * f.channels;
+    SC_CHECK(out.size() == header + row_bytes * img.height &&
+                 memcmp(out.data(), f.header, header) == 0 &&
+                 info.data_offset == header &&
+                 info.pitch == static_cast<int>(row_bytes),
+             "%s: %zu bytes, %s", f.format, out.size(),
+             RawFrameInfoJson(info).c_str());
+    if (out.size() != header + row_bytes * img.height) {
+      continue;
+    }
+    int bad = 0;
+    for (int y = 0; y < img.height; ++y) {
+      const uint8_t *src = ImageView(img).Row(y);
+      const uint8_t *dst = out.data() + header + row_bytes * y;
+      for (int x = 0; x < img.width; ++x) {
+        const uint8_t *s = src + x * 4;
+        const uint8_t *d = dst + x * f.channels;
+        if (d[0] != s[2] || d[1] != s[1] || d[2] != s[0] ||
+            (f.channels == 4 && d[3] != s[3])) {
+          ++bad;
+        }
+      }
+    }
+    SC_CHECK(bad == 0, "%s: %d pixels differ", f.format, bad);
+  }
+
+  std::vector<uint8_t> out;
+  VectorSink sink(&out);
+  RawFrameInfo info;
+  ErrorInfo err;
+  SC_CHECK(!WriteRawFrame(ImageView(img), "bmp", &sink, &info, &err),
+           "an unknown format should be rejected%s", "");
+}
+
+void CheckSidecarParser() {
+  RawFrameInfo bgra;
+  bgra.width = 1920;
+  bgra.height = 1080;
+  bgra.pitch = 7680;
+  bgra.origin_x = -1920;
+  bgra.origin_y = 0;
+  bgra.pixel_layout = "bgra8";
+  bgra.data_offset = 0;
+  RawFrameInfo nv12;
+  nv12.width = 641;
+  nv12.height = 3;
+  nv12.pitch = 641;
+  nv12.origin_x = 5;
+  nv12.origin_y = 6;
+  nv12.pixel_layout = "nv12";
+  nv12.data_offset = 0;
+  nv12.chroma_pitch = 642;
+  nv12.u_offset = 641 * 3;
+  nv12.v_offset = 641 * 3 + 1;
+  nv12.yuv_matrix = "bt709";
+  nv12.yuv_range = "limited";
+  for (const RawFrameInfo &info : {bgra, nv12}) {
+    RawFrameInfo parsed;
+    ErrorInfo err;
+    const std::string json = RawFrameInfoJson(info);
+    SC_CHECK(ParseRawFrameInfoJson(json, &parsed, &err) &&
+                 SameInfo(parsed, info),
+             "%s parsed as %s", json.c_str(),
+             RawFrameInfoJson(parsed).c_str());
+  }
+
+  const char *const bad[] = {
+      "",
+      "{\"width\":4}",
+      "{\"width\":0,\"height\":1,\"pitch\":0,\"origin_x\":0,\"origin_y\":0,"
+      "\"pixel_layout\":\"bgra8\",\"data_offset\":0}",
+      "{\"width\":65537,\"height\":1,\"pitch\":262148,\"origin_x\":0,"
+      "\"origin_y\":0,\"pixel_layout\":\"bgra8\",\"data_offset\":0}",
+      "{\"width\":4,\"height\":1,\"pitch\":15,\"origin_x\":0,\"origin_y\":0,"
+      "\"pixel_layout\":\"bgra8\",\"data_offset\":0}",
+      "{\"width\":4,\"height\":1,\"pitch\":16,\"origin_x\":0,\"origin_y\":0,"
+      "\"pixel_layout\":\"bgra8\",\"data_offset\":-1}",
+      "{\"width\":4,\"height\":1,\"pitch\":16,\"origin_x\":0,\"origin_y\":0,"
+      "\"pixel_layout\":\"argb\",\"data_offset\":0}",
+      "{\"width\":4,\"height\":2,\"pitch\":4,\"origin_x\":0,\"origin_y\":0,"
+      "\"pixel_layout\":\"nv12\",\"data_offset\":0}",
+  };
+  for (const char *json : bad) {
+    RawFrameInfo parsed;
+    ErrorInfo err;
+    SC_CHECK(!ParseRawFrameInfoJson(json, &parsed, &err) &&
+                 err.where == "ParseRawFrameInfoJson",
+             "%s should be rejected", json);
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  SetParallelThreads(4);
+  const test::TempDir dir("encode_raw_test");
+  CheckRawRoundTrip(dir);
+  CheckPaddedFile(dir);
+  CheckHostileSidecar(dir);
+  CheckPnm();
+  CheckSidecarParser();
+  return test::TestExitCode();
+}
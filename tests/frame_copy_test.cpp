@@ -0,0 +1,183 @@
+// Checks CopyPixels on every path (plain copy or copy+stats kernel, alpha
+// kept or forced opaque, full stats on or off) at every SIMD level, for
+// crops of a padded source into a padded destination, against a naive
+// copy; and DeliverFrame's copy of a mapped frame.
+
+#include "cpu_features.h"
+#include "frame_copy.h"
+#include "image_stats.h"
+#include "parallel.h"
+#include "test_util.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+constexpr uint8_t kCanary = 0xCD;
+
+// A mapped surface: a row pitch that is not a multiple of 16 and a screen
+// origin left of and below the primary monitor.
+struct Surface {
+  std::vector<uint8_t> bytes;
+  ImageView view;
+};
+
+Surface MakeSurface(int width, int height, uint32_t seed) {
+  ImageBuffer img;
+  test::FillTestImage(width, height, seed, &img);
+  Surface s;
+  const size_t stride = static_cast<size_t>(width) * 4 + 36;
+  s.bytes.assign(stride * static_cast<size_t>(height), kCanary);
+  for (int y = 0; y < height; ++y) {
+    memcpy(&s.bytes[static_cast<size_t>(y) * stride],
+           img.bgra.data() + static_cast<size_t>(y) * img.row_pitch,
+           static_cast<size_t>(width) * 4);
+  }
+  s.view = MappedView(s.bytes.data(), stride, width, height, -1920, 120);
+  return s;
+}
+
+StatsAccum NaiveStats(const uint8_t *row, int width) {
+  StatsAccum acc;
+  for (int x = 0; x < width; ++x) {
+    const uint8_t *p = row + x * 4;
+    acc.black += p[0] == 0 && p[1] == 0 && p[2] == 0;
+    acc.transparent += p[3] == 0;
+    acc.luma += static_cast<uint64_t>(kLumaB * p[0] + kLumaG * p[1] +
+                                      kLumaR * p[2]);
+  }
+  return acc;
+}
+
+void CheckCopy(const ImageView &src, AlphaPolicy alpha, bool with_stats,
+               bool with_full, const std::string &what) {
+  const size_t row_bytes = static_cast<size_t>(src.width) * 4;
+  const size_t pitch = row_bytes + 20;
+  std::vector<uint8_t> dst(pitch * static_cast<size_t>(src.height), kCanary);
+  StatsAccum stats;
+  FullStatsAccum full;
+  CopyPixels(src, alpha, dst.data(), pitch, with_stats ? &stats : nullptr,
+             with_full ? &full : nullptr);
+
+  // The naive result, and its stats measured one row at a time.
+  std::vector<uint8_t> want(row_bytes);
+  StatsAccum want_stats;
+  FullStatsAccum want_full;
+  int bad_rows = 0;
+  for (int y = 0; y < src.height; ++y) {
+    memcpy(want.data(), src.Row(y), row_bytes);
+    if (alpha == AlphaPolicy::kForceOpaque) {
+      for (size_t x = 3; x < row_bytes; x += 4) {
+        want[x] = 0xFF;
+      }
+    }
+    AddStats(NaiveStats(want.data(), src.width), &want_stats);
+    FullStatsRow(want.data(), src.width, &want_full);
+    const uint8_t *got = &dst[static_cast<size_t>(y) * pitch];
+    bool padding_kept = true;
+    for (size_t i = row_bytes; i < pitch; ++i) {
+      padding_kept = padding_kept && got[i] == kCanary;
+    }
+    if ((memcmp(got, want.data(), row_bytes) != 0 || !padding_kept) &&
+        bad_rows++ == 0) {
+      SC_CHECK(false, "%s: row %d %s", what.c_str(), y,
+               padding_kept ? "differs" : "wrote into the pitch padding");
+    }
+  }
+  SC_CHECK(bad_rows == 0, "%s: %d bad rows", what.c_str(), bad_rows);
+  if (with_stats) {
+    SC_CHECK(stats.black == want_stats.black &&
+                 stats.transparent == want_stats.transparent &&
+                 stats.luma == want_stats.luma,
+             "%s: stats differ", what.c_str());
+  }
+  if (with_full) {
+    SC_CHECK(full.luma_histogram == want_full.luma_histogram &&
+                 full.min == want_full.min && full.max == want_full.max &&
+                 full.sum == want_full.sum &&
+                 full.sum_sq == want_full.sum_sq &&
+                 full.color_sketch == want_full.color_sketch,
+             "%s: full stats differ", what.c_str());
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  const SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                              SimdLevel::kAvx2, SimdLevel::kAvx512};
+  // The large surface is over kParallelMinBytes, so with four threads its
+  // rows are split into bands whose partial stats get merged.
+  const int sizes[][2] = {{37, 23}, {1031, 301}};
+  for (const int threads : {1, 4}) {
+    SetParallelThreads(threads);
+    for (const auto &size : sizes) {
+      const Surface s =
+          MakeSurface(size[0], size[1], static_cast<uint32_t>(size[0]));
+      const ImageView &v = s.view;
+      // The whole surface, a crop inside it starting at an odd column, a
+      // single column and a single row.
+      const Rect rects[] = {
+          {v.origin_x, v.origin_y, v.origin_x + v.width,
+           v.origin_y + v.height},
+          {v.origin_x + 3, v.origin_y + 5, v.origin_x + v.width - 2,
+           v.origin_y + v.height - 1},
+          {v.origin_x + v.width - 1, v.origin_y, v.origin_x + v.width,
+           v.origin_y + v.height},
+          {v.origin_x, v.origin_y + 7, v.origin_x + v.width, v.origin_y + 8},
+      };
+      for (const Rect &r : rects) {
+        const ImageView crop = SubView(v, r);
+        for (const SimdLevel level : levels) {
+          if (level > DetectSimdLevel()) {
+            continue;
+          }
+          SetSimdLevelCap(level);
+          for (const AlphaPolicy alpha :
+               {AlphaPolicy::kKeep, AlphaPolicy::kForceOpaque}) {
+            for (int paths = 0; paths < 4; ++paths) {
+              const std::string what =
+                  std::to_string(crop.width) + "x" +
+                  std::to_string(crop.height) + " at (" +
+                  std::to_string(crop.origin_x) + "," +
+                  std::to_string(crop.origin_y) + ") " +
+                  SimdLevelName(level) + " threads=" +
+                  std::to_string(threads) +
+                  (alpha == AlphaPolicy::kKeep ? " keep" : " opaque") +
+                  ((paths & 1) ? " +stats" : "") +
+                  ((paths & 2) ? " +full" : "");
+              CheckCopy(crop, alpha, (paths & 1) != 0, (paths & 2) != 0,
+                        what);
+            }
+          }
+        }
+      }
+
+      // DeliverFrame with no sink copies the frame and keeps its origin.
+      ImageBuffer out;
+      ErrorInfo err;
+      SC_CHECK(DeliverFrame(v, AlphaPolicy::kForceOpaque, nullptr, &out,
+                            &err),
+               "DeliverFrame: %s", err.message.c_str());
+      SC_CHECK(out.width == v.width && out.height == v.height &&
+                   out.origin_x == v.origin_x && out.origin_y == v.origin_y,
+               "DeliverFrame: got %dx%d at (%d,%d)", out.width, out.height,
+               out.origin_x, out.origin_y);
+      for (int y = 0; y < out.height && y < v.height; ++y) {
+        const uint8_t *got =
+            out.bgra.data() + static_cast<size_t>(y) * out.row_pitch;
+        bool same = true;
+        for (int x = 0; x < v.width * 4; ++x) {
+          same = same && got[x] == ((x & 3) == 3 ? 0xFF : v.Row(y)[x]);
+        }
+        SC_CHECK(same, "DeliverFrame: row %d differs", y);
+      }
+    }
+  }
+  return test::TestExitCode();
+}
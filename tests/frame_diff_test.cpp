@@ -0,0 +1,299 @@
+// Compares DiffFrames at every SIMD level with a pixel-by-pixel count over
+// the shared area: identical frames, one changed pixel on either side of
+// each tile edge, scattered changes, frames at different origins and
+// sizes that are not a multiple of the tile. Dirty rectangles must cover
+// exactly the dirty tiles, without overlap, clipped to the area.
+
+#include "cpu_features.h"
+#include "frame_diff.h"
+#include "parallel.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+const uint8_t *PixelAt(const ImageView &img, int x, int y) {
+  return img.data + static_cast<size_t>(y) * img.stride +
+         static_cast<size_t>(x) * 4;
+}
+
+uint8_t *MutablePixel(ImageBuffer *img, int x, int y) {
+  return img->bgra.data() + static_cast<size_t>(y) * img->row_pitch +
+         static_cast<size_t>(x) * 4;
+}
+
+void CopyOf(const ImageBuffer &src, ImageBuffer *dst) {
+  AllocateImage(src.width, src.height, dst);
+  memcpy(dst->bgra.data(), src.bgra.data(),
+         static_cast<size_t>(src.row_pitch) * src.height);
+  dst->origin_x = src.origin_x;
+  dst->origin_y = src.origin_y;
+}
+
+// Changed pixels per tile, visiting every pixel of the area.
+std::vector<uint64_t> ReferenceTiles(const ImageView &a, const ImageView &b,
+                                     const FrameDiff &d) {
+  std::vector<uint64_t> tiles(static_cast<size_t>(d.tiles_x) * d.tiles_y);
+  for (int y = d.area.top; y < d.area.bottom; ++y) {
+    for (int x = d.area.left; x < d.area.right; ++x) {
+      const bool in_a = x >= a.origin_x && x < a.origin_x + a.width &&
+                        y >= a.origin_y && y < a.origin_y + a.height;
+      const bool in_b = x >= b.origin_x && x < b.origin_x + b.width &&
+                        y >= b.origin_y && y < b.origin_y + b.height;
+      bool changed = in_a != in_b;
+      if (in_a && in_b) {
+        changed = memcmp(PixelAt(a, x - a.origin_x, y - a.origin_y),
+                         PixelAt(b, x - b.origin_x, y - b.origin_y), 4) != 0;
+      }
+      if (changed) {
+        const int tx = (x - d.area.left) / d.tile_size;
+        const int ty = (y - d.area.top) / d.tile_size;
+        ++tiles[static_cast<size_t>(ty) * d.tiles_x + tx];
+      }
+    }
+  }
+  return tiles;
+}
+
+// Diffs a against b and checks every field against the reference.
+FrameDiff CheckDiff(const ImageView &a, const ImageView &b, int tile,
+                    const std::string &what) {
+  DiffOptions opt;
+  opt.tile_size = tile;
+  FrameDiff d;
+  ErrorInfo err;
+  if (!DiffFrames(a, b, opt, &d, &err)) {
+    SC_CHECK(false, "%s: %s", what.c_str(), err.message.c_str());
+    return d;
+  }
+  const Rect area{std::min(a.origin_x, b.origin_x),
+                  std::min(a.origin_y, b.origin_y),
+                  std::max(a.origin_x + a.width, b.origin_x + b.width),
+                  std::max(a.origin_y + a.height, b.origin_y + b.height)};
+  SC_CHECK(d.area.left == area.left && d.area.top == area.top &&
+               d.area.right == area.right && d.area.bottom == area.bottom,
+           "%s: wrong area", what.c_str());
+  SC_CHECK(d.tiles_x == (Width(area) + tile - 1) / tile &&
+               d.tiles_y == (Height(area) + tile - 1) / tile,
+           "%s: %dx%d tiles", what.c_str(), d.tiles_x, d.tiles_y);
+  const std::vector<uint64_t> want = ReferenceTiles(a, b, d);
+  uint64_t changed = 0;
+  int dirty = 0;
+  for (uint64_t c : want) {
+    changed += c;
+    dirty += c != 0;
+  }
+  SC_CHECK(d.changed_pixels == changed && d.dirty_tiles == dirty,
+           "%s: %llu changed in %d tiles, want %llu in %d", what.c_str(),
+           static_cast<unsigned long long>(d.changed_pixels), d.dirty_tiles,
+           static_cast<unsigned long long>(changed), dirty);
+  SC_CHECK(d.identical() == (changed == 0), "%s: identical() is wrong",
+           what.c_str());
+
+  // Paint each rectangle over the tile grid: every dirty tile once, and
+  // nothing else.
+  std::vector<int> painted(want.size());
+  int prev_top = area.top;
+  for (const Rect &r : d.dirty_rects) {
+    const bool inside = r.left >= area.left && r.top >= area.top &&
+                        r.right <= area.right && r.bottom <= area.bottom &&
+                        IsValidRect(r);
+    // Edges fall on tile boundaries unless clipped to the area.
+    const bool aligned =
+        (r.left - area.left) % tile == 0 && (r.top - area.top) % tile == 0 &&
+        ((r.right - area.left) % tile == 0 || r.right == area.right) &&
+        ((r.bottom - area.top) % tile == 0 || r.bottom == area.bottom);
+    if (!inside || !aligned || r.top < prev_top) {
+      SC_CHECK(false, "%s: bad rect %d,%d,%d,%d", what.c_str(), r.left,
+               r.top, r.right, r.bottom);
+      return d;
+    }
+    prev_top = r.top;
+    for (int ty = (r.top - area.top) / tile;
+         ty * tile < r.bottom - area.top; ++ty) {
+      for (int tx = (r.left - area.left) / tile;
+           tx * tile < r.right - area.left; ++tx) {
+        ++painted[static_cast<size_t>(ty) * d.tiles_x + tx];
+      }
+    }
+  }
+  for (size_t i = 0; i < want.size(); ++i) {
+    if (painted[i] != (want[i] != 0 ? 1 : 0)) {
+      SC_CHECK(false, "%s: tile %zu painted %d times, dirty %d", what.c_str(),
+               i, painted[i], want[i] != 0);
+      break;
+    }
+  }
+  return d;
+}
+
+void CheckIdentical(const ImageView &a, const std::string &what) {
+  const FrameDiff d = CheckDiff(a, a, kDiffTileSize, what + " identical");
+  SC_CHECK(d.identical() && d.dirty_rects.empty() && d.changed_ratio == 0.0 &&
+               d.total_pixels == static_cast<uint64_t>(a.width) * a.height,
+           "%s: identical frames reported changed", what.c_str());
+}
+
+// One pixel on each side of every tile edge, and at the frame's corners,
+// with one byte changed: each must dirty exactly its own tile.
+void CheckSinglePixels(const ImageBuffer &img, const std::string &what) {
+  const int tile = kDiffTileSize;
+  std::vector<int> xs = {0, img.width - 1};
+  std::vector<int> ys = {0, img.height - 1};
+  for (int e = tile; e < img.width; e += tile) {
+    xs.push_back(e - 1);
+    xs.push_back(e);
+  }
+  for (int e = tile; e < img.height; e += tile) {
+    ys.push_back(e - 1);
+    ys.push_back(e);
+  }
+  ImageBuffer b;
+  CopyOf(img, &b);
+  for (const int y : ys) {
+    for (const int x : xs) {
+      const int channel = (x + y) % 4; // alpha alone counts too
+      uint8_t *p = MutablePixel(&b, x, y);
+      p[channel] ^= 1;
+      const std::string at =
+          what + " pixel " + std::to_string(x) + "," + std::to_string(y);
+      const FrameDiff d = CheckDiff(ImageView(img), ImageView(b), tile, at);
+      const Rect want{x / tile * tile, y / tile * tile,
+                      std::min((x / tile + 1) * tile, img.width),
+                      std::min((y / tile + 1) * tile, img.height)};
+      SC_CHECK(d.changed_pixels == 1 && d.dirty_rects.size() == 1 &&
+                   d.dirty_rects[0].left == want.left &&
+                   d.dirty_rects[0].top == want.top &&
+                   d.dirty_rects[0].right == want.right &&
+                   d.dirty_rects[0].bottom == want.bottom,
+               "%s: not just its own tile", at.c_str());
+      p[channel] ^= 1;
+    }
+  }
+}
+
+void CheckScattered(const ImageBuffer &img, uint32_t seed,
+                    const std::string &what) {
+  std::mt19937 rng(seed);
+  for (const int tile : {1, 7, kDiffTileSize}) {
+    ImageBuffer b;
+    CopyOf(img, &b);
+    const int n = 1 + static_cast<int>(rng() % 40);
+    for (int i = 0; i < n; ++i) {
+      const int x = static_cast<int>(rng() % static_cast<uint32_t>(b.width));
+      const int y = static_cast<int>(rng() % static_cast<uint32_t>(b.height));
+      // A short horizontal run, sometimes crossing a tile edge.
+      const int len = 1 + static_cast<int>(rng() % 9);
+      for (int k = x; k < std::min(x + len, b.width); ++k) {
+        MutablePixel(&b, k, y)[rng() % 4] ^= 0x80;
+      }
+    }
+    CheckDiff(ImageView(img), ImageView(b), tile,
+              what + " scattered tile " + std::to_string(tile));
+  }
+}
+
+// Frames that only partly overlap: what only one covers counts as changed.
+void CheckOrigins(const ImageBuffer &img, const std::string &what) {
+  ImageBuffer b;
+  CopyOf(img, &b);
+  b.origin_x = img.origin_x + 5;
+  b.origin_y = img.origin_y - 3;
+  CheckDiff(ImageView(img), ImageView(b), kDiffTileSize, what + " shifted");
+  // A crop of the same pixels at its own place in the desktop changes
+  // nothing inside the crop.
+  if (img.width > 4 && img.height > 4) {
+    const ImageView crop =
+        SubView(ImageView(img),
+                Rect{img.origin_x + 2, img.origin_y + 1,
+                     img.origin_x + img.width - 1,
+                     img.origin_y + img.height - 2});
+    const FrameDiff d =
+        CheckDiff(ImageView(img), crop, kDiffTileSize, what + " crop");
+    SC_CHECK(d.changed_pixels ==
+                 static_cast<uint64_t>(img.width) * img.height -
+                     static_cast<uint64_t>(crop.width) * crop.height,
+             "%s crop: %llu changed", what.c_str(),
+             static_cast<unsigned long long>(d.changed_pixels));
+  }
+}
+
+// Runs of dirty tiles merge across a row and downwards while the span
+// stays the same; a different span starts a new rectangle.
+void CheckMergeShape() {
+  // With 1-pixel tiles, the changed pixels are the dirty tiles:
+  //   X X . X
+  //   X X . X
+  //   X X X .
+  //   . X X .
+  ImageBuffer a;
+  AllocateImage(4, 4, &a);
+  memset(a.bgra.data(), 0, static_cast<size_t>(a.row_pitch) * a.height);
+  ImageBuffer b;
+  CopyOf(a, &b);
+  const char *rows[] = {"XX.X", "XX.X", "XXX.", ".XX."};
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      if (rows[y][x] == 'X') {
+        MutablePixel(&b, x, y)[0] = 1;
+      }
+    }
+  }
+  const FrameDiff d = CheckDiff(ImageView(a), ImageView(b), 1, "merge shape");
+  const Rect want[] = {
+      {0, 0, 2, 2}, {3, 0, 4, 2}, {0, 2, 3, 3}, {1, 3, 3, 4}};
+  bool same = d.dirty_rects.size() == 4;
+  for (size_t i = 0; same && i < 4; ++i) {
+    const Rect &r = d.dirty_rects[i];
+    same = r.left == want[i].left && r.top == want[i].top &&
+           r.right == want[i].right && r.bottom == want[i].bottom;
+  }
+  SC_CHECK(same, "merge shape: %zu rects, not the expected four",
+           d.dirty_rects.size());
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  // The largest size has enough tile rows to be split into bands.
+  SetParallelThreads(4);
+  const SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                              SimdLevel::kAvx2, SimdLevel::kAvx512};
+  const int sizes[][2] = {{1, 1},  {31, 33}, {32, 32},
+                          {33, 31}, {100, 70}, {257, 129}};
+  for (const SimdLevel level : levels) {
+    if (level > DetectSimdLevel()) {
+      std::printf("%s: not supported here, skipped\n", SimdLevelName(level));
+      continue;
+    }
+    SetSimdLevelCap(level);
+    for (const auto &size : sizes) {
+      ImageBuffer img;
+      test::FillTestImage(size[0], size[1],
+                          static_cast<uint32_t>(size[0] * 31 + size[1]), &img);
+      img.origin_x = -7;
+      img.origin_y = 11;
+      const std::string what = std::string(SimdLevelName(level)) + " " +
+                               std::to_string(size[0]) + "x" +
+                               std::to_string(size[1]);
+      CheckIdentical(ImageView(img), what);
+      img.origin_x = 0;
+      img.origin_y = 0;
+      CheckSinglePixels(img, what);
+      CheckScattered(img, static_cast<uint32_t>(size[0] + size[1]), what);
+      img.origin_x = -7;
+      img.origin_y = 11;
+      CheckOrigins(img, what);
+    }
+  }
+  CheckMergeShape();
+  return test::TestExitCode();
+}
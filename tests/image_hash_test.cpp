@@ -0,0 +1,256 @@
+// Checks the perceptual hashes on images whose hashes are known (gradients
+// and halves), on identical images fed in different row bands, and on
+// near-duplicates: an upscaled copy and a lightly perturbed copy must stay
+// within a few bits while a different image must not. pHash is also
+// compared with a direct evaluation of its definition.
+
+#include "image_hash.h"
+#include "image_stats.h"
+#include "parallel.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+
+namespace sc {
+namespace {
+
+int Distance(uint64_t a, uint64_t b) { return std::popcount(a ^ b); }
+
+void Fill(int width, int height,
+          const std::function<uint8_t(int x, int y)> &grey,
+          ImageBuffer *img) {
+  AllocateImage(width, height, img);
+  for (int y = 0; y < height; ++y) {
+    uint8_t *row = img->bgra.data() + static_cast<size_t>(y) * img->row_pitch;
+    for (int x = 0; x < width; ++x) {
+      const uint8_t g = grey(x, y);
+      row[x * 4 + 0] = row[x * 4 + 1] = row[x * 4 + 2] = g;
+      row[x * 4 + 3] = 255;
+    }
+  }
+}
+
+// Smooth shapes with some texture, closer to a screen or photo than noise.
+uint8_t Scene(int x, int y, int width, int height, double phase) {
+  const double u = static_cast<double>(x) / width;
+  const double v = static_cast<double>(y) / height;
+  const double s = 0.5 + 0.25 * std::sin(6.0 * u + phase) +
+                   0.15 * std::cos(9.0 * v - 2.0 * phase) +
+                   0.1 * std::sin(23.0 * (u + v) + 3.0 * phase);
+  return static_cast<uint8_t>(std::lround(std::clamp(s, 0.0, 1.0) * 255.0));
+}
+
+// pHash straight from its definition: rounded BT.709 luma averaged over a
+// 32x32 grid (cell c covering pixels [n * c / 32, n * (c + 1) / 32)), the
+// 8x8 lowest terms of its 2D DCT-II, one bit per term above their median.
+uint64_t ReferencePhash(const ImageBuffer &img) {
+  double means[32][32] = {};
+  for (int cy = 0; cy < 32; ++cy) {
+    for (int cx = 0; cx < 32; ++cx) {
+      const int x0 = img.width * cx / 32;
+      const int x1 = std::max(img.width * (cx + 1) / 32, x0 + 1);
+      const int y0 = img.height * cy / 32;
+      const int y1 = std::max(img.height * (cy + 1) / 32, y0 + 1);
+      double sum = 0.0;
+      for (int y = y0; y < y1; ++y) {
+        const uint8_t *row =
+            img.bgra.data() + static_cast<size_t>(y) * img.row_pitch;
+        for (int x = x0; x < x1; ++x) {
+          sum += Luma8(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]);
+        }
+      }
+      means[cy][cx] = sum / ((x1 - x0) * (y1 - y0));
+    }
+  }
+  const double pi = 3.14159265358979323846;
+  std::array<double, 64> terms{};
+  for (int v = 0; v < 8; ++v) {
+    for (int u = 0; u < 8; ++u) {
+      double s = 0.0;
+      for (int y = 0; y < 32; ++y) {
+        for (int x = 0; x < 32; ++x) {
+          s += means[y][x] * std::cos(pi * (2 * x + 1) * u / 64.0) *
+               std::cos(pi * (2 * y + 1) * v / 64.0);
+        }
+      }
+      terms[static_cast<size_t>(v * 8 + u)] = s;
+    }
+  }
+  std::array<double, 64> sorted = terms;
+  std::sort(sorted.begin(), sorted.end());
+  const double median = (sorted[31] + sorted[32]) / 2.0;
+  uint64_t h = 0;
+  for (const double t : terms) {
+    h = (h << 1) | (t > median ? 1u : 0u);
+  }
+  return h;
+}
+
+void CheckKnownVectors() {
+  ImageBuffer img;
+  // Falling to the right: every cell brighter than its right neighbour.
+  Fill(90, 40, [](int x, int) { return static_cast<uint8_t>(250 - x * 2); },
+       &img);
+  SC_CHECK(ComputeImageHashes(ImageView(img)).dhash == ~0ull,
+           "falling gradient dhash %s",
+           HashHex(ComputeImageHashes(ImageView(img)).dhash).c_str());
+  Fill(90, 40, [](int x, int) { return static_cast<uint8_t>(x * 2); }, &img);
+  SC_CHECK(ComputeImageHashes(ImageView(img)).dhash == 0,
+           "rising gradient dhash %s",
+           HashHex(ComputeImageHashes(ImageView(img)).dhash).c_str());
+
+  // Halves: the bright blocks are the ones above the median.
+  Fill(
+      64, 48,
+      [](int x, int) { return static_cast<uint8_t>(x < 32 ? 200 : 10); },
+      &img);
+  ImageHashes h = ComputeImageHashes(ImageView(img));
+  SC_CHECK(h.block_mean == 0xF0F0F0F0F0F0F0F0ull, "left half block_mean %s",
+           HashHex(h.block_mean).c_str());
+  Fill(
+      64, 48,
+      [](int, int y) { return static_cast<uint8_t>(y < 24 ? 200 : 10); },
+      &img);
+  h = ComputeImageHashes(ImageView(img));
+  SC_CHECK(h.block_mean == 0xFFFFFFFF00000000ull, "top half block_mean %s",
+           HashHex(h.block_mean).c_str());
+
+  // A flat image has nothing above the median and no falling cells.
+  Fill(33, 17, [](int, int) { return static_cast<uint8_t>(77); }, &img);
+  h = ComputeImageHashes(ImageView(img));
+  SC_CHECK(h.dhash == 0 && h.block_mean == 0, "flat image: %s",
+           ImageHashesJson(h).c_str());
+
+  // Narrower than the grid, cells share pixels: the nine dhash columns
+  // of a 2-pixel image are pixel 0 five times, then pixel 1.
+  Fill(
+      2, 40,
+      [](int x, int) { return static_cast<uint8_t>(x == 0 ? 200 : 10); },
+      &img);
+  h = ComputeImageHashes(ImageView(img));
+  SC_CHECK(h.dhash == 0x0808080808080808ull, "2-pixel dhash %s",
+           HashHex(h.dhash).c_str());
+  Fill(1, 1, [](int, int) { return static_cast<uint8_t>(9); }, &img);
+  h = ComputeImageHashes(ImageView(img));
+  SC_CHECK(h.dhash == 0 && h.block_mean == 0, "1x1: %s",
+           ImageHashesJson(h).c_str());
+  SC_CHECK(ComputeImageHashes(ImageView()).dhash == 0,
+           "an empty view should hash to zero");
+
+  SC_CHECK(HashHex(0x0123456789ABCDEFull) == "0123456789abcdef",
+           "HashHex gave %s", HashHex(0x0123456789ABCDEFull).c_str());
+  ImageHashes known;
+  known.dhash = 1;
+  known.phash = 0xFF;
+  known.block_mean = ~0ull;
+  SC_CHECK(ImageHashesJson(known) ==
+               "{\"dhash\":\"0000000000000001\",\"phash\":"
+               "\"00000000000000ff\",\"block_mean\":\"ffffffffffffffff\"}",
+           "ImageHashesJson gave %s", ImageHashesJson(known).c_str());
+}
+
+// Rows fed in uneven bands, some large enough to be split across the row
+// pool, must give the hashes of the whole image at once.
+void CheckBands() {
+  ImageBuffer img;
+  test::FillTestImage(301, 257, 99, &img);
+  const ImageHashes whole = ComputeImageHashes(ImageView(img));
+  ImageHasher hasher;
+  hasher.Begin(img.width, img.height);
+  int y = 0;
+  for (const int rows : {1, 7, 100, 2, 130, 17}) {
+    hasher.AddRows(y, SubView(ImageView(img),
+                              Rect{0, y, img.width, y + rows}));
+    y += rows;
+  }
+  const ImageHashes banded = hasher.Finish();
+  SC_CHECK(y == img.height && banded.dhash == whole.dhash &&
+               banded.phash == whole.phash &&
+               banded.block_mean == whole.block_mean,
+           "banded %s, whole %s", ImageHashesJson(banded).c_str(),
+           ImageHashesJson(whole).c_str());
+}
+
+void CheckNearDuplicates() {
+  const int w = 320;
+  const int h = 200;
+  ImageBuffer base;
+  Fill(w, h, [&](int x, int y) { return Scene(x, y, w, h, 0.0); }, &base);
+  const ImageHashes hb = ComputeImageHashes(ImageView(base));
+  SC_CHECK(hb.phash == ReferencePhash(base), "phash %s, reference %s",
+           HashHex(hb.phash).c_str(), HashHex(ReferencePhash(base)).c_str());
+
+  // Twice the size, each pixel repeated: the same picture.
+  ImageBuffer big;
+  Fill(
+      w * 2, h * 2,
+      [&](int x, int y) { return Scene(x / 2, y / 2, w, h, 0.0); }, &big);
+  const ImageHashes hg = ComputeImageHashes(ImageView(big));
+  SC_CHECK(Distance(hb.dhash, hg.dhash) <= 2 &&
+               Distance(hb.phash, hg.phash) <= 2 &&
+               Distance(hb.block_mean, hg.block_mean) <= 2,
+           "upscaled: distances %d %d %d", Distance(hb.dhash, hg.dhash),
+           Distance(hb.phash, hg.phash),
+           Distance(hb.block_mean, hg.block_mean));
+
+  // Light noise on every pixel, then also a small patch painted over it.
+  // pHash is the one that notices the patch, by a few bits.
+  const struct {
+    const char *what;
+    bool patch;
+    int max_bits;
+  } perturbations[] = {{"noise", false, 2}, {"noise and patch", true, 10}};
+  for (const auto &pert : perturbations) {
+    std::mt19937 rng(7);
+    ImageBuffer noisy;
+    Fill(w, h,
+         [&](int x, int y) {
+           int g = Scene(x, y, w, h, 0.0) + static_cast<int>(rng() % 7) - 3;
+           if (pert.patch && x >= 100 && x < 110 && y >= 50 && y < 58) {
+             g = 255;
+           }
+           return static_cast<uint8_t>(std::clamp(g, 0, 255));
+         },
+         &noisy);
+    const ImageHashes hn = ComputeImageHashes(ImageView(noisy));
+    SC_CHECK(hn.phash == ReferencePhash(noisy), "%s: phash %s, reference %s",
+             pert.what, HashHex(hn.phash).c_str(),
+             HashHex(ReferencePhash(noisy)).c_str());
+    SC_CHECK(Distance(hb.dhash, hn.dhash) <= pert.max_bits &&
+                 Distance(hb.phash, hn.phash) <= pert.max_bits &&
+                 Distance(hb.block_mean, hn.block_mean) <= pert.max_bits,
+             "%s: distances %d %d %d", pert.what, Distance(hb.dhash, hn.dhash),
+             Distance(hb.phash, hn.phash),
+             Distance(hb.block_mean, hn.block_mean));
+  }
+
+  // The same kind of scene, shifted in phase: a different picture.
+  ImageBuffer other;
+  Fill(w, h, [&](int x, int y) { return Scene(x, y, w, h, 3.0); }, &other);
+  const ImageHashes ho = ComputeImageHashes(ImageView(other));
+  SC_CHECK(Distance(hb.dhash, ho.dhash) >= 16 &&
+               Distance(hb.phash, ho.phash) >= 16 &&
+               Distance(hb.block_mean, ho.block_mean) >= 16,
+           "different: distances %d %d %d", Distance(hb.dhash, ho.dhash),
+           Distance(hb.phash, ho.phash),
+           Distance(hb.block_mean, ho.block_mean));
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  SetParallelThreads(4);
+  CheckKnownVectors();
+  CheckBands();
+  CheckNearDuplicates();
+  return test::TestExitCode();
+}
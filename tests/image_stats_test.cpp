@@ -0,0 +1,300 @@
+// Checks that every image_stats kernel tier gives exactly the scalar sums,
+// and the full stats exactly the values of a plain per-pixel loop, on
+// random rows of every width up to a few vectors (so every tail length is
+// hit), at unaligned addresses, and on rows long enough to spill the 32-bit
+// luma lanes. Then checks the final statistics of small images worked out
+// by hand, and the distinct-colour estimate against images with a known
+// number of colours.
+
+#include "cpu_features.h"
+#include "image_stats.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace sc {
+namespace {
+
+const SimdLevel kLevels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                             SimdLevel::kAvx2, SimdLevel::kAvx512};
+
+// Channels are mostly 0 or 255 so that black and transparent pixels, and
+// the largest luma sums, turn up often.
+std::vector<uint8_t> RandomRow(int width, int offset, std::mt19937 *rng) {
+  std::vector<uint8_t> row(static_cast<size_t>(width) * 4 + offset);
+  for (size_t i = offset; i < row.size(); ++i) {
+    const uint32_t pick = (*rng)() % 4;
+    row[i] = pick == 0 ? 0 : pick == 1 ? 255 : static_cast<uint8_t>((*rng)());
+  }
+  return row;
+}
+
+StatsAccum NaiveStats(const uint8_t *row, int width) {
+  StatsAccum acc;
+  for (int x = 0; x < width; ++x) {
+    const uint8_t *p = row + x * 4;
+    acc.black += p[0] == 0 && p[1] == 0 && p[2] == 0;
+    acc.transparent += p[3] == 0;
+    acc.luma += static_cast<uint64_t>(kLumaB * p[0] + kLumaG * p[1] +
+                                      kLumaR * p[2]);
+  }
+  return acc;
+}
+
+// Everything but the colour sketch, whose hash only the library knows.
+FullStatsAccum NaiveFullStats(const uint8_t *row, int width) {
+  FullStatsAccum acc;
+  for (int x = 0; x < width; ++x) {
+    const uint8_t *p = row + x * 4;
+    ++acc.luma_histogram[Luma8(p[0], p[1], p[2])];
+    for (size_t c = 0; c < 4; ++c) {
+      acc.min[c] = std::min(acc.min[c], p[c]);
+      acc.max[c] = std::max(acc.max[c], p[c]);
+      acc.sum[c] += p[c];
+      acc.sum_sq[c] += static_cast<uint64_t>(p[c]) * p[c];
+    }
+  }
+  return acc;
+}
+
+bool SameStats(const StatsAccum &a, const StatsAccum &b) {
+  return a.black == b.black && a.transparent == b.transparent &&
+         a.luma == b.luma;
+}
+
+bool SameMoments(const FullStatsAccum &a, const FullStatsAccum &b) {
+  return a.luma_histogram == b.luma_histogram && a.min == b.min &&
+         a.max == b.max && a.sum == b.sum && a.sum_sq == b.sum_sq;
+}
+
+bool SameFullStats(const FullStatsAccum &a, const FullStatsAccum &b) {
+  return SameMoments(a, b) && a.color_sketch == b.color_sketch;
+}
+
+void CheckRow(const uint8_t *row, int width, const char *what) {
+  const StatsAccum want = NaiveStats(row, width);
+  std::vector<uint8_t> want_copy(static_cast<size_t>(width) * 4 + 1);
+  std::vector<uint8_t> got_copy(want_copy.size());
+  FullStatsAccum want_full;
+  SetSimdLevelCap(SimdLevel::kScalar);
+  FullStatsRow(row, width, &want_full);
+  const FullStatsAccum exact = NaiveFullStats(row, width);
+
+  for (const SimdLevel level : kLevels) {
+    if (level > DetectSimdLevel()) {
+      continue;
+    }
+    const char *name = SimdLevelName(level);
+    StatsAccum got;
+    StatsRowKernel(level)(row, width, &got);
+    SC_CHECK(SameStats(got, want), "%s: %s stats differ at width %d", what,
+             name, width);
+
+    for (const uint32_t alpha_or : {0u, 0xFF000000u}) {
+      StatsAccum copied;
+      // dst one byte off alignment, like src.
+      CopyStatsRowKernel(level)(row, width, alpha_or, got_copy.data() + 1,
+                                &copied);
+      for (int x = 0; x < width; ++x) {
+        uint32_t px;
+        memcpy(&px, row + x * 4, 4);
+        px |= alpha_or;
+        memcpy(want_copy.data() + 1 + x * 4, &px, 4);
+      }
+      const StatsAccum want_copied = NaiveStats(want_copy.data() + 1, width);
+      SC_CHECK(memcmp(got_copy.data() + 1, want_copy.data() + 1,
+                      static_cast<size_t>(width) * 4) == 0,
+               "%s: %s copy differs at width %d alpha_or %08x", what, name,
+               width, alpha_or);
+      SC_CHECK(SameStats(copied, want_copied),
+               "%s: %s copy stats differ at width %d alpha_or %08x", what,
+               name, width, alpha_or);
+    }
+
+    SetSimdLevelCap(level);
+    FullStatsAccum got_full;
+    FullStatsRow(row, width, &got_full);
+    SC_CHECK(SameFullStats(got_full, want_full),
+             "%s: %s full stats differ at width %d", what, name, width);
+    SC_CHECK(SameMoments(got_full, exact),
+             "%s: %s full stats are not the exact sums at width %d", what,
+             name, width);
+  }
+}
+
+ImageBuffer ImageOf(int width, int height, const std::vector<uint32_t> &px) {
+  ImageBuffer img;
+  AllocateImage(width, height, &img);
+  for (int y = 0; y < height; ++y) {
+    memcpy(img.bgra.data() + static_cast<size_t>(y) * img.row_pitch,
+           px.data() + static_cast<size_t>(y) * width,
+           static_cast<size_t>(width) * 4);
+  }
+  return img;
+}
+
+bool Near(double got, double want) { return std::fabs(got - want) < 1e-9; }
+
+// Statistics worked out by hand. Greys have luma equal to their value, as
+// the weights sum to exactly 32768.
+void CheckSmallImages() {
+  {
+    // Black and white, two of each: one bit of entropy.
+    const ImageBuffer img =
+        ImageOf(2, 2, {0xFF000000u, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFF000000u});
+    const FullImageStats s = ComputeFullImageStats(ImageView(img));
+    const ImageStats basic = ComputeImageStats(ImageView(img));
+    SC_CHECK(s.luma_histogram[0] == 2 && s.luma_histogram[255] == 2,
+             "black and white: histogram %llu %llu",
+             static_cast<unsigned long long>(s.luma_histogram[0]),
+             static_cast<unsigned long long>(s.luma_histogram[255]));
+    SC_CHECK(Near(s.luma_entropy, 1.0), "black and white: entropy %f",
+             s.luma_entropy);
+    SC_CHECK(s.r.min == 0 && s.r.max == 255 && Near(s.r.mean, 127.5) &&
+                 Near(s.r.stddev, 127.5),
+             "black and white: red %d %d %f %f", s.r.min, s.r.max, s.r.mean,
+             s.r.stddev);
+    SC_CHECK(s.a.min == 255 && s.a.max == 255 && Near(s.a.mean, 255.0) &&
+                 Near(s.a.stddev, 0.0),
+             "black and white: alpha %d %d %f %f", s.a.min, s.a.max,
+             s.a.mean, s.a.stddev);
+    SC_CHECK(s.distinct_colors == 2 && !s.solid_color,
+             "black and white: %llu colours, solid %d",
+             static_cast<unsigned long long>(s.distinct_colors),
+             s.solid_color);
+    SC_CHECK(Near(basic.avg_luma, 127.5) && Near(basic.black_ratio, 0.5) &&
+                 Near(basic.transparent_ratio, 0.0),
+             "black and white: luma %f black %f transparent %f",
+             basic.avg_luma, basic.black_ratio, basic.transparent_ratio);
+  }
+  {
+    // Four greys, one each: two bits; variance 25287.5 - 127.5^2.
+    const ImageBuffer img = ImageOf(
+        4, 1, {0xFF000000u, 0xFF555555u, 0xFFAAAAAAu, 0xFFFFFFFFu});
+    const FullImageStats s = ComputeFullImageStats(ImageView(img));
+    SC_CHECK(Near(s.luma_entropy, 2.0), "four greys: entropy %f",
+             s.luma_entropy);
+    SC_CHECK(s.luma_histogram[0x55] == 1 && s.luma_histogram[0xAA] == 1,
+             "four greys: histogram");
+    SC_CHECK(Near(s.g.mean, 127.5) && Near(s.g.stddev, std::sqrt(9031.25)),
+             "four greys: green %f %f", s.g.mean, s.g.stddev);
+    SC_CHECK(s.distinct_colors == 4, "four greys: %llu colours",
+             static_cast<unsigned long long>(s.distinct_colors));
+  }
+  {
+    // One colour with two alphas: not solid, but one RGB colour.
+    const ImageBuffer img = ImageOf(3, 1, {0x00123456u, 0xFF123456u,
+                                           0x00123456u});
+    const FullImageStats s = ComputeFullImageStats(ImageView(img));
+    const ImageStats basic = ComputeImageStats(ImageView(img));
+    SC_CHECK(!s.solid_color && s.distinct_colors == 1 &&
+                 Near(s.luma_entropy, 0.0) && Near(s.b.stddev, 0.0),
+             "alphas: solid %d, %llu colours, entropy %f", s.solid_color,
+             static_cast<unsigned long long>(s.distinct_colors),
+             s.luma_entropy);
+    SC_CHECK(Near(s.a.mean, 85.0) && Near(basic.transparent_ratio, 2.0 / 3.0),
+             "alphas: alpha mean %f, transparent %f", s.a.mean,
+             basic.transparent_ratio);
+    // Unrounded fixed-point luma, the same for all three pixels.
+    SC_CHECK(Near(basic.avg_luma,
+                  (6966.0 * 0x12 + 23436.0 * 0x34 + 2366.0 * 0x56) / 32768.0),
+             "alphas: avg luma %f", basic.avg_luma);
+  }
+  {
+    ImageBuffer img;
+    AllocateImage(9, 7, &img);
+    for (int y = 0; y < 7; ++y) {
+      uint32_t *row = reinterpret_cast<uint32_t *>(
+          img.bgra.data() + static_cast<size_t>(y) * img.row_pitch);
+      std::fill(row, row + 9, 0x80402010u);
+    }
+    const FullImageStats s = ComputeFullImageStats(ImageView(img));
+    SC_CHECK(s.solid_color && s.distinct_colors == 1 &&
+                 Near(s.luma_entropy, 0.0) &&
+                 s.luma_histogram[Luma8(0x10, 0x20, 0x40)] == 63,
+             "solid: solid %d, %llu colours, entropy %f", s.solid_color,
+             static_cast<unsigned long long>(s.distinct_colors),
+             s.luma_entropy);
+  }
+}
+
+// Images holding exactly n distinct RGB colours, each repeated a few
+// times, must be estimated within three standard errors (1.04 / sqrt(m),
+// about 1.6%), and the errors over all of them must average out to about
+// one.
+void CheckDistinctColors() {
+  const double sigma = 1.04 / std::sqrt(static_cast<double>(kColorSketchSize));
+  double sum_sq = 0.0;
+  int samples = 0;
+  for (const int n : {10, 100, 1000, 4000, 10000, 30000, 100000, 300000,
+                      1000000}) {
+    for (const uint32_t salt : {0u, 0x5A5A5Au, 0xC0FFEEu}) {
+      const int width = 1000;
+      const int repeats = n <= 1000 ? 3 : 1;
+      const int count = n * repeats;
+      const int height = (count + width - 1) / width;
+      ImageBuffer img;
+      AllocateImage(width, height, &img);
+      for (int i = 0; i < width * height; ++i) {
+        // An odd multiplier permutes the 24-bit colours, so the first n
+        // are distinct; the tail repeats colour 0.
+        const uint32_t k = i < count ? static_cast<uint32_t>(i % n) : 0u;
+        const uint32_t rgb = ((k * 0x9E3779u) ^ salt) & 0xFFFFFFu;
+        const uint32_t px = 0xFF000000u | rgb;
+        memcpy(img.bgra.data() + static_cast<size_t>(i / width) *
+                                     img.row_pitch +
+                   static_cast<size_t>(i % width) * 4,
+               &px, 4);
+      }
+      const FullImageStats s = ComputeFullImageStats(ImageView(img));
+      const double err =
+          static_cast<double>(s.distinct_colors) / n - 1.0;
+      SC_CHECK(std::fabs(err) <= 3.0 * sigma,
+               "%d colours (salt %06x): estimated %llu, %.2f%% off", n, salt,
+               static_cast<unsigned long long>(s.distinct_colors),
+               err * 100.0);
+      sum_sq += err * err;
+      ++samples;
+    }
+  }
+  const double rms = std::sqrt(sum_sq / samples);
+  SC_CHECK(rms <= 1.25 * sigma, "distinct colours: %.2f%% rms error",
+           rms * 100.0);
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  for (const SimdLevel level : kLevels) {
+    if (level > DetectSimdLevel()) {
+      std::printf("%s: not supported here, skipped\n", SimdLevelName(level));
+    }
+  }
+  std::mt19937 rng(12345);
+  // Every tail length of a 16-pixel vector, two vectors deep, from both an
+  // aligned and an unaligned start.
+  for (int width = 0; width <= 80; ++width) {
+    for (const int offset : {0, 1, 4}) {
+      const std::vector<uint8_t> row = RandomRow(width, offset, &rng);
+      CheckRow(row.data() + offset, width, "random");
+    }
+  }
+  // Long enough to spill the luma lanes several times; all white gives the
+  // largest sums.
+  for (const int width : {4099, 20003}) {
+    std::vector<uint8_t> row = RandomRow(width, 0, &rng);
+    CheckRow(row.data(), width, "long random");
+    std::fill(row.begin(), row.end(), uint8_t{255});
+    CheckRow(row.data(), width, "long white");
+  }
+  SetSimdLevelCap(DetectSimdLevel());
+  CheckSmallImages();
+  CheckDistinctColors();
+  return test::TestExitCode();
+}
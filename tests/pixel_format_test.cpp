@@ -0,0 +1,350 @@
+// Runs every pixel format kernel at every SIMD level against a per-pixel
+// reference: byte shuffles exactly, and luma, chroma and YUV decoding
+// against the BT.601/709 equations in double precision. 4:2:0 frames are
+// built from ConvertYuv420Rows on odd sizes, so that the trailing column
+// and row averaged with themselves are covered.
+
+#include "cpu_features.h"
+#include "pixel_format.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+// The fixed-point weights and the final rounding keep every result within
+// half a step of the exact value, plus a little for the weights.
+constexpr double kTolerance = 0.55;
+
+struct Equations {
+  double kr, kg, kb;
+  double y_offset, y_scale, c_scale;
+};
+
+Equations EquationsFor(const YuvOptions &opt) {
+  Equations e{};
+  e.kr = opt.matrix == YuvMatrix::kBt601 ? 0.299 : 0.2126;
+  e.kb = opt.matrix == YuvMatrix::kBt601 ? 0.114 : 0.0722;
+  e.kg = 1.0 - e.kr - e.kb;
+  const bool full = opt.range == YuvRange::kFull;
+  e.y_offset = full ? 0.0 : 16.0;
+  e.y_scale = full ? 1.0 : 219.0 / 255.0;
+  e.c_scale = full ? 1.0 : 224.0 / 255.0;
+  return e;
+}
+
+double Clamp255(double v) { return std::clamp(v, 0.0, 255.0); }
+
+const uint8_t *PixelAt(const ImageView &img, int x, int y) {
+  return img.data + static_cast<size_t>(y) * img.stride +
+         static_cast<size_t>(x) * 4;
+}
+
+std::string Describe(const char *what, SimdLevel level, int width,
+                     int height) {
+  return std::string(what) + " " + SimdLevelName(level) + " " +
+         std::to_string(width) + "x" + std::to_string(height);
+}
+
+// Byte layouts, exactly; gray8 within rounding of BT.709 luma. Unpacking
+// what was packed gives the source back, less what the format drops.
+void CheckPacked(const ImageView &src, SimdLevel level) {
+  const PixelFormat formats[] = {PixelFormat::kBgra8, PixelFormat::kRgba8,
+                                 PixelFormat::kRgb8, PixelFormat::kGray8,
+                                 PixelFormat::kRgba16};
+  for (const PixelFormat f : formats) {
+    const std::string what =
+        Describe(PixelFormatName(f), level, src.width, src.height);
+    const int bytes = PixelFormatBytes(f);
+    const PackRowFn pack = ConvertRowKernel(PixelFormat::kBgra8, f, level);
+    const UnpackRowFn unpack = UnpackRowKernel(f, level);
+    const PackRowFn copy = ConvertRowKernel(f, f, level);
+    SC_CHECK(pack && copy, "%s: no kernel", what.c_str());
+    SC_CHECK((unpack != nullptr) == (f != PixelFormat::kBgra8),
+             "%s: unexpected unpack kernel", what.c_str());
+    if (!pack || !copy) {
+      continue;
+    }
+    // One spare byte past the row catches a kernel that writes too far.
+    std::vector<uint8_t> row(static_cast<size_t>(src.width) * bytes + 1);
+    std::vector<uint8_t> copied(row.size());
+    std::vector<uint8_t> back(static_cast<size_t>(src.width) * 4);
+    int bad = 0;
+    for (int y = 0; y < src.height && bad == 0; ++y) {
+      row.back() = 0xA5;
+      pack(PixelAt(src, 0, y), src.width, row.data());
+      bad += row.back() != 0xA5;
+      copy(row.data(), src.width, copied.data());
+      bad += memcmp(row.data(), copied.data(), row.size() - 1) != 0;
+      for (int x = 0; x < src.width; ++x) {
+        const uint8_t *p = PixelAt(src, x, y);
+        const uint8_t *o = row.data() + static_cast<size_t>(x) * bytes;
+        switch (f) {
+        case PixelFormat::kBgra8:
+          bad += memcmp(o, p, 4) != 0;
+          break;
+        case PixelFormat::kRgba8:
+          bad += o[0] != p[2] || o[1] != p[1] || o[2] != p[0] || o[3] != p[3];
+          break;
+        case PixelFormat::kRgb8:
+          bad += o[0] != p[2] || o[1] != p[1] || o[2] != p[0];
+          break;
+        case PixelFormat::kGray8: {
+          const double luma = 0.2126 * p[2] + 0.7152 * p[1] + 0.0722 * p[0];
+          bad += std::abs(o[0] - luma) > kTolerance;
+          break;
+        }
+        case PixelFormat::kRgba16: {
+          const int order[4] = {2, 1, 0, 3};
+          for (int c = 0; c < 4; ++c) {
+            const int sample = o[c * 2] << 8 | o[c * 2 + 1];
+            bad += sample != p[order[c]] * 257;
+          }
+          break;
+        }
+        case PixelFormat::kNv12:
+        case PixelFormat::kI420:
+          break;
+        }
+        if (bad > 0) {
+          SC_CHECK(false, "%s: pixel (%d,%d) packed wrong", what.c_str(), x,
+                   y);
+          break;
+        }
+      }
+      if (bad > 0 || !unpack) {
+        continue;
+      }
+      unpack(row.data(), src.width, back.data());
+      for (int x = 0; x < src.width; ++x) {
+        const uint8_t *p = PixelAt(src, x, y);
+        const uint8_t *b = back.data() + static_cast<size_t>(x) * 4;
+        uint8_t want[4] = {p[0], p[1], p[2], p[3]};
+        if (f == PixelFormat::kGray8) {
+          want[0] = want[1] = want[2] = row[static_cast<size_t>(x)];
+        }
+        if (f == PixelFormat::kRgb8 || f == PixelFormat::kGray8) {
+          want[3] = 255;
+        }
+        if (memcmp(b, want, 4) != 0) {
+          SC_CHECK(false, "%s: pixel (%d,%d) unpacked wrong", what.c_str(),
+                   x, y);
+          ++bad;
+          break;
+        }
+      }
+    }
+  }
+  SC_CHECK(ConvertRowKernel(PixelFormat::kRgb8, PixelFormat::kRgba8, level) ==
+               nullptr,
+           "%s: rgb8 to rgba8 should have no kernel", SimdLevelName(level));
+  SC_CHECK(ConvertRowKernel(PixelFormat::kNv12, PixelFormat::kNv12, level) ==
+               nullptr,
+           "%s: nv12 rows cannot be copied alone", SimdLevelName(level));
+}
+
+// Converts a whole frame the way the raw writer does: rows in pairs, the
+// last odd row paired with itself and writing no second luma row.
+std::vector<uint8_t> ConvertFrame(const ImageView &src, PixelFormat f,
+                                  const YuvOptions &opt) {
+  const PlaneLayout l = PlaneLayoutOf(f, src.width, src.height);
+  std::vector<uint8_t> out(l.size);
+  const int uv_step = f == PixelFormat::kNv12 ? 2 : 1;
+  for (int y = 0; y < src.height; y += 2) {
+    const bool pair = y + 1 < src.height;
+    uint8_t *chroma_row = out.data() + static_cast<size_t>(y / 2) *
+                                           l.chroma_pitch;
+    ConvertYuv420Rows(PixelAt(src, 0, y), PixelAt(src, 0, pair ? y + 1 : y),
+                      src.width, opt,
+                      out.data() + static_cast<size_t>(y) * l.luma_pitch,
+                      pair ? out.data() +
+                                 static_cast<size_t>(y + 1) * l.luma_pitch
+                           : nullptr,
+                      chroma_row + l.u_offset, chroma_row + l.v_offset,
+                      uv_step);
+  }
+  return out;
+}
+
+void CheckYuv420(const ImageView &src, PixelFormat f, const YuvOptions &opt,
+                 SimdLevel level, std::vector<uint8_t> *scalar) {
+  const std::string what =
+      Describe(PixelFormatName(f), level, src.width, src.height) + " " +
+      YuvMatrixName(opt.matrix) + " " + YuvRangeName(opt.range);
+  const Equations e = EquationsFor(opt);
+  const PlaneLayout l = PlaneLayoutOf(f, src.width, src.height);
+  const std::vector<uint8_t> out = ConvertFrame(src, f, opt);
+  // The header promises the same bytes at every level.
+  if (level == SimdLevel::kScalar) {
+    *scalar = out;
+  } else {
+    SC_CHECK(out == *scalar, "%s: differs from the scalar kernels",
+             what.c_str());
+  }
+  const int uv_step = f == PixelFormat::kNv12 ? 2 : 1;
+  const auto luma_of = [&](const uint8_t *p) {
+    return e.kr * p[2] + e.kg * p[1] + e.kb * p[0];
+  };
+  for (int y = 0; y < src.height; ++y) {
+    for (int x = 0; x < src.width; ++x) {
+      const double want = e.y_offset + e.y_scale * luma_of(PixelAt(src, x, y));
+      const uint8_t got = out[static_cast<size_t>(y) * l.luma_pitch + x];
+      if (std::abs(got - Clamp255(want)) > kTolerance) {
+        SC_CHECK(false, "%s: Y(%d,%d) = %d, want %.3f", what.c_str(), x, y,
+                 got, want);
+        return;
+      }
+    }
+  }
+  for (int cy = 0; cy < l.chroma_height; ++cy) {
+    for (int cx = 0; cx < l.chroma_width; ++cx) {
+      // Mean of the 2x2 block, the last column and row standing in for
+      // the ones past the edge.
+      double b = 0.0;
+      double g = 0.0;
+      double r = 0.0;
+      for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+          const uint8_t *p =
+              PixelAt(src, std::min(cx * 2 + dx, src.width - 1),
+                      std::min(cy * 2 + dy, src.height - 1));
+          b += p[0] / 4.0;
+          g += p[1] / 4.0;
+          r += p[2] / 4.0;
+        }
+      }
+      const double luma = e.kr * r + e.kg * g + e.kb * b;
+      const double want_u =
+          128.0 + e.c_scale * (b - luma) / (2.0 * (1.0 - e.kb));
+      const double want_v =
+          128.0 + e.c_scale * (r - luma) / (2.0 * (1.0 - e.kr));
+      const size_t i = static_cast<size_t>(cy) * l.chroma_pitch +
+                       static_cast<size_t>(cx) * uv_step;
+      const uint8_t got_u = out[l.u_offset + i];
+      const uint8_t got_v = out[l.v_offset + i];
+      if (std::abs(got_u - Clamp255(want_u)) > kTolerance ||
+          std::abs(got_v - Clamp255(want_v)) > kTolerance) {
+        SC_CHECK(false, "%s: UV(%d,%d) = %d,%d, want %.3f,%.3f",
+                 what.c_str(), cx, cy, got_u, got_v, want_u, want_v);
+        return;
+      }
+    }
+  }
+}
+
+// Decodes every luma value against every chroma pair that reaches the
+// edges of the range, for both chroma layouts and subsamplings.
+void CheckYuvToBgra(const YuvOptions &opt) {
+  const std::string what =
+      std::string("decode ") + YuvMatrixName(opt.matrix) + " " +
+      YuvRangeName(opt.range);
+  const Equations e = EquationsFor(opt);
+  const int kWidth = 256;
+  std::vector<uint8_t> luma(kWidth);
+  for (int x = 0; x < kWidth; ++x) {
+    luma[static_cast<size_t>(x)] = static_cast<uint8_t>(x);
+  }
+  std::vector<uint8_t> bgra(static_cast<size_t>(kWidth) * 4);
+  for (int u = 0; u < 256; u += 17) {
+    for (int v = 0; v < 256; v += 15) {
+      for (const int shift : {0, 1}) {
+        // Interleaved, as nv12 stores them; the chroma is the same for
+        // every pixel, so the sample count only needs to cover the row.
+        std::vector<uint8_t> uv(static_cast<size_t>(kWidth) * 2);
+        for (size_t i = 0; i < uv.size(); i += 2) {
+          uv[i] = static_cast<uint8_t>(u);
+          uv[i + 1] = static_cast<uint8_t>(v);
+        }
+        YuvRowToBgra(luma.data(), uv.data(), uv.data() + 1, 2, shift, kWidth,
+                     opt, bgra.data());
+        for (int x = 0; x < kWidth; ++x) {
+          const double yy = (x - e.y_offset) / e.y_scale;
+          const double pb = (u - 128) / e.c_scale;
+          const double pr = (v - 128) / e.c_scale;
+          const double r = yy + 2.0 * (1.0 - e.kr) * pr;
+          const double b = yy + 2.0 * (1.0 - e.kb) * pb;
+          const double g = (yy - e.kr * r - e.kb * b) / e.kg;
+          const uint8_t *d = bgra.data() + static_cast<size_t>(x) * 4;
+          if (std::abs(d[0] - Clamp255(b)) > kTolerance ||
+              std::abs(d[1] - Clamp255(g)) > kTolerance ||
+              std::abs(d[2] - Clamp255(r)) > kTolerance || d[3] != 255) {
+            SC_CHECK(false,
+                     "%s: y=%d u=%d v=%d gives %d,%d,%d, want "
+                     "%.3f,%.3f,%.3f",
+                     what.c_str(), x, u, v, d[2], d[1], d[0], r, g, b);
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  const SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                              SimdLevel::kAvx2, SimdLevel::kAvx512};
+  const PixelFormat yuv_formats[] = {PixelFormat::kNv12, PixelFormat::kI420};
+  const YuvMatrix matrices[] = {YuvMatrix::kBt601, YuvMatrix::kBt709};
+  const YuvRange ranges[] = {YuvRange::kLimited, YuvRange::kFull};
+  const int sizes[][2] = {{1, 1},  {2, 2},  {3, 5},   {7, 3},
+                          {8, 8},  {9, 17}, {17, 9},  {33, 31},
+                          {64, 4}, {65, 3}, {129, 71}};
+  for (const auto &size : sizes) {
+    ImageBuffer img;
+    test::FillTestImage(size[0], size[1],
+                        static_cast<uint32_t>(size[0] * 6271 + size[1]), &img);
+    // A view that skips the first column: unaligned rows with a stride
+    // wider than the view.
+    ImageView narrow(img);
+    if (narrow.width > 1) {
+      narrow.data += 4;
+      --narrow.width;
+    }
+    std::vector<uint8_t> scalar[2][2][2][2];
+    for (const SimdLevel level : levels) {
+      if (level > DetectSimdLevel()) {
+        continue;
+      }
+      SetSimdLevelCap(level);
+      int v = 0;
+      for (const ImageView &view : {ImageView(img), narrow}) {
+        CheckPacked(view, level);
+        for (int fi = 0; fi < 2; ++fi) {
+          for (int mi = 0; mi < 2; ++mi) {
+            for (int ri = 0; ri < 2; ++ri) {
+              YuvOptions opt;
+              opt.matrix = matrices[mi];
+              opt.range = ranges[ri];
+              CheckYuv420(view, yuv_formats[fi], opt, level,
+                          &scalar[v][fi][mi][ri]);
+            }
+          }
+        }
+        ++v;
+      }
+    }
+  }
+  for (const SimdLevel level : levels) {
+    if (level > DetectSimdLevel()) {
+      std::printf("%s: not supported here, skipped\n", SimdLevelName(level));
+    }
+  }
+  for (const YuvMatrix m : matrices) {
+    for (const YuvRange r : ranges) {
+      YuvOptions opt;
+      opt.matrix = m;
+      opt.range = r;
+      CheckYuvToBgra(opt);
+    }
+  }
+  return test::TestExitCode();
+}
@@ -0,0 +1,276 @@
+// Round-trips images through EncodePng and an independent decoder (zlib's
+// inflate plus the PNG unfilters) and compares the pixels with the stored
+// layout each format should produce.
+
+#include "cpu_features.h"
+#include "encode_png.h"
+#include "parallel.h"
+#include "pixel_format.h"
+#include "test_util.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+// Must match the stripe size in encode_png.cpp; the heights below straddle
+// its stripe boundaries.
+constexpr size_t kStripeBytes = 1 << 20;
+
+uint32_t GetBe32(const uint8_t *p) {
+  return (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) |
+         (uint32_t{p[2]} << 8) | uint32_t{p[3]};
+}
+
+struct DecodedPng {
+  int width = 0;
+  int height = 0;
+  int bit_depth = 0;
+  int colour_type = 0;
+  std::vector<uint8_t> pixels; // unfiltered rows, tightly packed
+};
+
+int Paeth(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+bool DecodePng(const std::vector<uint8_t> &png, DecodedPng *out,
+               std::string *why) {
+  static const uint8_t kSignature[8] = {0x89, 'P',  'N',  'G',
+                                        0x0D, 0x0A, 0x1A, 0x0A};
+  if (png.size() < 8 || memcmp(png.data(), kSignature, 8) != 0) {
+    *why = "bad signature";
+    return false;
+  }
+  std::vector<uint8_t> idat;
+  bool ended = false;
+  size_t pos = 8;
+  while (!ended) {
+    if (png.size() - pos < 12) {
+      *why = "truncated chunk";
+      return false;
+    }
+    const uint32_t len = GetBe32(&png[pos]);
+    if (png.size() - pos - 12 < len) {
+      *why = "chunk overruns the file";
+      return false;
+    }
+    const uint8_t *type = &png[pos + 4];
+    const uint8_t *data = &png[pos + 8];
+    const uint32_t crc = static_cast<uint32_t>(crc32(
+        crc32(0, nullptr, 0), type, static_cast<uInt>(len + 4)));
+    if (crc != GetBe32(data + len)) {
+      *why = "bad crc on " + std::string(type, type + 4);
+      return false;
+    }
+    if (memcmp(type, "IHDR", 4) == 0 && len == 13) {
+      out->width = static_cast<int>(GetBe32(data));
+      out->height = static_cast<int>(GetBe32(data + 4));
+      out->bit_depth = data[8];
+      out->colour_type = data[9];
+      if (data[10] != 0 || data[11] != 0 || data[12] != 0) {
+        *why = "unexpected compression, filter or interlace method";
+        return false;
+      }
+    } else if (memcmp(type, "IDAT", 4) == 0) {
+      idat.insert(idat.end(), data, data + len);
+    } else if (memcmp(type, "IEND", 4) == 0) {
+      ended = true;
+    }
+    pos += 12 + len;
+  }
+  if (pos != png.size()) {
+    *why = "bytes after IEND";
+    return false;
+  }
+
+  int channels = 0;
+  switch (out->colour_type) {
+  case 0:
+    channels = 1;
+    break;
+  case 2:
+    channels = 3;
+    break;
+  case 6:
+    channels = 4;
+    break;
+  default:
+    *why = "unexpected colour type";
+    return false;
+  }
+  const size_t bpp = static_cast<size_t>(channels * out->bit_depth / 8);
+  const size_t line = static_cast<size_t>(out->width) * bpp;
+  std::vector<uint8_t> raw((line + 1) * static_cast<size_t>(out->height));
+  uLongf raw_size = static_cast<uLongf>(raw.size());
+  if (uncompress(raw.data(), &raw_size, idat.data(),
+                 static_cast<uLong>(idat.size())) != Z_OK ||
+      raw_size != raw.size()) {
+    *why = "zlib stream does not inflate to the image size";
+    return false;
+  }
+
+  out->pixels.assign(line * static_cast<size_t>(out->height), 0);
+  for (int y = 0; y < out->height; ++y) {
+    const uint8_t *in = &raw[static_cast<size_t>(y) * (line + 1)];
+    uint8_t *cur = &out->pixels[static_cast<size_t>(y) * line];
+    const uint8_t *prev = y > 0 ? cur - line : nullptr;
+    for (size_t i = 0; i < line; ++i) {
+      const int a = i >= bpp ? cur[i - bpp] : 0;
+      const int b = prev ? prev[i] : 0;
+      const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+      int pred = 0;
+      switch (in[0]) {
+      case 0:
+        break;
+      case 1:
+        pred = a;
+        break;
+      case 2:
+        pred = b;
+        break;
+      case 3:
+        pred = (a + b) / 2;
+        break;
+      case 4:
+        pred = Paeth(a, b, c);
+        break;
+      default:
+        *why = "unknown filter type " + std::to_string(in[0]);
+        return false;
+      }
+      cur[i] = static_cast<uint8_t>(in[1 + i] + pred);
+    }
+  }
+  return true;
+}
+
+// The stored layout, written out independently of the pack kernels except
+// for gray8, whose fixed-point BT.709 weights belong to pixel_format.
+std::vector<uint8_t> ExpectedPixels(const ImageView &img, PixelFormat fmt) {
+  const size_t bpp = static_cast<size_t>(PixelFormatBytes(fmt));
+  std::vector<uint8_t> out(bpp * static_cast<size_t>(img.width) *
+                           static_cast<size_t>(img.height));
+  const PackRowFn gray =
+      ConvertRowKernel(PixelFormat::kBgra8, PixelFormat::kGray8,
+                       SimdLevel::kScalar);
+  uint8_t *o = out.data();
+  for (int y = 0; y < img.height; ++y) {
+    const uint8_t *row = img.data + static_cast<size_t>(y) * img.stride;
+    if (fmt == PixelFormat::kGray8) {
+      gray(row, img.width, o);
+      o += img.width;
+      continue;
+    }
+    for (int x = 0; x < img.width; ++x) {
+      const uint8_t *p = row + x * 4;
+      const uint8_t rgba[4] = {p[2], p[1], p[0], p[3]};
+      for (int c = 0; c < (fmt == PixelFormat::kRgb8 ? 3 : 4); ++c) {
+        *o++ = rgba[c];
+        if (fmt == PixelFormat::kRgba16) {
+          *o++ = rgba[c]; // v * 257, big-endian
+        }
+      }
+    }
+  }
+  return out;
+}
+
+int ExpectedColourType(PixelFormat fmt) {
+  switch (fmt) {
+  case PixelFormat::kGray8:
+    return 0;
+  case PixelFormat::kRgb8:
+    return 2;
+  default:
+    return 6;
+  }
+}
+
+void CheckRoundTrip(const ImageView &img, PngLevel level, int threads,
+                    PixelFormat fmt) {
+  const std::string what = std::string(PngLevelName(level)) + " " +
+                           PixelFormatName(fmt) + " " +
+                           std::to_string(img.width) + "x" +
+                           std::to_string(img.height) + " threads=" +
+                           std::to_string(threads);
+  PngOptions opt;
+  opt.level = level;
+  opt.threads = threads;
+  opt.pixel_format = fmt;
+  std::vector<uint8_t> png;
+  ErrorInfo err;
+  if (!EncodePng(img, opt, &png, &err)) {
+    SC_CHECK(false, "%s: encode failed: %s", what.c_str(),
+             err.message.c_str());
+    return;
+  }
+  DecodedPng dec;
+  std::string why;
+  if (!DecodePng(png, &dec, &why)) {
+    SC_CHECK(false, "%s: %s", what.c_str(), why.c_str());
+    return;
+  }
+  SC_CHECK(dec.width == img.width && dec.height == img.height,
+           "%s: header says %dx%d", what.c_str(), dec.width, dec.height);
+  SC_CHECK(dec.bit_depth == (fmt == PixelFormat::kRgba16 ? 16 : 8),
+           "%s: bit depth %d", what.c_str(), dec.bit_depth);
+  SC_CHECK(dec.colour_type == ExpectedColourType(fmt), "%s: colour type %d",
+           what.c_str(), dec.colour_type);
+  const std::vector<uint8_t> expected = ExpectedPixels(img, fmt);
+  if (dec.pixels.size() != expected.size()) {
+    SC_CHECK(false, "%s: %zu bytes decoded, %zu expected", what.c_str(),
+             dec.pixels.size(), expected.size());
+    return;
+  }
+  const auto diff =
+      std::mismatch(expected.begin(), expected.end(), dec.pixels.begin());
+  SC_CHECK(diff.first == expected.end(), "%s: first difference at byte %zu",
+           what.c_str(),
+           static_cast<size_t>(diff.first - expected.begin()));
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  // Stripes go to the encode pool; give it workers even on a single core.
+  SetParallelThreads(4);
+
+  const PngLevel levels[] = {PngLevel::kStore, PngLevel::kFast,
+                             PngLevel::kDefault, PngLevel::kMax};
+  const PixelFormat formats[] = {PixelFormat::kRgba8, PixelFormat::kRgb8,
+                                 PixelFormat::kGray8, PixelFormat::kRgba16};
+  const int width = 333; // odd, so no row is a whole number of vectors
+  for (const PixelFormat fmt : formats) {
+    const size_t line =
+        static_cast<size_t>(width) * PixelFormatBytes(fmt) + 1;
+    const int rows = static_cast<int>(kStripeBytes / line);
+    // Single row, one short of a stripe, exactly one, and just past two.
+    const int heights[] = {1, rows - 1, rows, 2 * rows + 1};
+    for (const int height : heights) {
+      ImageBuffer img;
+      test::FillTestImage(width, height, static_cast<uint32_t>(height), &img);
+      for (const PngLevel level : levels) {
+        for (const int threads : {1, 4}) {
+          CheckRoundTrip(img, level, threads, fmt);
+        }
+      }
+    }
+  }
+  return test::TestExitCode();
+}
@@ -0,0 +1,202 @@
+// Round-trips images through the QOI encoder and DecodeQoi, and walks the
+// encoded streams to make sure every op (run, index, diff, luma, rgb and
+// rgba) was exercised and decoded.
+
+#include "encode_qoi.h"
+#include "output_file.h"
+#include "row_sink.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+enum Op { kRun, kIndex, kDiff, kLuma, kRgb, kRgba, kOpCount };
+const char *const kOpNames[kOpCount] = {"run",  "index", "diff",
+                                        "luma", "rgb",   "rgba"};
+
+// Counts the ops in a QOI stream; false if it is malformed.
+bool CountOps(const std::vector<uint8_t> &qoi, std::array<int, kOpCount> *ops) {
+  if (qoi.size() < 14 + 8) {
+    return false;
+  }
+  const uint64_t pixels =
+      uint64_t{(uint32_t{qoi[4]} << 24) | (uint32_t{qoi[5]} << 16) |
+               (uint32_t{qoi[6]} << 8) | qoi[7]} *
+      ((uint32_t{qoi[8]} << 24) | (uint32_t{qoi[9]} << 16) |
+       (uint32_t{qoi[10]} << 8) | qoi[11]);
+  size_t p = 14;
+  uint64_t seen = 0;
+  while (seen < pixels) {
+    if (p >= qoi.size() - 8) {
+      return false;
+    }
+    const uint8_t op = qoi[p];
+    if (op == 0xFE) {
+      ++(*ops)[kRgb];
+      p += 4;
+      ++seen;
+    } else if (op == 0xFF) {
+      ++(*ops)[kRgba];
+      p += 5;
+      ++seen;
+    } else if ((op & 0xC0) == 0xC0) {
+      ++(*ops)[kRun];
+      p += 1;
+      seen += (op & 0x3F) + 1;
+    } else if ((op & 0xC0) == 0x80) {
+      ++(*ops)[kLuma];
+      p += 2;
+      ++seen;
+    } else if ((op & 0xC0) == 0x40) {
+      ++(*ops)[kDiff];
+      p += 1;
+      ++seen;
+    } else {
+      ++(*ops)[kIndex];
+      p += 1;
+      ++seen;
+    }
+  }
+  static const uint8_t kEnd[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  return seen == pixels && p + 8 == qoi.size() &&
+         memcmp(&qoi[p], kEnd, 8) == 0;
+}
+
+// A row built pixel by pixel so that each op has to be chosen at least
+// once, in a known order.
+ImageBuffer OpImage() {
+  const uint8_t bgra[][4] = {
+      {10, 20, 30, 255},   // rgb: far from the opaque black start
+      {10, 20, 30, 255},   // run...
+      {10, 20, 30, 255},
+      {11, 19, 31, 255},   // diff: each channel within -2..1
+      {31, 40, 53, 255},   // luma: dg = +21, dr - dg and db - dg small
+      {10, 20, 30, 128},   // rgba: alpha changes
+      {200, 100, 50, 128}, // rgb again
+      {10, 20, 30, 128},   // index: seen two pixels back
+  };
+  // Then a run longer than the 62 one op can hold, wrapping onto the next
+  // row.
+  const int width = 29;
+  const int height = 5;
+  ImageBuffer img;
+  AllocateImage(width, height, &img);
+  for (int i = 0; i < width * height; ++i) {
+    const uint8_t *px = i < 8 ? bgra[i] : bgra[7];
+    uint8_t *dst = img.bgra.data() +
+                   static_cast<size_t>(i / width) * img.row_pitch +
+                   static_cast<size_t>(i % width) * 4;
+    memcpy(dst, px, 4);
+  }
+  return img;
+}
+
+void CheckRoundTrip(const ImageView &img, PixelFormat fmt, int band_rows,
+                    const char *what, std::array<int, kOpCount> *ops) {
+  const std::string name = std::string(what) + " " + PixelFormatName(fmt) +
+                           " " + std::to_string(img.width) + "x" +
+                           std::to_string(img.height) + " bands of " +
+                           std::to_string(band_rows);
+  std::vector<uint8_t> qoi;
+  VectorSink sink(&qoi);
+  QoiRowEncoder enc(&sink, fmt);
+  ErrorInfo err;
+  bool ok = enc.BeginImage(RowInfoOf(img), &err);
+  for (int y = 0; ok && y < img.height; y += band_rows) {
+    const int count = std::min(band_rows, img.height - y);
+    ok = enc.WriteRows(y, count, img.Row(y), img.stride, &err);
+  }
+  ok = ok && enc.Finish(&err);
+  if (!ok) {
+    SC_CHECK(false, "%s: encode failed: %s", name.c_str(),
+             err.message.c_str());
+    return;
+  }
+  SC_CHECK(qoi[12] == (fmt == PixelFormat::kRgb8 ? 3 : 4),
+           "%s: %d channels in the header", name.c_str(), qoi[12]);
+  SC_CHECK(CountOps(qoi, ops), "%s: malformed op stream", name.c_str());
+
+  ImageBuffer dec;
+  if (!DecodeQoi(qoi.data(), qoi.size(), &dec, &err)) {
+    SC_CHECK(false, "%s: decode failed: %s", name.c_str(),
+             err.message.c_str());
+    return;
+  }
+  if (dec.width != img.width || dec.height != img.height) {
+    SC_CHECK(false, "%s: decoded as %dx%d", name.c_str(), dec.width,
+             dec.height);
+    return;
+  }
+  // rgb8 drops alpha, so it decodes opaque.
+  const uint8_t alpha_or = fmt == PixelFormat::kRgb8 ? 0xFF : 0;
+  for (int y = 0; y < img.height; ++y) {
+    const uint8_t *want = img.Row(y);
+    const uint8_t *got =
+        dec.bgra.data() + static_cast<size_t>(y) * dec.row_pitch;
+    for (int x = 0; x < img.width; ++x) {
+      const uint8_t *w = want + x * 4;
+      const uint8_t *g = got + x * 4;
+      if (w[0] != g[0] || w[1] != g[1] || w[2] != g[2] ||
+          (w[3] | alpha_or) != g[3]) {
+        SC_CHECK(false, "%s: pixel (%d,%d) differs", name.c_str(), x, y);
+        return;
+      }
+    }
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  std::array<int, kOpCount> ops{};
+  const ImageBuffer op_image = OpImage();
+  CheckRoundTrip(op_image, PixelFormat::kRgba8, op_image.height, "ops", &ops);
+  for (int op = 0; op < kOpCount; ++op) {
+    SC_CHECK(ops[op] > 0, "the op image has no %s op", kOpNames[op]);
+  }
+  CheckRoundTrip(op_image, PixelFormat::kRgb8, 2, "ops", &ops);
+
+  const int sizes[][2] = {{1, 1}, {7, 3}, {64, 64}, {333, 101}};
+  for (const auto &size : sizes) {
+    ImageBuffer img;
+    test::FillTestImage(size[0], size[1],
+                        static_cast<uint32_t>(size[0] + size[1]), &img);
+    for (const PixelFormat fmt : {PixelFormat::kRgba8, PixelFormat::kRgb8}) {
+      for (const int band_rows : {1, 16, size[1]}) {
+        CheckRoundTrip(img, fmt, band_rows, "test image", &ops);
+      }
+    }
+    // The one-call encoder and a sub-rect view with a padded stride.
+    ImageView view(img);
+    if (view.width > 2 && view.height > 2) {
+      view.data += view.stride + 4;
+      view.width -= 2;
+      view.height -= 2;
+    }
+    std::vector<uint8_t> whole;
+    ErrorInfo err;
+    ImageBuffer dec;
+    SC_CHECK(EncodeQoi(view, &whole, &err) &&
+                 DecodeQoi(whole.data(), whole.size(), &dec, &err),
+             "EncodeQoi: %s", err.message.c_str());
+    for (int y = 0; y < dec.height && y < view.height; ++y) {
+      SC_CHECK(memcmp(dec.bgra.data() + static_cast<size_t>(y) *
+                                            dec.row_pitch,
+                      view.Row(y), static_cast<size_t>(view.width) * 4) == 0,
+               "EncodeQoi: row %d of a %dx%d view differs", y, view.width,
+               view.height);
+    }
+  }
+  for (int op = 0; op < kOpCount; ++op) {
+    std::printf("%-5s ops: %d\n", kOpNames[op], ops[op]);
+  }
+  return test::TestExitCode();
+}
@@ -0,0 +1,242 @@
+// Drives FrameScheduler on a fake clock: slots on time are waited for to
+// the tick and never drift, slots whose interval has passed are dropped
+// rather than served in a burst, and every slot is either served or
+// dropped. Also checks the late and latency accounting of RecordTally,
+// the nearest-rank percentiles of SummarizeLatency and, on the real clock,
+// that SleepUntil never returns early.
+
+#include "record.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+// Time stands still until a sleep moves it on to the deadline, or the test
+// moves it to stand for the work a frame took.
+struct FakeClock {
+  Clock::time_point now = Clock::time_point{} + std::chrono::hours(1);
+  std::vector<Clock::time_point> sleeps;
+
+  SchedulerClock Source() {
+    SchedulerClock clock;
+    clock.now = [this] { return now; };
+    clock.sleep_until = [this](Clock::time_point deadline) {
+      sleeps.push_back(deadline);
+      now = std::max(now, deadline);
+    };
+    return clock;
+  }
+};
+
+long long Ms(Clock::duration d) {
+  return std::chrono::duration_cast<milliseconds>(d).count();
+}
+
+void CheckOnTime() {
+  FakeClock clock;
+  const Clock::time_point start = clock.now;
+  FrameScheduler sched(10.0, 5, start, clock.Source());
+  for (int64_t want = 0; want < 5; ++want) {
+    const int64_t slot = sched.WaitNext();
+    SC_CHECK(slot == want && clock.now == start + milliseconds(100 * want),
+             "slot %lld at %lld ms, want %lld", static_cast<long long>(slot),
+             Ms(clock.now - start), static_cast<long long>(want));
+    // The frame takes a little under a period.
+    clock.now += milliseconds(90);
+  }
+  SC_CHECK(sched.WaitNext() == -1 && sched.WaitNext() == -1 &&
+               sched.dropped() == 0,
+           "after the last slot: %lld dropped",
+           static_cast<long long>(sched.dropped()));
+  SC_CHECK(clock.sleeps.size() == 5 &&
+               clock.sleeps.back() == start + milliseconds(400),
+           "%zu sleeps", clock.sleeps.size());
+
+  // Deadlines come from the slot number, so they stay on whole seconds
+  // at rates whose period is not a whole number of ticks.
+  for (const double fps : {30.0, 60.0, 29.97}) {
+    const FrameScheduler far(fps, 1 << 30, start);
+    bool drift = false;
+    for (int64_t s = 1; s <= 100000; s *= 10) {
+      const double exact = static_cast<double>(s) / fps;
+      const double got =
+          std::chrono::duration<double>(far.Deadline(s) - start).count();
+      drift = drift || std::abs(got - exact) > 1e-9;
+    }
+    SC_CHECK(!drift, "deadlines drift at %.2f fps", fps);
+  }
+}
+
+void CheckOverrun() {
+  FakeClock clock;
+  const Clock::time_point start = clock.now;
+  FrameScheduler sched(10.0, 10, start, clock.Source());
+  SC_CHECK(sched.WaitNext() == 0, "first slot%s", "");
+
+  // Slot 0 ran until 250 ms: slot 1's interval [100, 200) has passed and
+  // is dropped; slot 2 is served at once, without a sleep into the past.
+  clock.now = start + milliseconds(250);
+  int64_t slot = sched.WaitNext();
+  SC_CHECK(slot == 2 && sched.dropped() == 1 &&
+               clock.now == start + milliseconds(250),
+           "after an overrun: slot %lld, %lld dropped, at %lld ms",
+           static_cast<long long>(slot),
+           static_cast<long long>(sched.dropped()), Ms(clock.now - start));
+
+  // Late, but still within slot 3's interval: served, nothing dropped.
+  clock.now = start + milliseconds(310);
+  slot = sched.WaitNext();
+  SC_CHECK(slot == 3 && sched.dropped() == 1,
+           "late within the interval: slot %lld, %lld dropped",
+           static_cast<long long>(slot),
+           static_cast<long long>(sched.dropped()));
+
+  // Stuck past the end: the rest are dropped and nothing more is served.
+  clock.now = start + milliseconds(5000);
+  slot = sched.WaitNext();
+  SC_CHECK(slot == -1 && sched.dropped() == 10 - 3,
+           "past the end: slot %lld, %lld dropped",
+           static_cast<long long>(slot),
+           static_cast<long long>(sched.dropped()));
+}
+
+// Frames of random length, some several periods long: slots come out in
+// order, each while its interval is still open and never before it is
+// due, and served plus dropped is every slot.
+void CheckRandomLoads() {
+  std::mt19937 rng(3);
+  for (const double fps : {7.0, 30.0, 59.94, 144.0}) {
+    FakeClock clock;
+    const Clock::time_point start = clock.now;
+    const int64_t slots = 500;
+    FrameScheduler sched(fps, slots, start, clock.Source());
+    const double period_us = 1e6 / fps;
+    int64_t served = 0;
+    int64_t last = -1;
+    int bad = 0;
+    for (int64_t slot = sched.WaitNext(); slot >= 0;
+         slot = sched.WaitNext()) {
+      if (slot <= last || clock.now < sched.Deadline(slot) ||
+          clock.now >= sched.Deadline(slot + 1)) {
+        ++bad;
+      }
+      last = slot;
+      ++served;
+      const double load = (rng() % 4 == 0) ? (rng() % 400) / 100.0
+                                           : (rng() % 90) / 100.0;
+      clock.now += std::chrono::microseconds(
+          static_cast<int64_t>(load * period_us));
+    }
+    SC_CHECK(bad == 0 && served + sched.dropped() == slots && served > 0 &&
+                 sched.dropped() > 0,
+             "%.2f fps: %d bad slots, %lld served, %lld dropped", fps, bad,
+             static_cast<long long>(served),
+             static_cast<long long>(sched.dropped()));
+  }
+}
+
+void CheckSlotsFor() {
+  const struct {
+    double fps;
+    double duration_s;
+    int64_t want;
+  } cases[] = {{10.0, 3.0, 30}, {30.0, 0.05, 2}, {1.0, 0.0, 1},
+               {0.5, 10.0, 5},  {60.0, 1.0, 60}, {29.97, 10.0, 300}};
+  for (const auto &c : cases) {
+    RecordOptions opt;
+    opt.fps = c.fps;
+    opt.duration_s = c.duration_s;
+    SC_CHECK(FrameScheduler::SlotsFor(opt) == c.want,
+             "%.2f fps for %.2f s: %lld slots, want %lld", c.fps,
+             c.duration_s,
+             static_cast<long long>(FrameScheduler::SlotsFor(opt)),
+             static_cast<long long>(c.want));
+  }
+}
+
+void CheckTally() {
+  const Clock::time_point t0 = Clock::time_point{} + std::chrono::hours(1);
+  const auto due = [&](int slot) { return t0 + milliseconds(100 * slot); };
+  RecordTally tally;
+  // Out of order, as several encode workers can finish them; slot 2
+  // completes exactly at the next due time, which is not late.
+  tally.Add("f3", due(3), due(4), due(3) + milliseconds(150));
+  tally.Add("f1", due(1), due(2), due(1) + milliseconds(20));
+  tally.Add("f2", due(2), due(3), due(3));
+  tally.Add("f5", due(5), due(6), due(6) + milliseconds(1));
+  SC_CHECK(tally.late == 2, "%lld late, want 2",
+           static_cast<long long>(tally.late));
+  SC_CHECK(tally.first_path == "f1" && tally.last_path == "f5" &&
+               tally.first_due == due(1) && tally.last_due == due(5),
+           "first %s, last %s", tally.first_path.c_str(),
+           tally.last_path.c_str());
+  const std::vector<double> want = {150.0, 20.0, 100.0, 101.0};
+  SC_CHECK(tally.latency_ms == want, "latencies %g %g %g %g",
+           tally.latency_ms[0], tally.latency_ms[1], tally.latency_ms[2],
+           tally.latency_ms[3]);
+}
+
+void CheckPercentiles() {
+  std::vector<double> samples;
+  for (int i = 1; i <= 100; ++i) {
+    samples.push_back(i);
+  }
+  std::shuffle(samples.begin(), samples.end(), std::mt19937(5));
+  LatencySummary s = SummarizeLatency(samples);
+  SC_CHECK(s.p50_ms == 50 && s.p90_ms == 90 && s.p99_ms == 99 &&
+               s.max_ms == 100 && s.mean_ms == 50.5,
+           "1..100: %s", LatencySummaryJson(s).c_str());
+
+  // Nearest rank: the smallest sample with at least p of them at or
+  // below it.
+  s = SummarizeLatency({3.0, 1.0, 2.0});
+  SC_CHECK(s.p50_ms == 2 && s.p90_ms == 3 && s.p99_ms == 3 &&
+               s.max_ms == 3 && s.mean_ms == 2,
+           "1..3: %s", LatencySummaryJson(s).c_str());
+  s = SummarizeLatency({7.5});
+  SC_CHECK(s.p50_ms == 7.5 && s.p99_ms == 7.5 && s.mean_ms == 7.5,
+           "one sample: %s", LatencySummaryJson(s).c_str());
+  s = SummarizeLatency({});
+  SC_CHECK(LatencySummaryJson(s) ==
+               "{\"p50\":0,\"p90\":0,\"p99\":0,\"max\":0,\"mean\":0}",
+           "no samples: %s", LatencySummaryJson(s).c_str());
+}
+
+// The real clock: waits end at the deadline, not before it.
+void CheckRealClock() {
+  for (const int ms : {0, 1, 3, 12}) {
+    const Clock::time_point deadline = Clock::now() + milliseconds(ms);
+    SleepUntil(deadline);
+    SC_CHECK(Clock::now() >= deadline, "SleepUntil(+%d ms) woke early", ms);
+  }
+  FrameScheduler sched(200.0, 4, Clock::now());
+  for (int64_t slot = sched.WaitNext(); slot >= 0; slot = sched.WaitNext()) {
+    SC_CHECK(Clock::now() >= sched.Deadline(slot), "slot %lld served early",
+             static_cast<long long>(slot));
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  CheckOnTime();
+  CheckOverrun();
+  CheckRandomLoads();
+  CheckSlotsFor();
+  CheckTally();
+  CheckPercentiles();
+  CheckRealClock();
+  return test::TestExitCode();
+}
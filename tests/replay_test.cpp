@@ -0,0 +1,389 @@
+// Replays recordings written by the raw writers, back-to-back frames in one
+// file, concatenated PAM and PPM images, y4m streams and a directory of
+// files, and checks every frame comes back in order with its pixels,
+// origin and time. Files that are truncated, short of their sidecar or
+// that shrink after being opened must be refused, not read past their end.
+// MappedFile is checked on its own too.
+
+#include "capture_source.h"
+#include "encode_raw.h"
+#include "mapped_file.h"
+#include "output_file.h"
+#include "parallel.h"
+#include "replay_source.h"
+#include "test_util.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+constexpr int kWidth = 23;
+constexpr int kHeight = 9;
+constexpr int kFrames = 4;
+
+void WriteFile(const std::string &path, const std::string &bytes) {
+  ErrorInfo err;
+  SC_CHECK(WriteFileBytes(path, true, bytes.data(), bytes.size(), &err),
+           "cannot write %s: %s", path.c_str(), err.message.c_str());
+}
+
+std::string Encode(const ImageView &img, const char *format,
+                   RawFrameInfo *info) {
+  std::vector<uint8_t> out;
+  VectorSink sink(&out);
+  ErrorInfo err;
+  SC_CHECK(WriteRawFrame(img, format, &sink, info, &err), "%s: %s", format,
+           err.message.c_str());
+  return std::string(out.begin(), out.end());
+}
+
+// Frame i of every recording: a different image each, at its own origin.
+std::vector<ImageBuffer> MakeFrames() {
+  std::vector<ImageBuffer> frames(kFrames);
+  for (int i = 0; i < kFrames; ++i) {
+    test::FillTestImage(kWidth, kHeight, static_cast<uint32_t>(i + 1),
+                        &frames[static_cast<size_t>(i)]);
+    frames[static_cast<size_t>(i)].origin_x = -i * 10;
+    frames[static_cast<size_t>(i)].origin_y = i;
+  }
+  return frames;
+}
+
+// Pixel (x, y) of `got` against `want`; ppm drops alpha, which comes back
+// opaque.
+bool SameFrame(const ImageView &got, const ImageView &want, bool opaque) {
+  if (got.width != want.width || got.height != want.height) {
+    return false;
+  }
+  for (int y = 0; y < got.height; ++y) {
+    for (int x = 0; x < got.width; ++x) {
+      const uint8_t *g = got.Row(y) + x * 4;
+      const uint8_t *w = want.Row(y) + x * 4;
+      if (g[0] != w[0] || g[1] != w[1] || g[2] != w[2] ||
+          g[3] != (opaque ? 255 : w[3])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Opens `path` and reads every frame in order.
+void CheckRecording(const char *what, const std::string &path,
+                    const std::vector<ImageBuffer> &want, bool opaque,
+                    bool origins, bool zero_copy) {
+  ReplayReader reader;
+  ErrorInfo err;
+  if (!reader.Open(path, &err)) {
+    SC_CHECK(false, "%s: %s", what, err.message.c_str());
+    return;
+  }
+  SC_CHECK(reader.frame_count() == static_cast<int>(want.size()),
+           "%s: %d frames, want %zu", what, reader.frame_count(),
+           want.size());
+  for (int i = 0; i < reader.frame_count() && i < kFrames; ++i) {
+    const ImageBuffer &w = want[static_cast<size_t>(i)];
+    ImageView view;
+    if (!reader.Frame(i, &view, &err)) {
+      SC_CHECK(false, "%s: frame %d: %s", what, i, err.message.c_str());
+      continue;
+    }
+    SC_CHECK(SameFrame(view, ImageView(w), opaque),
+             "%s: frame %d has the wrong pixels", what, i);
+    SC_CHECK(!origins || (view.origin_x == w.origin_x &&
+                          view.origin_y == w.origin_y),
+             "%s: frame %d at %d,%d", what, i, view.origin_x,
+             view.origin_y);
+    SC_CHECK(reader.ZeroCopy(i) == zero_copy, "%s: frame %d zero copy %d",
+             what, i, reader.ZeroCopy(i));
+  }
+  ImageView view;
+  SC_CHECK(!reader.Frame(reader.frame_count(), &view, &err) &&
+               !reader.Frame(-1, &view, &err),
+           "%s: frames out of range should be refused", what);
+}
+
+void CheckFormats(const test::TempDir &dir,
+                  const std::vector<ImageBuffer> &frames) {
+  // Raw frames back to back under one sidecar, viewed in the mapped file.
+  // The sidecar only has the first origin, so the others are not checked.
+  std::string raw;
+  RawFrameInfo info;
+  for (const ImageBuffer &f : frames) {
+    raw += Encode(ImageView(f), "raw", &info);
+  }
+  const std::string raw_path = dir.File("frames.raw");
+  WriteFile(raw_path, raw);
+  ErrorInfo err;
+  SC_CHECK(WriteRawSidecar(raw_path, true, info, &err), "sidecar: %s",
+           err.message.c_str());
+  CheckRecording("raw", raw_path, frames, false, false, true);
+
+  // A trailing partial frame is not a frame.
+  WriteFile(raw_path, raw + std::string(kWidth * 4 * 2, 'x'));
+  CheckRecording("raw with a partial frame", raw_path, frames, false, false,
+                 true);
+
+  for (const char *format : {"pam", "ppm"}) {
+    std::string pnm;
+    for (const ImageBuffer &f : frames) {
+      pnm += Encode(ImageView(f), format, &info) + "\n";
+    }
+    const std::string path = dir.File(std::string("frames.") + format);
+    WriteFile(path, pnm);
+    CheckRecording(format, path, frames, strcmp(format, "ppm") == 0, false,
+                   false);
+  }
+}
+
+// A mono y4m stream: grey frames with their times from the frame rate.
+void CheckY4m(const test::TempDir &dir) {
+  std::string y4m = "YUV4MPEG2 W7 H3 F25:1 Cmono\n";
+  for (int i = 0; i < kFrames; ++i) {
+    y4m += "FRAME\n" + std::string(7 * 3, static_cast<char>(40 + i * 50));
+  }
+  const std::string path = dir.File("grey.y4m");
+  WriteFile(path, y4m);
+  ReplayReader reader;
+  ErrorInfo err;
+  if (!reader.Open(path, &err)) {
+    SC_CHECK(false, "y4m: %s", err.message.c_str());
+    return;
+  }
+  SC_CHECK(reader.frame_count() == kFrames, "y4m: %d frames",
+           reader.frame_count());
+  for (int i = 0; i < reader.frame_count(); ++i) {
+    ImageView view;
+    const bool ok = reader.Frame(i, &view, &err);
+    const uint8_t *p = ok ? view.Row(2) + 6 * 4 : nullptr;
+    SC_CHECK(ok && p[0] == 40 + i * 50 && p[1] == p[0] && p[2] == p[0] &&
+                 p[3] == 255,
+             "y4m: frame %d: %s", i, ok ? "wrong grey" : err.message.c_str());
+    SC_CHECK(reader.timestamp(i).has_value() &&
+                 std::abs(*reader.timestamp(i) - i / 25.0) < 1e-9,
+             "y4m: frame %d has the wrong time", i);
+  }
+}
+
+// Files replayed one after another in name order, whatever order they
+// were written in.
+void CheckDirectory(const test::TempDir &dir,
+                    const std::vector<ImageBuffer> &frames) {
+  const std::string sub = dir.File("dir");
+  std::filesystem::create_directories(sub);
+  for (int i = kFrames - 1; i >= 0; --i) {
+    const std::string path =
+        sub + "/frame_" + std::to_string(i) + (i % 2 ? ".pam" : ".raw");
+    ErrorInfo err;
+    RawFrameInfo info;
+    SC_CHECK(SaveRawFrame(ImageView(frames[static_cast<size_t>(i)]),
+                          i % 2 ? "pam" : "raw", path, true, &info, &err),
+             "%s: %s", path.c_str(), err.message.c_str());
+  }
+  WriteFile(sub + "/notes.txt", "not a frame");
+  ReplayReader reader;
+  ErrorInfo err;
+  if (!reader.Open(sub, &err)) {
+    SC_CHECK(false, "directory: %s", err.message.c_str());
+    return;
+  }
+  SC_CHECK(reader.frame_count() == kFrames, "directory: %d frames",
+           reader.frame_count());
+  for (int i = 0; i < reader.frame_count(); ++i) {
+    ImageView view;
+    SC_CHECK(reader.Frame(i, &view, &err) &&
+                 SameFrame(view, ImageView(frames[static_cast<size_t>(i)]),
+                           false),
+             "directory: frame %d is not frame_%d", i, i);
+    SC_CHECK(reader.timestamp(i).has_value(),
+             "directory: frame %d has no time", i);
+  }
+}
+
+void CheckTruncated(const test::TempDir &dir,
+                    const std::vector<ImageBuffer> &frames) {
+  RawFrameInfo pam_info;
+  RawFrameInfo raw_info;
+  const std::string pam = Encode(ImageView(frames[0]), "pam", &pam_info);
+  const std::string raw = Encode(ImageView(frames[0]), "raw", &raw_info);
+  const std::string path = dir.File("bad");
+  const struct {
+    const char *what;
+    std::string bytes;
+    bool sidecar;
+  } cases[] = {
+      {"empty", "", false},
+      {"pam short of its pixels", pam.substr(0, pam.size() - 1), false},
+      {"pam header only", pam.substr(0, pam_info.data_offset), false},
+      {"pam unterminated header", "P7\nWIDTH 4\nHEIGHT 4\n", false},
+      {"second pam truncated", pam + pam.substr(0, pam.size() / 2), false},
+      {"ppm huge", "P6\n65536 65536\n255\n" + std::string(64, 'x'), false},
+      {"y4m truncated frame",
+       "YUV4MPEG2 W4 H4 Cmono\nFRAME\n" + std::string(15, 'x'), false},
+      {"y4m garbage between frames",
+       "YUV4MPEG2 W1 H1 Cmono\nFRAME\nxjunk", false},
+      {"qoi header", "qoif\0\0", false},
+      {"raw without a sidecar", raw, false},
+      {"raw short of its sidecar", raw.substr(0, raw.size() - 1), true},
+  };
+  int n = 0;
+  for (const auto &c : cases) {
+    const std::string file = path + std::to_string(n++);
+    WriteFile(file, c.bytes);
+    if (c.sidecar) {
+      ErrorInfo err;
+      SC_CHECK(WriteRawSidecar(file, true, raw_info, &err), "sidecar: %s",
+               err.message.c_str());
+    }
+    ReplayReader reader;
+    ErrorInfo err;
+    SC_CHECK(!reader.Open(file, &err) && err.where == "ReplayReader::Open",
+             "%s should be refused", c.what);
+  }
+
+  // Shrunk after it was indexed: the frame is no longer all there.
+  const std::string shrinking = dir.File("shrinking.pam");
+  WriteFile(shrinking, pam + pam);
+  ReplayReader reader;
+  ErrorInfo err;
+  ImageView view;
+  const bool opened = reader.Open(shrinking, &err);
+  SC_CHECK(opened && reader.frame_count() == 2, "shrinking: %s",
+           err.message.c_str());
+  if (opened) {
+    std::filesystem::resize_file(shrinking, pam.size() + pam.size() / 2);
+    SC_CHECK(reader.Frame(0, &view, &err), "shrinking: frame 0: %s",
+             err.message.c_str());
+    err = ErrorInfo{};
+    SC_CHECK(!reader.Frame(1, &view, &err) &&
+                 err.where == "ReplayReader::Frame",
+             "shrinking: frame 1 should be refused, got \"%s\"",
+             err.message.c_str());
+  }
+}
+
+// The capture method hands the frames out in order, from `start`, and
+// either ends or loops.
+void CheckSession(const test::TempDir &dir,
+                  const std::vector<ImageBuffer> &frames) {
+  std::string pam;
+  RawFrameInfo info;
+  for (const ImageBuffer &f : frames) {
+    pam += Encode(ImageView(f), "pam", &info);
+  }
+  const std::string path = dir.File("session.pam");
+  WriteFile(path, pam);
+  const CaptureMethodInfo *method = FindCaptureMethod("replay");
+  if (!method) {
+    SC_CHECK(false, "replay is not a registered method%s", "");
+    return;
+  }
+  for (const bool loop : {false, true}) {
+    CaptureRequest req;
+    req.method = "replay";
+    req.replay.path = path;
+    req.replay.start = 1;
+    req.replay.loop = loop;
+    std::unique_ptr<CaptureSession> session = method->create();
+    ErrorInfo err;
+    if (!session->Open(req, &err)) {
+      SC_CHECK(false, "session: %s", err.message.c_str());
+      continue;
+    }
+    const int grabs = loop ? kFrames * 2 : kFrames - 1;
+    for (int g = 0; g < grabs; ++g) {
+      const int want = loop ? (g + 1) % kFrames : g + 1;
+      ImageBuffer out;
+      SC_CHECK(session->Grab(nullptr, &out, &err) &&
+                   SameFrame(ImageView(out),
+                             ImageView(frames[static_cast<size_t>(want)]),
+                             false),
+               "session (loop %d): grab %d is not frame %d", loop, g, want);
+    }
+    ImageBuffer out;
+    SC_CHECK(session->Grab(nullptr, &out, &err) == loop,
+             "session (loop %d): grab past the end", loop);
+  }
+
+  // Original pacing at a given rate: kFrames frames span kFrames - 1
+  // intervals at least.
+  CaptureRequest req;
+  req.method = "replay";
+  req.replay.path = path;
+  req.replay.pacing = ReplayPacing::kOriginal;
+  req.replay.fps = 50.0;
+  std::unique_ptr<CaptureSession> session = method->create();
+  ErrorInfo err;
+  SC_CHECK(session->Open(req, &err), "paced session: %s",
+           err.message.c_str());
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kFrames; ++i) {
+    ImageBuffer out;
+    SC_CHECK(session->Grab(nullptr, &out, &err), "paced grab %d: %s", i,
+             err.message.c_str());
+  }
+  const double took = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  SC_CHECK(took >= (kFrames - 1) / 50.0 - 1e-3,
+           "paced session took %.3f s", took);
+
+  // Without times or a rate there is nothing to pace by.
+  req.replay.fps = 0.0;
+  SC_CHECK(!session->Open(req, &err), "pacing without frame times%s", "");
+}
+
+void CheckMappedFile(const test::TempDir &dir) {
+  MappedFile map;
+  ErrorInfo err;
+  SC_CHECK(!map.Open(dir.File("missing"), &err) &&
+               err.where == "MappedFile::Open" && !map.data(),
+           "a missing file should not open%s", "");
+
+  const std::string empty = dir.File("empty");
+  WriteFile(empty, "");
+  SC_CHECK(map.Open(empty, &err) && !map.data() && map.size() == 0 &&
+               map.path() == empty,
+           "an empty file: %s", err.message.c_str());
+
+  std::string bytes(70000, '\0');
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = static_cast<char>(i * 7 + 3);
+  }
+  const std::string full = dir.File("full");
+  WriteFile(full, bytes);
+  SC_CHECK(map.Open(full, &err) && map.size() == bytes.size() &&
+               memcmp(map.data(), bytes.data(), bytes.size()) == 0,
+           "mapped bytes differ: %s", err.message.c_str());
+  // Ranges past the end are clipped, not faulted in.
+  map.Prefetch(4095, 10);
+  map.Prefetch(bytes.size() - 1, 1 << 20);
+  map.Prefetch(bytes.size(), 1);
+  map.Close();
+  SC_CHECK(!map.data() && map.size() == 0 && map.path().empty(),
+           "Close should forget the file%s", "");
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  SetParallelThreads(4);
+  const test::TempDir dir("replay_test");
+  const std::vector<ImageBuffer> frames = MakeFrames();
+  CheckFormats(dir, frames);
+  CheckY4m(dir);
+  CheckDirectory(dir, frames);
+  CheckTruncated(dir, frames);
+  CheckSession(dir, frames);
+  CheckMappedFile(dir);
+  return test::TestExitCode();
+}
@@ -0,0 +1,291 @@
+// Compares ResampleImage at every SIMD level with a direct evaluation of
+// the filters in double precision over every source pixel, for each filter,
+// shrinking and enlarging, extreme ratios and 1-pixel outputs; checks that
+// every level gives the same bytes and that flat images stay flat. Also
+// checks ScaledSize, which --scale and --max-width/--max-height go through.
+
+#include "cpu_features.h"
+#include "parallel.h"
+#include "resample.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+// The library filters in float; a byte may land one step away.
+constexpr double kTolerance = 1.0;
+
+double Filter(ScaleFilter f, double x) {
+  const double pi = 3.14159265358979323846;
+  const auto sinc = [&](double t) {
+    return t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+  };
+  switch (f) {
+  case ScaleFilter::kBox:
+    return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+  case ScaleFilter::kBilinear:
+    return std::fabs(x) < 1.0 ? 1.0 - std::fabs(x) : 0.0;
+  case ScaleFilter::kLanczos3:
+    return std::fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+  }
+  return 0.0;
+}
+
+// Normalised weights of every source index for output index i, the
+// filter stretched by the ratio when shrinking.
+std::vector<double> Weights(ScaleFilter f, int in, int out, int i) {
+  const double scale = static_cast<double>(in) / out;
+  const double stretch = std::max(scale, 1.0);
+  const double center = (i + 0.5) * scale;
+  std::vector<double> w(static_cast<size_t>(in));
+  double sum = 0.0;
+  for (int k = 0; k < in; ++k) {
+    w[static_cast<size_t>(k)] = Filter(f, (k + 0.5 - center) / stretch);
+    sum += w[static_cast<size_t>(k)];
+  }
+  for (double &v : w) {
+    v = sum != 0.0 ? v / sum : 0.0;
+  }
+  return w;
+}
+
+// Colour weighted by (alpha + 1) / 256 while filtering, as documented.
+std::vector<double> Reference(const ImageView &src, ScaleFilter f, int out_w,
+                              int out_h) {
+  std::vector<double> out(static_cast<size_t>(out_w) * out_h * 4);
+  std::vector<std::vector<double>> wx;
+  for (int x = 0; x < out_w; ++x) {
+    wx.push_back(Weights(f, src.width, out_w, x));
+  }
+  for (int y = 0; y < out_h; ++y) {
+    const std::vector<double> wy = Weights(f, src.height, out_h, y);
+    for (int x = 0; x < out_w; ++x) {
+      double acc[4] = {0.0, 0.0, 0.0, 0.0};
+      for (int sy = 0; sy < src.height; ++sy) {
+        if (wy[static_cast<size_t>(sy)] == 0.0) {
+          continue;
+        }
+        const uint8_t *row = src.Row(sy);
+        for (int sx = 0; sx < src.width; ++sx) {
+          const double w = wy[static_cast<size_t>(sy)] *
+                           wx[static_cast<size_t>(x)][static_cast<size_t>(sx)];
+          if (w == 0.0) {
+            continue;
+          }
+          const uint8_t *p = row + static_cast<size_t>(sx) * 4;
+          const double a = p[3];
+          for (int c = 0; c < 3; ++c) {
+            acc[c] += w * p[c] * (a + 1.0) / 256.0;
+          }
+          acc[3] += w * a;
+        }
+      }
+      double *o = out.data() + (static_cast<size_t>(y) * out_w + x) * 4;
+      const double inv = 256.0 / (std::max(acc[3], 0.0) + 1.0);
+      for (int c = 0; c < 3; ++c) {
+        o[c] = std::clamp(acc[c] * inv, 0.0, 255.0);
+      }
+      o[3] = std::clamp(acc[3], 0.0, 255.0);
+    }
+  }
+  return out;
+}
+
+void CheckResample(const ImageView &src, ScaleFilter f, int out_w, int out_h,
+                   SimdLevel level, std::vector<uint8_t> *scalar) {
+  const std::string what = std::string(ScaleFilterName(f)) + " " +
+                           SimdLevelName(level) + " " +
+                           std::to_string(src.width) + "x" +
+                           std::to_string(src.height) + " to " +
+                           std::to_string(out_w) + "x" + std::to_string(out_h);
+  ImageBuffer dst;
+  ResampleImage(src, AlphaPolicy::kKeep, f, out_w, out_h, &dst);
+  if (dst.width != out_w || dst.height != out_h) {
+    SC_CHECK(false, "%s: got %dx%d", what.c_str(), dst.width, dst.height);
+    return;
+  }
+  SC_CHECK(dst.origin_x == src.origin_x && dst.origin_y == src.origin_y,
+           "%s: origin not kept", what.c_str());
+  std::vector<uint8_t> bytes;
+  for (int y = 0; y < out_h; ++y) {
+    const uint8_t *row =
+        dst.bgra.data() + static_cast<size_t>(y) * dst.row_pitch;
+    bytes.insert(bytes.end(), row, row + static_cast<size_t>(out_w) * 4);
+  }
+  if (level == SimdLevel::kScalar) {
+    *scalar = bytes;
+  } else {
+    SC_CHECK(bytes == *scalar, "%s: differs from the scalar kernels",
+             what.c_str());
+  }
+  const std::vector<double> want = Reference(src, f, out_w, out_h);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    if (std::fabs(bytes[i] - want[i]) > kTolerance) {
+      const size_t px = i / 4;
+      SC_CHECK(false, "%s: pixel (%zu,%zu) channel %zu is %d, want %.3f",
+               what.c_str(), px % static_cast<size_t>(out_w),
+               px / static_cast<size_t>(out_w), i % 4, bytes[i], want[i]);
+      return;
+    }
+  }
+}
+
+// A flat image stays exactly flat through every filter, whatever its
+// alpha, including the 0 that some captures leave.
+void CheckFlat(ScaleFilter f) {
+  for (const uint32_t colour : {0x00336699u, 0x80FF0010u, 0xFF000000u}) {
+    ImageBuffer src;
+    AllocateImage(23, 17, &src);
+    for (int y = 0; y < src.height; ++y) {
+      uint8_t *row = src.bgra.data() + static_cast<size_t>(y) * src.row_pitch;
+      for (int x = 0; x < src.width; ++x) {
+        memcpy(row + x * 4, &colour, 4);
+      }
+    }
+    for (const auto &size : {std::pair{1, 1}, std::pair{7, 5},
+                             std::pair{23, 17}, std::pair{60, 41}}) {
+      ImageBuffer dst;
+      ResampleImage(ImageView(src), AlphaPolicy::kKeep, f, size.first,
+                    size.second, &dst);
+      int bad = 0;
+      for (int y = 0; y < dst.height; ++y) {
+        const uint8_t *row =
+            dst.bgra.data() + static_cast<size_t>(y) * dst.row_pitch;
+        for (int x = 0; x < dst.width; ++x) {
+          bad += memcmp(row + x * 4, &colour, 4) != 0;
+        }
+      }
+      SC_CHECK(bad == 0, "%s: flat %08x to %dx%d: %d pixels changed",
+               ScaleFilterName(f), colour, size.first, size.second, bad);
+    }
+  }
+  // kForceOpaque applies to the source: alpha comes out 255.
+  ImageBuffer src;
+  test::FillTestImage(9, 9, 5, &src);
+  ImageBuffer dst;
+  ResampleImage(ImageView(src), AlphaPolicy::kForceOpaque, f, 4, 4, &dst);
+  int opaque = 0;
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      const uint8_t *row =
+          dst.bgra.data() + static_cast<size_t>(y) * dst.row_pitch;
+      opaque += row[x * 4 + 3] == 255;
+    }
+  }
+  SC_CHECK(opaque == 16, "%s: force-opaque left %d of 16 pixels opaque",
+           ScaleFilterName(f), opaque);
+}
+
+void CheckScaledSize() {
+  struct Case {
+    int w, h;
+    double scale;
+    int max_w, max_h;
+    int want_w, want_h;
+  };
+  const Case cases[] = {
+      {1920, 1080, 1.0, 0, 0, 1920, 1080},
+      {1920, 1080, 2.0, 0, 0, 1920, 1080}, // never enlarged
+      {1920, 1080, 0.5, 0, 0, 960, 540},
+      {1920, 1080, 1.0, 1280, 0, 1280, 720},
+      {1920, 1080, 1.0, 0, 100, 178, 100}, // 177.78 rounds up
+      {1920, 1080, 1.0, 100, 100, 100, 56}, // 56.25 rounds down
+      {1000, 500, 0.5, 100, 0, 100, 50},   // the smaller scale wins
+      {1000, 1, 1.0, 10, 0, 10, 1},        // never below 1
+      {1, 1000, 1.0, 0, 10, 1, 10},
+      {3, 2, 0.5, 0, 0, 2, 1},             // 1.5 rounds away from zero
+      {5, 5, 0.01, 0, 0, 1, 1},
+      {640, 480, 1.0, 4000, 4000, 640, 480},
+  };
+  for (const Case &c : cases) {
+    int w = 0;
+    int h = 0;
+    ScaledSize(c.w, c.h, c.scale, c.max_w, c.max_h, &w, &h);
+    SC_CHECK(w == c.want_w && h == c.want_h,
+             "ScaledSize(%dx%d, %g, max %dx%d) = %dx%d, want %dx%d", c.w,
+             c.h, c.scale, c.max_w, c.max_h, w, h, c.want_w, c.want_h);
+  }
+  // Over a grid of sizes and limits, the result fits, keeps the aspect
+  // ratio to within rounding of one scale factor, and is at least 1x1.
+  for (int w = 1; w <= 2000; w += 37) {
+    for (int h = 1; h <= 1500; h += 53) {
+      for (const int max_w : {0, 1, 64, 333}) {
+        for (const int max_h : {0, 1, 48, 250}) {
+          int ow = 0;
+          int oh = 0;
+          ScaledSize(w, h, 1.0, max_w, max_h, &ow, &oh);
+          double s = 1.0;
+          if (max_w > 0) {
+            s = std::min(s, static_cast<double>(max_w) / w);
+          }
+          if (max_h > 0) {
+            s = std::min(s, static_cast<double>(max_h) / h);
+          }
+          const bool fits = ow >= 1 && oh >= 1 && ow <= w && oh <= h &&
+                            (max_w == 0 || ow <= max_w) &&
+                            (max_h == 0 || oh <= max_h);
+          const bool aspect = std::fabs(ow - std::max(w * s, 1.0)) <= 0.5 &&
+                              std::fabs(oh - std::max(h * s, 1.0)) <= 0.5;
+          if (!fits || !aspect) {
+            SC_CHECK(false, "ScaledSize(%dx%d, max %dx%d) = %dx%d", w, h,
+                     max_w, max_h, ow, oh);
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  // The large case has enough output rows to be split into bands.
+  SetParallelThreads(4);
+  const SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                              SimdLevel::kAvx2, SimdLevel::kAvx512};
+  const ScaleFilter filters[] = {ScaleFilter::kBox, ScaleFilter::kBilinear,
+                                 ScaleFilter::kLanczos3};
+  // Source and output sizes.
+  const int cases[][4] = {
+      {1, 1, 1, 1},     {17, 13, 5, 4},   {5, 4, 17, 13}, {33, 21, 33, 21},
+      {64, 64, 1, 1},   {9, 9, 1, 9},     {9, 9, 9, 1},   {1000, 3, 7, 3},
+      {3, 1000, 3, 7},  {2, 2, 301, 1},   {1, 1, 5, 3},   {300, 200, 97, 131},
+  };
+  for (const auto &c : cases) {
+    ImageBuffer img;
+    test::FillTestImage(c[0], c[1], static_cast<uint32_t>(c[0] * 977 + c[1]),
+                        &img);
+    img.origin_x = 4;
+    img.origin_y = -2;
+    std::vector<uint8_t> scalar[3];
+    for (const SimdLevel level : levels) {
+      if (level > DetectSimdLevel()) {
+        continue;
+      }
+      SetSimdLevelCap(level);
+      for (int f = 0; f < 3; ++f) {
+        CheckResample(ImageView(img), filters[f], c[2], c[3], level,
+                      &scalar[f]);
+      }
+    }
+  }
+  for (const SimdLevel level : levels) {
+    if (level > DetectSimdLevel()) {
+      std::printf("%s: not supported here, skipped\n", SimdLevelName(level));
+    }
+  }
+  for (const ScaleFilter f : filters) {
+    CheckFlat(f);
+  }
+  CheckScaledSize();
+  return test::TestExitCode();
+}
@@ -0,0 +1,300 @@
+// FrameQueue: FIFO order across many laps of capacities that are not a
+// power of two, many producers and consumers with no frame lost or seen
+// twice, and Close waking blocked callers. StagePipeline: the counters of
+// each drop policy, and a failing stage handing every frame back.
+
+#include "frame_queue.h"
+#include "parallel.h"
+#include "stage_pipeline.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace sc {
+namespace {
+
+// A capacity of 1 runs on a ring with a spare cell; the others wrap at a
+// position that is not a power of two.
+void CheckWrap(int capacity) {
+  FrameQueue q(capacity);
+  std::vector<StagedFrame> frames(static_cast<size_t>(capacity) + 1);
+  int64_t next_in = 0;
+  int64_t next_out = 0;
+  // Fill, overfill, and drain by varying amounts for many laps.
+  for (int round = 0; round < 60; ++round) {
+    const int pushes = 1 + round % capacity;
+    for (int i = 0; i < pushes; ++i) {
+      StagedFrame *f = &frames[static_cast<size_t>(next_in % (capacity + 1))];
+      f->slot = next_in;
+      if (!q.TryPush(f)) {
+        SC_CHECK(false, "capacity %d round %d: push %d of %d failed",
+                 capacity, round, i, pushes);
+        return;
+      }
+      ++next_in;
+    }
+    if (q.depth() == capacity) {
+      SC_CHECK(!q.TryPush(&frames[0]),
+               "capacity %d round %d: pushed past capacity", capacity, round);
+    }
+    const int pops = round % 2 == 0 ? pushes : q.depth();
+    for (int i = 0; i < pops; ++i) {
+      StagedFrame *f = q.TryPop();
+      SC_CHECK(f && f->slot == next_out,
+               "capacity %d round %d: popped %lld, want %lld", capacity,
+               round, f ? static_cast<long long>(f->slot) : -1LL,
+               static_cast<long long>(next_out));
+      ++next_out;
+    }
+  }
+  SC_CHECK(q.TryPop() == nullptr, "capacity %d: not empty at the end",
+           capacity);
+  SC_CHECK(q.max_depth() == capacity, "capacity %d: max depth %d", capacity,
+           q.max_depth());
+}
+
+void CheckManyProducersAndConsumers(int capacity) {
+  constexpr int kProducers = 3;
+  constexpr int kConsumers = 3;
+  constexpr int kEach = 5000;
+  FrameQueue q(capacity);
+  std::vector<StagedFrame> frames(kProducers * kEach);
+  std::vector<std::atomic<int>> seen(frames.size());
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < kEach; ++i) {
+        // Blocking and non-blocking pushes both.
+        StagedFrame *f = &frames[static_cast<size_t>(p * kEach + i)];
+        if (i % 2 == 0 || !q.TryPush(f)) {
+          q.Push(f);
+        }
+      }
+    });
+  }
+  std::atomic<int> popped{0};
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < kConsumers; ++c) {
+    consumers.emplace_back([&] {
+      while (StagedFrame *f = q.Pop()) {
+        seen[static_cast<size_t>(f - frames.data())].fetch_add(1);
+        popped.fetch_add(1);
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  q.Close();
+  for (std::thread &t : consumers) {
+    t.join();
+  }
+  int wrong = 0;
+  for (const auto &n : seen) {
+    wrong += n.load() != 1;
+  }
+  SC_CHECK(wrong == 0 && popped.load() == kProducers * kEach,
+           "capacity %d: %d frames not popped exactly once (%d popped)",
+           capacity, wrong, popped.load());
+}
+
+void CheckCloseWakesWaiters() {
+  FrameQueue empty(2);
+  FrameQueue full(2);
+  StagedFrame frames[3];
+  full.TryPush(&frames[0]);
+  full.TryPush(&frames[1]);
+  std::atomic<bool> pop_returned{false};
+  std::atomic<bool> push_returned{false};
+  StagedFrame *popped = &frames[2];
+  bool pushed = true;
+  std::thread popper([&] {
+    popped = empty.Pop();
+    pop_returned = true;
+  });
+  std::thread pusher([&] {
+    pushed = full.Push(&frames[2]);
+    push_returned = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  SC_CHECK(!pop_returned.load() && !push_returned.load(),
+           "Pop or Push returned before Close");
+  empty.Close();
+  full.Close();
+  popper.join();
+  pusher.join();
+  SC_CHECK(popped == nullptr, "Pop on a closed empty queue gave a frame");
+  SC_CHECK(!pushed, "Push on a closed full queue succeeded");
+  // Frames queued before Close can still be taken.
+  SC_CHECK(full.Pop() == &frames[0] && full.Pop() == &frames[1] &&
+               full.Pop() == nullptr,
+           "frames queued before Close were lost");
+}
+
+struct Run {
+  StagePipelineStats stats;
+  int64_t submitted = 0;
+  int64_t rejected = 0; // Submit returned false
+  int64_t written = 0;
+  int64_t written_skipped = 0;
+  int64_t made = 0;
+  bool ok = true;
+  std::string error;
+  bool reacquired_without_allocating = false;
+};
+
+// Submits `frames` frames as fast as possible; `encode_ms` slows encode
+// down so that its queue fills. The encode call numbered `fail_call`, if
+// any, fails; every policy encodes at least the first frame it gets.
+Run RunPipeline(DropPolicy drop, int frames, int encode_ms,
+                int fail_call = -1) {
+  Run r;
+  std::mutex mu;
+  std::atomic<int> encode_calls{0};
+  StagePipelineOptions opt;
+  opt.queue_depth = 1;
+  opt.drop = drop;
+  opt.encode_workers = 2;
+  StageFunctions fns;
+  fns.make_frame = [&] {
+    ++r.made; // only ever called from this thread, by Acquire
+    return std::make_unique<StagedFrame>();
+  };
+  fns.process = [](StagedFrame *, ErrorInfo *) { return true; };
+  fns.encode = [&, encode_ms, fail_call](StagedFrame *f, ErrorInfo *err) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(encode_ms));
+    if (encode_calls.fetch_add(1) == fail_call) {
+      *err = ErrorInfo{"encode failed", "test", std::nullopt, std::nullopt};
+      return false;
+    }
+    f->encoded.assign(1, static_cast<uint8_t>(f->slot));
+    return true;
+  };
+  fns.write = [&](StagedFrame *f, ErrorInfo *) {
+    std::lock_guard<std::mutex> lock(mu);
+    ++r.written;
+    if (f->encode_skipped) {
+      ++r.written_skipped;
+    } else if (f->encoded.size() != 1 ||
+               f->encoded[0] != static_cast<uint8_t>(f->slot)) {
+      r.error = "an encoded frame reached write without its bytes";
+    }
+    return true;
+  };
+  StagePipeline pipeline(opt, std::move(fns));
+  for (int i = 0; i < frames; ++i) {
+    StagedFrame *f = pipeline.Acquire();
+    f->slot = i;
+    ++r.submitted;
+    if (!pipeline.Submit(f)) {
+      ++r.rejected;
+    }
+  }
+  ErrorInfo err;
+  r.ok = pipeline.Finish(&err);
+  if (!r.ok && r.error.empty() && err.message != "encode failed") {
+    r.error = "unexpected error: " + err.message;
+  }
+  r.stats = pipeline.stats();
+  // Every frame made must be back on the free list: acquiring that many
+  // again allocates nothing and gives distinct frames.
+  const int64_t made = r.made;
+  std::set<StagedFrame *> again;
+  for (int64_t i = 0; i < made; ++i) {
+    again.insert(pipeline.Acquire());
+  }
+  r.reacquired_without_allocating =
+      r.made == made && static_cast<int64_t>(again.size()) == made;
+  for (StagedFrame *f : again) {
+    pipeline.Recycle(f);
+  }
+  return r;
+}
+
+void CheckPolicies() {
+  {
+    const Run r = RunPipeline(DropPolicy::kBlock, 40, 1);
+    SC_CHECK(r.ok && r.error.empty(), "block: %s", r.error.c_str());
+    SC_CHECK(r.written == 40 && r.stats.write.frames == 40 &&
+                 r.stats.encode.frames == 40 && r.stats.process.frames == 40,
+             "block: %lld written, stage frames %lld/%lld/%lld",
+             static_cast<long long>(r.written),
+             static_cast<long long>(r.stats.process.frames),
+             static_cast<long long>(r.stats.encode.frames),
+             static_cast<long long>(r.stats.write.frames));
+    SC_CHECK(r.stats.process.dropped + r.stats.encode.dropped +
+                     r.stats.write.dropped + r.stats.skipped_encodes ==
+                 0,
+             "block: frames dropped or skipped");
+    SC_CHECK(r.reacquired_without_allocating, "block: frames not recycled");
+  }
+  {
+    const Run r = RunPipeline(DropPolicy::kDropOldest, 60, 5);
+    const int64_t dropped = r.stats.process.dropped + r.stats.encode.dropped;
+    SC_CHECK(r.ok && r.error.empty(), "drop-oldest: %s", r.error.c_str());
+    SC_CHECK(dropped > 0, "drop-oldest: nothing dropped behind a slow encode");
+    SC_CHECK(r.written + dropped == 60 && r.stats.write.frames == r.written,
+             "drop-oldest: %lld written + %lld dropped != 60",
+             static_cast<long long>(r.written),
+             static_cast<long long>(dropped));
+    SC_CHECK(r.stats.skipped_encodes == 0 && r.stats.write.dropped == 0,
+             "drop-oldest: skipped or dropped at write");
+    SC_CHECK(r.reacquired_without_allocating,
+             "drop-oldest: frames not recycled");
+  }
+  {
+    const Run r = RunPipeline(DropPolicy::kSkipEncode, 60, 5);
+    SC_CHECK(r.ok && r.error.empty(), "skip-encode: %s", r.error.c_str());
+    SC_CHECK(r.stats.skipped_encodes > 0,
+             "skip-encode: nothing skipped behind a slow encode");
+    SC_CHECK(r.written == 60 && r.written_skipped == r.stats.skipped_encodes &&
+                 r.stats.encode.frames + r.stats.skipped_encodes == 60,
+             "skip-encode: %lld written, %lld skipped at write, %lld "
+             "counted, %lld encoded",
+             static_cast<long long>(r.written),
+             static_cast<long long>(r.written_skipped),
+             static_cast<long long>(r.stats.skipped_encodes),
+             static_cast<long long>(r.stats.encode.frames));
+    SC_CHECK(r.stats.process.dropped + r.stats.encode.dropped == 0,
+             "skip-encode: frames dropped");
+    SC_CHECK(r.reacquired_without_allocating,
+             "skip-encode: frames not recycled");
+  }
+}
+
+void CheckFailure() {
+  for (const DropPolicy drop :
+       {DropPolicy::kBlock, DropPolicy::kDropOldest, DropPolicy::kSkipEncode}) {
+    const Run r = RunPipeline(drop, 40, 1, 0);
+    SC_CHECK(!r.ok, "%s: Finish succeeded after a failed encode",
+             DropPolicyName(drop));
+    SC_CHECK(r.error.empty(), "%s: %s", DropPolicyName(drop),
+             r.error.c_str());
+    SC_CHECK(r.written < 40, "%s: every frame written despite the failure",
+             DropPolicyName(drop));
+    SC_CHECK(r.reacquired_without_allocating,
+             "%s: frames lost after a failure", DropPolicyName(drop));
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  // Encode jobs run on the encode pool; give it workers on any machine.
+  SetParallelThreads(4);
+  for (const int capacity : {1, 3, 5}) {
+    CheckWrap(capacity);
+    CheckManyProducersAndConsumers(capacity);
+  }
+  CheckCloseWakesWaiters();
+  CheckPolicies();
+  CheckFailure();
+  return test::TestExitCode();
+}
@@ -0,0 +1,149 @@
+// TaskPool and TaskGroup: every task runs exactly once, from the pool's
+// own workers and from outside threads, nested Run/Wait does not deadlock,
+// idle workers steal, a pool without workers runs everything on the
+// waiting thread, and a waiter never picks up a task queued before its
+// group's.
+
+#include "task_pool.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace sc {
+namespace {
+
+void CheckExactlyOnce(int workers) {
+  TaskPool pool(workers);
+  constexpr int kTasks = 2000;
+  std::vector<std::atomic<int>> runs(kTasks);
+  // Two outside threads submit half each into their own group.
+  std::vector<std::thread> submitters;
+  for (int t = 0; t < 2; ++t) {
+    submitters.emplace_back([&, t] {
+      TaskGroup group(&pool);
+      for (int i = t; i < kTasks; i += 2) {
+        group.Run([&runs, i] { runs[i].fetch_add(1); });
+      }
+      group.Wait();
+    });
+  }
+  for (std::thread &t : submitters) {
+    t.join();
+  }
+  int wrong = 0;
+  for (int i = 0; i < kTasks; ++i) {
+    wrong += runs[i].load() != 1;
+  }
+  SC_CHECK(wrong == 0, "%d workers: %d tasks not run exactly once", workers,
+           wrong);
+  SC_CHECK(pool.stats().tasks == kTasks, "%d workers: %lld tasks counted",
+           workers, static_cast<long long>(pool.stats().tasks));
+}
+
+// Three levels of tasks that each spawn and wait for their own subtasks,
+// more of them than there are workers, so waiting threads must help.
+void CheckNested(int workers) {
+  TaskPool pool(workers);
+  std::atomic<int> leaves{0};
+  TaskGroup top(&pool);
+  for (int i = 0; i < 8; ++i) {
+    top.Run([&] {
+      TaskGroup mid(&pool);
+      for (int j = 0; j < 8; ++j) {
+        mid.Run([&] {
+          TaskGroup low(&pool);
+          for (int k = 0; k < 8; ++k) {
+            low.Run([&] { leaves.fetch_add(1); });
+          }
+          low.Wait();
+        });
+      }
+      mid.Wait();
+    });
+  }
+  top.Wait();
+  SC_CHECK(leaves.load() == 512, "%d workers: %d of 512 nested tasks ran",
+           workers, leaves.load());
+}
+
+// A task on a worker queues subtasks on that worker's deque and then, in
+// place of waiting, spins until they have all run: only other workers can
+// have run them, by stealing.
+void CheckStealing() {
+  TaskPool pool(3);
+  std::atomic<int> done{0};
+  std::atomic<bool> timed_out{false};
+  std::atomic<bool> started{false};
+  TaskGroup outer(&pool);
+  TaskGroup inner(&pool);
+  outer.Run([&] {
+    started = true;
+    for (int i = 0; i < 16; ++i) {
+      inner.Run([&] { done.fetch_add(1); });
+    }
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    while (done.load() < 16) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        timed_out = true;
+        break;
+      }
+      std::this_thread::yield();
+    }
+  });
+  // Left to a worker: waiting now could run the task on this thread.
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+  outer.Wait();
+  inner.Wait();
+  SC_CHECK(!timed_out.load(), "subtasks were not stolen from a busy worker");
+  SC_CHECK(pool.stats().steals >= 16, "%lld steals counted",
+           static_cast<long long>(pool.stats().steals));
+}
+
+// With no workers the waiting thread runs its group's tasks, and only
+// tasks queued since the group's first: an older job stays queued until
+// its own group is waited on.
+void CheckZeroWorkersAndHelpingOrder() {
+  TaskPool pool(0);
+  SC_CHECK(pool.workers() == 0, "pool has %d workers", pool.workers());
+  const std::thread::id self = std::this_thread::get_id();
+  bool older_ran = false;
+  bool newer_ran = false;
+  bool on_caller = true;
+  TaskGroup older(&pool);
+  older.Run([&] {
+    older_ran = true;
+    on_caller = on_caller && std::this_thread::get_id() == self;
+  });
+  TaskGroup newer(&pool);
+  newer.Run([&] {
+    newer_ran = true;
+    on_caller = on_caller && std::this_thread::get_id() == self;
+  });
+  newer.Wait();
+  SC_CHECK(newer_ran, "the waited-on task did not run");
+  SC_CHECK(!older_ran, "waiting on a new group ran an older group's task");
+  older.Wait();
+  SC_CHECK(older_ran, "the older task did not run when waited on");
+  SC_CHECK(on_caller, "a task ran off the waiting thread");
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  for (const int workers : {0, 1, 3}) {
+    CheckExactlyOnce(workers);
+    CheckNested(workers);
+  }
+  CheckStealing();
+  CheckZeroWorkersAndHelpingOrder();
+  return test::TestExitCode();
+}
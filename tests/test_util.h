@@ -0,0 +1,103 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+
+// Shared by the test executables: a failed CHECK prints where and why and
+// makes main's TestExitCode() non-zero, but the test keeps going so that a
+// single run reports every mismatch.
+
+namespace sc::test {
+
+inline int &Failures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline int TestExitCode() {
+  if (Failures() > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", Failures());
+    return 1;
+  }
+  return 0;
+}
+
+// A fresh directory for the files one test run writes; removed when done.
+class TempDir {
+public:
+  explicit TempDir(const char *prefix) {
+    std::random_device rd;
+    path_ = std::filesystem::temp_directory_path() /
+            (std::string(prefix) + "_" + std::to_string(rd()));
+    std::filesystem::create_directories(path_);
+  }
+  TempDir(const TempDir &) = delete;
+  TempDir &operator=(const TempDir &) = delete;
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path_, ec);
+  }
+
+  std::string File(const std::string &name) const {
+    return (path_ / name).string();
+  }
+
+private:
+  std::filesystem::path path_;
+};
+
+// Noise, flat runs and gradients in bands of rows, so that every PNG filter
+// and QOI op and both short and long matches get exercised.
+inline void FillTestImage(int width, int height, uint32_t seed,
+                          ImageBuffer *img) {
+  AllocateImage(width, height, img);
+  std::mt19937 rng(seed);
+  for (int y = 0; y < height; ++y) {
+    uint8_t *row = img->bgra.data() + static_cast<size_t>(y) * img->row_pitch;
+    const int band = (y / 7) % 4;
+    for (int x = 0; x < width; ++x) {
+      uint8_t *p = row + x * 4;
+      switch (band) {
+      case 0: // noise
+        for (int c = 0; c < 4; ++c) {
+          p[c] = static_cast<uint8_t>(rng());
+        }
+        break;
+      case 1: // flat runs
+        p[0] = p[1] = p[2] = static_cast<uint8_t>((x / 13) * 40);
+        p[3] = 255;
+        break;
+      case 2: // gradients
+        p[0] = static_cast<uint8_t>(x);
+        p[1] = static_cast<uint8_t>(y * 3);
+        p[2] = static_cast<uint8_t>(x + y);
+        p[3] = static_cast<uint8_t>(255 - x / 4);
+        break;
+      default: // small steps from the pixel to the left
+        for (int c = 0; c < 4; ++c) {
+          const int prev = x > 0 ? p[c - 4] : 128;
+          p[c] = static_cast<uint8_t>(prev + static_cast<int>(rng() % 5) - 2);
+        }
+        break;
+      }
+    }
+  }
+}
+
+} // namespace sc::test
+
+#define SC_CHECK(cond, ...)                                                   \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      std::fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__,   \
+                   #cond);                                                    \
+      std::fprintf(stderr, __VA_ARGS__);                                      \
+      std::fputc('\n', stderr);                                               \
+      ++::sc::test::Failures();                                               \
+    }                                                                         \
+  } while (0)
@@ -0,0 +1,185 @@
+// Tone-maps every half-float value, negative, huge, infinite and NaN ones
+// included, and checks that each SIMD level gives the scalar bytes, that
+// 8-bit output is the exactly rounded sRGB encoding of the curve and that
+// 16-bit output is within one level of it.
+
+#include "cpu_features.h"
+#include "test_util.h"
+#include "tone_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sc {
+namespace {
+
+constexpr int kPixels = 65536;
+
+double SrgbEncode(double x) {
+  return x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
+}
+
+// The curves as tone_map.h describes them, in the same float operations:
+// negatives and NaN clip to 0, infinities to the largest half.
+float Curve(ToneMapOperator op, float x, float scale) {
+  x = x > 0.0f ? x : 0.0f;
+  x = x < 65504.0f ? x : 65504.0f;
+  x *= scale;
+  float y = 0.0f;
+  switch (op) {
+  case ToneMapOperator::kClip:
+    y = x;
+    break;
+  case ToneMapOperator::kReinhard:
+    y = x / (1.0f + x);
+    break;
+  case ToneMapOperator::kAcesFit:
+    y = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    break;
+  }
+  return y < 1.0f ? y : 1.0f;
+}
+
+int ExpectedAlpha(float a, int max) {
+  a = a > 0.0f ? a : 0.0f;
+  a = a < 1.0f ? a : 1.0f;
+  return static_cast<int>(std::lround(static_cast<double>(a) * max));
+}
+
+// Every half in R, and in G, B and A in other orders, so each channel sees
+// each value next to different neighbours.
+std::vector<uint8_t> AllHalves() {
+  std::vector<uint8_t> row(static_cast<size_t>(kPixels) * 8);
+  for (int i = 0; i < kPixels; ++i) {
+    const uint16_t h[4] = {static_cast<uint16_t>(i),
+                           static_cast<uint16_t>(kPixels - 1 - i),
+                           static_cast<uint16_t>(i * 7919),
+                           static_cast<uint16_t>(i * 40503 + 1)};
+    memcpy(&row[static_cast<size_t>(i) * 8], h, 8);
+  }
+  return row;
+}
+
+float Channel(const std::vector<uint8_t> &row, int x, int c) {
+  uint16_t h;
+  memcpy(&h, &row[static_cast<size_t>(x) * 8 + c * 2], 2);
+  return HalfToFloat(h);
+}
+
+void CheckReference(const std::vector<uint8_t> &src, ToneMapOperator op,
+                    float scale, const std::vector<uint8_t> &out8,
+                    const std::vector<uint8_t> &out16, const char *what) {
+  int bad8 = 0;
+  int bad16 = 0;
+  for (int x = 0; x < kPixels; ++x) {
+    const uint8_t *o8 = &out8[static_cast<size_t>(x) * 4];
+    const uint8_t *o16 = &out16[static_cast<size_t>(x) * 8];
+    for (int c = 0; c < 3; ++c) {
+      const double v = Curve(op, Channel(src, x, c), scale);
+      const long want8 = std::lround(255.0 * SrgbEncode(v));
+      const long want16 = std::lround(65535.0 * SrgbEncode(v));
+      const int got16 = (o16[c * 2] << 8) | o16[c * 2 + 1];
+      if (o8[2 - c] != want8 && bad8++ == 0) {
+        SC_CHECK(false, "%s: 8-bit channel %d of pixel %04x is %d, want %ld",
+                 what, c, x, o8[2 - c], want8);
+      }
+      if (std::abs(got16 - want16) > 1 && bad16++ == 0) {
+        SC_CHECK(false, "%s: 16-bit channel %d of pixel %04x is %d, want %ld",
+                 what, c, x, got16, want16);
+      }
+    }
+    const float a = Channel(src, x, 3);
+    SC_CHECK(o8[3] == ExpectedAlpha(a, 255) &&
+                 ((o16[6] << 8) | o16[7]) == ExpectedAlpha(a, 65535),
+             "%s: alpha of pixel %04x (%.9g) is %d/%d", what, x, a, o8[3],
+             (o16[6] << 8) | o16[7]);
+  }
+  SC_CHECK(bad8 == 0, "%s: %d 8-bit samples off", what, bad8);
+  SC_CHECK(bad16 == 0, "%s: %d 16-bit samples off by more than one", what,
+           bad16);
+}
+
+// The kernels at `level` on whole rows and on short runs at every offset
+// mod 8, against the scalar output.
+void CheckLevel(const std::vector<uint8_t> &src, ToneMapOperator op,
+                float scale, SimdLevel level, const std::vector<uint8_t> &ref8,
+                const std::vector<uint8_t> &ref16, const std::string &what) {
+  const std::string name = what + " " + SimdLevelName(level);
+  for (const bool sixteen : {false, true}) {
+    const ToneMapRowFn kernel = sixteen ? ToneMapRow16Kernel(op, level)
+                                        : ToneMapRowKernel(op, level);
+    const std::vector<uint8_t> &ref = sixteen ? ref16 : ref8;
+    const size_t bpp = sixteen ? 8 : 4;
+    std::vector<uint8_t> out(ref.size());
+    kernel(src.data(), kPixels, scale, out.data());
+    SC_CHECK(out == ref, "%s: %d-bit row differs from scalar", name.c_str(),
+             sixteen ? 16 : 8);
+    for (int start = 0; start < 8; ++start) {
+      for (int width = 1; width <= 11; ++width) {
+        std::vector<uint8_t> part(static_cast<size_t>(width) * bpp);
+        kernel(&src[static_cast<size_t>(start) * 8], width, scale,
+               part.data());
+        SC_CHECK(memcmp(part.data(), &ref[start * bpp], part.size()) == 0,
+                 "%s: %d-bit run of %d at %d differs", name.c_str(),
+                 sixteen ? 16 : 8, width, start);
+      }
+    }
+  }
+}
+
+void CheckExtremes(ToneMapOperator op, const char *name) {
+  const float values[] = {-1.0f,     -65504.0f, -INFINITY, NAN,
+                          65504.0f,  INFINITY,  1e4f,      -0.0f};
+  for (const float f : values) {
+    const uint16_t h = FloatToHalf(f);
+    const uint16_t px[4] = {h, h, h, h};
+    uint8_t out[4];
+    ToneMapRowKernel(op, SimdLevel::kScalar)(
+        reinterpret_cast<const uint8_t *>(px), 1, 1.0f, out);
+    // Out-of-gamut negatives and NaN are black; anything huge is white
+    // under every curve.
+    const int want = f > 1000.0f ? 255 : f <= 0.0f || std::isnan(f) ? 0 : -1;
+    if (want >= 0) {
+      SC_CHECK(out[0] == want && out[1] == want && out[2] == want,
+               "%s: %g maps to %d, want %d", name, f, out[0], want);
+    }
+  }
+}
+
+} // namespace
+} // namespace sc
+
+int main() {
+  using namespace sc;
+  const std::vector<uint8_t> src = AllHalves();
+  const ToneMapOperator ops[] = {ToneMapOperator::kClip,
+                                 ToneMapOperator::kReinhard,
+                                 ToneMapOperator::kAcesFit};
+  const SimdLevel levels[] = {SimdLevel::kSse2, SimdLevel::kAvx2,
+                              SimdLevel::kAvx512};
+  // SDR white at 80 (scRGB 1.0), 203 and 1000 nits, and a brightening one.
+  const float scales[] = {1.0f, 80.0f / 203.0f, 0.08f, 4.0f};
+  for (const ToneMapOperator op : ops) {
+    CheckExtremes(op, ToneMapOperatorName(op));
+    for (const float scale : scales) {
+      const std::string what = std::string(ToneMapOperatorName(op)) +
+                               " scale " + std::to_string(scale);
+      std::vector<uint8_t> ref8(static_cast<size_t>(kPixels) * 4);
+      std::vector<uint8_t> ref16(static_cast<size_t>(kPixels) * 8);
+      ToneMapRowKernel(op, SimdLevel::kScalar)(src.data(), kPixels, scale,
+                                               ref8.data());
+      ToneMapRow16Kernel(op, SimdLevel::kScalar)(src.data(), kPixels, scale,
+                                                 ref16.data());
+      CheckReference(src, op, scale, ref8, ref16, what.c_str());
+      for (const SimdLevel level : levels) {
+        if (level <= DetectSimdLevel()) {
+          CheckLevel(src, op, scale, level, ref8, ref16, what);
+        }
+      }
+    }
+  }
+  return test::TestExitCode();
+}